@@ -250,9 +250,15 @@ public:
  */
 	void on_frame(struct framebuffer::raw& _frame, uint32_t fps_n, uint32_t fps_d);
 /**
- * Call all notifiers (on_sample).
+ * Call all notifiers (on_sample) for a block of samples.
+ *
+ * Parameter samples: The samples. If stereo, L and R alternate.
+ * Parameter count: Number of samples (pairs if stereo).
+ * Parameter stereo: If true, samples are stereo.
+ * Parameter decimated: If true, the samples are decimated (see audioapi_instance::decimation_factor()), and go
+ *	to dumpers that want decimated audio. Otherwise the samples are at core rate and go to other dumpers.
  */
-	void on_sample(short l, short r);
+	void on_samples(const int16_t* samples, size_t count, bool stereo, bool decimated);
 /**
  * Call all notifiers (on_rate_change)
  *
@@ -267,8 +273,10 @@ public:
 	void on_gameinfo_change(const gameinfo& gi);
 /**
  * Get current sound rate in effect.
+ *
+ * Parameter decimated: If true, get the rate of decimated audio.
  */
-	std::pair<uint32_t, uint32_t> get_rate();
+	std::pair<uint32_t, uint32_t> get_rate(bool decimated = false);
 /**
  * Get current gameinfo in effect.
  */
@@ -301,7 +309,7 @@ public:
 /**
  * Calculate number of sound samples to drop due to dropped frame.
  */
-	uint64_t killed_audio_length(uint32_t fps_n, uint32_t fps_d, double& fraction);
+	uint64_t killed_audio_length(uint32_t fps_n, uint32_t fps_d, double& fraction, bool decimated = false);
 private:
 	void statuschange();
 	friend class dumper_base;
@@ -310,6 +318,7 @@ private:
 	std::set<dumper_base*> sdumpers;
 	uint32_t current_rate_n;
 	uint32_t current_rate_d;
+	unsigned current_decimation;
 	gameinfo current_gi;
 	std::ostream* output;
 	threads::rlock lock;
@@ -364,12 +373,22 @@ public:
 	{
 		bool r = mdumper->render_video_hud(target, source, hscl, vscl, lgap, tgap, rgap, bgap, fn);
 		if(!r)
-			samples_killed += mdumper->killed_audio_length(fps_n, fps_d, akillfrac);
+			samples_killed += mdumper->killed_audio_length(fps_n, fps_d, akillfrac, decimated_audio);
 		return r;
 	}
+/**
+ * Request audio decimated to at most audioapi_instance::decimate_above samples per second, instead of audio at
+ * core rate. Has to be called before the dumper is added to sample notifications.
+ */
+	void request_decimated_audio() { decimated_audio = true; }
+/**
+ * Does this dumper want decimated audio?
+ */
+	bool wants_decimated_audio() const { return decimated_audio; }
 private:
 	friend class master_dumper;
 	uint64_t samples_killed;
+	bool decimated_audio;
 	master_dumper* mdumper;
 	dumper_factory_base* fbase;
 	double akillfrac;
@@ -1,6 +1,7 @@
 #ifndef _audioapi__hpp__included__
 #define _audioapi__hpp__included__
 
+#include "library/decimator.hpp"
 #include "library/threads.hpp"
 
 #include <map>
@@ -8,6 +9,7 @@
 #include <cstdlib>
 #include <string>
 #include <stdexcept>
+#include <vector>
 
 class audioapi_instance
 {
@@ -96,6 +98,17 @@ public:
  * Parameter rate: Rate of buffer in samples per second.
  */
 	void submit_buffer(int16_t* samples, size_t count, bool stereo, double rate);
+/**
+ * Music submitted at rates above this is decimated before playback and for dumpers that request it.
+ */
+	const static unsigned decimate_above = 96000;
+/**
+ * Get decimation factor for music at specified rate.
+ *
+ * Parameter rate: The rate in samples per second.
+ * Returns: The factor, 1 if music at this rate is not decimated.
+ */
+	static unsigned decimation_factor(double rate);
 /**
  * Get the voice channel playback/record rate.
  *
@@ -278,6 +291,8 @@ private:
 	volatile float _voicep_volume;
 	volatile float _voicer_volume;
 	resampler music_resampler;
+	decimator music_decimator;
+	std::vector<int16_t> decimated;
 	bool last_adjust;	//Adjusting consequtively is too hard.
 	static bool vu_disabled;
 };
@@ -4,6 +4,7 @@
 #include "core/window.hpp"
 #include "core/queue.hpp"
 #include "library/command.hpp"
+#include "library/dispatch.hpp"
 #include "library/framebuffer.hpp"
 #include "library/triplebuffer.hpp"
 
@@ -59,6 +60,15 @@ public:
  * Redraw the framebuffer, reusing contents from last redraw. Runs lua hooks if last redraw ran them.
  */
 	void redraw_framebuffer();
+/**
+ * Remember frame from core without rendering it (render decimation). The frame is not copied, so its memory must
+ * stay valid until the next frame is emulated. The frame is rendered by flush_skipped() or the next redraw.
+ */
+	void skip_framebuffer(framebuffer::raw& torender);
+/**
+ * Render the last skipped frame, if a frame has been skipped since the last render.
+ */
+	void flush_skipped();
 /**
  * Return last complete framebuffer.
  */
@@ -102,6 +112,9 @@ private:
 	render_info buffer3;
 	triplebuffer::triplebuffer<render_info> buffering;
 	bool last_redraw_no_lua;
+	framebuffer::info skipped;
+	bool has_skipped;
+	struct dispatch::target<bool> corechange;
 	subtitle_commentary& subtitles;
 	settingvar::group& settings;
 	memwatch_set& mwatch;
@@ -38,6 +38,11 @@ public:
  */
 	double get_speed_multiplier() throw();
 
+/**
+ * Is the framerate unthrottled (speed multiplier is INFINITE or turbo is on)?
+ */
+	bool is_unthrottled() throw();
+
 /**
  * Sets the nominal frame rate. Framerate limiting tries to maintain the nominal framerate when there is no other
  * explict framerate to maintain.
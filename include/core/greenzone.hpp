@@ -0,0 +1,110 @@
+#ifndef _greenzone__hpp__included__
+#define _greenzone__hpp__included__
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <fstream>
+#include "library/portctrl-data.hpp"
+
+class movie_logic;
+class loaded_rom;
+class lua_state;
+namespace settingvar { class group; }
+
+/**
+ * Greenzone: Frame-indexed cache of core states for fast seeking during read-only playback.
+ *
+ * Snapshots are taken every greenzone-interval frames. Snapshots near the current frame are kept densely, and
+ * spacing doubles with distance. Snapshots are dropped when the movie input before them changes, so stale states are
+ * never restored. Restoring is a seek, not a rerecord, and runs the Lua rewind callbacks.
+ */
+class greenzone
+{
+public:
+/**
+ * Ctor.
+ */
+	greenzone(movie_logic& _mlogic, loaded_rom& _rom, lua_state& _lua2, settingvar::group& _settings);
+/**
+ * Dtor.
+ */
+	~greenzone();
+/**
+ * Are snapshots taken at all (greenzone-interval is nonzero)?
+ */
+	bool enabled();
+/**
+ * Should a snapshot be taken at current frame? Only true in read-only playback when enabled.
+ */
+	bool capture_due();
+/**
+ * Take a snapshot of current state. The core has to be at a point where it can save.
+ *
+ * Throws std::bad_alloc: Not enough memory.
+ */
+	void capture();
+/**
+ * Restore the latest valid snapshot before specified frame.
+ *
+ * Parameter frame: The frame to seek to.
+ * Returns: The frame restored to, or 0 if no snapshot helps (the current frame is at least as close).
+ * Throws std::runtime_error: Error restoring state.
+ */
+	uint64_t restore(uint64_t frame);
+/**
+ * Drop all snapshots.
+ */
+	void clear();
+/**
+ * Get number of snapshots.
+ */
+	size_t get_count() { return snapshots.size(); }
+/**
+ * Get amount of memory used by snapshots in bytes.
+ */
+	uint64_t get_memory() { return memory_used; }
+private:
+	struct snapshot
+	{
+		uint64_t frame;
+		uint64_t ptr;
+		uint64_t lagged_frames;
+		std::vector<uint32_t> pollcounters;
+		unsigned poll_flag;
+		int64_t rtc_second;
+		int64_t rtc_subsecond;
+		size_t state_size;
+		//Compressed core state in memory, or if empty, at spill_offset in spill file.
+		std::vector<char> state;
+		uint64_t spill_offset;
+		uint64_t spill_size;
+	};
+	greenzone(const greenzone&);
+	greenzone& operator=(const greenzone&);
+	void validate();
+	void thin(uint64_t cursor);
+	void enforce_limits(uint64_t cursor);
+	void drop(std::map<uint64_t, snapshot>::iterator i);
+	std::vector<char> read_state(snapshot& s);
+	movie_logic& mlogic;
+	loaded_rom& rom;
+	lua_state& lua2;
+	settingvar::group& settings;
+	std::map<uint64_t, snapshot> snapshots;
+	std::string projectid;
+	uint64_t memory_used;
+	//Scratch buffers for capturing, reused between captures.
+	std::vector<char> state_arena;
+	std::vector<char> compress_arena;
+	//Copy of the input at the last validation. Copy-on-write, so pages never edited are not compared.
+	portctrl::frame_vector checked;
+	//Spill file.
+	std::string spill_name;
+	std::fstream spill;
+	uint64_t spill_used;
+	size_t spilled_count;
+};
+
+#endif
@@ -3,6 +3,9 @@
 
 #include "library/threads.hpp"
 #include <cstring>
+#include <map>
+#include <memory>
+#include <typeindex>
 
 class movie_logic;
 class memory_space;
@@ -10,6 +13,7 @@ class memwatch_set;
 class voice_commentary;
 class subtitle_commentary;
 class movie_branches;
+class greenzone;
 class multitrack_edit;
 class _lsnes_status;
 class alias_binds_manager;
@@ -103,6 +107,7 @@ struct emulator_instance
 	voice_commentary* commentary;
 	subtitle_commentary* subtitles;
 	movie_branches* mbranch;
+	greenzone* gzone;
 	controller_state* controls;
 	button_mapping* buttons;
 	multitrack_edit* mteditor;
@@ -131,13 +136,54 @@ struct emulator_instance
 	threads::id emu_thread;
 	time_t random_seed_value;
 	dtor_list D;
+/**
+ * Get state of a core for this instance, creating it on first use. Cores keep their emulation state here instead
+ * of in globals, so that every instance has its own.
+ */
+	template<typename T> T& get_core_state()
+	{
+		std::shared_ptr<void>& s = core_states[std::type_index(typeid(T))];
+		if(!s)
+			s.reset(new T);
+		return *reinterpret_cast<T*>(s.get());
+	}
 private:
 	emulator_instance(const emulator_instance&);
 	emulator_instance& operator=(const emulator_instance&);
+	std::map<std::type_index, std::shared_ptr<void>> core_states;
 };
 
 extern emulator_instance lsnes_instance;
 
+/**
+ * Binds an emulator instance to the calling thread for lifetime of this object. While bound, CORE() in that thread
+ * returns the instance, so several instances can each run main_loop() in their own thread.
+ *
+ * Only cores keeping their state with get_core_state() (sky and test) can run in several instances at once. Each
+ * instance loads its own copy of the ROM.
+ */
+class emulator_instance_binding
+{
+public:
+/**
+ * Bind instance to calling thread, making the thread its emulation thread.
+ */
+	emulator_instance_binding(emulator_instance& inst);
+/**
+ * Restore previous binding.
+ */
+	~emulator_instance_binding();
+private:
+	emulator_instance_binding(const emulator_instance_binding&);
+	emulator_instance_binding& operator=(const emulator_instance_binding&);
+	emulator_instance* prev;
+};
+
+/**
+ * Get instance bound to calling thread, or lsnes_instance if none is. Does not check the thread.
+ */
+emulator_instance& current_instance();
+
 emulator_instance& CORE();
 
 #endif
@@ -24,6 +24,10 @@ extern std::string msu1_base_path;
 void mainloop_signal_need_rewind(void* ptr);
 
 void set_stop_at_frame(uint64_t frame = 0);
+/**
+ * Seek to frame in readonly mode, restoring the nearest greenzone snapshot before it and running forward from there.
+ */
+void seek_to_frame(uint64_t frame);
 void switch_projects(const std::string& newproj);
 void close_rom();
 void load_new_rom(const romload_request& req);
@@ -47,6 +47,15 @@ struct loaded_rom
  * throws std::bad_alloc: Not enough memory.
  */
 	std::vector<char> save_core_state(bool nochecksum = false);
+/**
+ * Saves core state into arena, reusing its memory. The arena is grown as needed, but never shrunk, so saving
+ * repeatedly into the same arena does not allocate. WARNING: This takes emulated time.
+ *
+ * parameter arena: The buffer to save into.
+ * returns: Size of the saved state (including checksum) at start of arena.
+ * throws std::bad_alloc: Not enough memory.
+ */
+	size_t save_core_state(std::vector<char>& arena, bool nochecksum = false);
 
 /**
  * Loads core state from buffer.
@@ -55,6 +64,14 @@ struct loaded_rom
  * throws std::runtime_error: Loading state failed.
  */
 	void load_core_state(const std::vector<char>& buf, bool nochecksum = false);
+/**
+ * Loads core state from memory.
+ *
+ * parameter buf: The state.
+ * parameter size: Size of the state.
+ * throws std::runtime_error: Loading state failed.
+ */
+	void load_core_state(const char* buf, size_t size, bool nochecksum = false);
 
 /**
  * Get internal type representation.
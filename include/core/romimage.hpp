@@ -225,5 +225,7 @@ rom_image_handle construct_rom(const std::string& movie_filename, const std::vec
 extern std::map<std::string, core_type*> preferred_core;
 //Main hasher
 extern fileimage::hash lsnes_image_hasher;
+//Hash index used by main hasher.
+extern fileimage::hashindex lsnes_hash_index;
 
 #endif
@@ -161,6 +161,14 @@ public:
  * Get current point
  */
 	unsigned get_point();
+/**
+ * Is render decimation active (frames are rendered only now and then while running unthrottled)?
+ */
+	bool is_render_skip() { return render_skip; }
+/**
+ * Set render decimation active flag.
+ */
+	void set_render_skip(bool enable) { render_skip = enable; }
 /**
  * Get the current runmode.
  */
@@ -179,6 +187,8 @@ private:
 	bool saved_cancel;
 	//Current point.
 	unsigned point;
+	//Render decimation active.
+	bool render_skip;
 };
 
 #endif
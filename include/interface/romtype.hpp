@@ -188,6 +188,7 @@ struct core_vma_info
 		special = false;
 		read = NULL;
 		write = NULL;
+		dirty_gen = NULL;
 	}
 /**
  * Name of the VMA.
@@ -235,6 +236,14 @@ struct core_vma_info
  * Parameter data: Byte to write.
  */
 	void (*write)(uint64_t offset, uint8_t data);
+/**
+ * If not NULL, per-page modification generations for backing_ram (one entry per page_hash::page_size bytes). The
+ * core increments the generation of each page it may have modified, allowing incremental hashing of the VMA.
+ *
+ * memory.hash_state_incremental hashes the VMAs instead of the savestate if all of them track modified pages, so
+ * cores should only track pages if their VMAs hold all of the savestate.
+ */
+	uint64_t* dirty_gen;
 };
 
 /**
@@ -327,6 +336,8 @@ struct core_core
 	std::map<std::string, std::vector<char>> save_sram();
 	void load_sram(std::map<std::string, std::vector<char>>& sram);
 	void serialize(std::vector<char>& out);
+	size_t serialize(char* out, size_t outsize);
+	size_t serialize_size();
 	void unserialize(const char* in, size_t insize);
 	core_region& get_region();
 	void power();
@@ -402,8 +413,29 @@ protected:
 	virtual void c_load_sram(std::map<std::string, std::vector<char>>& sram) = 0;
 /**
  * Serialize the system state.
+ *
+ * The default implementation serializes using c_serialize_into(). Cores have to override at least one of
+ * c_serialize() and c_serialize_into().
+ */
+	virtual void c_serialize(std::vector<char>& out);
+/**
+ * Serialize the system state into caller-provided memory.
+ *
+ * The default implementation serializes using c_serialize() and copies the result.
+ *
+ * Parameter out: The buffer to write to. May be NULL if outsize is 0.
+ * Parameter outsize: Size of the buffer.
+ * Returns: Size of the state. If larger than outsize, the buffer contents are undefined and the call has to be
+ *	repeated with large enough buffer.
+ */
+	virtual size_t c_serialize_into(char* out, size_t outsize);
+/**
+ * Get the size of serialized system state. May be an estimate, the size c_serialize_into() returns is exact.
+ *
+ * The default implementation serializes using c_serialize_into() and discards the result. Cores where that is
+ * expensive should override this.
  */
-	virtual void c_serialize(std::vector<char>& out) = 0;
+	virtual size_t c_serialize_size();
 /**
  * Unserialize the system state.
  */
@@ -544,6 +576,7 @@ private:
 	bool hidden;
 	std::map<std::string, interface_action> actions;
 	threads::lock actions_lock;
+	bool serialize_fallback;
 };
 
 struct core_type
@@ -584,6 +617,8 @@ public:
 		core->load_sram(sram);
 	}
 	void serialize(std::vector<char>& out) { core->serialize(out); }
+	size_t serialize(char* out, size_t outsize) { return core->serialize(out, outsize); }
+	size_t serialize_size() { return core->serialize_size(); }
 	void unserialize(const char* in, size_t insize) { core->unserialize(in, insize); }
 	core_region& get_region() { return core->get_region(); }
 	void power() { core->power(); }
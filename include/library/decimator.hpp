@@ -0,0 +1,64 @@
+#ifndef _library__decimator__hpp__included__
+#define _library__decimator__hpp__included__
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+/**
+ * Audio decimator: Reduces sampling rate by a power of two using a cascade of halfband FIR filters.
+ *
+ * All stages but the last use short filters, since they only have to reject what would alias into the final
+ * passband. The last stage is sharp, passing up to 0.4 times the output rate with about 70dB of alias rejection.
+ */
+class decimator
+{
+public:
+/**
+ * Create decimator passing samples through unchanged.
+ */
+	decimator();
+/**
+ * Set decimation factor. Resets the filter state if factor changes.
+ *
+ * Parameter factor: The factor, must be power of two.
+ * Throws std::runtime_error: Factor is not power of two.
+ */
+	void set_factor(unsigned factor);
+/**
+ * Get decimation factor.
+ */
+	unsigned get_factor() const { return factor; }
+/**
+ * Clear the filter state.
+ */
+	void reset();
+/**
+ * Decimate samples.
+ *
+ * Parameter in: The input samples. If stereo, L and R alternate.
+ * Parameter count: Number of input samples (pairs if stereo).
+ * Parameter stereo: If true, input is stereo. Changing this resets the filter state.
+ * Parameter out: Output buffer, with space for at least count / get_factor() + 1 samples (pairs if stereo).
+ * Returns: Number of samples (pairs if stereo) written.
+ */
+	size_t process(const int16_t* in, size_t count, bool stereo, int16_t* out);
+/**
+ * Get smallest power of two factor that reduces rate to at most limit.
+ */
+	static unsigned factor_for(double rate, double limit);
+private:
+	struct stage
+	{
+		//Odd-indexed coefficients h[1], h[3], ..., the center one is 1/2 and the rest are zero.
+		std::vector<float> coeffs;
+		std::vector<float> history[2];
+	};
+	void run_stage(stage& s, std::vector<float>& data, unsigned ch);
+	unsigned factor;
+	bool stereo;
+	std::vector<stage> stages;
+	std::vector<float> work[2];
+};
+
+#endif
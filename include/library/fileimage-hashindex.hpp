@@ -0,0 +1,110 @@
+#ifndef _library__fileimage_hashindex__hpp__included__
+#define _library__fileimage_hashindex__hpp__included__
+
+#include <functional>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include "threads.hpp"
+
+namespace fileimage
+{
+/**
+ * Persistent index of file hashes.
+ *
+ * Entries are keyed by (absolute filename, prefix length), and are only valid as long as the file size and
+ * modification time stay the same. The index is stored as an append-only log that is compacted when it grows too
+ * large compared to the number of live entries.
+ */
+class hashindex
+{
+public:
+/**
+ * Create a new index.
+ *
+ * Parameter _dbname_fn: Function returning the name of the index file. Called when the index is first accessed.
+ *	If it returns "", the index is not persisted.
+ */
+	hashindex(std::function<std::string()> _dbname_fn);
+/**
+ * Look up hash of file.
+ *
+ * If the index has no entry for the file, an old-style <file>.sha256[-<prefix>] cache file is imported if present
+ * and up to date. The cache file is left in place.
+ *
+ * Parameter filename: The name of the file.
+ * Parameter prefix: Number of bytes skipped from start of file.
+ * Parameter hash: The hash is written here.
+ * Returns: True if found, false if not found or stale.
+ */
+	bool lookup(const std::string& filename, uint64_t prefix, std::string& hash);
+/**
+ * Store hash of file. Current size and modification time of file are recorded with it.
+ *
+ * Parameter filename: The name of the file.
+ * Parameter prefix: Number of bytes skipped from start of file.
+ * Parameter hash: The hash. If "", the entry is removed.
+ */
+	void store(const std::string& filename, uint64_t prefix, const std::string& hash);
+/**
+ * Remove all entries for file.
+ *
+ * Parameter filename: The name of the file.
+ */
+	void remove(const std::string& filename);
+/**
+ * Find files with given hash. The files are not checked to be up to date.
+ *
+ * Parameter hash: The hash to search for.
+ * Returns: List of (filename, prefix) pairs.
+ */
+	std::list<std::pair<std::string, uint64_t>> find(const std::string& hash);
+/**
+ * Import old-style hash database (lines of form <hash>:<prefix>|<filename>). The database is left in place.
+ *
+ * The imported hashes are unverified: find() returns them, but lookup() does not, so the files get rehashed on
+ * first use. Files already in the index are not touched.
+ *
+ * The import is recorded in the index along with the size and modification time of the database, and the database
+ * is not read again unless it changes.
+ *
+ * Parameter dbfile: The database to import.
+ * Returns: True if database was imported (now or earlier), false if it did not exist.
+ */
+	bool import_db(const std::string& dbfile);
+/**
+ * Rewrite the index file to only contain live entries.
+ */
+	void compact();
+private:
+	struct entry
+	{
+		uint64_t size;
+		time_t mtime;
+		std::string hash;
+	};
+	typedef std::pair<std::string, uint64_t> key_t;
+	hashindex(const hashindex&);
+	hashindex& operator=(const hashindex&);
+	void load();
+	void set_entry(const key_t& key, const entry* e);
+	void log_entry(const key_t& key, const entry* e);
+	void log_record(const std::string& hash, uint64_t prefix, uint64_t size, time_t mtime,
+		const std::string& filename);
+	void do_store(const std::string& filename, uint64_t prefix, const std::string& hash);
+	void do_compact();
+	threads::lock mlock;
+	std::function<std::string()> dbname_fn;
+	bool loaded;
+	std::string dbname;
+	uint64_t records;
+	std::map<key_t, entry> entries;
+	std::map<std::string, std::set<key_t>> by_hash;
+	//Imported old-style databases, with their size and modification time at import.
+	std::map<std::string, entry> imports;
+};
+}
+
+#endif
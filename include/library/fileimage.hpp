@@ -10,6 +10,7 @@
 namespace fileimage
 {
 class hash;
+class hashindex;
 
 /**
  * Future for SHA-256 computation.
@@ -75,14 +76,18 @@ private:
 
 /**
  * Class performing SHA-256 hashing.
+ *
+ * Files are hashed by a pool of worker threads, with results cached in optional persistent hash index.
  */
 class hash
 {
 public:
 /**
  * Create a new SHA-256 hasher.
+ *
+ * Parameter _index: The hash index to use for caching results, or NULL for no caching.
  */
-	hash();
+	hash(hashindex* _index = NULL);
 /**
  * Destroy a SHA-256 hasher. Causes all current jobs to fail.
  */
@@ -104,33 +109,40 @@ public:
  */
 	void entrypoint();
 private:
-	void link(hashval& future);
-	void unlink(hashval& future);
-	void send_callback(uint64_t this_completed);
-	void send_idle();
-
-	friend class hashval;
 	struct queue_job
 	{
 		std::string filename;
 		uint64_t prefix;
 		uint64_t size;
+		uint64_t progress;
 		unsigned cbid;
+		bool busy;
 		volatile unsigned interested;
 	};
+	void link(hashval& future);
+	void unlink(hashval& future);
+	void send_callback();
+	void send_idle();
+	void hash_job(queue_job& job);
+	void resolve(unsigned cbid, const std::string& hash, uint64_t prefix);
+	void resolve_error(unsigned cbid, const std::string& err);
+	hashval queue_file(const std::string& filename, uint64_t size, uint64_t prefixlen);
+
+	friend class hashval;
 	hash(const hash&);
 	hash& operator=(const hash&);
-	threads::thread* hash_thread;
+	std::vector<threads::thread*> hash_threads;
+	hashindex* index;
 	threads::lock mlock;
 	threads::cv condition;
 	std::list<queue_job> queue;
-	std::list<queue_job>::iterator current_job;
 	hashval* first_future;
 	hashval* last_future;
 	unsigned next_cbid;
 	std::function<void(uint64_t, uint64_t)> progresscb;
 	bool quitting;
 	uint64_t total_work;
+	uint64_t done_work;
 	uint64_t work_size;
 };
 
@@ -3,6 +3,9 @@
 
 #include <cstdint>
 #include <map>
+#include <list>
+#include <vector>
+#include <unordered_map>
 #include <string>
 #include <fstream>
 #include "threads.hpp"
@@ -12,6 +15,7 @@
 #define SUPERCLUSTER_SIZE (static_cast<uint64_t>(CLUSTER_SIZE) * CLUSTERS_PER_SUPER)
 #define FILESYSTEM_SUPERBLOCK 1
 #define FILESYSTEM_ROOTDIR 2
+#define FILESYSTEM_CACHE_CLUSTERS 128
 
 /**
  * A filesystem.
@@ -23,8 +27,14 @@ public:
  * Create a new filesystem or open existing one, backed by specified file.
  *
  * Parameters backingfile: The backing file name.
+ * Parameters use_mmap: If true, read data through memory mapping of the file instead of the cluster cache. This is
+ *	best for collections that are mostly read. Ignored if not supported on the platform.
  */
-	filesystem(const std::string& backingfile);
+	filesystem(const std::string& backingfile, bool use_mmap = false);
+/**
+ * Destructor.
+ */
+	~filesystem();
 /**
  * Allocate a new file.
  *
@@ -95,15 +105,16 @@ public:
  * Create/Open a new filesystem and take reference to that.
  *
  * Parameters backingfile: The backing file.
+ * Parameters use_mmap: Use memory mapping for reads.
  */
-		ref(const std::string& backingfile)
+		ref(const std::string& backingfile, bool use_mmap = false)
 		{
 			refcnt = NULL;
 			mlock = NULL;
 			try {
 				refcnt = new unsigned;
 				mlock = new threads::lock;
-				fs = new filesystem(backingfile);
+				fs = new filesystem(backingfile, use_mmap);
 			} catch(...) {
 				delete refcnt;
 				delete mlock;
@@ -206,16 +217,35 @@ private:
 	filesystem(const filesystem&);
 	filesystem& operator=(const filesystem&);
 	void link_cluster(uint32_t cluster, uint32_t linkto);
+	void set_free(uint32_t cluster, bool free);
+	void read_cluster(uint32_t cluster, uint32_t offset, char* data, size_t length);
+	void read_backing(uint64_t offset, char* data, size_t length);
+	void write_cluster(uint32_t cluster, uint32_t offset, const char* data, size_t length);
+	void unmap();
 	struct supercluster
 	{
-		unsigned free_clusters;
 		uint32_t clusters[CLUSTERS_PER_SUPER];
 		void load(std::fstream& s, uint32_t index);
 		void save(std::fstream& s, uint32_t index);
 	};
+	struct cached_cluster
+	{
+		uint32_t cluster;
+		char data[CLUSTER_SIZE];
+	};
 	uint32_t supercluster_count;
-	std::map<uint32_t, supercluster> superclusters;
+	std::vector<supercluster> superclusters;
+	//Free cluster bitmap (bit set => free), and first word that might have free clusters.
+	std::vector<uint64_t> free_map;
+	size_t free_hint;
+	//Recently used clusters, most recent first.
+	std::list<cached_cluster> cache;
+	std::unordered_map<uint32_t, std::list<cached_cluster>::iterator> cache_index;
 	std::fstream backing;
+	std::string backing_name;
+	bool use_mmap;
+	char* map_base;
+	uint64_t map_size;
 };
 
 
@@ -7,6 +7,7 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <memory>
 #include "framebuffer-pixfmt.hpp"
 #include "threads.hpp"
 #include "memtracker.hpp"
@@ -492,7 +493,7 @@ struct font
 	struct glyph
 	{
 		bool wide;		//If set, 16 wide instead of 8.
-		uint32_t* data;		//Glyph data. Bitpacked with element padding between rows.
+		const uint32_t* data;	//Glyph data. Bitpacked with element padding between rows.
 		size_t offset;		//Glyph offset.
 		uint32_t get_width() const throw() { return wide ? 16 : 8; }
 		uint32_t get_height() const throw() { return 16; }
@@ -504,6 +505,35 @@ struct font
 				return ((data[y >> 2] >> (31 - (((y & 3) << 3) + x))) & 1) != 0;
 			}
 		}
+		uint32_t read_row(uint32_t y) const throw()	//Leftmost pixel is the highest bit.
+		{
+			if(wide)
+				return (data[y >> 1] >> (16 - ((y & 1) << 4))) & 0xFFFF;
+			else
+				return (data[y >> 2] >> (24 - ((y & 3) << 3))) & 0xFF;
+		}
+	};
+
+	/**
+	 * Prebuilt font data (generated at build time, used in place).
+	 */
+	struct builtin_data
+	{
+		size_t count;			//Number of glyphs.
+		const uint32_t* codepoints;	//Codepoints of glyphs (sorted).
+		const glyph* glyphs;		//The glyphs (in the same order as codepoints).
+		const int16_t* bmp_pagemap;	//Page index for each 256-codepoint page of BMP, -1 if none.
+		const uint32_t* bmp_pages;	//256 entries per page: 1 + glyph index, 0 if no glyph.
+	};
+
+	/**
+	 * Rendered text run.
+	 */
+	struct text_run
+	{
+		size_t width;			//Width of the run.
+		size_t height;			//Height of the run.
+		std::vector<uint8_t> mask;	//width * height bytes, 2 for foreground, 1 for background, 0 for none.
 	};
 
 	/**
@@ -527,6 +557,12 @@ struct font
  * Throws std::runtime_error: Bad font data.
  */
 	void load_hex(const char* data, size_t size);
+/**
+ * Use prebuilt font data. Glyphs loaded with load_hex() take precedence over glyphs in prebuilt data.
+ *
+ * Parameter data: The font data. Used in place, and must remain valid for lifetime of the font.
+ */
+	void load_builtin(const builtin_data& data);
 /**
  * Locate glyph.
  *
@@ -598,13 +634,42 @@ struct font
  * Parameter vdbl: If set, double height vertically.
  */
 	void render(uint8_t* buf, size_t stride, const std::string& str, uint32_t alignx, bool hdbl, bool vdbl);
+/**
+ * Get rendered text run.
+ *
+ * Recently rendered runs are cached, so repeatedly rendering the same text is cheap.
+ *
+ * Parameter str: The string to render.
+ * Parameter alignx: The x alignment.
+ * Parameter hdbl: If set, double width horizontally.
+ * Parameter vdbl: If set, double height vertically.
+ * Returns: The rendered run.
+ */
+	std::shared_ptr<const text_run> get_text_run(const std::string& str, uint32_t alignx, bool hdbl, bool vdbl);
 private:
+	struct text_run_key
+	{
+		std::string str;
+		uint32_t alignx;
+		bool hdbl;
+		bool vdbl;
+		bool operator<(const text_run_key& k) const;
+	};
 	glyph bad_glyph;
 	uint32_t bad_glyph_data[4];
 	std::map<uint32_t, glyph> glyphs;
+	const builtin_data* builtin;
+	//Two-level table of glyphs in BMP. Pages without glyphs are empty.
+	std::vector<std::vector<const glyph*>> bmp_table;
 	size_t tabstop;
 	std::vector<uint32_t> memory;
+	threads::lock run_cache_lock;
+	std::map<text_run_key, std::pair<std::shared_ptr<const text_run>, uint64_t>> run_cache;
+	uint64_t run_cache_clock;
 	void load_hex_glyph(const char* data, size_t size);
+	void rebuild_bmp_table();
+	const glyph* get_builtin_glyph(uint32_t glyph) throw();
+	void render_run(uint8_t* buf, size_t stride, const std::string& str, uint32_t alignx, bool hdbl, bool vdbl);
 };
 
 
@@ -2,9 +2,19 @@
 #define _library__gc__hpp__included__
 
 #include <cstdlib>
+#include <cstdint>
 
 namespace GC
 {
+/**
+ * Garbage-collected object.
+ *
+ * New objects start in the young generation, which is collected separately (minor collection). Objects surviving a
+ * collection are promoted to the old generation, which is collected incrementally (major collection).
+ *
+ * Objects referencing other objects by something else than GC::pointer must report those in trace(), and must call
+ * write_barrier() after changing what they reference.
+ */
 class item
 {
 public:
@@ -12,13 +22,41 @@ public:
 	virtual ~item();
 	void mark_root();
 	void unmark_root();
+/**
+ * Collect all garbage now (synchronously).
+ */
 	static void do_gc();
+/**
+ * Request a major collection. The collection is performed by gc_step().
+ */
+	static void request_gc();
+/**
+ * Do a bounded amount of collection work.
+ *
+ * Performs a minor collection if the young generation has grown large, then advances any major collection in
+ * progress by at most budget objects.
+ *
+ * Parameter budget: Maximum number of old objects to process.
+ * Returns: True if a collection is still in progress, false if idle.
+ */
+	static bool gc_step(size_t budget);
 protected:
 	virtual void trace() = 0;
 	void mark();
+	void write_barrier();
 private:
+	friend struct collector;
+	item(const item&);
+	item& operator=(const item&);
+	item* prev;		//Previous in generation list.
+	item* next;		//Next in generation list.
+	item* gray_next;	//Next in gray list.
+	item* remembered_next;	//Next in remembered set.
 	size_t root_count;
-	bool reachable;
+	uint64_t epoch;		//Collection epoch this object was last marked in.
+	uint64_t generation;	//Young generation serial this object was created in.
+	bool gray;		//In gray list?
+	bool remembered;	//In remembered set?
 };
 
 struct obj_tag {};
@@ -0,0 +1,95 @@
+#ifndef _library__mathexpr_program__hpp__included__
+#define _library__mathexpr_program__hpp__included__
+
+#include "mathexpr.hpp"
+#include <map>
+
+namespace mathexpr
+{
+/**
+ * Expressions compiled into flat instruction array.
+ *
+ * Every expression node becomes one instruction with its own value register and argument promises prepared in
+ * advance, so evaluation does not allocate. Instructions are evaluated on demand (operators such as && and if
+ * evaluate only some of their arguments), at most once per evaluation round. Subexpressions that only depend on
+ * constants are folded at compile time.
+ *
+ * The results are the same as evaluating the expression trees directly.
+ */
+class program
+{
+public:
+/**
+ * Create a new empty program.
+ */
+	program();
+/**
+ * Destroy a program.
+ */
+	~program();
+/**
+ * Compile an expression into the program. Nodes shared with previously added expressions are shared in the
+ * program too.
+ *
+ * Parameter root: The expression.
+ * Returns: Entry point for evaluate().
+ */
+	unsigned add(GC::pointer<mathexpr> root);
+/**
+ * Start a new evaluation round. Until next call, each subexpression is evaluated at most once.
+ */
+	void reset();
+/**
+ * Evaluate an expression.
+ *
+ * Parameter entry: The entry point returned by add().
+ * Returns: The value. Valid until next reset().
+ * Throws error: Evaluation failed.
+ */
+	value evaluate(unsigned entry);
+/**
+ * Get number of instructions in program.
+ */
+	size_t size() { return code.size(); }
+private:
+	enum opcode
+	{
+		OP_FIXED,		//Constant value.
+		OP_UNDEFINED,		//Undefined variable.
+		OP_FORWARD,		//Value of another instruction.
+		OP_CALL,		//Call operator.
+		OP_TYPEERROR,		//Type mismatch between operator and arguments.
+	};
+	enum insn_state
+	{
+		S_BUSY,
+		S_DONE,
+		S_FAILED,
+	};
+	struct insn
+	{
+		opcode op;
+		typeinfo* type;
+		operinfo* fn;
+		void* prepared;
+		std::vector<unsigned> args;
+		void* reg;
+		value result;
+		uint64_t round;
+		insn_state state;
+		error::errorcode errcode;
+		std::string errmsg;
+	};
+	program(const program&);
+	program& operator=(const program&);
+	unsigned compile(mathexpr* node);
+	void fold(unsigned i);
+	value eval(unsigned i);
+	std::vector<insn> code;
+	std::map<mathexpr*, unsigned> compiled;
+	std::vector<GC::pointer<mathexpr>> roots;
+	uint64_t round;
+};
+}
+
+#endif
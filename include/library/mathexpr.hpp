@@ -43,7 +43,13 @@ struct operinfo
 	operinfo(std::string funcname);
 	operinfo(std::string opername, unsigned _operands, int _percedence, bool _rtl = false);
 	virtual ~operinfo();
-	virtual void evaluate(value target, std::vector<std::function<value()>> promises) = 0;
+	virtual void evaluate(value target, const std::vector<std::function<value()>>& promises) = 0;
+	//Prepare for repeated evaluation with the same promises. Returns handle for evaluate_prepared().
+	virtual void* prepare(const std::vector<std::function<value()>>& promises);
+	virtual void evaluate_prepared(value target, void* prepared);
+	virtual void unprepare(void* prepared);
+	//True if result only depends on the arguments (so it can be constant-folded).
+	virtual bool is_pure();
 	const std::string fnname;
 	const bool is_operator;
 	const unsigned  operands; 		//Only for operators (max 2 operands).
@@ -84,38 +90,61 @@ struct typeinfo
 
 template<class T> struct operinfo_wrapper : public operinfo
 {
-	operinfo_wrapper(std::string funcname, T (*_fn)(std::vector<std::function<T&()>> promises))
+	operinfo_wrapper(std::string funcname, T (*_fn)(const std::vector<std::function<T&()>>& promises))
 		: operinfo(funcname), fn(_fn)
 	{
 	}
 	operinfo_wrapper(std::string opername, unsigned _operands, int _percedence, bool _rtl,
-		T (*_fn)(std::vector<std::function<T&()>> promises))
+		T (*_fn)(const std::vector<std::function<T&()>>& promises))
 		: operinfo(opername, _operands, _percedence, _rtl), fn(_fn)
 	{
 	}
 	~operinfo_wrapper()
 	{
 	}
-	void evaluate(value target, std::vector<std::function<value()>> promises)
+	void evaluate(value target, const std::vector<std::function<value()>>& promises)
 	{
 		std::vector<std::function<T&()>> _promises;
-		for(auto i : promises) {
+		wrap_promises(_promises, promises);
+		*(T*)(target._value) = fn(_promises);
+	}
+	void* prepare(const std::vector<std::function<value()>>& promises)
+	{
+		std::vector<std::function<T&()>>* _promises = new std::vector<std::function<T&()>>();
+		wrap_promises(*_promises, promises);
+		return _promises;
+	}
+	void evaluate_prepared(value target, void* prepared)
+	{
+		*(T*)(target._value) = fn(*(std::vector<std::function<T&()>>*)prepared);
+	}
+	void unprepare(void* prepared)
+	{
+		delete (std::vector<std::function<T&()>>*)prepared;
+	}
+	bool is_pure()
+	{
+		return true;
+	}
+private:
+	static void wrap_promises(std::vector<std::function<T&()>>& out,
+		const std::vector<std::function<value()>>& promises)
+	{
+		for(auto& i : promises) {
 			std::function<value()> f = i;
-			_promises.push_back([f, this]() -> T& {
+			out.push_back([f]() -> T& {
 				auto r = f();
 				return *(T*)r._value;
 			});
 		}
-		*(T*)(target._value) = fn(_promises);
 	}
-private:
-	T (*fn)(std::vector<std::function<T&()>> promises);
+	T (*fn)(const std::vector<std::function<T&()>>& promises);
 };
 
 template<class T> struct opfun_info
 {
 	std::string name;
-	T (*_fn)(std::vector<std::function<T&()>> promises);
+	T (*_fn)(const std::vector<std::function<T&()>>& promises);
 	bool is_operator;
 	unsigned operands;
 	int precedence;
@@ -265,6 +294,7 @@ public:
 protected:
 	void trace();
 private:
+	friend class program;
 	void mark_error_and_throw(error::errorcode _errcode, const std::string& _error);
 	eval_state state;
 	typeinfo& type;				//Type of value.
@@ -6,7 +6,10 @@
 #include <vector>
 #include <cstdint>
 #include <cstring>
+#include <map>
+#include <atomic>
 #include "threads.hpp"
+#include "pagehash.hpp"
 #include "arch-detect.hpp"
 
 
@@ -16,11 +19,23 @@
 class memory_space
 {
 public:
+/**
+ * Constructor.
+ */
+	memory_space();
+/**
+ * Destructor.
+ */
+	~memory_space();
 /**
  * Information about region of memory.
  */
 	struct region
 	{
+/**
+ * Constructor.
+ */
+		region() { dirty_gen = NULL; }
 /**
  * Destructor.
  */
@@ -61,6 +76,18 @@ public:
  * manipulate this buffer (faster). Must be NULL for special regions.
  */
 		unsigned char* direct_map;
+/**
+ * Per-page (page_hash::page_size) modification generations, or NULL if the region does not track modified
+ * pages. The owner of the memory must increment the generation of every page it modifies.
+ */
+		uint64_t* dirty_gen;
+/**
+ * Mark range of region as modified (no-op if region does not track modified pages).
+ *
+ * Parameter offset: Offset of the first modified byte.
+ * Parameter tsize: Number of modified bytes.
+ */
+		void mark_dirty(uint64_t offset, uint64_t tsize);
 /**
  * Read from region.
  *
@@ -100,9 +127,10 @@ public:
  * Parameter memory: Memory backing the region.
  * Parameter size: Size of the region.
  * Parameter _readonly: If true, region is readonly.
+ * Parameter _dirty_gen: Per-page modification generations, or NULL if not tracked.
  */
 		region_direct(const std::string& name, uint64_t base, int endian, unsigned char* memory,
-			size_t size, bool _readonly = false);
+			size_t size, bool _readonly = false, uint64_t* _dirty_gen = NULL);
 /**
  * Destructor.
  */
@@ -148,13 +176,13 @@ public:
 /**
  * Get number of regions.
  */
-	size_t get_region_count() { return u_regions.size(); }
+	size_t get_region_count() { return current.load(std::memory_order_acquire)->regions.size(); }
 /**
  * Get linear RAM size.
  *
  * Returns: The linear RAM size in bytes.
  */
-	uint64_t get_linear_size() { return linear_size; }
+	uint64_t get_linear_size() { return current.load(std::memory_order_acquire)->linear_size; }
 /**
  * Get list of all regions in memory space.
  */
@@ -248,12 +276,39 @@ public:
  * Returns: The textual address.
  */
 	std::string address_to_textual(uint64_t addr);
+/**
+ * Incrementally hash contents of all linear (RAM) regions.
+ *
+ * Only pages that have been modified since the last call are rehashed. This needs every linear region to be
+ * directly mapped and to track modified pages.
+ *
+ * Parameter hashout: 32-byte buffer to store the hash to.
+ * Returns: True if hashed, false if there are no linear regions or some region does not track modified pages.
+ */
+	bool hash_linear_incremental(uint8_t* hashout);
 private:
+	memory_space(const memory_space&);
+	memory_space& operator=(const memory_space&);
+/**
+ * Immutable region table. Lookups use the current snapshot without locking. Replaced snapshots are kept until
+ * the memory space is destroyed, since readers may still be using them.
+ */
+	struct snapshot
+	{
+		uint64_t serial;
+		std::vector<region*> regions;
+		std::vector<region*> lregions;
+		std::vector<uint64_t> linear_bases;
+		uint64_t linear_size;
+		//Index of region entirely covering each lookup page of the low addresses (resp. linear addresses), or
+		//no_page if none does.
+		std::vector<uint32_t> pages;
+		std::vector<uint32_t> lpages;
+	};
+	std::atomic<snapshot*> current;
+	std::list<snapshot*> snapshots;
 	threads::lock mlock;
-	std::vector<region*> u_regions;
-	std::vector<region*> u_lregions;
-	std::vector<uint64_t> linear_bases;
-	uint64_t linear_size;
+	std::map<region*, page_hash> page_hashes;
 	static int _get_system_endian();
 	static int sysendian;
 };
@@ -2,6 +2,7 @@
 #define _library__memorywatch__hpp__included__
 
 #include "mathexpr.hpp"
+#include "mathexpr-program.hpp"
 #include <functional>
 #include <list>
 #include <set>
@@ -29,7 +30,7 @@ struct memread_oper : public mathexpr::operinfo
  *
  * Note: The first promise is for the address.
  */
-	void evaluate(mathexpr::value target, std::vector<std::function<mathexpr::value()>> promises);
+	void evaluate(mathexpr::value target, const std::vector<std::function<mathexpr::value()>>& promises);
 	//Fields.
 	unsigned bytes;		//Number of bytes to read.
 	bool signed_flag;	//Is signed?
@@ -75,6 +76,8 @@ struct item
 	item(mathexpr::typeinfo& t)
 		: expr(GC::obj_tag(), &t)
 	{
+		program = NULL;
+		program_entry = 0;
 	}
 /**
  * Get the value as string.
@@ -90,6 +93,8 @@ struct item
 	GC::pointer<item_printer> printer;		//Printer to use.
 	GC::pointer<mathexpr::mathexpr> expr;	//Expression to watch.
 	std::string format;				//Formatting to use.
+	mathexpr::program* program;			//Compiled program (NULL => evaluate the tree).
+	unsigned program_entry;				//Entry of expr in program.
 };
 
 /**
@@ -97,6 +102,10 @@ struct item
  */
 struct set
 {
+/**
+ * Ctor.
+ */
+	set();
 /**
  * Dtor.
  */
@@ -167,7 +176,10 @@ struct set
 	void swap(set& s) throw();
 private:
 	static size_t utflength_rate(const std::string& s);
+	void compile();
+	void discard_program();
 	std::map<std::string, item> roots;
+	mathexpr::program* program;
 };
 }
 
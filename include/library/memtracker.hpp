@@ -2,14 +2,20 @@
 #define _library__memtracker__hpp__included__
 
 #include "threads.hpp"
+#include <atomic>
+#include <cstdint>
 #include <map>
+#include <vector>
 
 class memtracker
 {
 public:
 	memtracker();
 	~memtracker();
-	void operator()(const char* category, ssize_t change);
+	//Get small integer ID for category, registering the category if needed.
+	unsigned intern(const char* category);
+	void operator()(unsigned category, ssize_t change);
+	void operator()(const char* category, ssize_t change) { (*this)(intern(category), change); }
 	void reset(const char* category, size_t value);
 	std::map<std::string, size_t> report();
 	static memtracker& singleton();
@@ -17,7 +23,7 @@ public:
 	{
 	public:
 		autorelease(memtracker& _track, const char* cat, size_t amount)
-			: tracker(_track), category(cat), committed(amount)
+			: tracker(_track), category(_track.intern(cat)), committed(amount)
 		{
 			tracker(category, committed);
 		}
@@ -37,13 +43,29 @@ public:
 		}
 	private:
 		memtracker& tracker;
-		const char* category;
+		unsigned category;
 		size_t committed;
 	};
 private:
+	friend struct memtracker_tls;
+	const static unsigned max_categories = 256;
+	const static unsigned ptr_cache_size = 512;
+	//Counters of one thread. Only written by the owning thread.
+	struct slab;
+	slab* get_slab();
+	void release_slab(slab* s);
+	int64_t total(unsigned category);
 	bool invalid;
+	uint64_t serial;
 	threads::lock mut;
-	std::map<std::string, size_t> data;
+	//Intern lookup by category pointer, filled on first use of each pointer.
+	std::atomic<const char*> ptr_keys[ptr_cache_size];
+	std::atomic<unsigned> ptr_vals[ptr_cache_size];
+	std::map<std::string, unsigned> ids;
+	std::vector<std::string> names;
+	std::vector<slab*> slabs;
+	std::vector<slab*> free_slabs;
+	int64_t retired[max_categories];
 	memtracker(const memtracker&);
 	memtracker& operator=(const memtracker&);
 };
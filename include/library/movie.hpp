@@ -215,8 +215,11 @@ public:
 	void fast_save(uint64_t& _frame, uint64_t& _ptr, uint64_t& _lagc, std::vector<uint32_t>& counters);
 /**
  * Fast load.
+ *
+ * Parameter keep_readonly: If true, stay in readonly mode instead of switching to readwrite (truncating the movie).
  */
-	void fast_load(uint64_t& _frame, uint64_t& _ptr, uint64_t& _lagc, std::vector<uint32_t>& counters);
+	void fast_load(uint64_t& _frame, uint64_t& _ptr, uint64_t& _lagc, std::vector<uint32_t>& counters,
+		bool keep_readonly = false);
 /**
  * Poll flag handling.
  */
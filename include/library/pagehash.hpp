@@ -0,0 +1,63 @@
+#ifndef _library__pagehash__hpp__included__
+#define _library__pagehash__hpp__included__
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+/**
+ * Incremental hash of page-granular memory.
+ *
+ * The memory is split into pages, each page is hashed with SHA-256 and the page hashes are combined into a
+ * binary Merkle tree. Only pages that have changed since the last update (as indicated by per-page modification
+ * generations) and the tree nodes above them are rehashed.
+ */
+class page_hash
+{
+public:
+/**
+ * Log2 of page size.
+ */
+	const static unsigned page_shift = 12;
+/**
+ * Page size.
+ */
+	const static uint64_t page_size = 1ULL << page_shift;
+/**
+ * Get number of pages needed to cover memory of specified size.
+ */
+	static uint64_t pages_for(uint64_t size) { return (size + page_size - 1) >> page_shift; }
+/**
+ * Create new hash of empty memory.
+ */
+	page_hash();
+/**
+ * Update the hash.
+ *
+ * Parameter mem: The memory to hash.
+ * Parameter size: Size of memory to hash. If different from size of last update, everything is rehashed.
+ * Parameter gens: Per-page modification generations (pages_for(size) entries). A page is rehashed only if its
+ *	generation differs from the one seen on last update. If NULL, all pages are rehashed.
+ * Returns: Number of pages rehashed.
+ */
+	uint64_t update(const uint8_t* mem, uint64_t size, const uint64_t* gens);
+/**
+ * Read the root hash.
+ *
+ * Parameter hashout: 32-byte buffer to store the hash to.
+ */
+	void read(uint8_t* hashout);
+/**
+ * Forget all cached page hashes, forcing a full rehash on next update.
+ */
+	void reset();
+private:
+	uint64_t memsize;
+	bool valid;
+	std::vector<uint64_t> seen;
+	//Level 0 is leaves, last level is the root. 32 bytes per node.
+	std::vector<std::vector<uint8_t>> levels;
+	std::vector<std::vector<bool>> stale;
+};
+
+#endif
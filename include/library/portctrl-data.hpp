@@ -16,6 +16,7 @@
 #include <map>
 #include <list>
 #include <set>
+#include <memory>
 #include "json.hpp"
 #include "threads.hpp"
 #include "memtracker.hpp"
@@ -311,6 +312,18 @@ public:
  * Returns: The value of control. Buttons return 0 or 1.
  */
 	short (*read)(const type* _this, const unsigned char* buffer, unsigned idx, unsigned ctrl);
+/**
+ * Read controller data of one control from compressed representations of consecutive frames.
+ *
+ * Parameter buffer: The buffer storing compressed representation of controller state in the first frame.
+ * Parameter stride: Distance between compressed representations of consecutive frames in bytes.
+ * Parameter count: Number of frames.
+ * Parameter idx: Index of controller.
+ * Parameter ctrl: The control to query.
+ * Parameter out: Array of count elements to write the values to. Buttons give 0 or 1.
+ */
+	void (*read_range)(const type* _this, const unsigned char* buffer, size_t stride, size_t count, unsigned idx,
+		unsigned ctrl, short* out);
 /**
  * Take compressed controller data and serialize it into textual representation.
  *
@@ -532,6 +545,27 @@ public:
 			throw std::runtime_error("Bad legacy PCID");
 		return legacy_pcids[pcid];
 	}
+/**
+ * Serialize consecutive frames to text format, one frame per line (LF-terminated).
+ *
+ * Parameter buffer: The compressed representation of the first frame.
+ * Parameter stride: Distance between compressed representations of consecutive frames in bytes.
+ * Parameter count: Number of frames.
+ * Parameter textbuf: The text buffer to write to. Needs to have space for count * MAX_SERIALIZED_SIZE bytes. Not
+ *	NUL-terminated.
+ * Returns: Number of bytes written.
+ */
+	size_t serialize(const unsigned char* buffer, size_t stride, size_t count, char* textbuf) const throw();
+/**
+ * Deserialize consecutive frames from text format.
+ *
+ * Parameter buffer: The compressed representation of the first frame.
+ * Parameter stride: Distance between compressed representations of consecutive frames in bytes.
+ * Parameter count: Number of frames.
+ * Parameter lines: Text representations of the frames, each terminated by NUL, CR or LF.
+ * Throws std::runtime_error: Bad serialized representation.
+ */
+	void deserialize(unsigned char* buffer, size_t stride, size_t count, const char* const* lines) const;
 private:
 	type_set(std::vector<class type*> types, struct index_map control_map);
 	size_t* port_offsets;
@@ -1111,11 +1145,94 @@ public:
 		if(x >= frames)
 			throw std::runtime_error("frame_vector::operator[]: Illegal index");
 		if(page != cache_page_num) {
-			cache_page = &pages[page];
+			cache_page = &writable_page(page);
 			cache_page_num = page;
 		}
 		return frame(cache_page->content + pageoffset, *types, this);
 	}
+/**
+ * Read specified subframe.
+ *
+ * Unlike operator[], this never makes private copies of pages shared with other vectors.
+ *
+ * Parameter x: The frame number.
+ * Returns: Copy of the controller frame, with dedicated memory.
+ * Throws std::runtime_error: Invalid frame index.
+ */
+	frame get(size_t x) const
+	{
+		if(x >= frames)
+			throw std::runtime_error("frame_vector::get: Illegal index");
+		frame c(*types);
+		c = frame(const_cast<unsigned char*>(frame_data(x)), *types);
+		return c;
+	}
+/**
+ * Read sync flag of specified subframe.
+ *
+ * Parameter x: The frame number.
+ * Returns: The sync flag.
+ * Throws std::runtime_error: Invalid frame index.
+ */
+	bool is_sync(size_t x) const
+	{
+		if(x >= frames)
+			throw std::runtime_error("frame_vector::is_sync: Illegal index");
+		return frame::sync(frame_data(x));
+	}
+/**
+ * Read control of specified subframe.
+ *
+ * Like get(), this never makes private copies of shared pages. The page is cached and the frame is not copied, so
+ * this is cheap for repeated reads from the same page.
+ *
+ * Parameter x: The frame number.
+ * Parameter port: The port.
+ * Parameter controller: The controller.
+ * Parameter ctrl: The control id.
+ * Returns: The axis value.
+ * Throws std::runtime_error: Invalid frame index.
+ */
+	short read_axis3(size_t x, unsigned port, unsigned controller, unsigned ctrl)
+	{
+		if(x >= frames)
+			throw std::runtime_error("frame_vector::read_axis3: Illegal index");
+		if(port >= types->ports())
+			return 0;
+		auto& t = types->port_type(port);
+		return t.read(&t, const_cast<unsigned char*>(cached_frame_data(x)) + types->port_offset(port),
+			controller, ctrl);
+	}
+/**
+ * Read control of specified subframe.
+ *
+ * Parameter x: The frame number.
+ * Parameter idx: Index of control.
+ * Returns: The axis value.
+ * Throws std::runtime_error: Invalid frame index.
+ */
+	short read_axis2(size_t x, unsigned idx)
+	{
+		index_triple t = types->index_to_triple(idx);
+		if(t.valid)
+			return read_axis3(x, t.port, t.controller, t.control);
+		else
+			return 0;
+	}
+/**
+ * Copy subframes from another vector (or this vector).
+ *
+ * Pages that are entirely overwritten are shared with the source instead of being copied.
+ *
+ * Parameter dst: The first subframe to write. Must be such that all written subframes are in range.
+ * Parameter src: The vector to copy from. Must have the same port types.
+ * Parameter srcidx: The first subframe to read. Must be such that all read subframes are in range.
+ * Parameter count: Number of subframes to copy.
+ * Parameter backwards: If set, copy the last subframe first. Only matters if the ranges overlap.
+ * Throws std::bad_alloc: Not enough memory.
+ * Throws std::runtime_error: Port type mismatch.
+ */
+	void copy_frames(size_t dst, frame_vector& src, size_t srcidx, size_t count, bool backwards = false);
 /**
  * Append a subframe.
  *
@@ -1200,13 +1317,15 @@ public:
  */
 	size_t get_frames_per_page() const { return frames_per_page; }
 /**
- * Get content of given page.
+ * Get content of given page for writing.
+ *
+ * If the page is shared with other vectors, it is unshared first.
  */
-	unsigned char* get_page_buffer(size_t page) { return pages[page].content; }
+	unsigned char* get_page_buffer(size_t page) { return writable_page(page).content; }
 /**
- * Get content of given page.
+ * Get content of given page for reading.
  */
-	const unsigned char* get_page_buffer(size_t page) const { return pages.find(page)->second.content; }
+	const unsigned char* get_page_buffer(size_t page) const { return pages.find(page)->second->content; }
 /**
  * Get binary save size.
  *
@@ -1228,6 +1347,58 @@ public:
  * Throws std::runtime_error: Error saving.
  */
 	void load_binary(binarystream::input& stream);
+/**
+ * Load frames in text format (one frame per line), appending them to the vector.
+ *
+ * Empty lines are skipped and CRs at end of line are ignored. Large inputs are decoded using multiple threads.
+ *
+ * Parameter buf: The text.
+ * Parameter len: Length of the text.
+ * Throws std::bad_alloc: Not enough memory.
+ * Throws std::runtime_error: Bad serialized representation. The vector is left unchanged.
+ */
+	void load_text(const char* buf, size_t len);
+/**
+ * Save frames in text format, one frame per line (LF-terminated).
+ *
+ * Large vectors are encoded using multiple threads.
+ *
+ * Parameter out: The text is stored here.
+ * Throws std::bad_alloc: Not enough memory.
+ */
+	void save_text(std::vector<char>& out);
+/**
+ * Serialize subframes to text format, one subframe per line (LF-terminated), appending to buffer.
+ *
+ * Parameter first: The first subframe to serialize.
+ * Parameter count: Number of subframes to serialize.
+ * Parameter out: The text is appended here.
+ * Throws std::bad_alloc: Not enough memory.
+ * Throws std::runtime_error: Invalid range.
+ */
+	void serialize_frames(size_t first, size_t count, std::vector<char>& out) const;
+/**
+ * Find first subframe that differs from another vector.
+ *
+ * Pages shared between the vectors are skipped without comparing them.
+ *
+ * Parameter with: The vector to compare with. Must have the same port types.
+ * Parameter first: The first subframe to compare.
+ * Parameter count: Number of subframes to compare. Must be such that all subframes are in range in both vectors.
+ * Returns: The index of first differing subframe, or first + count if there is none.
+ * Throws std::runtime_error: Port type mismatch or invalid range.
+ */
+	size_t first_difference(const frame_vector& with, size_t first, size_t count) const;
+/**
+ * Read one control from a range of subframes.
+ *
+ * Parameter first: The first subframe to read.
+ * Parameter count: Number of subframes to read.
+ * Parameter idx: Index of the control.
+ * Parameter out: Array of count elements to write the values to. Buttons give 0 or 1, invalid controls 0.
+ * Throws std::runtime_error: Invalid range or index.
+ */
+	void read_column(size_t first, size_t count, unsigned idx, short* out) const;
 /**
  * Check that the movies are compatible up to a point.
  *
@@ -1328,27 +1499,63 @@ private:
 			memtracker::singleton()(movie_page_id, CONTROLLER_PAGE_SIZE + 36);
 			memset(content, 0, CONTROLLER_PAGE_SIZE);
 		}
+		page(const page& p) {
+			memtracker::singleton()(movie_page_id, CONTROLLER_PAGE_SIZE + 36);
+			memcpy(content, p.content, CONTROLLER_PAGE_SIZE);
+		}
 		~page() { memtracker::singleton()(movie_page_id, -CONTROLLER_PAGE_SIZE - 36); }
 		unsigned char content[CONTROLLER_PAGE_SIZE];
+	private:
+		page& operator=(const page&);
 	};
 	size_t frames_per_page;
 	size_t frame_size;
 	size_t frames;
 	const type_set* types;
-	size_t cache_page_num;
-	page* cache_page;
-	std::map<size_t, page> pages;
+	//The cached page is never shared, so it can be written through directly.
+	mutable size_t cache_page_num;
+	mutable page* cache_page;
+	//Page cached for reading only. Dropped whenever the page is replaced.
+	mutable size_t rcache_page_num;
+	mutable const page* rcache_page;
+	//Pages are shared copy-on-write between vectors. Shared pages are never written.
+	std::map<size_t, std::shared_ptr<page>> pages;
 	uint64_t real_frame_count;
 	uint64_t frame_count_at_freeze;
 	size_t freeze_count;
 	std::set<fchange_listener*> on_framecount_change;
 	size_t walk_helper(size_t frame, bool sflag) throw();
+	page& writable_page(size_t n);
+	const page& readable_page(size_t n) const { return *pages.find(n)->second; }
+	const unsigned char* frame_data(size_t x) const
+	{
+		return readable_page(x / frames_per_page).content + frame_size * (x % frames_per_page);
+	}
+	const unsigned char* cached_frame_data(size_t x)
+	{
+		size_t page = x / frames_per_page;
+		size_t pageoffset = frame_size * (x % frames_per_page);
+		if(page == cache_page_num)
+			return cache_page->content + pageoffset;
+		if(page != rcache_page_num) {
+			rcache_page = &readable_page(page);
+			rcache_page_num = page;
+		}
+		return rcache_page->content + pageoffset;
+	}
 	threads::lock mlock;
-	void clear_cache()
+	void clear_cache() const
 	{
 		cache_page_num = 0;
 		cache_page_num--;
 		cache_page = NULL;
+		clear_read_cache();
+	}
+	void clear_read_cache() const
+	{
+		rcache_page_num = 0;
+		rcache_page_num--;
+		rcache_page = NULL;
 	}
 	memtracker::autorelease tracker;
 };
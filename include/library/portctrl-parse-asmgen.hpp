@@ -243,6 +243,65 @@ template<class T> void emit_write_button(T& a, assembler::label_list& labels, as
 //
 template<class T> void emit_write_axis(T& a, assembler::label_list& labels, assembler::label& l,
 	assembler::label& end, int32_t offset);
+
+//Emit function prologue for range read function.
+//
+//The range read function takes seven parameters. In order:
+//	- Dummy pointer (to be ignored).
+//	- controller state of the first frame to be queried.
+//	- distance between controller states of consecutive frames in bytes (size_t).
+//	- number of frames (size_t).
+//	- controller number (unsigned)
+//	- control index number (unsigned)
+//	- output array (pointer to short).
+//
+//Initialize pending value to 0. The dispatch code is the same as for read function.
+//
+template<class T> void emit_read_range_prologue(T& a, assembler::label_list& labels);
+
+//Emit function epilogue for range read function.
+//
+//Range read function does not return anything.
+//
+template<class T> void emit_read_range_epilogue(T& a, assembler::label_list& labels);
+
+//Emit code to read button value across frames.
+//
+//For each frame, write 1 to output array if the specified bit is set, 0 otherwise. Advance to next frame and
+//output element. Then jump to <end>.
+//
+// Parameters:
+//	- l: Label for the code fragment itself (this needs to be defined).
+//	- end: Code to return from the range read function.
+//	- offset: Byte offset within controller state (0-based).
+//	- mask: Bitmask for the button bit.
+//
+template<class T> void emit_read_range_button(T& a, assembler::label_list& labels, assembler::label& l,
+	assembler::label& end, int32_t offset, uint8_t mask);
+
+//Emit code to read axis value across frames.
+//
+//For each frame, write value in specified location to output array. Advance to next frame and output element.
+//Then jump to <end>.
+//
+// Parameters:
+//	- l: Label for the code fragment itself (this needs to be defined).
+//	- end: Code to return from the range read function.
+//	- offset: Low byte offset in controller state (high byte is at <offset>+1). Signed.
+//
+template<class T> void emit_read_range_axis(T& a, assembler::label_list& labels, assembler::label& l,
+	assembler::label& end, int32_t offset);
+
+//Emit code to read invalid control across frames.
+//
+//Write pending value (0) to every element of output array. Then fall through to code following this.
+//
+// Parameters:
+//	- l: Label for the code fragment itself (this needs to be defined).
+//	- end: Code to return from the range read function.
+//
+template<class T> void emit_read_range_blank(T& a, assembler::label_list& labels, assembler::label& l,
+	assembler::label& end);
 }
 }
 
@@ -172,9 +172,35 @@ public:
 		hash(hashout, reinterpret_cast<const uint8_t*>(&data[0]), data.size());
 		return tostring(hashout);
 	}
+/**
+ * Appends data of the same length to several contexts at once. Equivalent to calling write() on each context, but
+ * may hash multiple messages in parallel (multi-buffer). The contexts must be distinct.
+ *
+ * Parameter ctx: The contexts to write to.
+ * Parameter data: The data to write, one pointer per context.
+ * Parameter datalen: The length of data written to each context.
+ * Parameter count: Number of contexts.
+ */
+	static void write_multi(sha256* const* ctx, const uint8_t* const* data, size_t datalen, size_t count) throw();
+
+/**
+ * Get name of SHA-256 implementation in use ("portable", "shani" or "avx2").
+ *
+ * Returns: The name of implementation.
+ */
+	static std::string get_backend();
+
+/**
+ * Select SHA-256 implementation. "auto" selects the fastest one supported by the CPU. Only intended for
+ * benchmarking; all implementations give the same results.
+ *
+ * Parameter name: The name of implementation.
+ * Returns: True if successful, false if the implementation is not supported.
+ */
+	static bool set_backend(const std::string& name);
 private:
 	uint32_t state[8];
-	uint32_t datablock[16];
+	uint8_t datablock[64];
 	unsigned blockbytes;
 	uint64_t totalbytes;
 	bool finished;
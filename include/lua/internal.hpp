@@ -23,6 +23,7 @@ extern lua::class_group lua_class_pure;
 extern lua::class_group lua_class_movie;
 extern lua::class_group lua_class_memory;
 extern lua::class_group lua_class_fileio;
+extern lua::class_group lua_class_worker;
 
 void push_keygroup_parameters(lua::state& L, keyboard::key& p);
 
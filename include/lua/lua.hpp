@@ -37,6 +37,8 @@ struct lua_state
 	void callback_do_frame() throw();
 	void callback_do_frame_emulated() throw();
 	void callback_do_rewind() throw();
+	void callback_pre_rewind() throw();
+	void callback_post_rewind() throw();
 	void callback_do_readwrite() throw();
 	void callback_do_idle() throw();
 	void callback_do_timer() throw();
@@ -1,4 +1,5 @@
 #include "core/advdumper.hpp"
+#include "core/audioapi.hpp"
 #include "core/instance.hpp"
 #include "core/misc.hpp"
 #include "library/globalwrap.hpp"
@@ -163,6 +164,7 @@ dumper_base::dumper_base()
 	mdumper = NULL;
 	fbase = NULL;
 	samples_killed = 0;
+	decimated_audio = false;
 }
 
 dumper_base::dumper_base(master_dumper& _mdumper, dumper_factory_base& _fbase)
@@ -171,6 +173,7 @@ dumper_base::dumper_base(master_dumper& _mdumper, dumper_factory_base& _fbase)
 	threads::arlock h(mdumper->lock);
 	mdumper->dumpers[fbase] = this;
 	samples_killed = 0;
+	decimated_audio = false;
 }
 
 dumper_base::~dumper_base() throw()
@@ -190,6 +193,7 @@ master_dumper::master_dumper(lua_state& _lua2)
 {
 	current_rate_n = 48000;
 	current_rate_d = 1;
+	current_decimation = 1;
 	output = &std::cerr;
 }
 
@@ -238,9 +242,13 @@ void master_dumper::statuschange()
 		i->dump_status_change();
 }
 
-std::pair<uint32_t, uint32_t> master_dumper::get_rate()
+std::pair<uint32_t, uint32_t> master_dumper::get_rate(bool decimated)
 {
 	threads::arlock h(lock);
+	if(decimated && current_decimation > 1) {
+		uint32_t ga = gcd(current_rate_n, current_decimation);
+		return std::make_pair(current_rate_n / ga, current_rate_d * (current_decimation / ga));
+	}
 	return std::make_pair(current_rate_n, current_rate_d);
 }
 
@@ -268,21 +276,26 @@ void master_dumper::on_frame(struct framebuffer::raw& _frame, uint32_t fps_n, ui
 		}
 }
 
-void master_dumper::on_sample(short l, short r)
+void master_dumper::on_samples(const int16_t* samples, size_t count, bool stereo, bool decimated)
 {
 	threads::arlock h(lock);
-	for(auto i : sdumpers)
-		try {
-			if(__builtin_expect(i->samples_killed, 0)) {
-				i->samples_killed--;
-				continue;
+	unsigned step = stereo ? 2 : 1;
+	for(auto i : sdumpers) {
+		if((i->decimated_audio && current_decimation > 1) != decimated)
+			continue;
+		for(size_t j = 0; j < count; j++)
+			try {
+				if(__builtin_expect(i->samples_killed, 0)) {
+					i->samples_killed--;
+					continue;
+				}
+				i->on_sample(samples[step * j], samples[step * j + step - 1]);
+			} catch(std::exception& e) {
+				(*output) << "Error in on_sample: " << e.what() << std::endl;
+			} catch(...) {
+				(*output) << "Error in on_sample: <unknown error>" << std::endl;
 			}
-			i->on_sample(l, r);
-		} catch(std::exception& e) {
-			(*output) << "Error in on_sample: " << e.what() << std::endl;
-		} catch(...) {
-			(*output) << "Error in on_sample: <unknown error>" << std::endl;
-		}
+	}
 }
 
 void master_dumper::on_rate_change(uint32_t n, uint32_t d)
@@ -294,12 +307,14 @@ void master_dumper::on_rate_change(uint32_t n, uint32_t d)
 	if(n != current_rate_n || d != current_rate_d) {
 		current_rate_n = n;
 		current_rate_d = d;
+		current_decimation = audioapi_instance::decimation_factor(1.0 * n / d);
 	} else
 		return;
 
 	for(auto i : sdumpers)
 		try {
-			i->on_rate_change(current_rate_n, current_rate_d);
+			auto rate = get_rate(i->decimated_audio);
+			i->on_rate_change(rate.first, rate.second);
 		} catch(std::exception& e) {
 			(*output) << "Error in on_rate_change: " << e.what() << std::endl;
 		} catch(...) {
@@ -369,9 +384,9 @@ template<bool X> bool master_dumper::render_video_hud(struct framebuffer::fb<X>&
 	return !lua_kill_video;
 }
 
-uint64_t master_dumper::killed_audio_length(uint32_t fps_n, uint32_t fps_d, double& fraction)
+uint64_t master_dumper::killed_audio_length(uint32_t fps_n, uint32_t fps_d, double& fraction, bool decimated)
 {
-	auto r = get_rate();
+	auto r = get_rate(decimated);
 	double x = 1.0 * fps_d * r.first / (fps_n * r.second) + fraction;
 	uint64_t y = x;
 	fraction = x - y;
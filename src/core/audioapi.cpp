@@ -212,14 +212,25 @@ void audioapi_instance::record_voice(float* samples, size_t count)
 	voicer_get = ptr;
 }
 
+unsigned audioapi_instance::decimation_factor(double rate)
+{
+	return decimator::factor_for(rate, decimate_above);
+}
+
 void audioapi_instance::submit_buffer(int16_t* samples, size_t count, bool stereo, double rate)
 {
-	if(stereo)
-		for(unsigned i = 0; i < count; i++)
-			CORE().mdumper->on_sample(samples[2 * i + 0], samples[2 * i + 1]);
-	else
-		for(unsigned i = 0; i < count; i++)
-			CORE().mdumper->on_sample(samples[i], samples[i]);
+	auto& core = CORE();
+	core.mdumper->on_samples(samples, count, stereo, false);
+	//High-rate music is decimated once, both for playback and for dumpers that want lower rate.
+	unsigned factor = decimation_factor(rate);
+	music_decimator.set_factor(factor);
+	if(factor > 1) {
+		decimated.resize((stereo ? 2 : 1) * (count / factor + 1));
+		count = music_decimator.process(samples, count, stereo, &decimated[0]);
+		samples = &decimated[0];
+		rate /= factor;
+		core.mdumper->on_samples(samples, count, stereo, true);
+	}
 	//Limit buffers to avoid overrunning.
 	if(count > music_bufsize / (stereo ? 2 : 1))
 		count = music_bufsize / (stereo ? 2 : 1);
@@ -96,6 +96,9 @@ emu_framebuffer::emu_framebuffer(subtitle_commentary& _subtitles, settingvar::gr
 	iqueue(_iqueue), screenshot(cmd, CFRAMEBUF::ss, [this](command::arg_filename a) { this->do_screenshot(a); })
 {
 	last_redraw_no_lua = false;
+	has_skipped = false;
+	//The remembered frame may be gone with the old core.
+	corechange.set(edispatch.core_changed, [this](bool x) { this->has_skipped = false; });
 }
 
 void emu_framebuffer::do_screenshot(command::arg_filename file)
@@ -165,11 +168,37 @@ void emu_framebuffer::redraw_framebuffer(framebuffer::raw& todraw, bool no_lua,
 	buffering.put_write();
 	edispatch.screen_update();
 	last_redraw_no_lua = no_lua;
+	has_skipped = false;
 	supdater.update();
 }
 
+void emu_framebuffer::skip_framebuffer(framebuffer::raw& todraw)
+{
+	//Only remember where the frame is. It gets copied if it is ever rendered.
+	skipped.type = todraw.get_format();
+	skipped.mem = reinterpret_cast<char*>(todraw.get_start());
+	skipped.physwidth = skipped.width = todraw.get_width();
+	skipped.physheight = skipped.height = todraw.get_height();
+	skipped.physstride = skipped.stride = todraw.get_stride();
+	skipped.offset_x = 0;
+	skipped.offset_y = 0;
+	has_skipped = true;
+}
+
+void emu_framebuffer::flush_skipped()
+{
+	if(!has_skipped)
+		return;
+	framebuffer::raw last(skipped);
+	redraw_framebuffer(last, false, true);
+}
+
 void emu_framebuffer::redraw_framebuffer()
 {
+	if(has_skipped) {
+		flush_skipped();
+		return;
+	}
 	framebuffer::raw copy;
 	buffering.read_last_write_synchronous([&copy](render_info& ri) { copy = ri.fbuf; });
 	//Redraws are never spontaneous
@@ -55,6 +55,12 @@ double framerate_regulator::get_speed_multiplier() throw()
 	return multiplier_framerate;
 }
 
+bool framerate_regulator::is_unthrottled() throw()
+{
+	threads::alock h(framerate_lock);
+	return turboed || multiplier_framerate == std::numeric_limits<double>::infinity();
+}
+
 void framerate_regulator::freeze_time(uint64_t curtime)
 {
 	get_time(curtime, true);
@@ -0,0 +1,273 @@
+#include "core/greenzone.hpp"
+#include "core/misc.hpp"
+#include "core/moviedata.hpp"
+#include "core/movie.hpp"
+#include "core/rom.hpp"
+#include "core/settings.hpp"
+#include "library/minmax.hpp"
+#include "lua/lua.hpp"
+#include <cstdio>
+#include <stdexcept>
+#include <zlib.h>
+
+//Number of snapshots kept at full density on each side of the cursor.
+#define DENSE_SNAPSHOTS 32
+
+namespace
+{
+	settingvar::supervariable<settingvar::model_int<0, 1000000>> SET_greenzone_interval(lsnes_setgrp,
+		"greenzone-interval", "Movie‣Greenzone‣Snapshot interval", 0);
+	settingvar::supervariable<settingvar::model_int<1, 1048576>> SET_greenzone_memory(lsnes_setgrp,
+		"greenzone-memory", "Movie‣Greenzone‣Memory limit (MB)", 256);
+	settingvar::supervariable<settingvar::model_int<0, 1048576>> SET_greenzone_spill(lsnes_setgrp,
+		"greenzone-spill", "Movie‣Greenzone‣Disk spill limit (MB)", 0);
+
+	uint64_t distance(uint64_t a, uint64_t b)
+	{
+		return (a > b) ? (a - b) : (b - a);
+	}
+}
+
+greenzone::greenzone(movie_logic& _mlogic, loaded_rom& _rom, lua_state& _lua2, settingvar::group& _settings)
+	: mlogic(_mlogic), rom(_rom), lua2(_lua2), settings(_settings)
+{
+	memory_used = 0;
+	spill_used = 0;
+	spilled_count = 0;
+}
+
+greenzone::~greenzone()
+{
+	if(spill_name != "") {
+		spill.close();
+		remove(spill_name.c_str());
+	}
+}
+
+bool greenzone::enabled()
+{
+	return SET_greenzone_interval(settings) != 0;
+}
+
+bool greenzone::capture_due()
+{
+	uint64_t interval = SET_greenzone_interval(settings);
+	if(!interval || !mlogic || !mlogic.get_movie().readonly_mode())
+		return false;
+	uint64_t frame = mlogic.get_movie().get_current_frame();
+	if(!frame || frame % interval)
+		return false;
+	if(projectid != mlogic.get_mfile().projectid)
+		return true;
+	if(!snapshots.count(frame))
+		return true;
+	//The existing snapshot only needs replacing if the input before it has changed.
+	validate();
+	return !snapshots.count(frame);
+}
+
+void greenzone::capture()
+{
+	moviefile& mf = mlogic.get_mfile();
+	if(projectid != mf.projectid) {
+		clear();
+		projectid = mf.projectid;
+	}
+	validate();
+	snapshot s;
+	mlogic.get_movie().fast_save(s.frame, s.ptr, s.lagged_frames, s.pollcounters);
+	s.poll_flag = rom.get_pflag();
+	s.rtc_second = mf.dyn.rtc_second;
+	s.rtc_subsecond = mf.dyn.rtc_subsecond;
+	s.spill_offset = 0;
+	s.spill_size = 0;
+	s.state_size = rom.save_core_state(state_arena, true);
+	uLongf csize = compressBound(s.state_size);
+	if(compress_arena.size() < csize)
+		compress_arena.resize(csize);
+	if(compress2(reinterpret_cast<Bytef*>(&compress_arena[0]), &csize,
+		reinterpret_cast<Bytef*>(&state_arena[0]), s.state_size, 1) != Z_OK)
+		throw std::runtime_error("Failed to compress greenzone snapshot");
+	s.state.assign(compress_arena.begin(), compress_arena.begin() + csize);
+	auto old = snapshots.find(s.frame);
+	if(old != snapshots.end())
+		drop(old);
+	uint64_t frame = s.frame;
+	memory_used += s.state.size();
+	snapshots[frame] = std::move(s);
+	thin(frame);
+	enforce_limits(frame);
+}
+
+uint64_t greenzone::restore(uint64_t frame)
+{
+	if(!mlogic || !mlogic.get_movie().readonly_mode())
+		return 0;
+	moviefile& mf = mlogic.get_mfile();
+	if(projectid != mf.projectid) {
+		clear();
+		projectid = mf.projectid;
+		return 0;
+	}
+	validate();
+	auto best = snapshots.lower_bound(frame);
+	if(best == snapshots.begin())
+		return 0;
+	best--;
+	snapshot& s = best->second;
+	movie& mov = mlogic.get_movie();
+	uint64_t cur = mov.get_current_frame();
+	if(cur >= s.frame && cur <= frame)
+		return 0;	//Just running forward is at least as fast.
+	std::vector<char> state = read_state(s);
+	//Seeking in playback does not alter the movie, so this is not a rerecord.
+	lua2.callback_pre_rewind();
+	rom.load_core_state(state, true);
+	rom.set_pflag(s.poll_flag);
+	mf.dyn.save_frame = s.frame;
+	mf.dyn.lagged_frames = s.lagged_frames;
+	mf.dyn.pollcounters = s.pollcounters;
+	mf.dyn.poll_flag = s.poll_flag;
+	mf.dyn.rtc_second = s.rtc_second;
+	mf.dyn.rtc_subsecond = s.rtc_subsecond;
+	uint64_t _ptr = s.ptr;
+	mov.fast_load(mf.dyn.save_frame, _ptr, mf.dyn.lagged_frames, mf.dyn.pollcounters, true);
+	lua2.callback_post_rewind();
+	return s.frame;
+}
+
+void greenzone::clear()
+{
+	snapshots.clear();
+	checked.clear();
+	memory_used = 0;
+	spilled_count = 0;
+	if(spill.is_open()) {
+		spill.close();
+		spill.open(spill_name, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+	}
+	spill_used = 0;
+}
+
+void greenzone::validate()
+{
+	portctrl::frame_vector& input = *mlogic.get_mfile().input;
+	//Nothing to check yet, but snapshots taken from now on depend on the input as it is.
+	if(snapshots.empty()) {
+		checked = input;
+		return;
+	}
+	//Pages still shared with the copy taken at the last check are skipped without comparing them, so this only
+	//looks at input edited since.
+	uint64_t valid;
+	try {
+		valid = input.first_difference(checked, 0, min(input.size(), checked.size()));
+	} catch(std::exception& e) {
+		valid = 0;	//Different port types.
+	}
+	//A snapshot depends on the input before it.
+	for(auto i = snapshots.begin(); i != snapshots.end();) {
+		if(i->second.ptr > valid)
+			drop(i++);
+		else
+			i++;
+	}
+	checked = input;
+}
+
+void greenzone::thin(uint64_t cursor)
+{
+	uint64_t interval = SET_greenzone_interval(settings);
+	if(!interval)
+		return;
+	//Spacing doubles every time distance from cursor doubles past the dense window.
+	for(auto i = snapshots.begin(); i != snapshots.end();) {
+		uint64_t d = distance(i->first, cursor) / (DENSE_SNAPSHOTS * interval) + 1;
+		unsigned k = 0;
+		while(d >>= 1)
+			k++;
+		uint64_t spacing = interval << min(k, 40U);
+		if(i->first % spacing)
+			drop(i++);
+		else
+			i++;
+	}
+}
+
+void greenzone::enforce_limits(uint64_t cursor)
+{
+	uint64_t mem_limit = static_cast<uint64_t>(SET_greenzone_memory(settings)) << 20;
+	uint64_t spill_limit = static_cast<uint64_t>(SET_greenzone_spill(settings)) << 20;
+	while(memory_used > mem_limit) {
+		//Farthest snapshot still in memory goes first.
+		auto far = snapshots.end();
+		for(auto i = snapshots.begin(); i != snapshots.end(); i++)
+			if(!i->second.state.empty() && i->first != cursor && (far == snapshots.end() ||
+				distance(i->first, cursor) > distance(far->first, cursor)))
+				far = i;
+		if(far == snapshots.end())
+			break;
+		snapshot& s = far->second;
+		if(spill_used + s.state.size() <= spill_limit) {
+			try {
+				if(!spill.is_open()) {
+					if(spill_name == "")
+						spill_name = get_temp_file();
+					spill.open(spill_name, std::ios::in | std::ios::out | std::ios::binary |
+						std::ios::trunc);
+					spill_used = 0;
+				}
+				spill.seekp(spill_used);
+				spill.write(&s.state[0], s.state.size());
+				if(!spill)
+					throw std::runtime_error("Error writing greenzone spill file");
+				s.spill_offset = spill_used;
+				s.spill_size = s.state.size();
+				spill_used += s.spill_size;
+				spilled_count++;
+				memory_used -= s.state.size();
+				std::vector<char>().swap(s.state);
+				continue;
+			} catch(std::exception& e) {
+				spill.clear();
+			}
+		}
+		drop(far);
+	}
+}
+
+void greenzone::drop(std::map<uint64_t, snapshot>::iterator i)
+{
+	if(i->second.state.empty()) {
+		//Spill file space is reclaimed when nothing is left in it.
+		if(!--spilled_count && spill.is_open()) {
+			spill.close();
+			spill.open(spill_name, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+			spill_used = 0;
+		}
+	} else
+		memory_used -= i->second.state.size();
+	snapshots.erase(i);
+}
+
+std::vector<char> greenzone::read_state(snapshot& s)
+{
+	std::vector<char> spilled;
+	const std::vector<char>* src = &s.state;
+	if(s.state.empty()) {
+		spilled.resize(s.spill_size);
+		spill.seekg(s.spill_offset);
+		spill.read(&spilled[0], s.spill_size);
+		if(!spill) {
+			spill.clear();
+			throw std::runtime_error("Error reading greenzone spill file");
+		}
+		src = &spilled;
+	}
+	std::vector<char> state(s.state_size);
+	uLongf size = s.state_size;
+	if(uncompress(reinterpret_cast<Bytef*>(&state[0]), &size, reinterpret_cast<const Bytef*>(&(*src)[0]),
+		src->size()) != Z_OK || size != s.state_size)
+		throw std::runtime_error("Corrupt greenzone snapshot");
+	return state;
+}
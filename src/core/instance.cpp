@@ -8,6 +8,7 @@
 #include "core/emustatus.hpp"
 #include "core/framebuffer.hpp"
 #include "core/framerate.hpp"
+#include "core/greenzone.hpp"
 #include "core/instance.hpp"
 #include "core/inthread.hpp"
 #include "core/jukebox.hpp"
@@ -98,6 +99,7 @@ emulator_instance::emulator_instance()
 	D.init(keyboard);
 	D.init(mapper, *keyboard, *command);
 	D.init(rom);
+	D.init(gzone, *mlogic, *rom, *lua2, *settings);
 	D.init(fbuf, *subtitles, *settings, *mwatch, *keyboard, *dispatch, *lua2, *rom, *supdater, *command,
 		*iqueue);
 	D.init(buttons, *controls, *mapper, *keyboard, *fbuf, *dispatch, *lua2, *command);
@@ -135,8 +137,33 @@ emulator_instance::~emulator_instance()
 
 emulator_instance lsnes_instance;
 
+namespace
+{
+	thread_local emulator_instance* bound_instance = NULL;
+}
+
+emulator_instance_binding::emulator_instance_binding(emulator_instance& inst)
+{
+	prev = bound_instance;
+	bound_instance = &inst;
+	inst.emu_thread = threads::id();
+}
+
+emulator_instance_binding::~emulator_instance_binding()
+{
+	bound_instance = prev;
+}
+
+emulator_instance& current_instance()
+{
+	return bound_instance ? *bound_instance : lsnes_instance;
+}
+
 emulator_instance& CORE()
 {
+	//An instance bound to this thread is always run from it.
+	if(bound_instance)
+		return *bound_instance;
 	if(threads::id() != lsnes_instance.emu_thread) {
 		std::cerr << "WARNING: CORE() called in wrong thread." << std::endl;
 #ifdef __linux__
@@ -22,6 +22,7 @@
 
 #include <cstdint>
 #include <cmath>
+#include <algorithm>
 #include <list>
 #include <iostream>
 #include <fstream>
@@ -73,6 +74,12 @@ namespace
 		lsnes_setgrp, "opus-bitrate", "commentary‣Bitrate", OPUS_BITRATE);
 	settingvar::supervariable<settingvar::model_int<OPUS_MIN_BITRATE,OPUS_MAX_BITRATE>> SET_opus_max_bitrate(
 		lsnes_setgrp, "opus-max-bitrate", "commentary‣Max bitrate", OPUS_MAX_BITRATE);
+	settingvar::supervariable<settingvar::model_int<0,256>> SET_opus_export_threads(lsnes_setgrp,
+		"opus-export-threads", "commentary‣Superstream export threads", 0);
+	settingvar::supervariable<settingvar::model_int<0,3600>> SET_opus_export_segment(lsnes_setgrp,
+		"opus-export-segment", "commentary‣Superstream export segment (s)", 10);
+	settingvar::supervariable<settingvar::model_bool<settingvar::yes_no>> SET_opus_mmap(lsnes_setgrp,
+		"opus-mmap-collection", "commentary‣Memory-map collection for reading", false);
 
 	struct voicesub_state
 	{
@@ -283,6 +290,19 @@ namespace
 		{
 			return (seqno < packets.size()) ? packets[seqno].length() : 0;
 		}
+		//Get offset of specified packet from start of stream in samples.
+		uint64_t packet_offset(uint32_t seqno)
+		{
+			if(!seqno) return 0;
+			return packet_ends[min(seqno, (uint32_t)packet_ends.size()) - 1];
+		}
+		//Get the first packet starting at or after specified offset in samples (blocks() if none).
+		uint32_t packet_at(uint64_t offset)
+		{
+			if(!offset) return 0;
+			//Packet i + 1 starts where packet i ends.
+			return std::lower_bound(packet_ends.begin(), packet_ends.end(), offset) - packet_ends.begin() + 1;
+		}
 		//Get data of specified packet.
 		//Can throw.
 		std::vector<unsigned char> packet(uint32_t seqno)
@@ -346,6 +366,7 @@ namespace
 		void destroy();
 		filesystem::ref fs;
 		std::vector<opus_packetinfo> packets;
+		std::vector<uint64_t> packet_ends;	//Offset of end of each packet in samples.
 		uint64_t total_len;
 		uint64_t s_timebase;
 		uint32_t next_cluster;
@@ -453,6 +474,7 @@ namespace
 					if(r2 < psize)
 						throw std::runtime_error("Incomplete data stream");
 					packets.push_back(p);
+					packet_ends.push_back(total_len);
 					total_frames++;
 				}
 		}
@@ -803,6 +825,7 @@ out:
 			opus_packetinfo p(payload_len, len, off);
 			total_len += p.length();
 			packets.push_back(p);
+			packet_ends.push_back(total_len);
 		} catch(std::exception& e) {
 			(stringfmt() << "Can't write opus packet: " << e.what()).throwex();
 		}
@@ -972,11 +995,15 @@ out:
 		}
 		//While number of samples is so great that adequate convergence period can be ensured without
 		//decoding this packet, just skip the samples from the packet.
-		while(samples > OPUS_CONVERGE_MAX) {
-			samples -= stream.packet_length(next_block++);
+		if(samples > OPUS_CONVERGE_MAX) {
+			uint64_t base = stream.packet_offset(next_block);
+			next_block = max(next_block, stream.packet_at(base + samples - OPUS_CONVERGE_MAX));
 			//Did we hit EOF?
-			if(next_block >= blocks)
+			if(next_block >= blocks) {
+				next_block = blocks;
 				return;
+			}
+			samples -= stream.packet_offset(next_block) - base;
 		}
 		//Okay, we are near the point. Start decoding packets.
 		while(samples > 0) {
@@ -1035,9 +1062,12 @@ out:
 		void alter_stream_gain(uint64_t index, uint16_t newgain);
 		//Enumerate all valid stream indices, in time order.
 		std::list<uint64_t> all_streams();
-		//Export the entiere superstream.
+		//Get the end time of the last ending stream.
+		uint64_t end_time();
+		//Export the entiere superstream, using specified number of threads (0 => one per processor) and
+		//segments of specified length in samples (0 => one segment).
 		//Can throw.
-		void export_superstream(std::ofstream& out);
+		void export_superstream(std::ofstream& out, unsigned nthreads, uint64_t segment);
 	private:
 		filesystem::ref fs;
 		uint64_t next_index;
@@ -1046,8 +1076,37 @@ out:
 		std::set<uint64_t> free_indices;
 		std::map<uint64_t, uint64_t> entries;
 		std::multimap<uint64_t, uint64_t> streams_by_time;
-		//FIXME: Something more efficient.
 		std::map<uint64_t, opus_stream*> streams;
+		//Interval index for stabbing queries: a treap of streams ordered by (start time, index), with maximum
+		//end time over each subtree. Updated in place as streams are added, deleted or moved. Streams are only
+		//added once complete, so lengths don't change afterwards.
+		struct interval_node
+		{
+			uint64_t start;
+			uint64_t end;
+			uint64_t index;
+			uint64_t maxend;
+			uint32_t priority;
+			interval_node* left;
+			interval_node* right;
+		};
+		interval_node* intervals;
+		uint32_t interval_seed;
+		void index_stream(uint64_t index);
+		void unindex_stream(uint64_t index);
+		static void update_interval(interval_node* n);
+		static interval_node* insert_interval(interval_node* t, interval_node* n);
+		static interval_node* erase_interval(interval_node* t, uint64_t start, uint64_t index);
+		static void split_intervals(interval_node* t, uint64_t start, uint64_t index, interval_node*& l,
+			interval_node*& r);
+		static interval_node* merge_intervals(interval_node* l, interval_node* r);
+		static void free_intervals(interval_node* t);
+		static void query_intervals(interval_node* t, uint64_t start, uint64_t end, std::list<uint64_t>& s);
+		//Get streams overlapping range [start, end), with references taken.
+		std::list<opus_stream*> streams_in(uint64_t start, uint64_t end);
+		//Mix samples [start, start + len) of superstream to out, as 32-bit little-endian samples.
+		//Can throw.
+		void export_segment(uint64_t start, uint64_t len, char* out);
 	};
 
 	stream_collection::stream_collection(filesystem::ref filesys)
@@ -1055,6 +1114,8 @@ out:
 	{
 		next_stream = 0;
 		next_index = 0;
+		intervals = NULL;
+		interval_seed = 0x9E3779B9UL;
 		//The stream index table is in cluster 2.
 		uint32_t next_cluster = 2;
 		uint32_t next_offset = 0;
@@ -1072,12 +1133,14 @@ out:
 					opus_stream* x = new opus_stream(timebase, fs, ctrl_cluster, data_cluster);
 					entries[next_index] = i;
 					streams_by_time.insert(std::make_pair(timebase, next_index));
-					streams[next_index++] = x;
+					streams[next_index] = x;
+					index_stream(next_index++);
 				} else
 					free_indices.insert(i);
 				next_stream = ++i;
 			}
 		} catch(std::exception& e) {
+			free_intervals(intervals);
 			for(auto i : streams)
 				i.second->put_ref();
 			(stringfmt() << "Failed to parse LSVS: " << e.what()).throwex();
@@ -1090,23 +1153,163 @@ out:
 		for(auto i : streams)
 			i.second->put_ref();
 		streams.clear();
+		free_intervals(intervals);
+	}
+
+	void stream_collection::update_interval(interval_node* n)
+	{
+		n->maxend = n->end;
+		if(n->left)
+			n->maxend = max(n->maxend, n->left->maxend);
+		if(n->right)
+			n->maxend = max(n->maxend, n->right->maxend);
+	}
+
+	void stream_collection::split_intervals(interval_node* t, uint64_t start, uint64_t index, interval_node*& l,
+		interval_node*& r)
+	{
+		//Nodes ordered before (start, index) go to l, the rest to r.
+		if(!t) {
+			l = r = NULL;
+		} else if(t->start < start || (t->start == start && t->index < index)) {
+			split_intervals(t->right, start, index, t->right, r);
+			update_interval(t);
+			l = t;
+		} else {
+			split_intervals(t->left, start, index, l, t->left);
+			update_interval(t);
+			r = t;
+		}
+	}
+
+	stream_collection::interval_node* stream_collection::merge_intervals(interval_node* l, interval_node* r)
+	{
+		if(!l || !r)
+			return l ? l : r;
+		if(l->priority > r->priority) {
+			l->right = merge_intervals(l->right, r);
+			update_interval(l);
+			return l;
+		} else {
+			r->left = merge_intervals(l, r->left);
+			update_interval(r);
+			return r;
+		}
+	}
+
+	stream_collection::interval_node* stream_collection::insert_interval(interval_node* t, interval_node* n)
+	{
+		if(!t)
+			return n;
+		if(n->priority > t->priority) {
+			split_intervals(t, n->start, n->index, n->left, n->right);
+			update_interval(n);
+			return n;
+		}
+		if(n->start < t->start || (n->start == t->start && n->index < t->index))
+			t->left = insert_interval(t->left, n);
+		else
+			t->right = insert_interval(t->right, n);
+		update_interval(t);
+		return t;
+	}
+
+	stream_collection::interval_node* stream_collection::erase_interval(interval_node* t, uint64_t start,
+		uint64_t index)
+	{
+		if(!t)
+			return NULL;
+		if(t->start == start && t->index == index) {
+			interval_node* n = merge_intervals(t->left, t->right);
+			delete t;
+			return n;
+		}
+		if(start < t->start || (start == t->start && index < t->index))
+			t->left = erase_interval(t->left, start, index);
+		else
+			t->right = erase_interval(t->right, start, index);
+		update_interval(t);
+		return t;
+	}
+
+	void stream_collection::free_intervals(interval_node* t)
+	{
+		if(!t)
+			return;
+		free_intervals(t->left);
+		free_intervals(t->right);
+		delete t;
+	}
+
+	void stream_collection::query_intervals(interval_node* t, uint64_t start, uint64_t end,
+		std::list<uint64_t>& s)
+	{
+		while(t) {
+			//Nothing in this subtree lasts past the start.
+			if(t->maxend <= start)
+				return;
+			query_intervals(t->left, start, end, s);
+			//The root and everything right of it start at or after the end.
+			if(t->start >= end)
+				return;
+			if(t->end > start)
+				s.push_back(t->index);
+			t = t->right;
+		}
+	}
+
+	void stream_collection::index_stream(uint64_t index)
+	{
+		interval_node* n = new interval_node;
+		n->start = streams[index]->timebase();
+		n->end = n->start + streams[index]->length();
+		n->index = index;
+		n->left = n->right = NULL;
+		update_interval(n);
+		//Xorshift for treap priorities.
+		interval_seed ^= interval_seed << 13;
+		interval_seed ^= interval_seed >> 17;
+		interval_seed ^= interval_seed << 5;
+		n->priority = interval_seed;
+		intervals = insert_interval(intervals, n);
+	}
+
+	void stream_collection::unindex_stream(uint64_t index)
+	{
+		uint64_t timebase = streams[index]->timebase();
+		auto itr = streams_by_time.lower_bound(timebase);
+		auto itr2 = streams_by_time.upper_bound(timebase);
+		for(auto x = itr; x != itr2; x++)
+			if(x->second == index) {
+				streams_by_time.erase(x);
+				break;
+			}
+		intervals = erase_interval(intervals, timebase, index);
 	}
 
 	std::list<uint64_t> stream_collection::streams_at(uint64_t point)
 	{
 		threads::alock m(mlock);
 		std::list<uint64_t> s;
-		for(auto i : streams) {
-			uint64_t start = i.second->timebase();
-			uint64_t end = start + i.second->length();
-			if(point >= start && point < end) {
-				i.second->get_ref();
-				s.push_back(i.first);
-			}
-		}
+		query_intervals(intervals, point, point + 1, s);
+		for(auto i : s)
+			streams[i]->get_ref();
 		return s;
 	}
 
+	std::list<opus_stream*> stream_collection::streams_in(uint64_t start, uint64_t end)
+	{
+		threads::alock m(mlock);
+		std::list<uint64_t> s;
+		std::list<opus_stream*> r;
+		query_intervals(intervals, start, end, s);
+		for(auto i : s) {
+			streams[i]->get_ref();
+			r.push_back(streams[i]);
+		}
+		return r;
+	}
+
 	uint64_t stream_collection::add_stream(opus_stream& stream)
 	{
 		uint64_t idx;
@@ -1134,6 +1337,7 @@ out:
 			fs.skip_data(write_cluster, write_offset, 16 * entry_number);
 			fs.write_data(write_cluster, write_offset, buffer, 16, dummy1, dummy2);
 			streams_by_time.insert(std::make_pair(stream.timebase(), idx));
+			index_stream(idx);
 			entries[idx] = entry_number;
 			return idx;
 		} catch(std::exception& e) {
@@ -1161,13 +1365,7 @@ out:
 		char buffer[16] = {0};
 		fs.skip_data(write_cluster, write_offset, 16 * entry_number);
 		fs.write_data(write_cluster, write_offset, buffer, 16, dummy1, dummy2);
-		auto itr = streams_by_time.lower_bound(streams[index]->timebase());
-		auto itr2 = streams_by_time.upper_bound(streams[index]->timebase());
-		for(auto x = itr; x != itr2; x++)
-			if(x->second == index) {
-				streams_by_time.erase(x);
-				break;
-			}
+		unindex_stream(index);
 		streams[index]->delete_stream();
 		streams.erase(index);
 	}
@@ -1187,15 +1385,10 @@ out:
 				fs.skip_data(write_cluster, write_offset, 16 * entries[index]);
 				fs.write_data(write_cluster, write_offset, buffer, 8, dummy1, dummy2);
 			}
-			auto itr = streams_by_time.lower_bound(streams[index]->timebase());
-			auto itr2 = streams_by_time.upper_bound(streams[index]->timebase());
-			for(auto x = itr; x != itr2; x++)
-				if(x->second == index) {
-					streams_by_time.erase(x);
-					break;
-				}
+			unindex_stream(index);
 			streams[index]->timebase(newts);
 			streams_by_time.insert(std::make_pair(newts, index));
+			index_stream(index);
 		} catch(std::exception& e) {
 			(stringfmt() << "Failed to alter stream timebase: " << e.what()).throwex();
 		}
@@ -1223,18 +1416,58 @@ out:
 		return s;
 	}
 
-	void stream_collection::export_superstream(std::ofstream& out)
+	uint64_t stream_collection::end_time()
 	{
-		std::list<uint64_t> slist = all_streams();
-		//Find the total length of superstream.
-		uint64_t len = 0;
-		for(auto i : slist) {
-			opus_stream* s = get_stream(i);
-			if(s) {
-				len = max(len, s->timebase() + s->length());
-				s->put_ref();
+		threads::alock m(mlock);
+		//The root of the index covers everything.
+		return intervals ? intervals->maxend : 0;
+	}
+
+	void stream_collection::export_segment(uint64_t start, uint64_t len, char* out)
+	{
+		std::vector<float> mix(len);
+		std::vector<float> buf(len);
+		std::list<opus_stream*> slist = streams_in(start, start + len);
+		for(auto i = slist.begin(); i != slist.end(); i++) {
+			opus_stream* s = *i;
+			opus_playback_stream* p;
+			try {
+				p = new opus_playback_stream(*s);
+			} catch(...) {
+				//Drop the remaining references taken by streams_in().
+				for(; i != slist.end(); i++)
+					(*i)->put_ref();
+				throw;
+			}
+			s->put_ref();
+			try {
+				//Streams starting before the segment are seeked into it. Skipping decodes enough of
+				//the stream before the segment for the decoder state to converge.
+				uint64_t ts = s->timebase();
+				uint64_t off = 0;
+				if(ts < start)
+					p->skip(start - ts);
+				else
+					off = ts - start;
+				p->read(&buf[0], len - off);
+				for(size_t u = 0; u < len - off; u++)
+					mix[off + u] += buf[u];
+			} catch(...) {
+				delete p;
+				for(i++; i != slist.end(); i++)
+					(*i)->put_ref();
+				throw;
 			}
+			delete p;
 		}
+		for(size_t t = 0; t < len; t++)
+			serialization::s32l(out + 4 * t, mix[t] * 268435456);
+	}
+
+	void stream_collection::export_superstream(std::ofstream& out, unsigned nthreads, uint64_t segment)
+	{
+		//Find the total length of superstream.
+		uint64_t len = end_time();
 		char header[32];
 		serialization::u64l(header, 0x1C586F532EULL);			//Magic and header size.
 		serialization::u64l(header + 8, len);
@@ -1244,80 +1477,87 @@ out:
 		if(!out)
 			throw std::runtime_error("Error writing PCM output");
 
-		//Find the first valid stream.
-		auto next_i = slist.begin();
-		opus_stream* next_stream = NULL;
-		while(next_i != slist.end()) {
-			next_stream = get_stream(*next_i);
-			next_i++;
-			if(next_stream)
-				break;
-		}
-		uint64_t next_ts;
-		next_ts = next_stream ? next_stream->timebase() : len;
-
-		std::list<opus_playback_stream*> active;
-		try {
-			for(uint64_t s = 0; s < len;) {
-				if(s == next_ts) {
-					active.push_back(new opus_playback_stream(*next_stream));
-					next_stream->put_ref();
-					next_stream = NULL;
-					while(next_i != slist.end()) {
-						next_stream = get_stream(*next_i);
-						next_i++;
-						if(!next_stream)
-							continue;
-						uint64_t next_ts = next_stream->timebase();
-						if(next_ts > s)
-							break;
-						//Okay, this starts too...
-						active.push_back(new opus_playback_stream(*next_stream));
-						next_stream->put_ref();
-						next_stream = NULL;
-					};
-					next_ts = next_stream ? next_stream->timebase() : len;
-				}
-				uint64_t maxsamples = min(next_ts - s, static_cast<uint64_t>(OUTPUT_BLOCK));
-				maxsamples = min(maxsamples, len - s);
-				char outbuf[4 * OUTPUT_BLOCK];
-				float buf1[OUTPUT_BLOCK];
-				float buf2[OUTPUT_BLOCK];
-				for(size_t t = 0; t < maxsamples; t++)
-					buf1[t] = 0;
-				for(auto t : active) {
-					t->read(buf2, maxsamples);
-					for(size_t u = 0; u < maxsamples; u++)
-						buf1[u] += buf2[u];
+		//The superstream is split into segments that are decoded and mixed in parallel, and written out in
+		//order. The number of segments in flight is bounded to limit memory use.
+		if(!segment)
+			segment = max(len, static_cast<uint64_t>(1));
+		uint64_t segments = (len + segment - 1) / segment;
+		if(!nthreads)
+			nthreads = max(threads::thread::hardware_concurrency(), 1U);
+		uint64_t max_inflight = 2 * nthreads;
+		threads::lock qlock;
+		threads::cv qcv;
+		uint64_t next_segment = 0;
+		uint64_t next_write = 0;
+		std::map<uint64_t, std::vector<char>> done;
+		std::string error;
+		auto worker = [&]() {
+			while(true) {
+				uint64_t seg;
+				{
+					threads::alock m(qlock);
+					while(next_segment < segments && next_segment >= next_write + max_inflight &&
+						error == "")
+						qcv.wait(m);
+					if(next_segment >= segments || error != "")
+						return;
+					seg = next_segment++;
 				}
-				for(auto t = active.begin(); t != active.end();) {
-					if((*t)->eof()) {
-						auto todel = t;
-						t++;
-						delete *todel;
-						active.erase(todel);
-					} else
-						t++;
+				//Nothing may escape the thread, or the whole process terminates.
+				std::string err;
+				try {
+					uint64_t seglen = min(len - seg * segment, segment);
+					std::vector<char> data(4 * seglen);
+					export_segment(seg * segment, seglen, &data[0]);
+					threads::alock m(qlock);
+					done[seg].swap(data);
+					qcv.notify_all();
+					continue;
+				} catch(std::exception& e) {
+					err = e.what();
+				} catch(...) {
+					err = "Unknown error";
 				}
-				for(size_t t = 0; t < maxsamples; t++)
-					serialization::s32l(outbuf + 4 * t, buf1[t] * 268435456);
-				out.write(outbuf, 4 * maxsamples);
-				if(!out)
-					throw std::runtime_error("Failed to write PCM");
-				s += maxsamples;
+				threads::alock m(qlock);
+				if(error == "")
+					error = err;
+				qcv.notify_all();
+				return;
 			}
+		};
+		std::vector<threads::thread*> workers;
+		try {
+			for(unsigned i = 0; i < nthreads && i < segments; i++)
+				workers.push_back(new threads::thread(worker));
 		} catch(std::exception& e) {
-			(stringfmt() << "Failed to export PCM: " << e.what()).throwex();
+			threads::alock m(qlock);
+			error = e.what();
+			qcv.notify_all();
+		}
+		threads::alock m(qlock);
+		while(next_write < segments && error == "") {
+			if(!done.count(next_write)) {
+				qcv.wait(m);
+				continue;
+			}
+			std::vector<char> data;
+			data.swap(done[next_write]);
+			done.erase(next_write);
+			m.unlock();
+			out.write(&data[0], data.size());
+			m.lock();
+			if(!out && error == "")
+				error = "Failed to write PCM";
+			next_write++;
+			qcv.notify_all();
 		}
-		for(auto t = active.begin(); t != active.end();) {
-			if((*t)->eof()) {
-				auto todelete = t;
-				t++;
-				delete *todelete;
-				active.erase(todelete);
-			} else
-				t++;
+		m.unlock();
+		for(auto i : workers) {
+			i->join();
+			delete i;
 		}
+		if(error != "")
+			(stringfmt() << "Failed to export PCM: " << error).throwex();
 	}
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1909,7 +2149,8 @@ void voice_commentary::export_superstream(const std::string& filename)
 	std::ofstream s(filename, std::ios_base::out | std::ios_base::binary);
 	if(!s)
 		throw std::runtime_error("Can't open output file");
-	_internal->current_collection->export_superstream(s);
+	_internal->current_collection->export_superstream(s, SET_opus_export_threads(settings),
+		static_cast<uint64_t>(SET_opus_export_segment(settings)) * OPUS_SAMPLERATE);
 }
 
 void voice_commentary::load_collection(const std::string& filename)
@@ -1918,7 +2159,8 @@ void voice_commentary::load_collection(const std::string& filename)
 	threads::alock m2(_internal->current_collection_lock);
 	filesystem::ref newfs;
 	stream_collection* newc;
-	newfs = filesystem::ref(filename);
+	//Collections that are mostly played back read faster through memory mapping.
+	newfs = filesystem::ref(filename, SET_opus_mmap(settings));
 	newc = new stream_collection(newfs);
 	if(_internal->current_collection)
 		delete _internal->current_collection;
@@ -10,6 +10,7 @@
 #include "core/emustatus.hpp"
 #include "core/framebuffer.hpp"
 #include "core/framerate.hpp"
+#include "core/greenzone.hpp"
 #include "core/instance.hpp"
 #include "core/inthread.hpp"
 #include "core/jukebox.hpp"
@@ -59,22 +60,34 @@ namespace
 		"advance-subframe-timeout", "Delays‣Subframe advance", 100);
 	settingvar::supervariable<settingvar::model_bool<settingvar::yes_no>> SET_pause_on_end(lsnes_setgrp,
 		"pause-on-end", "Movie‣Pause on end", false);
+	//Render decimation when running unthrottled. 0 => No limit.
+	settingvar::supervariable<settingvar::model_int<0,1000>> SET_ff_render_every(lsnes_setgrp,
+		"fastforward-render-every", "UI‣Fast-forward render every Nth frame", 0);
+	settingvar::supervariable<settingvar::model_int<0,1000>> SET_ff_render_rate(lsnes_setgrp,
+		"fastforward-render-rate", "UI‣Fast-forward renders per second", 0);
 
+	//Main loop state is per thread, each thread running main_loop() drives its own instance.
 	//Mode and filename of pending load, one of LOAD_* constants.
-	int loadmode;
-	std::string pending_load;
-	std::string pending_new_project;
+	thread_local int loadmode;
+	thread_local std::string pending_load;
+	thread_local std::string pending_new_project;
 	//Queued saves (all savestates).
-	std::set<std::pair<std::string, int>> queued_saves;
+	thread_local std::set<std::pair<std::string, int>> queued_saves;
+	//Frames skipped since last render and time of last render.
+	thread_local uint64_t frames_since_render = 0;
+	thread_local uint64_t last_render_time = 0;
 	//Unsafe rewind.
-	bool do_unsafe_rewind = false;
-	void* unsafe_rewind_obj = NULL;
+	thread_local bool do_unsafe_rewind = false;
+	thread_local void* unsafe_rewind_obj = NULL;
 	//Stop at frame.
-	bool stop_at_frame_active = false;
-	uint64_t stop_at_frame = 0;
+	thread_local bool stop_at_frame_active = false;
+	thread_local uint64_t stop_at_frame = 0;
+	//Greenzone seek (target frame, 0 if none).
+	thread_local bool seek_pending = false;
+	thread_local uint64_t seek_target = 0;
 	//Macro hold.
-	bool macro_hold_1;
-	bool macro_hold_2;
+	thread_local bool macro_hold_1;
+	thread_local bool macro_hold_2;
 }
 
 void mainloop_signal_need_rewind(void* ptr)
@@ -94,7 +107,7 @@ bool movie_logic::notify_user_poll()
 portctrl::frame movie_logic::update_controls(bool subframe, bool forced)
 {
 	auto& core = CORE();
-	if(core.lua2->requests_subframe_paint)
+	if(core.lua2->requests_subframe_paint && !core.runmode->is_render_skip())
 		core.fbuf->redraw_framebuffer();
 
 	if(subframe) {
@@ -164,6 +177,9 @@ portctrl::frame movie_logic::update_controls(bool subframe, bool forced)
 		core.runmode->set_point(emulator_runmode::P_START);
 		core.supdater->update();
 	}
+	//Show the last frame if stopping.
+	if(!core.runmode->is_freerunning())
+		core.fbuf->flush_skipped();
 	platform::flush_command_queue();
 	portctrl::frame tmp = core.controls->get(core.mlogic->get_movie().get_current_frame());
 	core.rom->pre_emulate_frame(tmp);	//Preset controls, the lua will override if needed.
@@ -280,12 +296,36 @@ public:
 		return CORE().random_seed_value;
 	}
 
+	//Should rendering of this frame be skipped? Only the rendering is skipped, emulation, dumping and Lua
+	//on_frame_emulated/on_frame callbacks run for every frame, so this does not affect the movie.
+	bool skip_render(emulator_instance& core)
+	{
+		unsigned every = SET_ff_render_every(*core.settings);
+		unsigned rate = SET_ff_render_rate(*core.settings);
+		core.runmode->set_render_skip(core.runmode->is_freerunning() && core.framerate->is_unthrottled() &&
+			(every || rate));
+		uint64_t now = framerate_regulator::get_utime();
+		if(core.runmode->is_render_skip()) {
+			frames_since_render++;
+			if(every && frames_since_render < every)
+				return true;
+			if(rate && now - last_render_time < 1000000 / rate)
+				return true;
+		}
+		frames_since_render = 0;
+		last_render_time = now;
+		return false;
+	}
+
 	void output_frame(framebuffer::raw& screen, uint32_t fps_n, uint32_t fps_d)
 	{
 		auto& core = CORE();
 		core.lua2->callback_do_frame_emulated();
 		core.runmode->set_point(emulator_runmode::P_VIDEO);
-		core.fbuf->redraw_framebuffer(screen, false, true);
+		if(skip_render(core))
+			core.fbuf->skip_framebuffer(screen);
+		else
+			core.fbuf->redraw_framebuffer(screen, false, true);
 		auto rate = core.rom->get_audio_rate();
 		uint32_t gv = gcd(fps_n, fps_d);
 		uint32_t ga = gcd(rate.first, rate.second);
@@ -600,6 +640,13 @@ namespace
 			close_rom();
 		});
 
+	command::fnptr<const std::string&> CMD_seek_frame(lsnes_cmds, "seek-frame", "Seek to frame",
+		"Syntax: seek-frame <frame>\nSeeks to <frame> in playback mode, starting from the nearest greenzone "
+		"snapshot.\n",
+		[](const std::string& args) {
+			seek_to_frame(parse_value<uint64_t>(args));
+		});
+
 	command::fnptr<> CMD_set_rwmode(lsnes_cmds, "set-rwmode", "Switch to recording mode",
 		"Syntax: set-rwmode\nSwitches to recording mode\n",
 		[]() {
@@ -744,6 +791,38 @@ jumpback:
 				<< std::endl;
 			return 1;
 		}
+		if(seek_pending) {
+			seek_pending = false;
+			if(!*core.mlogic) {
+				core.runmode->end_load();
+				seek_target = 0;
+				return 0;
+			}
+			uint64_t t = framerate_regulator::get_utime();
+			uint64_t restored = 0;
+			try {
+				restored = core.gzone->restore(seek_target);
+			} catch(std::bad_alloc& e) {
+				OOM_panic();
+			} catch(std::exception& e) {
+				messages << "Greenzone seek failed: " << e.what() << std::endl;
+			}
+			core.runmode->end_load();		//Restore previous mode.
+			if(restored) {
+				//Main loop runs the rest of the way.
+				core.runmode->set_point(emulator_runmode::P_SAVE);
+				core.supdater->update();
+				messages << "Restored frame " << restored << " in " << (framerate_regulator::get_utime() -
+					t) << " usec." << std::endl;
+				return 1;
+			}
+			if(core.mlogic->get_movie().get_current_frame() < seek_target)
+				set_stop_at_frame(seek_target);
+			else
+				messages << "No greenzone snapshot before frame " << seek_target << std::endl;
+			seek_target = 0;
+			return 0;
+		}
 		if(pending_new_project != "") {
 			std::string id = pending_new_project;
 			pending_new_project = "";
@@ -825,7 +904,8 @@ nothing_to_do:
 			}
 			if(do_unsafe_rewind && !unsafe_rewind_obj) {
 				uint64_t t = framerate_regulator::get_utime();
-				core.mlogic->get_mfile().dyn.savestate = core.rom->save_core_state(true);
+				std::vector<char>& state = core.mlogic->get_mfile().dyn.savestate;
+				state.resize(core.rom->save_core_state(state, true));
 				core.lua2->callback_do_unsafe_rewind(core.mlogic->get_movie(), NULL);
 				do_unsafe_rewind = false;
 				messages << "Rewind point set in " << (framerate_regulator::get_utime() - t)
@@ -865,7 +945,7 @@ void frob_with_value(unsigned a, unsigned b, unsigned c, short& d)
 
 void main_loop(struct loaded_rom& rom, struct moviefile& initial, bool load_has_to_succeed)
 {
-	lsnes_instance.emu_thread = threads::id();
+	current_instance().emu_thread = threads::id();
 	auto& core = CORE();
 	//Set up the frob with inputs routine.
 	core.mlogic->set_frob_with_value(frob_with_value);
@@ -932,6 +1012,16 @@ void main_loop(struct loaded_rom& rom, struct moviefile& initial, bool load_has_
 			if(core.runmode->is_quit() && queued_saves.empty())
 				break;
 			handle_saves();
+			try {
+				if(core.gzone->capture_due()) {
+					core.rom->runtosave();
+					core.gzone->capture();
+				}
+			} catch(std::bad_alloc& e) {
+				OOM_panic();
+			} catch(std::exception& e) {
+				messages << "Greenzone snapshot failed: " << e.what() << std::endl;
+			}
 			int r = 0;
 			if(queued_saves.empty())
 				r = handle_load();
@@ -940,6 +1030,10 @@ void main_loop(struct loaded_rom& rom, struct moviefile& initial, bool load_has_
 					core.mlogic->get_mfile().dyn.save_frame != 0);
 				first_round = core.mlogic->get_mfile().dyn.save_frame;
 				stop_at_frame_active = false;
+				if(seek_target) {
+					set_stop_at_frame(seek_target);
+					seek_target = 0;
+				}
 				just_did_loadstate = first_round;
 				core.controls->reset_framehold();
 				core.dbg->do_callback_frame(core.mlogic->get_movie().get_current_frame(), true);
@@ -997,6 +1091,17 @@ void set_stop_at_frame(uint64_t frame)
 	platform::set_paused(false);
 }
 
+void seek_to_frame(uint64_t frame)
+{
+	seek_target = frame;
+	seek_pending = (frame != 0);
+	if(!seek_pending)
+		return;
+	CORE().runmode->start_load();
+	platform::cancel_wait();
+	platform::set_paused(false);
+}
+
 void do_flush_slotinfo()
 {
 	CORE().slotcache->flush();
@@ -171,14 +171,15 @@ void movie_branches::export_branch(const std::string& filename, const std::strin
 		while(vsize > 0) {
 			uint64_t count = (vsize > pageframes) ? pageframes : vsize;
 			size_t bytes = count * stride;
-			unsigned char* content = v.get_page_buffer(pagenum++);
-			file.write(reinterpret_cast<char*>(content), bytes);
+			const unsigned char* content = const_cast<const portctrl::frame_vector&>(v).
+				get_page_buffer(pagenum++);
+			file.write(reinterpret_cast<const char*>(content), bytes);
 			vsize -= count;
 		}
 	} else {
 		char buf[MAX_SERIALIZED_SIZE];
 		for(uint64_t i = 0; i < v.size(); i++) {
-			v[i].serialize(buf);
+			v.get(i).serialize(buf);
 			file << buf << std::endl;
 		}
 	}
@@ -68,6 +68,7 @@ namespace
 			readonly = (_write == NULL);
 			special = _special;
 			direct_map = NULL;
+			dirty_gen = NULL;
 		}
 		~iospace_region() throw() {}
 		void read(uint64_t offset, void* buffer, size_t rsize)
@@ -111,7 +112,7 @@ void cart_mappings_refresher::operator()()
 				tmp = new iospace_region(i.name, i.base, i.size, i.special, i.read, i.write);
 			else
 				tmp = new memory_space::region_direct(i.name, i.base, i.endian,
-					reinterpret_cast<uint8_t*>(i.backing_ram), i.size, i.readonly);
+					reinterpret_cast<uint8_t*>(i.backing_ram), i.size, i.readonly, i.dirty_gen);
 			regions.push_back(tmp);
 			tmp = NULL;
 		}
@@ -106,7 +106,7 @@ namespace
 		regread_oper();
 		~regread_oper();
 		//The first promise is the register name.
-		void evaluate(mathexpr::value target, std::vector<std::function<mathexpr::value()>> promises);
+		void evaluate(mathexpr::value target, const std::vector<std::function<mathexpr::value()>>& promises);
 		//Fields.
 		bool signed_flag;
 		loaded_rom* rom;
@@ -121,7 +121,7 @@ namespace
 	regread_oper::~regread_oper()
 	{
 	}
-	void regread_oper::evaluate(mathexpr::value target, std::vector<std::function<mathexpr::value()>> promises)
+	void regread_oper::evaluate(mathexpr::value target, const std::vector<std::function<mathexpr::value()>>& promises)
 	{
 		if(promises.size() != 1)
 			throw mathexpr::error(mathexpr::error::ARGCOUNT, "register read operator takes 1 argument");
@@ -617,7 +617,7 @@ void memwatch_set::rebuild(std::map<std::string, memwatch_item>& nitems)
 		}
 		watch_set.swap(new_set);
 	}
-	GC::item::do_gc();
+	GC::item::request_gc();
 }
 
 void memwatch_set::watch_output(const std::string& name, const std::string& value)
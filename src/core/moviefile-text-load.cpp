@@ -133,22 +133,9 @@ namespace
 
 	void read_input(zip::reader& r, const std::string& mname, portctrl::frame_vector& input)
 	{
-		portctrl::frame tmp = input.blank_frame(false);
-		std::istream& m = r[mname];
-		try {
-			std::string x;
-			while(std::getline(m, x)) {
-				istrip_CR(x);
-				if(x != "") {
-					tmp.deserialize(x.c_str());
-					input.append(tmp);
-				}
-			}
-			delete &m;
-		} catch(...) {
-			delete &m;
-			throw;
-		}
+		std::vector<char> text;
+		r.read_raw_file(mname, text);
+		input.load_text(text.empty() ? "" : &text[0], text.size());
 	}
 
 	void read_pollcounters(zip::reader& r, const std::string& file, std::vector<uint32_t>& pctr)
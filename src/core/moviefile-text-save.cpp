@@ -85,20 +85,9 @@ namespace
 
 	void write_input(zip::writer& w, const std::string& mname, portctrl::frame_vector& input)
 	{
-		std::ostream& m = w.create_file(mname);
-		try {
-			char buffer[MAX_SERIALIZED_SIZE];
-			for(size_t i = 0; i < input.size(); i++) {
-				input[i].serialize(buffer);
-				m << buffer << std::endl;
-			}
-			if(!m)
-				throw std::runtime_error("Can't write ZIP file member");
-			w.close_file();
-		} catch(...) {
-			w.close_file();
-			throw;
-		}
+		std::vector<char> text;
+		input.save_text(text);
+		w.write_raw_file(mname, text);
 	}
 
 	void write_subtitles(zip::writer& w, const std::string& file, std::map<moviefile_subtiming, std::string>& x)
@@ -46,7 +46,7 @@ namespace
 			return x;
 		}
 		void c_load_sram(std::map<std::string, std::vector<char>>& sram) {}
-		void c_serialize(std::vector<char>& out) { out.clear(); }
+		size_t c_serialize_into(char* out, size_t outsize) { return 0; }
 		void c_unserialize(const char* in, size_t insize) {}
 		core_region& c_get_region() { return *this; }
 		void c_power() {}
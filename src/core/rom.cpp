@@ -147,39 +147,54 @@ std::map<std::string, std::vector<char>> load_sram_commandline(const std::vector
 std::vector<char> loaded_rom::save_core_state(bool nochecksum)
 {
 	std::vector<char> ret;
-	rtype().serialize(ret);
+	ret.resize(save_core_state(ret, nochecksum));
+	return ret;
+}
+
+size_t loaded_rom::save_core_state(std::vector<char>& arena, bool nochecksum)
+{
+	size_t extra = nochecksum ? 0 : 32;
+	if(arena.size() <= extra)
+		arena.resize(rtype().serialize_size() + extra);
+	size_t size;
+	while((size = rtype().serialize(arena.size() > extra ? &arena[0] : NULL, arena.size() - extra)) >
+		arena.size() - extra)
+		arena.resize(size + extra);
 	if(nochecksum)
-		return ret;
-	size_t offset = ret.size();
+		return size;
 	unsigned char tmp[32];
 #ifdef USE_LIBGCRYPT_SHA256
-	gcry_md_hash_buffer(GCRY_MD_SHA256, tmp, &ret[0], offset);
+	gcry_md_hash_buffer(GCRY_MD_SHA256, tmp, &arena[0], size);
 #else
-	sha256::hash(tmp, ret);
+	sha256::hash(tmp, reinterpret_cast<const uint8_t*>(&arena[0]), size);
 #endif
-	ret.resize(offset + 32);
-	memcpy(&ret[offset], tmp, 32);
-	return ret;
+	memcpy(&arena[size], tmp, 32);
+	return size + 32;
 }
 
 void loaded_rom::load_core_state(const std::vector<char>& buf, bool nochecksum)
+{
+	load_core_state(buf.empty() ? NULL : &buf[0], buf.size(), nochecksum);
+}
+
+void loaded_rom::load_core_state(const char* buf, size_t size, bool nochecksum)
 {
 	if(nochecksum) {
-		rtype().unserialize(&buf[0], buf.size());
+		rtype().unserialize(buf, size);
 		return;
 	}
 
-	if(buf.size() < 32)
+	if(size < 32)
 		throw std::runtime_error("Savestate corrupt");
 	if(!savestate_no_check(*CORE().settings)) {
 		unsigned char tmp[32];
 #ifdef USE_LIBGCRYPT_SHA256
-		gcry_md_hash_buffer(GCRY_MD_SHA256, tmp, &buf[0], buf.size() - 32);
+		gcry_md_hash_buffer(GCRY_MD_SHA256, tmp, buf, size - 32);
 #else
-		sha256::hash(tmp, reinterpret_cast<const uint8_t*>(&buf[0]), buf.size() - 32);
+		sha256::hash(tmp, reinterpret_cast<const uint8_t*>(buf), size - 32);
 #endif
-		if(memcmp(tmp, &buf[buf.size() - 32], 32))
+		if(memcmp(tmp, buf + size - 32, 32))
 			throw std::runtime_error("Savestate corrupt");
 	}
-	rtype().unserialize(&buf[0], buf.size() - 32);
+	rtype().unserialize(buf, size - 32);
 }
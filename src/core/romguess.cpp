@@ -1,91 +1,39 @@
 #include "core/instance.hpp"
+#include "core/misc.hpp"
 #include "core/rom.hpp"
+#include "core/romimage.hpp"
 #include "core/settings.hpp"
 #include "core/window.hpp"
 #include "interface/romtype.hpp"
 #include "library/directory.hpp"
+#include "library/fileimage-hashindex.hpp"
 #include "library/zip.hpp"
 
-#include <fstream>
-
 namespace
 {
-	bool db_loaded;
-	std::map<std::pair<std::string, uint64_t>, std::string> our_db;
-	std::string database_name()
-	{
-		return get_config_path() + "/rom.db";
-	}
-
-	void load_db()
+	bool db_imported;
+	fileimage::hashindex& hash_index()
 	{
-		std::ifstream db(database_name());
-		if(db) {
-			std::string line;
-			while(std::getline(db, line)) {
-				istrip_CR(line);
-				size_t split = line.find_first_of("|");
-				if(split >= line.length())
-					continue;
-				std::string hash = line.substr(0, split);
-				std::string filename = line.substr(split + 1);
-				uint64_t prefix = 0;
-				size_t split2 = hash.find_first_of(":");
-				if(split2 < hash.length()) {
-					std::string _prefix = hash.substr(split2 + 1);
-					hash = hash.substr(0, split2);
-					try { prefix = parse_value<uint64_t>(_prefix); } catch(...) {};
-				}
-				if(hash != "") {
-					our_db[std::make_pair(filename, prefix)] = hash;
-				} else {
-					our_db.erase(std::make_pair(filename, prefix));
-				}
-			}
-		}
-		db_loaded = true;
+		//Import the old ROM database. The index remembers the import, so it is only read again if changed.
+		if(!db_imported)
+			lsnes_hash_index.import_db(get_config_path() + "/rom.db");
+		db_imported = true;
+		return lsnes_hash_index;
 	}
 
-	void record_hash(const std::string& _file, uint64_t prefix, const std::string& hash)
+	void record_hash(const std::string& file, uint64_t prefix, const std::string& hash)
 	{
-		if(!db_loaded) load_db();
-		//Database write. If there is existing entry for file, it is overwritten.
-		std::string file = directory::absolute_path(_file);
-		std::pair<std::string, uint64_t> key = std::make_pair(file, prefix);
-		if(hash == "" && !our_db.count(key))
-			return;		//Already correct.
-		if(our_db.count(key) && our_db[key] == hash)
-			return;		//Already correct.
-		if(hash != "")
-			our_db[key] = hash;
-		else
-			our_db.erase(key);
-		std::ofstream db(database_name(), std::ios::app);
-		db << hash << ":" << prefix << "|" << file << std::endl;
+		hash_index().store(file, prefix, hash);
 	}
 
-	void record_hash_deleted(const std::string& _file)
+	void record_hash_deleted(const std::string& file)
 	{
-		if(!db_loaded) load_db();
-		auto itr = our_db.begin();
-		while(true) {
-			itr = our_db.lower_bound(std::make_pair(_file, 0));
-			if(itr == our_db.end() || itr->first.first != _file)
-				return;
-			record_hash(_file, itr->first.second, "");
-		}
+		hash_index().remove(file);
 	}
 
 	std::list<std::pair<std::string, uint64_t>> retretive_files_by_hash(const std::string& hash)
 	{
-		if(!db_loaded) load_db();
-		//Database read. The read is for keys with given value.
-		std::list<std::pair<std::string, uint64_t>> x;
-		for(auto i : our_db)
-			if(i.second == hash) {
-				x.push_back(i.first);
-			}
-		return x;
+		return hash_index().find(hash);
 	}
 
 	std::string hash_file(const std::string& file, uint64_t hsize)
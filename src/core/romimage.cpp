@@ -5,12 +5,14 @@
 #include "core/nullcore.hpp"
 #include "core/settings.hpp"
 #include "core/window.hpp"
+#include "library/fileimage-hashindex.hpp"
 #include "library/memtracker.hpp"
 #include "library/zip.hpp"
 #include <functional>
 
 fileimage::image rom_image::null_img;
-fileimage::hash lsnes_image_hasher;
+fileimage::hashindex lsnes_hash_index([]() -> std::string { return get_config_path() + "/romhash.db"; });
+fileimage::hash lsnes_image_hasher(&lsnes_hash_index);
 rom_image rom_image_handle::null_img;
 
 namespace
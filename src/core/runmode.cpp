@@ -31,6 +31,7 @@ emulator_runmode::emulator_runmode()
 	saved_mode = PAUSE;
 	point = 0;
 	magic = 0;
+	render_skip = false;
 	advanced = false;
 	cancel = false;
 }
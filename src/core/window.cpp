@@ -13,6 +13,7 @@
 #include "core/window.hpp"
 #include "fonts/wrapper.hpp"
 #include "library/framebuffer.hpp"
+#include "library/gc.hpp"
 #include "library/minmax.hpp"
 #include "library/string.hpp"
 #include "library/threads.hpp"
@@ -336,13 +337,14 @@ void platform::fatal_error() throw()
 
 namespace
 {
-	volatile bool normal_pause;
+	//Modal pause is set from the UI thread. The rest is per emulation thread.
+	thread_local bool normal_pause;
 	volatile bool modal_pause;
-	volatile uint64_t continue_time;
+	thread_local uint64_t continue_time;
 
 
-	uint64_t on_idle_time;
-	uint64_t on_timer_time;
+	thread_local uint64_t on_idle_time;
+	thread_local uint64_t on_timer_time;
 	void reload_lua_timers()
 	{
 		auto& core = CORE();
@@ -353,6 +355,7 @@ namespace
 }
 
 #define MAXWAIT 100000ULL
+#define GC_STEP_BUDGET 1000
 
 void platform::dummy_event_loop() throw()
 {
@@ -393,6 +396,8 @@ void platform::flush_command_queue() throw()
 			reload_lua_timers();
 			run_idle = false;
 		}
+		//Collect garbage a bit at a time while waiting.
+		GC::item::gc_step(GC_STEP_BUDGET);
 		threads::alock h(core.iqueue->queue_lock);
 		core.iqueue->run_queue(true);
 		if(!pausing_allowed)
@@ -447,6 +452,8 @@ void platform::wait(uint64_t usec) throw()
 			run_idle = false;
 			reload_lua_timers();
 		}
+		//Collect garbage a bit at a time while waiting.
+		GC::item::gc_step(GC_STEP_BUDGET);
 		threads::alock h(core.iqueue->queue_lock);
 		core.iqueue->run_queue(true);
 		if(core.iqueue->queue_function_run)
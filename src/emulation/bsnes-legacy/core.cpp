@@ -1218,12 +1218,21 @@ namespace
 					messages << "WARNING: SRAM '" << i.first << ": Not found on cartridge."
 						<< std::endl;
 		}
-		void c_serialize(std::vector<char>& out) {
+		size_t c_serialize_into(char* out, size_t outsize) {
 			if(!internal_rom)
 				throw std::runtime_error("No ROM loaded");
+			if(outsize < SNES::system.serialize_size)
+				return SNES::system.serialize_size;
+			//bsnes serializes into a buffer of its own, so this copies once.
 			serializer s = SNES::system.serialize();
-			out.resize(s.size());
-			memcpy(&out[0], s.data(), s.size());
+			if(s.size() <= outsize)
+				memcpy(out, s.data(), s.size());
+			return s.size();
+		}
+		size_t c_serialize_size() {
+			if(!internal_rom)
+				throw std::runtime_error("No ROM loaded");
+			return SNES::system.serialize_size;
 		}
 		void c_unserialize(const char* in, size_t insize) {
 			if(!internal_rom)
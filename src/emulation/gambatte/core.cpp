@@ -75,6 +75,11 @@ namespace
 	std::vector<char> init_savestate;
 	uint32_t cover_fbmem[480 * 432];
 	uint32_t primary_framebuffer[160*144];
+	//libgambatte saves and loads states via vectors. These keep their capacity between savestates.
+	std::vector<char> save_scratch;
+	std::vector<char> load_scratch;
+	//Size of the last savestate. Sizing a state would otherwise need saving it, so this is the size estimate.
+	size_t last_state_size = 0;
 	uint32_t accumulator_l = 0;
 	uint32_t accumulator_r = 0;
 	unsigned accumulator_s = 0;
@@ -404,6 +409,7 @@ namespace
 		romdata.resize(size);
 		memcpy(&romdata[0], data, size);
 		internal_rom = inttype;
+		last_state_size = 0;
 		do_reset_flag = false;
 
 		for(unsigned i = 0; i < 12; i++)
@@ -601,26 +607,36 @@ namespace
 				instance->setRtcBase(timebase);
 			}
 		}
-		void c_serialize(std::vector<char>& out) {
+		size_t c_serialize_into(char* out, size_t outsize) {
 			if(!internal_rom)
 				throw std::runtime_error("Can't save without ROM");
-			instance->saveState(out);
-			size_t osize = out.size();
-			out.resize(osize + 4 * sizeof(primary_framebuffer) / sizeof(primary_framebuffer[0]));
-			for(size_t i = 0; i < sizeof(primary_framebuffer) / sizeof(primary_framebuffer[0]); i++)
+			instance->saveState(save_scratch);
+			size_t osize = save_scratch.size();
+			size_t fbsize = sizeof(primary_framebuffer) / sizeof(primary_framebuffer[0]);
+			size_t size = osize + 4 * fbsize + 2;
+			last_state_size = size;
+			if(size > outsize)
+				return size;
+			memcpy(out, &save_scratch[0], osize);
+			for(size_t i = 0; i < fbsize; i++)
 				serialization::u32b(&out[osize + 4 * i], primary_framebuffer[i]);
-			out.push_back(frame_overflow >> 8);
-			out.push_back(frame_overflow);
+			out[size - 2] = frame_overflow >> 8;
+			out[size - 1] = frame_overflow;
+			return size;
+		}
+		size_t c_serialize_size() {
+			if(!internal_rom)
+				throw std::runtime_error("Can't save without ROM");
+			//If this is too small, the save is retried with the right size.
+			return last_state_size ? last_state_size : c_serialize_into(NULL, 0);
 		}
 		void c_unserialize(const char* in, size_t insize) {
 			if(!internal_rom)
 				throw std::runtime_error("Can't load without ROM");
 			size_t foffset = insize - 2 - 4 * sizeof(primary_framebuffer) /
 				sizeof(primary_framebuffer[0]);
-			std::vector<char> tmp;
-			tmp.resize(foffset);
-			memcpy(&tmp[0], in, foffset);
-			instance->loadState(tmp);
+			load_scratch.assign(in, in + foffset);
+			instance->loadState(load_scratch);
 			for(size_t i = 0; i < sizeof(primary_framebuffer) / sizeof(primary_framebuffer[0]); i++)
 				primary_framebuffer[i] = serialization::u32b(&in[foffset + 4 * i]);
 
@@ -309,17 +309,7 @@ namespace sky
 			inst.state.paused = inst.state.paused ? 0 : 1;
 		if(inst.state.paused)
 			return state_level_play;
-		int lr = 0, ad = 0;
-		bool jump = ((b & 16) != 0);
-		if((b & 1) != 0) lr--;
-		if((b & 2) != 0) lr++;
-		if((b & 4) != 0) ad++;
-		if((b & 8) != 0) ad--;
-		if((b & 256) != 0) lr = 2;	//Cheat for demo.
-		if((b & 512) != 0) ad = 2;	//Cheat for demo.
-		uint8_t death = inst.state.simulate_frame(inst.gsfx, lr, ad, jump);
-		if(!inst.state.p.death && inst.state.waited < 65535)
-			inst.state.waited++;
+		uint8_t death = inst.state.play_level_frame(inst.gsfx, b);
 		draw_level(inst);
 		if(inst.state.timeattack)
 			draw_timeattack_time(inst, inst.state.waited);
@@ -17,6 +17,7 @@ namespace sky
 	void load_rom(struct instance& inst, const std::string& filename);
 	void combine_background(struct instance& inst, size_t back);
 	demo lookup_demo(struct instance& inst, const uint8_t* levelhash);
+	uint64_t get_utime();
 }
 
 
@@ -0,0 +1,301 @@
+#include "search.hpp"
+#include "library/exrethrow.hpp"
+#include "library/minmax.hpp"
+#include "library/threads.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+
+namespace sky
+{
+	namespace
+	{
+		//States claimed by a worker at a time.
+		const size_t search_chunk = 64;
+
+		//Left/right, up/down (never both of a pair) and jump.
+		const uint16_t search_inputs_tab[] = {
+			0, 1, 2, 4, 5, 6, 8, 9, 10,
+			16, 17, 18, 20, 21, 22, 24, 25, 26
+		};
+		const size_t search_inputs_count = sizeof(search_inputs_tab) / sizeof(search_inputs_tab[0]);
+
+		struct silent_noise : public noise_maker
+		{
+			~silent_noise() {}
+			void operator()(int sound, bool hipri) {}
+		};
+
+		struct node
+		{
+			physics p;
+			uint64_t hash;
+			int64_t score;
+			uint32_t parent;
+			uint16_t input;
+			uint16_t waited;
+			uint8_t secret;
+			uint8_t death;
+		};
+
+		//Path back to start: parent index and input for each kept state of each frame.
+		struct step
+		{
+			uint32_t parent;
+			uint16_t input;
+		};
+
+		uint64_t hash_node(const node& n)
+		{
+			const uint8_t* p = reinterpret_cast<const uint8_t*>(&n.p);
+			uint64_t h = 0xcbf29ce484222325ULL;
+			for(size_t i = 0; i < sizeof(n.p); i++)
+				h = (h ^ p[i]) * 0x100000001b3ULL;
+			return (h ^ n.secret) * 0x100000001b3ULL;
+		}
+
+		bool same_state(const node& a, const node& b)
+		{
+			return a.secret == b.secret && !memcmp(&a.p, &b.p, sizeof(a.p));
+		}
+
+		int64_t default_fitness(const physics& p)
+		{
+			//Finishing beats everything, then distance, then speed.
+			if(p.death == physics::death_finished)
+				return std::numeric_limits<int64_t>::max() / 2 + p.lspeed;
+			return (static_cast<int64_t>(p.lpos) << 16) + p.lspeed;
+		}
+
+		//Worker pool expanding all states of one frame at a time. Workers claim chunks of states from a shared
+		//counter until the frame is exhausted, so uneven chunks balance out. Exceptions (e.g. from fitness) are
+		//rethrown by expand().
+		struct expander
+		{
+			expander(const gstate& start, unsigned nthreads, const search_fitness& _fitness, bool _score)
+				: fitness(_fitness), score(_score)
+			{
+				generation = 0;
+				active = 0;
+				quit = false;
+				current = NULL;
+				out.resize(nthreads);
+				errors.resize(nthreads);
+				for(unsigned i = 0; i < nthreads; i++)
+					scratch.push_back(std::unique_ptr<gstate>(new gstate(start)));
+				for(unsigned i = 0; i < nthreads; i++)
+					workers.push_back(new threads::thread([this, i]() { this->worker(i); }));
+			}
+			~expander()
+			{
+				{
+					threads::alock h(lock);
+					quit = true;
+					work.notify_all();
+				}
+				for(auto i : workers) {
+					i->join();
+					delete i;
+				}
+			}
+			//Expand all states in cur. Results are in out, one vector per worker.
+			void expand(const std::vector<node>& cur)
+			{
+				threads::alock h(lock);
+				current = &cur;
+				next = 0;
+				for(auto& i : out)
+					i.clear();
+				for(auto& i : errors)
+					i = exrethrow::storage();
+				active = workers.size();
+				generation++;
+				work.notify_all();
+				while(active)
+					done.wait(h);
+				for(auto& i : errors)
+					if(i) i.rethrow();
+			}
+			std::vector<std::vector<node>> out;
+		private:
+			void worker(unsigned id)
+			{
+				silent_noise sfx;
+				gstate& s = *scratch[id];
+				uint64_t seen = 0;
+				while(true) {
+					{
+						threads::alock h(lock);
+						while(generation == seen && !quit)
+							work.wait(h);
+						if(quit)
+							return;
+						seen = generation;
+					}
+					const std::vector<node>& cur = *current;
+					try {
+						expand_states(id, sfx, s, cur);
+					} catch(std::exception& e) {
+						errors[id] = exrethrow::storage(e);
+					} catch(...) {
+						std::runtime_error e("Unknown error in input search");
+						errors[id] = exrethrow::storage(e);
+					}
+					//Other workers stop at their next chunk.
+					if(errors[id])
+						next = cur.size();
+					threads::alock h(lock);
+					if(!--active)
+						done.notify_all();
+				}
+			}
+			void expand_states(unsigned id, silent_noise& sfx, gstate& s, const std::vector<node>& cur)
+			{
+				std::vector<node>& o = out[id];
+				size_t i;
+				while((i = next.fetch_add(search_chunk)) < cur.size()) {
+					size_t end = min(i + search_chunk, cur.size());
+					for(size_t j = i; j < end; j++)
+						for(size_t k = 0; k < search_inputs_count; k++) {
+							s.p = cur[j].p;
+							s.waited = cur[j].waited;
+							s.secret = cur[j].secret;
+							//Level play without rendering, as in do_level_play(). The
+							//searched inputs never pause nor escape.
+							s.play_level_frame(sfx, s.curdemo.fetchkeys(search_inputs_tab[k],
+								s.p.lpos, s.p.framecounter));
+							uint8_t death = s.p.death;
+							//Crashing takes a while to play out, but is certain as soon as
+							//death is set.
+							if(death && death != physics::death_finished)
+								continue;
+							node n;
+							n.p = s.p;
+							n.waited = s.waited;
+							n.secret = s.secret;
+							n.death = death;
+							n.parent = j;
+							n.input = search_inputs_tab[k];
+							n.score = score ? fitness(n.p) : 0;
+							n.hash = hash_node(n);
+							o.push_back(n);
+						}
+				}
+			}
+			const search_fitness& fitness;
+			bool score;
+			std::vector<std::unique_ptr<gstate>> scratch;
+			std::vector<threads::thread*> workers;
+			threads::lock lock;
+			threads::cv work;
+			threads::cv done;
+			uint64_t generation;
+			unsigned active;
+			bool quit;
+			const std::vector<node>* current;
+			std::atomic<size_t> next;
+			std::vector<exrethrow::storage> errors;
+		};
+	}
+
+	search_params::search_params()
+	{
+		frames = 600;
+		beam = 4096;
+		threads = 0;
+		serial_fitness = false;
+	}
+
+	search_result search_inputs(const gstate& start, const search_params& params)
+	{
+		search_result r;
+		r.finished = false;
+		r.expanded = 0;
+		r.merged = 0;
+		if(start.state != state_level_play)
+			throw std::runtime_error("Input search has to start in level play");
+		search_fitness fitness = params.fitness ? params.fitness : search_fitness(default_fitness);
+		unsigned nthreads = params.threads ? params.threads : threads::thread::hardware_concurrency();
+		nthreads = max(nthreads, 1U);
+		size_t beam = max(params.beam, static_cast<size_t>(1));
+
+		std::vector<node> cur(1);
+		cur[0].p = start.p;
+		cur[0].waited = start.waited;
+		cur[0].secret = start.secret;
+		cur[0].death = start.p.death;
+		cur[0].parent = 0;
+		cur[0].input = 0;
+		cur[0].score = fitness(start.p);
+		r.score = cur[0].score;
+		r.end = start.p;
+		std::vector<std::vector<step>> history;
+		//Best state seen so far: frame (number of inputs) and index.
+		size_t best_frame = 0;
+		size_t best_index = 0;
+		expander x(start, nthreads, fitness, !params.serial_fitness);
+		std::vector<node> nxt;
+		for(unsigned f = 0; f < params.frames && !cur.empty(); f++) {
+			x.expand(cur);
+			nxt.clear();
+			for(auto& i : x.out)
+				nxt.insert(nxt.end(), i.begin(), i.end());
+			r.expanded += nxt.size();
+			//Merge identical states. Identical states score the same, so unscored states can be merged before
+			//scoring. Ties are broken by candidate index (parent, then input), so the state kept does not depend
+			//on which worker produced it first.
+			std::sort(nxt.begin(), nxt.end(), [](const node& a, const node& b) {
+				if(a.hash != b.hash)
+					return a.hash < b.hash;
+				if(a.parent != b.parent)
+					return a.parent < b.parent;
+				return a.input < b.input;
+			});
+			size_t kept = 0;
+			for(size_t i = 0; i < nxt.size(); i++) {
+				if(kept && nxt[kept - 1].hash == nxt[i].hash && same_state(nxt[kept - 1], nxt[i]))
+					continue;
+				nxt[kept++] = nxt[i];
+			}
+			r.merged += nxt.size() - kept;
+			nxt.resize(kept);
+			if(params.serial_fitness)
+				for(auto& i : nxt)
+					i.score = fitness(i.p);
+			if(nxt.size() > beam) {
+				std::nth_element(nxt.begin(), nxt.begin() + beam, nxt.end(),
+					[](const node& a, const node& b) { return a.score > b.score; });
+				nxt.resize(beam);
+			}
+			history.push_back(std::vector<step>(nxt.size()));
+			bool any_finished = false;
+			for(size_t i = 0; i < nxt.size(); i++) {
+				history.back()[i].parent = nxt[i].parent;
+				history.back()[i].input = nxt[i].input;
+				bool finished = (nxt[i].death == physics::death_finished);
+				if((finished && !r.finished) || (finished == r.finished && nxt[i].score > r.score)) {
+					r.score = nxt[i].score;
+					r.finished = finished;
+					r.end = nxt[i].p;
+					best_frame = history.size();
+					best_index = i;
+				}
+				any_finished |= finished;
+			}
+			//Nothing can finish earlier than the first finish.
+			if(any_finished)
+				break;
+			std::swap(cur, nxt);
+		}
+		r.inputs.resize(best_frame);
+		for(size_t i = best_frame; i > 0; i--) {
+			const step& s = history[i - 1][best_index];
+			r.inputs[i - 1] = s.input;
+			best_index = s.parent;
+		}
+		return r;
+	}
+}
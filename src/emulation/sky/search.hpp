@@ -0,0 +1,39 @@
+#ifndef _skycore__search__hpp__included__
+#define _skycore__search__hpp__included__
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "state.hpp"
+
+namespace sky
+{
+	//Score of a state in input search (higher is better). States where the ship has died are dropped without
+	//scoring, p.death is either 0 or physics::death_finished (ship reached the exit).
+	typedef std::function<int64_t(const physics& p)> search_fitness;
+
+	struct search_params
+	{
+		search_params();
+		unsigned frames;		//Maximum number of frames to search.
+		size_t beam;			//Number of states kept per frame.
+		unsigned threads;		//Worker threads, 0 => one per processor.
+		search_fitness fitness;		//Fitness, empty => Distance, then speed.
+		bool serial_fitness;		//Fitness is not thread safe (e.g. calls Lua), call it from this thread.
+	};
+
+	struct search_result
+	{
+		std::vector<uint16_t> inputs;	//Inputs (simulate_frame() button bits) of best sequence.
+		int64_t score;			//Fitness of best sequence.
+		physics end;			//Ship state at the end of best sequence.
+		bool finished;			//Best sequence completes the level.
+		uint64_t expanded;		//Number of states simulated.
+		uint64_t merged;		//Number of states dropped as duplicates.
+	};
+
+	//Beam search over level play inputs, starting from state start (which must be in state_level_play). Searching
+	//stops at the first frame where some sequence completes the level, or after params.frames frames.
+	search_result search_inputs(const gstate& start, const search_params& params);
+}
+#endif
@@ -4,17 +4,26 @@
 #include "instance.hpp"
 #include "logic.hpp"
 #include "demo.hpp"
+#include "search.hpp"
 #include "core/dispatch.hpp"
 #include "core/audioapi.hpp"
+#include "core/command.hpp"
+#include "core/emustatus.hpp"
 #include "core/instance.hpp"
 #include "core/messages.hpp"
+#include "core/movie.hpp"
+#include "core/moviefile.hpp"
+#include "core/rom.hpp"
 #include "interface/romtype.hpp"
 #include "interface/callbacks.hpp"
 #include "library/framebuffer-pixfmt-rgb32.hpp"
+#include "library/lua-base.hpp"
+#include "library/pagehash.hpp"
+#include "library/string.hpp"
+#include <algorithm>
 
 namespace sky
 {
-	bool pflag;
 	int cstyle = 0;
 	const unsigned iindexes[3][7] = {
 		{0, 1, 2, 3, 4, 5, 6},
@@ -26,17 +35,77 @@ namespace sky
 		{NULL, NULL, NULL}
 	};
 
-	//Framebuffer.
-	uint32_t cover_fbmem[320*200];
-	struct framebuffer::info cover_fbinfo = {
-		&framebuffer::pixfmt_rgb32,		//Format.
-		(char*)cover_fbmem,		//Memory.
-		320, 200, 1280,			//Physical size.
-		320, 200, 1280,			//Logical size.
-		0, 0				//Offset.
+	framebuffer::info cover_fbinfo(std::vector<uint32_t>& mem)
+	{
+		struct framebuffer::info inf = {
+			&framebuffer::pixfmt_rgb32,		//Format.
+			(char*)&mem[0],			//Memory.
+			320, 200, 1280,			//Physical size.
+			320, 200, 1280,			//Logical size.
+			0, 0				//Offset.
+		};
+		return inf;
+	}
+
+	//Emulation state, kept per emulator instance.
+	struct core_state
+	{
+		core_state()
+			: cover_fbmem(320*200), cover(cover_fbinfo(cover_fbmem))
+		{
+			pflag = false;
+		}
+		instance corei;
+		bool pflag;
+		//Framebuffer.
+		std::vector<uint32_t> cover_fbmem;
+		framebuffer::raw cover;
+		//Page modification generations for the RAM, WRAM and SRAM VMAs.
+		std::vector<uint64_t> dirty_gen[3];
 	};
 
-	struct instance corei;
+	core_state& cstate()
+	{
+		return current_instance().get_core_state<core_state>();
+	}
+
+	instance& corei()
+	{
+		return cstate().corei;
+	}
+
+	size_t vma_bound(unsigned i)
+	{
+		size_t total = corei().state.as_ram().second;
+		const size_t bounds[4] = {0, 131072, total - 32, total};
+		return bounds[i];
+	}
+
+	uint64_t* vma_dirty_gen(unsigned i)
+	{
+		std::vector<uint64_t>& gen = cstate().dirty_gen[i];
+		gen.resize(page_hash::pages_for(vma_bound(i + 1) - vma_bound(i)));
+		return &gen[0];
+	}
+
+	void mark_state_dirty(size_t offset, size_t size)
+	{
+		for(unsigned i = 0; i < 3; i++) {
+			size_t low = std::max(offset, vma_bound(i));
+			size_t high = std::min(offset + size, vma_bound(i + 1));
+			if(low >= high)
+				continue;
+			uint64_t* gen = vma_dirty_gen(i);
+			for(size_t j = (low - vma_bound(i)) >> page_hash::page_shift;
+				j <= (high - 1 - vma_bound(i)) >> page_hash::page_shift; j++)
+				gen[j]++;
+		}
+	}
+
+	void mark_state_dirty()
+	{
+		mark_state_dirty(0, corei().state.as_ram().second);
+	}
 
 	portctrl::controller X4 = {"(system)", "(system)", {
 		{portctrl::button::TYPE_BUTTON, 'F', "framesync", true}
@@ -270,27 +339,33 @@ namespace sky
 			std::map<std::string, std::vector<char>> r;
 			std::vector<char> sram;
 			sram.resize(32);
-			memcpy(&sram[0], corei.state.sram, 32);
+			memcpy(&sram[0], corei().state.sram, 32);
 			r["sram"] = sram;
 			return r;
 		}
 		void c_load_sram(std::map<std::string, std::vector<char>>& sram) {
 			if(sram.count("sram") && sram["sram"].size() == 32)
-				memcpy(corei.state.sram, &sram["sram"][0], 32);
+				memcpy(corei().state.sram, &sram["sram"][0], 32);
 			else
-				memset(corei.state.sram, 0, 32);
+				memset(corei().state.sram, 0, 32);
+			mark_state_dirty();
 		}
-		void c_serialize(std::vector<char>& out) {
-			auto wram = corei.state.as_ram();
-			out.resize(wram.second);
-			memcpy(&out[0], wram.first, wram.second);
+		size_t c_serialize_into(char* out, size_t outsize) {
+			auto wram = corei().state.as_ram();
+			if(wram.second <= outsize)
+				memcpy(out, wram.first, wram.second);
+			return wram.second;
+		}
+		size_t c_serialize_size() {
+			return corei().state.as_ram().second;
 		}
 		void c_unserialize(const char* in, size_t insize) {
-			auto wram = corei.state.as_ram();
+			auto wram = corei().state.as_ram();
 			if(insize != wram.second)
 				throw std::runtime_error("Save is of wrong size");
 			memcpy(wram.first, in, wram.second);
-			handle_loadstate(corei);
+			handle_loadstate(corei());
+			mark_state_dirty();
 		}
 		core_region& c_get_region() { return *this; }
 		void c_power() {}
@@ -301,15 +376,26 @@ namespace sky
 		void c_install_handler() {}
 		void c_uninstall_handler() {}
 		void c_emulate() {
+			core_state& cs = cstate();
 			uint16_t x = 0;
-			if(simulate_needs_input(corei)) {
+			if(simulate_needs_input(cs.corei)) {
 				for(unsigned i = 0; i < 7; i++)
 					if(ecore_callbacks->get_input(0, 1, iindexes[cstyle][i]))
 						x |= (1 << i);
-				pflag = true;
+				cs.pflag = true;
+			}
+			uint8_t ostate = cs.corei.state.state;
+			simulate_frame(cs.corei, x);
+			//The level and demo only change when the game state changes, everything from the DMA
+			//state onwards may change every frame.
+			if(ostate != cs.corei.state.state)
+				mark_state_dirty();
+			else {
+				auto ram = cs.corei.state.as_ram();
+				size_t hot = reinterpret_cast<uint8_t*>(&cs.corei.state.dma) - ram.first;
+				mark_state_dirty(hot, ram.second - hot);
 			}
-			simulate_frame(corei, x);
-			uint32_t* fb = corei.get_framebuffer();
+			uint32_t* fb = cs.corei.get_framebuffer();
 			framebuffer::info inf;
 			inf.type = &framebuffer::pixfmt_rgb32;
 			inf.mem = reinterpret_cast<char*>(fb);
@@ -326,18 +412,15 @@ namespace sky
 			ecore_callbacks->output_frame(ls, 656250, 18227);
 			ecore_callbacks->timer_tick(18227, 656250);
 			size_t samples = 1333;
-			samples += corei.extrasamples();
+			samples += cs.corei.extrasamples();
 			int16_t sbuf[2668];
-			fetch_sfx(corei, sbuf, samples);
+			fetch_sfx(cs.corei, sbuf, samples);
 			CORE().audio->submit_buffer(sbuf, samples, true, 48000);
 		}
 		void c_runtosave() {}
-		bool c_get_pflag() { return pflag; }
-		void c_set_pflag(bool _pflag) { pflag = _pflag; }
-		framebuffer::raw& c_draw_cover() {
-			static framebuffer::raw x(cover_fbinfo);
-			return x;
-		}
+		bool c_get_pflag() { return cstate().pflag; }
+		void c_set_pflag(bool _pflag) { cstate().pflag = _pflag; }
+		framebuffer::raw& c_draw_cover() { return cstate().cover; }
 		std::string c_get_core_shortname() const { return "sky"; }
 		void c_pre_emulate_frame(portctrl::frame& cf) {}
 		void c_execute_action(unsigned id, const std::vector<interface_action_paramval>& p) {}
@@ -350,14 +433,15 @@ namespace sky
 			size_t size = images[0].size;
 			std::string filename(_filename, _filename + size);
 			try {
-				load_rom(corei, filename);
+				load_rom(corei(), filename);
 			} catch(std::exception& e) {
 				messages << e.what();
 				return -1;
 			}
 			//Clear the RAM.
-			memset(corei.state.as_ram().first, 0, corei.state.as_ram().second);
-			rom_boot_vector(corei);
+			memset(corei().state.as_ram().first, 0, corei().state.as_ram().second);
+			rom_boot_vector(corei());
+			mark_state_dirty();
 			return 0;
 		}
 		controller_set t_controllerconfig(std::map<std::string, std::string>& settings)
@@ -374,27 +458,30 @@ namespace sky
 			std::list<core_vma_info> r;
 			core_vma_info ram;
 			ram.name = "RAM";
-			ram.backing_ram = corei.state.as_ram().first;
+			ram.backing_ram = corei().state.as_ram().first;
 			ram.size = 131072;
 			ram.base = 0;
 			ram.endian = 0;
 			ram.volatile_flag = true;
+			ram.dirty_gen = vma_dirty_gen(0);
 			r.push_back(ram);
 			core_vma_info wram;
 			wram.name = "WRAM";
-			wram.backing_ram = corei.state.as_ram().first + 131072;
-			wram.size = corei.state.as_ram().second - 131072 - 32;
+			wram.backing_ram = corei().state.as_ram().first + 131072;
+			wram.size = corei().state.as_ram().second - 131072 - 32;
 			wram.base = 131072;
 			wram.endian = 0;
 			wram.volatile_flag = true;
+			wram.dirty_gen = vma_dirty_gen(1);
 			r.push_back(wram);
 			core_vma_info sram;
 			sram.name = "SRAM";
-			sram.backing_ram = corei.state.as_ram().first + corei.state.as_ram().second - 32;
+			sram.backing_ram = corei().state.as_ram().first + corei().state.as_ram().second - 32;
 			sram.size = 32;
-			sram.base = corei.state.as_ram().second - 32;
+			sram.base = corei().state.as_ram().second - 32;
 			sram.endian = 0;
 			sram.volatile_flag = false;
+			sram.dirty_gen = vma_dirty_gen(2);
 			r.push_back(sram);
 			return r;
 		}
@@ -423,8 +510,101 @@ namespace sky
 		void c_reset_to_load()
 		{
 			//Clear the RAM and jump to boot vector.
-			memset(corei.state.as_ram().first, 0, corei.state.as_ram().second);
-			rom_boot_vector(corei);
+			memset(corei().state.as_ram().first, 0, corei().state.as_ram().second);
+			rom_boot_vector(corei());
+			mark_state_dirty();
 		}
 	} sky_core;
+
+	//Replace movie input from current frame on, leaving the movie in readonly mode so the inputs play back.
+	void write_search_inputs(const std::vector<uint16_t>& inputs)
+	{
+		auto& core = CORE();
+		movie& mov = core.mlogic->get_movie();
+		portctrl::frame_vector& v = *core.mlogic->get_mfile().input;
+		uint64_t frame, ptr, lagc;
+		std::vector<uint32_t> counters;
+		mov.fast_save(frame, ptr, lagc, counters);
+		{
+			portctrl::frame_vector::notify_freeze freeze(v);
+			v.resize(ptr);
+			for(auto i : inputs) {
+				portctrl::frame f = v.blank_frame(true);
+				for(unsigned j = 0; j < 7; j++)
+					if(i & (1 << j))
+						f.axis3(0, 1, iindexes[cstyle][j], 1);
+				v.append(f);
+			}
+		}
+		mov.fast_load(frame, ptr, lagc, counters, true);
+		core.supdater->update();
+		core.dispatch->status_update();
+	}
+
+	//Fitness from global Lua function, called with a table of the ship state. Lua can only run in this thread.
+	search_fitness lua_fitness(lua::state& L, const std::string& fn)
+	{
+		return [&L, fn](const physics& p) -> int64_t {
+			L.getglobal(fn.c_str());
+			L.newtable();
+			auto field = [&L](const char* name, int64_t value) {
+				L.pushnumber(value);
+				L.setfield(-2, name);
+			};
+			field("framecounter", p.framecounter);
+			field("lpos", p.lpos);
+			field("lspeed", p.lspeed);
+			field("hpos", p.hpos);
+			field("vpos", p.vpos);
+			field("hspeed", p.hspeed);
+			field("vspeed", p.vspeed);
+			field("fuel_left", p.fuel_left);
+			field("o2_left", p.o2_left);
+			field("death", p.death);
+			field("flags", p.flags);
+			if(L.pcall(1, 1, 0)) {
+				std::string err = L.tostring(-1) ? L.tostring(-1) : "(error object is not a string)";
+				L.pop(1);
+				throw std::runtime_error("Error in fitness function: " + err);
+			}
+			if(!L.isnumber(-1)) {
+				L.pop(1);
+				throw std::runtime_error("Fitness function has to return a number");
+			}
+			int64_t score = L.tonumber(-1);
+			L.pop(1);
+			return score;
+		};
+	}
+
+	command::fnptr<const std::string&> CMD_sky_search(lsnes_cmds, "sky-search", "Search inputs for sky",
+		"Syntax: sky-search <frames> [<beam> [<threads> [<function>]]]\nSearches for inputs going furthest in "
+		"<frames> frames (or finishing the level first), keeping <beam> best states each frame. If <function> "
+		"is given, the global Lua function of that name scores states instead. It is called with a table of "
+		"the ship state (framecounter, lpos, lspeed, hpos, vpos, hspeed, vspeed, fuel_left, o2_left, death and "
+		"flags) and returns a number, higher being better. The result replaces the movie from the current "
+		"frame on.\n",
+		[](const std::string& args) {
+			auto& core = CORE();
+			regex_results r = regex("([0-9]+)([ \t]+([0-9]+)([ \t]+([0-9]+)([ \t]+([^ \t]+))?)?)?[ \t]*",
+				args, "Syntax: sky-search <frames> [<beam> [<threads> [<function>]]]");
+			if(!*core.mlogic || core.rom->get_core_identifier() != sky_core.c_core_identifier())
+				throw std::runtime_error("Sky is not running");
+			search_params p;
+			p.frames = parse_value<unsigned>(r[1]);
+			if(r[3] != "")
+				p.beam = parse_value<size_t>(r[3]);
+			if(r[5] != "")
+				p.threads = parse_value<unsigned>(r[5]);
+			if(r[7] != "") {
+				p.fitness = lua_fitness(*core.lua, r[7]);
+				p.serial_fitness = true;
+			}
+			uint64_t t = get_utime();
+			search_result res = search_inputs(corei().state, p);
+			messages << "Searched " << res.expanded << " states (" << res.merged << " duplicates) in "
+				<< (get_utime() - t) / 1000 << "ms: " << res.inputs.size() << " frames, "
+				<< (res.finished ? "level finished" : "level not finished") << std::endl;
+			write_search_inputs(res.inputs);
+		});
 }
@@ -31,6 +31,21 @@ namespace sky
 			secret |= 0x80;
 		return dstatus;
 	}
+	uint8_t gstate::play_level_frame(noise_maker& sfx, uint16_t b)
+	{
+		int lr = 0, ad = 0;
+		bool jump = ((b & 16) != 0);
+		if((b & 1) != 0) lr--;
+		if((b & 2) != 0) lr++;
+		if((b & 4) != 0) ad++;
+		if((b & 8) != 0) ad--;
+		if((b & 256) != 0) lr = 2;	//Cheat for demo.
+		if((b & 512) != 0) ad = 2;	//Cheat for demo.
+		uint8_t death = simulate_frame(sfx, lr, ad, jump);
+		if(!p.death && waited < 65535)
+			waited++;
+		return death;
+	}
 	void gstate::change_state(uint8_t newstate)
 	{
 		state = newstate;
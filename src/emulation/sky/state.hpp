@@ -62,6 +62,8 @@ namespace sky
 		uint8_t sram[32];		//SRAM.
 		void level_init(uint8_t _stage);
 		uint8_t simulate_frame(noise_maker& sfx, int lr, int ad, bool jump);
+		//One frame of level play with keys b (after demo). Returns the death status.
+		uint8_t play_level_frame(noise_maker& sfx, uint16_t b);
 		void change_state(uint8_t newstate);
 		std::pair<uint8_t*, size_t> as_ram();
 	};
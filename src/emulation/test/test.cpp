@@ -42,18 +42,37 @@
 
 namespace
 {
-	uint32_t cover_fbmem[480 * 432];
-	bool pflag = false;
+	framebuffer::info cover_fbinfo(std::vector<uint32_t>& mem)
+	{
+		struct framebuffer::info inf = {
+			&framebuffer::pixfmt_rgb32,		//Format.
+			(char*)&mem[0],			//Memory.
+			480, 432, 1920,			//Physical size.
+			480, 432, 1920,			//Logical size.
+			0, 0				//Offset.
+		};
+		return inf;
+	}
 
-	//Framebuffer.
-	struct framebuffer::info cover_fbinfo = {
-		&framebuffer::pixfmt_rgb32,		//Format.
-		(char*)cover_fbmem,		//Memory.
-		480, 432, 1920,			//Physical size.
-		480, 432, 1920,			//Logical size.
-		0, 0				//Offset.
+	//Emulation state, kept per emulator instance.
+	struct core_state
+	{
+		core_state()
+			: cover_fbmem(480 * 432), cover(cover_fbinfo(cover_fbmem))
+		{
+			pflag = false;
+		}
+		bool pflag;
+		//Framebuffer.
+		std::vector<uint32_t> cover_fbmem;
+		framebuffer::raw cover;
 	};
 
+	core_state& cstate()
+	{
+		return current_instance().get_core_state<core_state>();
+	}
+
 	struct interface_device_reg test_registers[] = {
 		{NULL, NULL, NULL}
 	};
@@ -72,16 +91,16 @@ namespace
 		return r;
 	}
 
-	void redraw_cover_fbinfo()
+	void redraw_cover_fbinfo(std::vector<uint32_t>& cover_fbmem)
 	{
-		for(size_t i = 0; i < sizeof(cover_fbmem) / sizeof(cover_fbmem[0]); i++)
+		for(size_t i = 0; i < cover_fbmem.size(); i++)
 			cover_fbmem[i] = 0x00000000;
-		cover_render_string(cover_fbmem, 0, 0, "TEST MODE", 0xFFFFFF, 0x00000, 480, 432, 1920, 4);
+		cover_render_string(&cover_fbmem[0], 0, 0, "TEST MODE", 0xFFFFFF, 0x00000, 480, 432, 1920, 4);
 	}
 
-	void redraw_screen()
+	void redraw_screen(std::vector<uint32_t>& cover_fbmem)
 	{
-		for(size_t i = 0; i < sizeof(cover_fbmem) / sizeof(cover_fbmem[0]); i++)
+		for(size_t i = 0; i < cover_fbmem.size(); i++)
 			cover_fbmem[i] = 0x00000000;
 		{
 			std::ostringstream str;
@@ -91,7 +110,7 @@ namespace
 			for(unsigned i = 0; i < 15; i++)
 				if(ecore_callbacks->get_input(1, 0, i + 6)) k |= (1 << i);
 			str << hex::to16(k);
-			cover_render_string(cover_fbmem, 0, 0, str.str(), 0xFFFFFF, 0x00000, 480, 432, 1920, 4);
+			cover_render_string(&cover_fbmem[0], 0, 0, str.str(), 0xFFFFFF, 0x00000, 480, 432, 1920, 4);
 		}
 		{
 			std::ostringstream str;
@@ -101,7 +120,7 @@ namespace
 			for(unsigned i = 0; i < 15; i++)
 				if(ecore_callbacks->get_input(2, 0, i + 6)) k |= (1 << i);
 			str << hex::to16(k);
-			cover_render_string(cover_fbmem, 0, 16, str.str(), 0xFFFFFF, 0x00000, 480, 432, 1920, 4);
+			cover_render_string(&cover_fbmem[0], 0, 16, str.str(), 0xFFFFFF, 0x00000, 480, 432, 1920, 4);
 		}
 	}
 
@@ -137,7 +156,7 @@ namespace
 			return s;
 		}
 		void c_load_sram(std::map<std::string, std::vector<char>>& sram) {}
-		void c_serialize(std::vector<char>& out) { out.clear(); }
+		size_t c_serialize_into(char* out, size_t outsize) { return 0; }
 		void c_unserialize(const char* in, size_t insize) {}
 		core_region& c_get_region() { return *this; }
 		void c_power() {}
@@ -148,12 +167,13 @@ namespace
 		void  c_install_handler() {}
 		void c_uninstall_handler() {}
 		void c_emulate() {
+			core_state& cs = cstate();
 			int16_t audio[800] = {0};
-			pflag = false;
-			redraw_screen();
+			cs.pflag = false;
+			redraw_screen(cs.cover_fbmem);
 			framebuffer::info inf;
 			inf.type = &framebuffer::pixfmt_rgb32;
-			inf.mem = reinterpret_cast<char*>(cover_fbmem);
+			inf.mem = reinterpret_cast<char*>(&cs.cover_fbmem[0]);
 			inf.physwidth = 480;
 			inf.physheight = 432;
 			inf.physstride = 1920;
@@ -167,12 +187,12 @@ namespace
 			CORE().audio->submit_buffer(audio, 800, false, 48000);
 		}
 		void c_runtosave() {}
-		bool c_get_pflag() { return pflag; }
-		void c_set_pflag(bool _pflag) { pflag = _pflag; }
+		bool c_get_pflag() { return cstate().pflag; }
+		void c_set_pflag(bool _pflag) { cstate().pflag = _pflag; }
 		framebuffer::raw& c_draw_cover() {
-			static framebuffer::raw x(cover_fbinfo);
-			redraw_cover_fbinfo();
-			return x;
+			core_state& cs = cstate();
+			redraw_cover_fbinfo(cs.cover_fbmem);
+			return cs.cover;
 		}
 		std::string c_get_core_shortname() const { return "test"; }
 		void c_pre_emulate_frame(portctrl::frame& cf) {}
@@ -0,0 +1,125 @@
+//Convert .hex font into prebuilt font data (C++ source) usable by framebuffer::font::load_builtin().
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <stdexcept>
+
+namespace
+{
+	struct glyph
+	{
+		bool wide;
+		std::vector<uint32_t> data;
+	};
+
+	void parse_line(std::map<uint32_t, glyph>& glyphs, const std::string& line)
+	{
+		size_t splitter = line.find(':');
+		size_t linelen = line.length();
+		if(splitter >= linelen || splitter > 7 || !(splitter + 33 == linelen || splitter + 65 == linelen) ||
+			line.find_first_not_of("0123456789ABCDEFabcdef:") < linelen ||
+			line.find(':', splitter + 1) < linelen)
+			throw std::runtime_error("Invalid line '" + line + "'");
+		char* end;
+		unsigned long cp = strtoul(line.substr(0, splitter).c_str(), &end, 16);
+		if(*end || cp > 0x10FFFF)
+			throw std::runtime_error("Invalid line '" + line + "'");
+		std::string cdata = line.substr(splitter + 1);
+		glyph& g = glyphs[cp];
+		g.wide = (cdata.length() == 64);
+		g.data.clear();
+		for(size_t i = 0; i < cdata.length(); i += 8)
+			g.data.push_back(strtoul(cdata.substr(i, 8).c_str(), &end, 16));
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if(argc != 2) {
+		std::cerr << "Syntax: mkfont <hexfile>" << std::endl;
+		return 1;
+	}
+	std::map<uint32_t, glyph> glyphs;
+	try {
+		std::ifstream in(argv[1]);
+		if(!in)
+			throw std::runtime_error(std::string("Can't open '") + argv[1] + "'");
+		std::string line;
+		while(std::getline(in, line)) {
+			while(line.length() && (line[line.length() - 1] == '\r' || line[line.length() - 1] == '\n'))
+				line = line.substr(0, line.length() - 1);
+			if(line.length() && line[0] != '#')
+				parse_line(glyphs, line);
+		}
+	} catch(std::exception& e) {
+		std::cerr << argv[1] << ": " << e.what() << std::endl;
+		return 1;
+	}
+	//Space is always blank (the same as done by font::load_hex()).
+	glyphs[32].wide = false;
+	glyphs[32].data = std::vector<uint32_t>(4);
+
+	std::cout << "#include \"library/framebuffer.hpp\"" << std::endl << std::endl;
+	std::cout << "namespace" << std::endl << "{" << std::endl;
+	//Glyph data.
+	std::map<uint32_t, size_t> offsets;
+	size_t offset = 0;
+	std::cout << "\tconst uint32_t glyph_data[] = {" << std::endl;
+	for(auto& i : glyphs) {
+		offsets[i.first] = offset;
+		std::cout << "\t\t";
+		for(auto j : i.second.data)
+			std::cout << "0x" << std::hex << j << std::dec << "U,";
+		std::cout << std::endl;
+		offset += i.second.data.size();
+	}
+	std::cout << "\t};" << std::endl;
+	//Codepoints.
+	std::cout << "\tconst uint32_t codepoints[] = {" << std::endl;
+	for(auto& i : glyphs)
+		std::cout << "\t\t" << i.first << "," << std::endl;
+	std::cout << "\t};" << std::endl;
+	//Glyphs.
+	std::cout << "\tconst framebuffer::font::glyph glyphs[] = {" << std::endl;
+	for(auto& i : glyphs)
+		std::cout << "\t\t{" << (i.second.wide ? "true" : "false") << ", glyph_data + " << offsets[i.first]
+			<< ", " << offsets[i.first] << "}," << std::endl;
+	std::cout << "\t};" << std::endl;
+	//BMP lookup table.
+	std::vector<std::vector<uint32_t>> pages;
+	int pagemap[256];
+	for(unsigned i = 0; i < 256; i++)
+		pagemap[i] = -1;
+	size_t idx = 0;
+	for(auto& i : glyphs) {
+		idx++;
+		if(i.first > 0xFFFF)
+			break;
+		if(pagemap[i.first >> 8] < 0) {
+			pagemap[i.first >> 8] = pages.size();
+			pages.push_back(std::vector<uint32_t>(256));
+		}
+		pages[pagemap[i.first >> 8]][i.first & 0xFF] = idx;
+	}
+	std::cout << "\tconst int16_t bmp_pagemap[] = {" << std::endl;
+	for(unsigned i = 0; i < 256; i++)
+		std::cout << ((i % 16) ? " " : "\t\t") << pagemap[i] << "," << ((i % 16 == 15) ? "\n" : "");
+	std::cout << "\t};" << std::endl;
+	std::cout << "\tconst uint32_t bmp_pages[] = {" << std::endl;
+	for(auto& i : pages)
+		for(unsigned j = 0; j < 256; j++)
+			std::cout << ((j % 16) ? " " : "\t\t") << i[j] << "," << ((j % 16 == 15) ? "\n" : "");
+	if(pages.empty())
+		std::cout << "\t\t0" << std::endl;
+	std::cout << "\t};" << std::endl;
+	std::cout << "}" << std::endl << std::endl;
+	std::cout << "extern const framebuffer::font::builtin_data font_builtin_data;" << std::endl;
+	std::cout << "const framebuffer::font::builtin_data font_builtin_data = {" << std::endl;
+	std::cout << "\t" << glyphs.size() << ", codepoints, glyphs, bmp_pagemap, bmp_pages" << std::endl;
+	std::cout << "};" << std::endl;
+	return 0;
+}
@@ -212,6 +212,7 @@ namespace
 			shortname = p.shortname;
 			id = p.id;
 			internal_pflag = false;
+			last_state_size = 0;
 			caps1 = p.flags;
 			regions = p.regions;
 			actions = p.actions;
@@ -412,14 +413,34 @@ namespace
 				throw std::runtime_error("Loadstate failed: " + std::string(err));
 			});
 		}
-		void c_serialize(std::vector<char>& out)
+		lsnes_core_savestate savestate()
 		{
 			lsnes_core_savestate s;
 			entrypoint(id, s, [](const char* name, const char* err) {
 				throw std::runtime_error("Savestate failed: " + std::string(err));
 			});
+			last_state_size = s.size;
+			return s;
+		}
+		void c_serialize(std::vector<char>& out)
+		{
+			lsnes_core_savestate s = savestate();
 			out.resize(s.size);
-			memcpy(&out[0], s.data, s.size);
+			if(s.size)
+				memcpy(&out[0], s.data, s.size);
+		}
+		size_t c_serialize_into(char* out, size_t outsize)
+		{
+			lsnes_core_savestate s = savestate();
+			//The state is in core-owned memory, copy it straight to destination.
+			if(s.size <= outsize)
+				memcpy(out, s.data, s.size);
+			return s.size;
+		}
+		size_t c_serialize_size()
+		{
+			//Asking the size takes a full savestate, so estimate from the last one.
+			return last_state_size;
 		}
 		unsigned c_action_flags(unsigned _id)
 		{
@@ -693,6 +714,7 @@ failed:
 		std::string shortname;
 		unsigned id;
 		bool internal_pflag;
+		size_t last_state_size;
 		unsigned caps1;
 		std::vector<std::string> trace_cpus;
 		std::map<unsigned, portctrl::type*> ports;
@@ -8,6 +8,7 @@
 #include <string>
 #include <algorithm>
 #include <cctype>
+#include <cstring>
 #include <stdexcept>
 #include <list>
 #include <limits>
@@ -381,6 +382,7 @@ core_core::core_core(std::initializer_list<portctrl::type*> ports, std::initiali
 		actions[i._symbol] = i;
 
 	hidden = false;
+	serialize_fallback = false;
 	uninitialized_cores_set().insert(this);
 	all_cores_set().insert(this);
 	new_core_flag = true;
@@ -395,6 +397,7 @@ core_core::core_core(std::vector<portctrl::type*> ports, std::vector<interface_a
 		actions[i._symbol] = i;
 
 	hidden = false;
+	serialize_fallback = false;
 	uninitialized_cores_set().insert(this);
 	all_cores_set().insert(this);
 	new_core_flag = true;
@@ -473,6 +476,54 @@ void core_core::serialize(std::vector<char>& out)
 	c_serialize(out);
 }
 
+size_t core_core::serialize(char* out, size_t outsize)
+{
+	return c_serialize_into(out, outsize);
+}
+
+size_t core_core::serialize_size()
+{
+	return c_serialize_size();
+}
+
+void core_core::c_serialize(std::vector<char>& out)
+{
+	size_t size = c_serialize_size();
+	while(true) {
+		out.resize(size);
+		size_t nsize = c_serialize_into(size ? &out[0] : NULL, size);
+		if(nsize <= size) {
+			out.resize(nsize);
+			return;
+		}
+		size = nsize;
+	}
+}
+
+size_t core_core::c_serialize_into(char* out, size_t outsize)
+{
+	//The default c_serialize() comes back here if the core overrides neither.
+	if(serialize_fallback)
+		throw std::logic_error("Core does not implement savestates");
+	std::vector<char> tmp;
+	serialize_fallback = true;
+	try {
+		c_serialize(tmp);
+	} catch(...) {
+		serialize_fallback = false;
+		throw;
+	}
+	serialize_fallback = false;
+	if(tmp.size() <= outsize && tmp.size())
+		memcpy(out, &tmp[0], tmp.size());
+	return tmp.size();
+}
+
+size_t core_core::c_serialize_size()
+{
+	return c_serialize_into(NULL, 0);
+}
+
 void core_core::unserialize(const char* in, size_t insize)
 {
 	c_unserialize(in, insize);
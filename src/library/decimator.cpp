@@ -0,0 +1,132 @@
+#include "decimator.hpp"
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+	//Number of nonzero coefficient pairs in early and final stages.
+	const unsigned early_pairs = 4;
+	const unsigned final_pairs = 14;
+	//Kaiser window parameter (about 70dB stopband).
+	const double kaiser_beta = 7.0;
+
+	double bessel_i0(double x)
+	{
+		double sum = 1;
+		double term = 1;
+		for(unsigned k = 1; k < 50; k++) {
+			term *= (x / (2 * k)) * (x / (2 * k));
+			sum += term;
+			if(term < sum * 1e-12)
+				break;
+		}
+		return sum;
+	}
+
+	//Kaiser-windowed halfband lowpass, returning odd coefficients scaled for unity DC gain.
+	std::vector<float> design_halfband(unsigned pairs)
+	{
+		std::vector<double> h(pairs);
+		double M = 2 * pairs - 1;
+		double sum = 0;
+		for(unsigned k = 0; k < pairs; k++) {
+			double n = 2 * k + 1;
+			double sinc = sin(M_PI * n / 2) / (M_PI * n);
+			double w = bessel_i0(kaiser_beta * sqrt(1 - (n / M) * (n / M))) / bessel_i0(kaiser_beta);
+			h[k] = sinc * w;
+			sum += h[k];
+		}
+		std::vector<float> r(pairs);
+		for(unsigned k = 0; k < pairs; k++)
+			r[k] = h[k] * 0.25 / sum;
+		return r;
+	}
+}
+
+decimator::decimator()
+{
+	factor = 1;
+	stereo = false;
+}
+
+void decimator::set_factor(unsigned _factor)
+{
+	if(!_factor || (_factor & (_factor - 1)))
+		throw std::runtime_error("Decimation factor must be power of two");
+	if(_factor == factor)
+		return;
+	factor = _factor;
+	stages.clear();
+	for(unsigned i = 1; i < factor; i <<= 1) {
+		stages.push_back(stage());
+		stages.back().coeffs = design_halfband((2 * i == factor) ? final_pairs : early_pairs);
+	}
+	reset();
+}
+
+void decimator::reset()
+{
+	for(auto& i : stages)
+		for(unsigned ch = 0; ch < 2; ch++)
+			i.history[ch].assign(4 * i.coeffs.size() - 2, 0);
+}
+
+unsigned decimator::factor_for(double rate, double limit)
+{
+	unsigned f = 1;
+	while(rate / f > limit && f < 65536)
+		f <<= 1;
+	return f;
+}
+
+void decimator::run_stage(stage& s, std::vector<float>& data, unsigned ch)
+{
+	std::vector<float>& h = s.history[ch];
+	h.insert(h.end(), data.begin(), data.end());
+	size_t pairs = s.coeffs.size();
+	size_t taps = 4 * pairs - 1;
+	size_t n = (h.size() >= taps) ? (h.size() - taps) / 2 + 1 : 0;
+	data.resize(n);
+	const float* x = &h[0];
+	float* y = n ? &data[0] : NULL;
+	//Loop over outputs innermost, so the compiler can vectorize.
+	for(size_t j = 0; j < n; j++)
+		y[j] = 0.5f * x[2 * j + 2 * pairs - 1];
+	for(size_t k = 0; k < pairs; k++) {
+		float c = s.coeffs[k];
+		const float* a = x + 2 * pairs - 2 - 2 * k;
+		const float* b = x + 2 * pairs + 2 * k;
+		for(size_t j = 0; j < n; j++)
+			y[j] += c * (a[2 * j] + b[2 * j]);
+	}
+	h.erase(h.begin(), h.begin() + 2 * n);
+}
+
+size_t decimator::process(const int16_t* in, size_t count, bool _stereo, int16_t* out)
+{
+	unsigned chans = _stereo ? 2 : 1;
+	if(factor == 1) {
+		for(size_t i = 0; i < chans * count; i++)
+			out[i] = in[i];
+		return count;
+	}
+	if(_stereo != stereo) {
+		stereo = _stereo;
+		reset();
+	}
+	size_t n = 0;
+	for(unsigned ch = 0; ch < chans; ch++) {
+		std::vector<float>& w = work[ch];
+		w.resize(count);
+		for(size_t i = 0; i < count; i++)
+			w[i] = in[chans * i + ch];
+		for(auto& s : stages)
+			run_stage(s, w, ch);
+		n = w.size();
+		for(size_t i = 0; i < n; i++) {
+			float v = floor(w[i] + 0.5f);
+			out[chans * i + ch] = (v > 32767) ? 32767 : ((v < -32768) ? -32768 : v);
+		}
+	}
+	return n;
+}
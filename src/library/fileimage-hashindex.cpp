@@ -0,0 +1,331 @@
+#include "fileimage-hashindex.hpp"
+#include "directory.hpp"
+#include "string.hpp"
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <unistd.h>
+
+namespace fileimage
+{
+namespace
+{
+	//Compact if log has this many records more than twice the live entries.
+	const uint64_t compact_slack = 256;
+	//Size recorded for entries whose hash has not been verified. No file can have this size.
+	const uint64_t unverified_size = 0xFFFFFFFFFFFFFFFFULL;
+	//Hash recorded for imported old-style databases. Never a valid hash.
+	const char* import_marker = "imported";
+
+	std::string normalize(const std::string& filename)
+	{
+		try {
+			return directory::absolute_path(filename);
+		} catch(...) {
+			return filename;
+		}
+	}
+
+	bool file_stat(const std::string& filename, uint64_t& size, time_t& mtime)
+	{
+		try {
+			if(!directory::is_regular(filename))
+				return false;
+			size = directory::size(filename);
+			mtime = directory::mtime(filename);
+			return true;
+		} catch(...) {
+			return false;
+		}
+	}
+
+	//Import old-style cache file. Returns "" if not present or stale.
+	std::string import_sidecar(const std::string& filename, uint64_t prefix, time_t mtime)
+	{
+		std::string cache = filename + ".sha256";
+		if(prefix) cache += (stringfmt() << "-" << prefix).str();
+		std::ifstream in(cache);
+		if(!in)
+			return "";
+		std::string tmp, cached_hash;
+		time_t rfiletime = 0;
+		std::getline(in, tmp);
+		std::istringstream _in(tmp);
+		_in >> rfiletime;
+		std::getline(in, cached_hash);
+		istrip_CR(cached_hash);
+		in.close();
+		if(rfiletime != mtime)
+			return "";	//Stale.
+		return cached_hash;
+	}
+}
+
+hashindex::hashindex(std::function<std::string()> _dbname_fn)
+{
+	dbname_fn = _dbname_fn;
+	loaded = false;
+	records = 0;
+}
+
+void hashindex::load()
+{
+	//Caller holds the lock.
+	if(loaded)
+		return;
+	loaded = true;
+	dbname = dbname_fn();
+	if(dbname == "")
+		return;
+	std::ifstream db(dbname);
+	if(!db)
+		return;
+	//Format: <hash>|<prefix>|<size>|<mtime>|<filename>. Empty hash deletes the entry. Hash "imported" records
+	//an imported old-style database.
+	std::string line;
+	while(std::getline(db, line)) {
+		istrip_CR(line);
+		size_t split[4];
+		size_t p = 0;
+		bool ok = true;
+		for(unsigned i = 0; i < 4; i++) {
+			split[i] = line.find_first_of("|", p);
+			if(split[i] >= line.length()) {
+				ok = false;
+				break;
+			}
+			p = split[i] + 1;
+		}
+		if(!ok)
+			continue;
+		records++;
+		try {
+			entry e;
+			e.hash = line.substr(0, split[0]);
+			uint64_t prefix = parse_value<uint64_t>(line.substr(split[0] + 1, split[1] - split[0] - 1));
+			e.size = parse_value<uint64_t>(line.substr(split[1] + 1, split[2] - split[1] - 1));
+			e.mtime = parse_value<int64_t>(line.substr(split[2] + 1, split[3] - split[2] - 1));
+			key_t key(line.substr(split[3] + 1), prefix);
+			if(e.hash == import_marker)
+				imports[key.first] = e;
+			else
+				set_entry(key, (e.hash != "") ? &e : NULL);
+		} catch(...) {
+		}
+	}
+	db.close();
+	if(records > 2 * entries.size() + imports.size() + compact_slack)
+		do_compact();
+}
+
+void hashindex::set_entry(const key_t& key, const entry* e)
+{
+	if(entries.count(key)) {
+		std::string oldhash = entries[key].hash;
+		by_hash[oldhash].erase(key);
+		if(by_hash[oldhash].empty())
+			by_hash.erase(oldhash);
+		entries.erase(key);
+	}
+	if(e) {
+		entries[key] = *e;
+		by_hash[e->hash].insert(key);
+	}
+}
+
+void hashindex::log_entry(const key_t& key, const entry* e)
+{
+	if(e)
+		log_record(e->hash, key.second, e->size, e->mtime, key.first);
+	else
+		log_record("", key.second, 0, 0, key.first);
+}
+
+void hashindex::log_record(const std::string& hash, uint64_t prefix, uint64_t size, time_t mtime,
+	const std::string& filename)
+{
+	if(dbname == "")
+		return;
+	{
+		std::ofstream db(dbname, std::ios::app);
+		if(!db)
+			return;
+		db << hash << "|" << prefix << "|" << size << "|" << static_cast<int64_t>(mtime) << "|" << filename
+			<< std::endl;
+	}
+	records++;
+	if(records > 2 * entries.size() + imports.size() + compact_slack)
+		do_compact();
+}
+
+void hashindex::do_store(const std::string& filename, uint64_t prefix, const std::string& hash)
+{
+	key_t key(normalize(filename), prefix);
+	entry e;
+	if(hash == "" || !file_stat(key.first, e.size, e.mtime)) {
+		if(!entries.count(key))
+			return;		//Already correct.
+		set_entry(key, NULL);
+		log_entry(key, NULL);
+		return;
+	}
+	e.hash = hash;
+	if(entries.count(key)) {
+		entry& o = entries[key];
+		if(o.hash == e.hash && o.size == e.size && o.mtime == e.mtime)
+			return;		//Already correct.
+	}
+	set_entry(key, &e);
+	log_entry(key, &e);
+}
+
+bool hashindex::lookup(const std::string& filename, uint64_t prefix, std::string& hash)
+{
+	threads::alock h(mlock);
+	load();
+	key_t key(normalize(filename), prefix);
+	uint64_t size;
+	time_t mtime;
+	if(!file_stat(key.first, size, mtime)) {
+		if(entries.count(key)) {
+			set_entry(key, NULL);
+			log_entry(key, NULL);
+		}
+		return false;
+	}
+	if(entries.count(key)) {
+		entry& e = entries[key];
+		if(e.size == size && e.mtime == mtime) {
+			hash = e.hash;
+			return true;
+		}
+		//Stale.
+		set_entry(key, NULL);
+		log_entry(key, NULL);
+		return false;
+	}
+	std::string cached_hash = import_sidecar(key.first, prefix, mtime);
+	if(cached_hash == "")
+		return false;
+	do_store(key.first, prefix, cached_hash);
+	hash = cached_hash;
+	return true;
+}
+
+void hashindex::store(const std::string& filename, uint64_t prefix, const std::string& hash)
+{
+	threads::alock h(mlock);
+	load();
+	do_store(filename, prefix, hash);
+}
+
+void hashindex::remove(const std::string& filename)
+{
+	threads::alock h(mlock);
+	load();
+	std::string file = normalize(filename);
+	while(true) {
+		auto itr = entries.lower_bound(key_t(file, 0));
+		if(itr == entries.end() || itr->first.first != file)
+			return;
+		key_t key = itr->first;
+		set_entry(key, NULL);
+		log_entry(key, NULL);
+	}
+}
+
+std::list<std::pair<std::string, uint64_t>> hashindex::find(const std::string& hash)
+{
+	threads::alock h(mlock);
+	load();
+	std::list<std::pair<std::string, uint64_t>> x;
+	if(by_hash.count(hash))
+		for(auto& i : by_hash[hash])
+			x.push_back(i);
+	return x;
+}
+
+bool hashindex::import_db(const std::string& dbfile)
+{
+	threads::alock h(mlock);
+	load();
+	std::string dbkey = normalize(dbfile);
+	entry m;
+	if(!file_stat(dbkey, m.size, m.mtime))
+		return false;
+	if(imports.count(dbkey) && imports[dbkey].size == m.size && imports[dbkey].mtime == m.mtime)
+		return true;	//Already imported.
+	std::ifstream db(dbfile);
+	if(!db)
+		return false;
+	//Replay the log first, as later lines override earlier ones.
+	std::map<key_t, std::string> old;
+	std::string line;
+	while(std::getline(db, line)) {
+		istrip_CR(line);
+		size_t split = line.find_first_of("|");
+		if(split >= line.length())
+			continue;
+		std::string hash = line.substr(0, split);
+		std::string filename = line.substr(split + 1);
+		uint64_t prefix = 0;
+		size_t split2 = hash.find_first_of(":");
+		if(split2 < hash.length()) {
+			std::string _prefix = hash.substr(split2 + 1);
+			hash = hash.substr(0, split2);
+			try { prefix = parse_value<uint64_t>(_prefix); } catch(...) {};
+		}
+		old[key_t(filename, prefix)] = hash;
+	}
+	db.close();
+	//The old database has no size nor modification time, so the entries are only hints for find(). The size
+	//never matches, so first lookup() of the file treats the entry as stale and the file gets rehashed.
+	for(auto& i : old) {
+		key_t key(normalize(i.first.first), i.first.second);
+		entry e;
+		if(i.second == "" || entries.count(key) || !file_stat(key.first, e.size, e.mtime))
+			continue;
+		e.hash = i.second;
+		e.size = unverified_size;
+		e.mtime = 0;
+		set_entry(key, &e);
+		log_entry(key, &e);
+	}
+	m.hash = import_marker;
+	imports[dbkey] = m;
+	log_record(m.hash, 0, m.size, m.mtime, dbkey);
+	return true;
+}
+
+void hashindex::compact()
+{
+	threads::alock h(mlock);
+	load();
+	do_compact();
+}
+
+void hashindex::do_compact()
+{
+	if(dbname == "")
+		return;
+	std::string tmpname = dbname + ".tmp";
+	{
+		std::ofstream db(tmpname);
+		if(!db)
+			return;
+		for(auto& i : entries)
+			db << i.second.hash << "|" << i.first.second << "|" << i.second.size << "|"
+				<< static_cast<int64_t>(i.second.mtime) << "|" << i.first.first << "\n";
+		for(auto& i : imports)
+			db << i.second.hash << "|0|" << i.second.size << "|" << static_cast<int64_t>(i.second.mtime)
+				<< "|" << i.first << "\n";
+		if(!db)
+			return;
+	}
+	if(directory::rename_overwrite(tmpname.c_str(), dbname.c_str()) < 0) {
+		unlink(tmpname.c_str());
+		return;
+	}
+	records = entries.size() + imports.size();
+}
+}
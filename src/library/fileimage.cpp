@@ -1,6 +1,7 @@
 #include "fileimage.hpp"
 #include "sha256.hpp"
 #include "fileimage-patch.hpp"
+#include "fileimage-hashindex.hpp"
 #include "string.hpp"
 #include "minmax.hpp"
 #include "zip.hpp"
@@ -12,7 +13,8 @@ namespace fileimage
 {
 namespace
 {
-	std::map<std::string, std::pair<time_t, std::string>> cached_entries;
+	//Hashing is mostly I/O bound, so don't use too many threads.
+	const unsigned max_hash_threads = 4;
 
 	threads::lock& global_queue_mutex()
 	{
@@ -36,67 +38,16 @@ namespace
 		return NULL;
 	}
 
-	std::string lookup_cache(const std::string& filename, uint64_t prefixlen)
-	{
-		std::string cache = filename + ".sha256";
-		if(prefixlen) cache += (stringfmt() << "-" << prefixlen).str();
-		time_t filetime = directory::mtime(filename);
-		if(cached_entries.count(cache)) {
-			//Found the cache entry...
-			if(cached_entries[cache].first == filetime)
-				return cached_entries[cache].second;
-			else {
-				//Stale.
-				unlink(cache.c_str());
-				cached_entries.erase(cache);
-				return "";
-			}
-		}
-
-		std::string cached_hash;
-		time_t rfiletime;
-
-		std::ifstream in(cache);
-		if(!in)
-			return "";	//Failed.
-
-		std::string tmp;
-		std::getline(in, tmp);
-		std::istringstream _in(tmp);
-		_in >> rfiletime;
-		std::getline(in, cached_hash);
-
-		if(rfiletime == filetime) {
-			cached_entries[cache] = std::make_pair(rfiletime, cached_hash);
-		} else  {
-			//Stale.
-			unlink(cache.c_str());
-			cached_entries.erase(cache);
-			return "";
-		}
-		return cached_hash;
-	}
-
-	void store_cache(const std::string& filename, uint64_t prefixlen, const std::string& value)
-	{
-		std::string cache = filename + ".sha256";
-		if(prefixlen) cache += (stringfmt() << "-" << prefixlen).str();
-		time_t filetime = directory::mtime(filename);
-		std::ofstream out(cache);
-		cached_entries[cache] = std::make_pair(filetime, value);
-		if(!out)
-			return;		//Failed!
-		out << filetime << std::endl;
-		out << value << std::endl;
-		out.close();
-	}
-
 	uint64_t get_file_size(const std::string& filename)
 	{
-		uintmax_t size = directory::size(filename);
-		if(size == static_cast<uintmax_t>(-1))
+		try {
+			uintmax_t size = directory::size(filename);
+			if(size == static_cast<uintmax_t>(-1))
+				return 0;
+			return size;
+		} catch(...) {
 			return 0;
-		return size;
+		}
 	}
 }
 
@@ -201,9 +152,10 @@ hashval& hashval::operator=(const hashval& f)
 void hashval::resolve(unsigned id, const std::string& hash, uint64_t _prefix)
 {
 	threads::alock h(mlock);
-	hasher->unlink(*this);
-	if(id != cbid)
+	if(id != cbid || !hasher)
 		return;
+	hasher->unlink(*this);
+	hasher = NULL;
 	is_ready = true;
 	value = hash;
 	prefixv = _prefix;
@@ -213,9 +165,10 @@ void hashval::resolve(unsigned id, const std::string& hash, uint64_t _prefix)
 void hashval::resolve_error(unsigned id, const std::string& err)
 {
 	threads::alock h(mlock);
-	hasher->unlink(*this);
-	if(id != cbid)
+	if(id != cbid || !hasher)
 		return;
+	hasher->unlink(*this);
+	hasher = NULL;
 	is_ready = true;
 	error = err;
 	prefixv = 0;
@@ -230,7 +183,7 @@ void hash::link(hashval& future)
 		unsigned cbid = future.cbid;
 		for(auto& i : queue)
 			if(i.cbid == cbid)
-				i.interested--;
+				i.interested++;
 	}
 	future.prev = last_future;
 	future.next = NULL;
@@ -249,7 +202,7 @@ void hash::unlink(hashval& future)
 		unsigned cbid = future.cbid;
 		for(auto& i : queue)
 			if(i.cbid == cbid)
-				i.interested++;
+				i.interested--;
 	}
 	if(&future == first_future)
 		first_future = future.next;
@@ -261,38 +214,38 @@ void hash::unlink(hashval& future)
 		future.next->prev = future.prev;
 }
 
-hashval hash::operator()(const std::string& filename, uint64_t prefixlen)
+hashval hash::queue_file(const std::string& filename, uint64_t size, uint64_t prefixlen)
 {
 	queue_job j;
 	j.filename = filename;
 	j.prefix = prefixlen;
-	j.size = get_file_size(filename);
-	j.cbid = next_cbid++;
+	j.size = size;
+	j.progress = 0;
+	j.busy = false;
+	//Accounts for the future created below, which is linked before the job is queued.
 	j.interested = 1;
+	{
+		threads::alock h(mlock);
+		j.cbid = next_cbid++;
+	}
 	hashval future(*this, j.cbid);
-	queue.push_back(j);
 	threads::alock h(mlock);
+	queue.push_back(j);
 	total_work += j.size;
 	work_size += j.size;
-	condition.notify_all();
+	condition.notify_one();
 	return future;
 }
 
+hashval hash::operator()(const std::string& filename, uint64_t prefixlen)
+{
+	return queue_file(filename, get_file_size(filename), prefixlen);
+}
+
 hashval hash::operator()(const std::string& filename, std::function<uint64_t(uint64_t)> prefixlen)
 {
-	queue_job j;
-	j.filename = filename;
-	j.size = get_file_size(filename);
-	j.prefix = prefixlen(j.size);
-	j.cbid = next_cbid++;
-	j.interested = 1;
-	hashval future(*this, j.cbid);
-	queue.push_back(j);
-	threads::alock h(mlock);
-	total_work += j.size;
-	work_size += j.size;
-	condition.notify_all();
-	return future;
+	uint64_t size = get_file_size(filename);
+	return queue_file(filename, size, prefixlen(size));
 }
 
 void hash::set_callback(std::function<void(uint64_t, uint64_t)> cb)
@@ -301,16 +254,21 @@ void hash::set_callback(std::function<void(uint64_t, uint64_t)> cb)
 	progresscb = cb;
 }
 
-hash::hash()
+hash::hash(hashindex* _index)
 {
+	index = _index;
 	quitting = false;
 	first_future = NULL;
 	last_future = NULL;
 	next_cbid = 0;
 	total_work = 0;
+	done_work = 0;
 	work_size = 0;
 	progresscb = [](uint64_t x, uint64_t y) -> void {};
-	hash_thread = new threads::thread(thread_trampoline, this);
+	unsigned threadcount = threads::thread::hardware_concurrency();
+	threadcount = max(min(threadcount, max_hash_threads), 1U);
+	for(unsigned i = 0; i < threadcount; i++)
+		hash_threads.push_back(new threads::thread(thread_trampoline, this));
 }
 
 hash::~hash()
@@ -320,100 +278,130 @@ hash::~hash()
 		quitting = true;
 		condition.notify_all();
 	}
-	hash_thread->join();
-	delete hash_thread;
+	for(auto i : hash_threads) {
+		i->join();
+		delete i;
+	}
 	threads::alock h2(global_queue_mutex());
 	while(first_future)
 		first_future->resolve_error(first_future->cbid, "Hasher deleted");
 }
 
+void hash::resolve(unsigned cbid, const std::string& hash, uint64_t prefix)
+{
+	threads::alock h2(global_queue_mutex());
+	hashval* fut = first_future;
+	while(fut) {
+		//Resolving unlinks the future.
+		hashval* next = fut->next;
+		fut->resolve(cbid, hash, prefix);
+		fut = next;
+	}
+}
+
+void hash::resolve_error(unsigned cbid, const std::string& err)
+{
+	threads::alock h2(global_queue_mutex());
+	hashval* fut = first_future;
+	while(fut) {
+		hashval* next = fut->next;
+		fut->resolve_error(cbid, err);
+		fut = next;
+	}
+}
+
 void hash::entrypoint()
 {
-	FILE* fp;
 	while(true) {
+		std::list<queue_job>::iterator job;
 		//Wait for work or quit signal.
 		{
 			threads::alock h(mlock);
-			while(!quitting && queue.empty()) {
-				send_idle();
+			while(true) {
+				if(quitting)
+					return;
+				for(job = queue.begin(); job != queue.end() && job->busy; job++);
+				if(job != queue.end())
+					break;
+				if(queue.empty())
+					send_idle();
 				condition.wait(h);
 			}
-			if(quitting)
-				return;
-			//We hawe work.
-			current_job = queue.begin();
-		}
-
-		//Hash this item.
-		uint64_t progress = 0;
-		std::string cached_hash;
-		fp = NULL;
-		cached_hash = lookup_cache(current_job->filename, current_job->prefix);
-		if(cached_hash != "") {
-			threads::alock h2(global_queue_mutex());
-			for(hashval* fut = first_future; fut != NULL; fut = fut->next)
-				fut->resolve(current_job->cbid, cached_hash, current_job->prefix);
-			goto finished;
-		}
-		fp = fopen(current_job->filename.c_str(), "rb");
-		if(!fp) {
-			threads::alock h2(global_queue_mutex());
-			for(hashval* fut = first_future; fut != NULL; fut = fut->next)
-				fut->resolve_error(current_job->cbid, "Can't open file");
-		} else {
-			sha256 hash;
-			uint64_t toskip = current_job->prefix;
-			while(!feof(fp) && !ferror(fp)) {
-				{
-					threads::alock h(mlock);
-					if(!current_job->interested)
-						goto finished; //Aborted.
-				}
-				unsigned char buf[16384];
-				uint64_t offset = 0;
-				size_t s = fread(buf, 1, sizeof(buf), fp);
-				progress += s;
-				//The first current_job->prefix bytes need to be skipped.
-				offset = min(toskip, (uint64_t)s);
-				toskip -= offset;
-				if(s > offset) hash.write(buf + offset, s - offset);
-				send_callback(progress);
-			}
-			if(ferror(fp)) {
-				threads::alock h2(global_queue_mutex());
-				for(hashval* fut = first_future; fut != NULL; fut = fut->next)
-					fut->resolve_error(current_job->cbid, "Can't read file");
-			} else {
-				std::string hval = hash.read();
-				threads::alock h2(global_queue_mutex());
-				for(hashval* fut = first_future; fut != NULL; fut = fut->next)
-					fut->resolve(current_job->cbid, hval, current_job->prefix);
-				store_cache(current_job->filename, current_job->prefix, hval);
-			}
+			//We have work.
+			job->busy = true;
 		}
-finished:
-		if(fp) fclose(fp);
+		hash_job(*job);
 		//Okay, this work item is complete.
 		{
 			threads::alock h(mlock);
-			total_work -= current_job->size;
-			queue.erase(current_job);
+			total_work -= job->size;
+			done_work -= job->progress;
+			queue.erase(job);
+		}
+		send_callback();
+	}
+}
+
+void hash::hash_job(queue_job& job)
+{
+	std::string cached_hash;
+	if(index && index->lookup(job.filename, job.prefix, cached_hash)) {
+		resolve(job.cbid, cached_hash, job.prefix);
+		return;
+	}
+	FILE* fp = fopen(job.filename.c_str(), "rb");
+	if(!fp) {
+		resolve_error(job.cbid, "Can't open file");
+		return;
+	}
+	sha256 hash;
+	uint64_t toskip = job.prefix;
+	while(!feof(fp) && !ferror(fp)) {
+		unsigned char buf[65536];
+		uint64_t offset = 0;
+		size_t s = fread(buf, 1, sizeof(buf), fp);
+		{
+			threads::alock h(mlock);
+			if(!job.interested) {
+				fclose(fp);
+				return; //Aborted.
+			}
+			job.progress += s;
+			done_work += s;
 		}
-		send_callback(0);
+		//The first job.prefix bytes need to be skipped.
+		offset = min(toskip, (uint64_t)s);
+		toskip -= offset;
+		if(s > offset) hash.write(buf + offset, s - offset);
+		send_callback();
+	}
+	if(ferror(fp)) {
+		fclose(fp);
+		resolve_error(job.cbid, "Can't read file");
+		return;
 	}
+	fclose(fp);
+	std::string hval = hash.read();
+	resolve(job.cbid, hval, job.prefix);
+	if(index)
+		index->store(job.filename, job.prefix, hval);
 }
 
-void hash::send_callback(uint64_t this_completed)
+void hash::send_callback()
 {
 	uint64_t amount;
+	std::function<void(uint64_t, uint64_t)> cb;
+	uint64_t wsize;
 	{
 		threads::alock h(mlock);
-		if(this_completed > total_work)
+		if(done_work > total_work)
 			amount = 0;
 		else
-			amount = total_work - this_completed;
+			amount = total_work - done_work;
+		cb = progresscb;
+		wsize = work_size;
 	}
-	progresscb(amount, work_size);
+	cb(amount, wsize);
 }
 
 void hash::send_idle()
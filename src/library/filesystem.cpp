@@ -4,9 +4,23 @@
 #include <cstring>
 #include <stdexcept>
 #include <iostream>
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
-filesystem::filesystem(const std::string& file)
+filesystem::filesystem(const std::string& file, bool _use_mmap)
 {
+	backing_name = file;
+#if defined(_WIN32) || defined(_WIN64)
+	use_mmap = false;
+#else
+	use_mmap = _use_mmap;
+#endif
+	map_base = NULL;
+	map_size = 0;
+	free_hint = 0;
 	backing.open(file, std::ios_base::out | std::ios_base::app);
 	backing.close();
 	backing.open(file, std::ios_base::in | std::ios_base::out | std::ios_base::binary | std::ios_base::ate);
@@ -17,8 +31,14 @@ filesystem::filesystem(const std::string& file)
 	if(!backing)
 		throw std::runtime_error("Can't get file size.");
 	supercluster_count = (backing_size + SUPERCLUSTER_SIZE - 1) / SUPERCLUSTER_SIZE;
-	for(unsigned i = 0; i < supercluster_count; i++)
+	superclusters.resize(supercluster_count);
+	free_map.resize(supercluster_count * CLUSTERS_PER_SUPER / 64);
+	for(unsigned i = 0; i < supercluster_count; i++) {
 		superclusters[i].load(backing, i);
+		for(unsigned j = 0; j < CLUSTERS_PER_SUPER; j++)
+			if(!superclusters[i].clusters[j])
+				set_free(i * CLUSTERS_PER_SUPER + j, true);
+	}
 	if(supercluster_count == 0) {
 		allocate_cluster();	//Will allocate cluster 2 (main directory).
 		//Write superblock to cluster 1.
@@ -43,39 +63,142 @@ filesystem::filesystem(const std::string& file)
 	}
 }
 
+filesystem::~filesystem()
+{
+	unmap();
+}
+
+void filesystem::set_free(uint32_t cluster, bool free)
+{
+	size_t word = cluster / 64;
+	uint64_t bit = 1ULL << (cluster % 64);
+	if(free) {
+		free_map[word] |= bit;
+		if(word < free_hint)
+			free_hint = word;
+	} else
+		free_map[word] &= ~bit;
+}
+
+void filesystem::unmap()
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+	if(map_base)
+		munmap(map_base, map_size);
+#endif
+	map_base = NULL;
+	map_size = 0;
+}
+
+void filesystem::read_cluster(uint32_t cluster, uint32_t offset, char* data, size_t length)
+{
+	uint64_t base = static_cast<uint64_t>(cluster) * CLUSTER_SIZE;
+#if !defined(_WIN32) && !defined(_WIN64)
+	if(use_mmap) {
+		if(base + CLUSTER_SIZE > map_size) {
+			//The file has grown, map it again.
+			unmap();
+			backing.flush();
+			backing.clear();
+			backing.seekg(0, std::ios_base::end);
+			uint64_t size = backing.tellg();
+			int fd = open(backing_name.c_str(), O_RDONLY);
+			void* m = (fd >= 0 && size) ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+			if(fd >= 0)
+				close(fd);
+			if(m != MAP_FAILED) {
+				map_base = reinterpret_cast<char*>(m);
+				map_size = size;
+			}
+		}
+		if(base + CLUSTER_SIZE <= map_size) {
+			memcpy(data, map_base + base + offset, length);
+			return;
+		}
+	}
+#endif
+	auto i = cache_index.find(cluster);
+	if(i != cache_index.end()) {
+		cache.splice(cache.begin(), cache, i->second);
+		memcpy(data, i->second->data + offset, length);
+		return;
+	}
+	if(length == CLUSTER_SIZE) {
+		//Whole cluster is read, no point in caching it (this is most likely a bulk read).
+		read_backing(base, data, CLUSTER_SIZE);
+		return;
+	}
+	if(cache.size() < FILESYSTEM_CACHE_CLUSTERS)
+		cache.push_front(cached_cluster());
+	else {
+		//Reuse the least recently used entry.
+		cache_index.erase(cache.back().cluster);
+		cache.splice(cache.begin(), cache, --cache.end());
+	}
+	cached_cluster& c = cache.front();
+	c.cluster = cluster;
+	cache_index[cluster] = cache.begin();
+	read_backing(base, c.data, CLUSTER_SIZE);
+	memcpy(data, c.data + offset, length);
+}
+
+void filesystem::read_backing(uint64_t offset, char* data, size_t length)
+{
+	backing.clear();
+	backing.seekg(offset, std::ios_base::beg);
+	backing.read(data, length);
+	//Allocated clusters are always written whole, so short read means the file is damaged.
+	if(!backing)
+		throw std::runtime_error("Can't read data");
+}
+
+void filesystem::write_cluster(uint32_t cluster, uint32_t offset, const char* data, size_t length)
+{
+	backing.clear();
+	backing.seekp(static_cast<uint64_t>(cluster) * CLUSTER_SIZE + offset, std::ios_base::beg);
+	backing.write(data, length);
+	if(!backing)
+		throw std::runtime_error("Can't write data");
+	auto i = cache_index.find(cluster);
+	if(i != cache_index.end())
+		memcpy(i->second->data + offset, data, length);
+	//Make the write visible in the mapping.
+	if(map_base)
+		backing.flush();
+}
 
 uint32_t filesystem::allocate_cluster()
 {
-	for(unsigned i = 0; i < supercluster_count; i++) {
-		supercluster& c = superclusters[i];
-		if(c.free_clusters)
-			for(unsigned j = 0; j < CLUSTERS_PER_SUPER; j++)
-				if(!c.clusters[j]) {
-					c.clusters[j] = 1;
-					c.save(backing, i);
-					//Write zeroes over the cluster.
-					uint32_t cluster = i * CLUSTERS_PER_SUPER + j;
-					char buffer[CLUSTER_SIZE];
-					memset(buffer, 0, CLUSTER_SIZE);
-					backing.seekp(cluster * CLUSTER_SIZE, std::ios_base::beg);
-					backing.write(buffer, CLUSTER_SIZE);
-					if(!backing)
-						throw std::runtime_error("Can't zero out the new cluster");
-					return cluster;
-				}
+	for(size_t i = free_hint; i < free_map.size(); i++) {
+		if(!free_map[i])
+			continue;
+		free_hint = i;
+		uint32_t cluster = i * 64 + __builtin_ctzll(free_map[i]);
+		supercluster& c = superclusters[cluster / CLUSTERS_PER_SUPER];
+		c.clusters[cluster % CLUSTERS_PER_SUPER] = 1;
+		c.save(backing, cluster / CLUSTERS_PER_SUPER);
+		set_free(cluster, false);
+		//Write zeroes over the cluster.
+		char buffer[CLUSTER_SIZE];
+		memset(buffer, 0, CLUSTER_SIZE);
+		write_cluster(cluster, 0, buffer, CLUSTER_SIZE);
+		return cluster;
 	}
+	free_hint = free_map.size();
 	//Create a new supercluster.
+	superclusters.resize(supercluster_count + 1);
+	free_map.resize((supercluster_count + 1) * CLUSTERS_PER_SUPER / 64);
 	supercluster& c = superclusters[supercluster_count];
-	c.free_clusters = 65535;
 	c.clusters[0] = 0xFFFFFFFFU;					//Reserved for cluster table.
 	for(unsigned i = 1; i < CLUSTERS_PER_SUPER; i++)
 		c.clusters[i] = 0;					//Free.
 	if(!supercluster_count)
 		c.clusters[1] = 0xFFFFFFFFU;				//Reserved for superblock.
 	unsigned j = supercluster_count ? 1 : 2;
-	if(!supercluster_count)
-		c.free_clusters--;					//The superblock.
 	c.clusters[j] = 1;						//End of chain.
+	for(unsigned i = 0; i < CLUSTERS_PER_SUPER; i++)
+		if(!c.clusters[i])
+			set_free(supercluster_count * CLUSTERS_PER_SUPER + i, true);
 	c.save(backing, supercluster_count);
 	char blankbuf[2 * CLUSTER_SIZE];
 	memset(blankbuf, 0, 2 * CLUSTER_SIZE);
@@ -103,19 +226,25 @@ void filesystem::free_cluster_chain(uint32_t cluster)
 {
 	if(cluster == 2)
 		throw std::runtime_error("Cluster 2 can't be freed");
-	if(cluster / CLUSTERS_PER_SUPER >= supercluster_count)
-		throw std::runtime_error("Bad cluster to free");
-	uint32_t oldnext = superclusters[cluster / CLUSTERS_PER_SUPER].clusters[cluster % CLUSTERS_PER_SUPER];
-	if(oldnext == 0)
-		throw std::runtime_error("Attempted to free free cluster");
-	if(oldnext == 0xFFFFFFFFU)
-		throw std::runtime_error("Attempted to free system cluster");
-	superclusters[cluster / CLUSTERS_PER_SUPER].clusters[cluster % CLUSTERS_PER_SUPER] = 0;
-	//If there is no next block, or the next block is in different supercluster, save the cluster table.
-	if(oldnext == 1 || oldnext / CLUSTERS_PER_SUPER != cluster / CLUSTERS_PER_SUPER)
-		superclusters[cluster / CLUSTERS_PER_SUPER].save(backing, cluster / CLUSTERS_PER_SUPER);
-	if(oldnext != 1)
-		free_cluster_chain(oldnext);
+	while(true) {
+		if(cluster / CLUSTERS_PER_SUPER >= supercluster_count)
+			throw std::runtime_error("Bad cluster to free");
+		uint32_t oldnext = superclusters[cluster / CLUSTERS_PER_SUPER].clusters[cluster %
+			CLUSTERS_PER_SUPER];
+		if(oldnext == 0)
+			throw std::runtime_error("Attempted to free free cluster");
+		if(oldnext == 0xFFFFFFFFU)
+			throw std::runtime_error("Attempted to free system cluster");
+		superclusters[cluster / CLUSTERS_PER_SUPER].clusters[cluster % CLUSTERS_PER_SUPER] = 0;
+		set_free(cluster, true);
+		//If there is no next block, or the next block is in different supercluster, save the cluster
+		//table.
+		if(oldnext == 1 || oldnext / CLUSTERS_PER_SUPER != cluster / CLUSTERS_PER_SUPER)
+			superclusters[cluster / CLUSTERS_PER_SUPER].save(backing, cluster / CLUSTERS_PER_SUPER);
+		if(oldnext == 1)
+			return;
+		cluster = oldnext;
+	}
 }
 
 size_t filesystem::skip_data(uint32_t& cluster, uint32_t& ptr, uint32_t length)
@@ -163,11 +292,7 @@ size_t filesystem::read_data(uint32_t& cluster, uint32_t& ptr, void* data, uint3
 		//Read to end of cluster.
 		size_t maxread = min(length, max(static_cast<uint32_t>(CLUSTER_SIZE), ptr) - ptr);
 		if(maxread) {
-			backing.clear();
-			backing.seekg(cluster * CLUSTER_SIZE + ptr, std::ios_base::beg);
-			backing.read(_data, maxread);
-			if(!backing)
-				throw std::runtime_error("Can't read data");
+			read_cluster(cluster, ptr, _data, maxread);
 			length -= maxread;
 			_data += maxread;
 			ptr += maxread;
@@ -205,24 +330,12 @@ void filesystem::write_data(uint32_t& cluster, uint32_t& ptr, const void* data,
 		//Write to end of cluster.
 		size_t maxwrite = min(length, max(static_cast<uint32_t>(CLUSTER_SIZE), ptr) - ptr);
 		if(maxwrite) {
-			char buffer[CLUSTER_SIZE];
-			memset(buffer, 0, CLUSTER_SIZE);
 			if(!assigned) {
 				real_cluster = cluster;
 				real_ptr = ptr;
 				assigned = true;
 			}
-			backing.seekp(0, std::ios_base::end);
-			uint64_t backing_size = backing.tellp();
-			if(backing_size > cluster * CLUSTER_SIZE) {
-				backing.seekg(cluster * CLUSTER_SIZE, std::ios_base::beg);
-				backing.read(buffer, CLUSTER_SIZE);
-			}
-			memcpy(buffer + ptr, _data, maxwrite);
-			backing.seekp(cluster * CLUSTER_SIZE, std::ios_base::beg);
-			backing.write(buffer, CLUSTER_SIZE);
-			if(!backing)
-				throw std::runtime_error("Can't write data");
+			write_cluster(cluster, ptr, _data, maxwrite);
 			length -= maxwrite;
 			_data += maxwrite;
 			ptr += maxwrite;
@@ -264,11 +377,8 @@ void filesystem::supercluster::load(std::fstream& s, uint32_t index)
 	s.read(buffer, CLUSTER_SIZE);
 	if(!s)
 		throw std::runtime_error("Can't read cluster table");
-	free_clusters = 0;
-	for(unsigned i = 0; i < CLUSTERS_PER_SUPER; i++) {
-		if(!(clusters[i] = serialization::u32b(buffer + 4 * i)))
-			free_clusters++;
-	}
+	for(unsigned i = 0; i < CLUSTERS_PER_SUPER; i++)
+		clusters[i] = serialization::u32b(buffer + 4 * i);
 }
 
 void filesystem::supercluster::save(std::fstream& s, uint32_t index)
@@ -6,6 +6,7 @@
 #include "minmax.hpp"
 #include "utf8.hpp"
 #include <functional>
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <list>
@@ -639,6 +640,79 @@ bool object::kill_request(void* obj) throw()
 	return false;
 }
 
+namespace
+{
+	//Max number of cached text runs.
+	const size_t run_cache_entries = 256;
+	//Max size (in pixels) of cached text run.
+	const size_t run_cache_maxpixels = 65536;
+
+	//Table for doubling bits of a byte (each bit becomes two adjacent bits).
+	struct bit_doubler
+	{
+		bit_doubler()
+		{
+			for(unsigned i = 0; i < 256; i++) {
+				uint16_t v = 0;
+				for(unsigned j = 0; j < 8; j++)
+					if((i >> j) & 1)
+						v |= 3 << (2 * j);
+				table[i] = v;
+			}
+		}
+		uint32_t operator()(uint32_t row, bool wide)
+		{
+			if(wide)
+				return ((uint32_t)table[row >> 8] << 16) | table[row & 0xFF];
+			else
+				return table[row];
+		}
+		uint16_t table[256];
+	};
+
+	bit_doubler& double_bits()
+	{
+		static bit_doubler x;
+		return x;
+	}
+
+	template<typename T> void blit_span(T* r, size_t n, color c)
+	{
+		if(!c)
+			return;		//Transparent, nothing to do.
+		if(c.inv == 0) {
+			//Opaque, the result does not depend on the old pixel.
+			T v = c.blend(static_cast<T>(0));
+			for(size_t j = 0; j < n; j++)
+				r[j] = v;
+		} else
+			for(size_t j = 0; j < n; j++)
+				r[j] = c.blend(r[j]);
+	}
+
+	template<typename T> void blit_run_row(T* r, const uint8_t* m, size_t n, color& fg, color& bg)
+	{
+		//Blend spans of equal mask values at once.
+		size_t j = 0;
+		while(j < n) {
+			size_t k = j + 1;
+			while(k < n && m[k] == m[j])
+				k++;
+			if(m[j])
+				blit_span(r + j, k - j, (m[j] == 2) ? fg : bg);
+			j = k;
+		}
+	}
+}
+
+bool font::text_run_key::operator<(const text_run_key& k) const
+{
+	if(alignx != k.alignx) return (alignx < k.alignx);
+	if(hdbl != k.hdbl) return (hdbl < k.hdbl);
+	if(vdbl != k.vdbl) return (vdbl < k.vdbl);
+	return (str < k.str);
+}
+
 font::font()
 {
 	bad_glyph_data[0] = 0x018001AAU;
@@ -647,6 +721,9 @@ font::font()
 	bad_glyph_data[3] = 0x55800180U;
 	bad_glyph.wide = false;
 	bad_glyph.data = bad_glyph_data;
+	bmp_table.resize(256);
+	builtin = NULL;
+	run_cache_clock = 0;
 }
 
 void font::load_hex_glyph(const char* data, size_t size)
@@ -707,14 +784,64 @@ void font::load_hex(const char* data, size_t size)
 	glyphs[32].offset = memory.size() - 4;
 	for(auto& i : glyphs)
 		i.second.data = &memory[i.second.offset];
+	rebuild_bmp_table();
+}
+
+void font::rebuild_bmp_table()
+{
+	for(auto& i : bmp_table)
+		i.clear();
+	for(auto& i : glyphs) {
+		if(i.first > 0xFFFF)
+			break;
+		auto& page = bmp_table[i.first >> 8];
+		if(page.empty())
+			page.resize(256, &bad_glyph);
+		page[i.first & 0xFF] = &i.second;
+	}
+	threads::alock h(run_cache_lock);
+	run_cache.clear();
 }
 
 const font::glyph& font::get_glyph(uint32_t glyph) throw()
 {
-	if(glyphs.count(glyph))
-		return glyphs[glyph];
-	else
-		return bad_glyph;
+	if(glyph <= 0xFFFF) {
+		auto& page = bmp_table[glyph >> 8];
+		if(!page.empty() && page[glyph & 0xFF] != &bad_glyph)
+			return *page[glyph & 0xFF];
+		const struct glyph* g = get_builtin_glyph(glyph);
+		return g ? *g : bad_glyph;
+	}
+	auto i = glyphs.find(glyph);
+	if(i != glyphs.end())
+		return i->second;
+	const struct glyph* g = get_builtin_glyph(glyph);
+	return g ? *g : bad_glyph;
+}
+
+const font::glyph* font::get_builtin_glyph(uint32_t glyph) throw()
+{
+	if(!builtin)
+		return NULL;
+	if(glyph <= 0xFFFF) {
+		int16_t page = builtin->bmp_pagemap[glyph >> 8];
+		if(page < 0)
+			return NULL;
+		uint32_t idx = builtin->bmp_pages[256 * page + (glyph & 0xFF)];
+		return idx ? &builtin->glyphs[idx - 1] : NULL;
+	}
+	const uint32_t* end = builtin->codepoints + builtin->count;
+	const uint32_t* i = std::lower_bound(builtin->codepoints, end, glyph);
+	if(i == end || *i != glyph)
+		return NULL;
+	return &builtin->glyphs[i - builtin->codepoints];
+}
+
+void font::load_builtin(const builtin_data& data)
+{
+	builtin = &data;
+	threads::alock h(run_cache_lock);
+	run_cache.clear();
 }
 
 std::set<uint32_t> font::get_glyphs_set()
@@ -722,6 +849,9 @@ std::set<uint32_t> font::get_glyphs_set()
 	std::set<uint32_t> out;
 	for(auto& i : glyphs)
 		out.insert(i.first);
+	if(builtin)
+		for(size_t i = 0; i < builtin->count; i++)
+			out.insert(builtin->codepoints[i]);
 	return out;
 }
 
@@ -787,99 +917,99 @@ uint32_t font::get_width(const std::string& string)
 template<bool X> void font::render(struct fb<X>& scr, int32_t x, int32_t y, const std::string& text,
 	color fg, color bg, bool hdbl, bool vdbl) throw()
 {
+	if(!fg && !bg)
+		return;
 	x += scr.get_origin_x();
 	y += scr.get_origin_y();
-	size_t swidth = scr.get_width();
-	size_t sheight = scr.get_height();
-
-	for_each_glyph(text, x, hdbl, vdbl, [this, x, y, &scr, swidth, sheight, &fg, &bg](uint32_t lx, uint32_t ly,
-		const glyph& g, bool hdbl, bool vdbl) {
-		//Render this glyph at x + lx, y + ly.
-		int32_t gx = x + lx;
-		int32_t gy = y + ly;
-		//Don't draw characters completely off-screen.
-		if(gy <= (vdbl ? -32 : -16) || gy >= (ssize_t)sheight)
-			return;
-		if(gx <= -(hdbl ? 2 : 1) * (g.wide ? 16 : 8) || gx >= (ssize_t)swidth)
-			return;
-		//Compute the bounding box.
-		uint32_t xstart = 0;
-		uint32_t ystart = 0;
-		uint32_t xlength = (hdbl ? 2 : 1) * (g.wide ? 16 : 8);
-		uint32_t ylength = (vdbl ? 32 : 16);
-		if(gx < 0)	xstart = -gx;
-		if(gy < 0)	ystart = -gy;
-		xlength -= xstart;
-		ylength -= ystart;
-		if(gx + xstart + xlength > swidth)	xlength = swidth - (gx + xstart);
-		if(gy + ystart + ylength > sheight)	ylength = sheight - (gy + ystart);
-		if(g.data)
-			for(size_t i = 0; i < ylength; i++) {
-				typename fb<X>::element_t* r = scr.rowptr(gy + ystart + i) +
-					(gx + xstart);
-				uint32_t _y = (i + ystart) >> (vdbl ? 1 : 0);
-				uint32_t d = g.data[_y >> (g.wide ? 1 : 2)];
-				if(g.wide)
-					d >>= 16 - ((_y & 1) << 4);
-				else
-					d >>= 24 - ((_y & 3) << 3);
-				if(hdbl)
-					for(size_t j = 0; j < xlength; j++) {
-						uint32_t b = (g.wide ? 15 : 7) - ((j + xstart) >> 1);
-						if(((d >> b) & 1) != 0)
-							fg.apply(r[j]);
-						else
-							bg.apply(r[j]);
-					}
-				else
-					for(size_t j = 0; j < xlength; j++) {
-						uint32_t b = (g.wide ? 15 : 7) - (j + xstart);
-						if(((d >> b) & 1) != 0)
-							fg.apply(r[j]);
-						else
-							bg.apply(r[j]);
-					}
-			}
-		else
-			for(size_t i = 0; i < ylength; i++) {
-				typename fb<X>::element_t* r = scr.rowptr(gy + ystart + i) + (gx + xstart);
-				for(size_t j = 0; j < xlength; j++)
-					bg.apply(r[j]);
-			}
-	});
+	ssize_t swidth = scr.get_width();
+	ssize_t sheight = scr.get_height();
+
+	std::shared_ptr<const text_run> run;
+	try {
+		run = get_text_run(text, x, hdbl, vdbl);
+	} catch(...) {
+		return;
+	}
+	//Clip the run to the screen.
+	ssize_t xstart = std::max((ssize_t)0, (ssize_t)-x);
+	ssize_t ystart = std::max((ssize_t)0, (ssize_t)-y);
+	ssize_t xend = std::min((ssize_t)run->width, swidth - x);
+	ssize_t yend = std::min((ssize_t)run->height, sheight - y);
+	if(xstart >= xend || ystart >= yend)
+		return;
+	for(ssize_t i = ystart; i < yend; i++)
+		blit_run_row(scr.rowptr(y + i) + (x + xstart), &run->mask[i * run->width + xstart], xend - xstart,
+			fg, bg);
 }
 
 void font::render(uint8_t* buf, size_t stride, const std::string& str, uint32_t alignx, bool hdbl, bool vdbl)
 {
-	for_each_glyph(str, alignx, hdbl, vdbl, [this, buf, stride]
+	auto run = get_text_run(str, alignx, hdbl, vdbl);
+	const uint8_t* m = run->width ? &run->mask[0] : NULL;
+	for(size_t i = 0; i < run->height; i++) {
+		for(size_t j = 0; j < run->width; j++)
+			if(m[j])
+				buf[j] = m[j] >> 1;
+		m += run->width;
+		buf += stride;
+	}
+}
+
+void font::render_run(uint8_t* buf, size_t stride, const std::string& str, uint32_t alignx, bool hdbl,
+	bool vdbl)
+{
+	for_each_glyph(str, alignx, hdbl, vdbl, [buf, stride]
 		(uint32_t lx, uint32_t ly, const glyph& g, bool hdbl, bool vdbl) {
 		uint8_t* ptr = buf + (ly * stride + lx);
 		size_t xlength = (g.wide ? 16 : 8) << (hdbl ? 1 : 0);
 		size_t height = 16 << (vdbl ? 1 : 0);
 
-		if(g.data)
-			for(size_t i = 0; i < height; i++) {
-				uint32_t _y = i >> (vdbl ? 1 : 0);
-				uint32_t d = g.data[_y >> (g.wide ? 1 : 2)];
-				if(g.wide)
-					d >>= 16 - ((_y & 1) << 4);
-				else
-					d >>= 24 - ((_y & 3) << 3);
-				if(hdbl)
-					for(size_t j = 0; j < xlength; j++) {
-						uint32_t b = (g.wide ? 15 : 7) - (j >> 1);
-						ptr[j] = ((d >> b) & 1);
-					}
-				else
-					for(size_t j = 0; j < xlength; j++) {
-						uint32_t b = (g.wide ? 15 : 7) - j;
-						ptr[j] = ((d >> b) & 1);
-					}
-				ptr += stride;
-			}
+		for(size_t i = 0; i < height; i++) {
+			uint32_t d = g.data ? g.read_row(i >> (vdbl ? 1 : 0)) : 0;
+			if(hdbl)
+				d = double_bits()(d, g.wide);
+			for(size_t j = 0; j < xlength; j++)
+				ptr[j] = 1 + ((d >> (xlength - 1 - j)) & 1);
+			ptr += stride;
+		}
 	});
 }
 
+std::shared_ptr<const font::text_run> font::get_text_run(const std::string& str, uint32_t alignx, bool hdbl,
+	bool vdbl)
+{
+	text_run_key k;
+	k.str = str;
+	//Alignment only matters for tabs.
+	k.alignx = (str.find('\t') < str.length()) ? alignx : 0;
+	k.hdbl = hdbl;
+	k.vdbl = vdbl;
+	threads::alock h(run_cache_lock);
+	auto i = run_cache.find(k);
+	if(i != run_cache.end()) {
+		i->second.second = ++run_cache_clock;
+		return i->second.first;
+	}
+	std::shared_ptr<text_run> r(new text_run);
+	auto size = get_metrics(str, k.alignx, hdbl, vdbl);
+	r->width = size.first;
+	r->height = size.second;
+	r->mask.resize(r->width * r->height);
+	if(r->width)
+		render_run(&r->mask[0], r->width, str, k.alignx, hdbl, vdbl);
+	if(r->width * r->height <= run_cache_maxpixels) {
+		if(run_cache.size() >= run_cache_entries) {
+			//Evict the least recently used entry.
+			auto oldest = run_cache.begin();
+			for(auto j = run_cache.begin(); j != run_cache.end(); j++)
+				if(j->second.second < oldest->second.second)
+					oldest = j;
+			run_cache.erase(oldest);
+		}
+		run_cache[k] = std::make_pair(r, ++run_cache_clock);
+	}
+	return r;
+}
 
 void font::for_each_glyph(const std::string& str, uint32_t alignx, bool xdbl, bool ydbl,
 	std::function<void(uint32_t x, uint32_t y, const glyph& g, bool xdbl, bool ydbl)> cb)
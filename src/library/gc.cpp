@@ -1,30 +1,237 @@
 #include "gc.hpp"
-#include <list>
-#include <iostream>
-#include <set>
 
 namespace GC
 {
 namespace
 {
-	std::set<item*>* gc_items;
+	//Minor collection is done when young generation has this many objects.
+	const size_t young_limit = 4096;
+	//Major collection is started automatically when old generation exceeds this (or twice the size after last
+	//major collection, whichever is greater).
+	const size_t min_old_limit = 16384;
+
+	enum phase_t
+	{
+		IDLE,		//No major collection in progress.
+		ROOTS,		//Scanning for roots.
+		MARK,		//Tracing from gray objects.
+		SWEEP,		//Deleting unmarked old objects.
+	};
+
+	struct gen_list
+	{
+		item* head;
+		item* tail;
+		size_t count;
+	};
+
+	//All fields zero-initialized before any constructors run.
+	struct gc_state
+	{
+		gen_list young;
+		gen_list old;
+		uint64_t young_serial;		//Serial of the current young generation.
+		uint64_t epoch;			//Current marking epoch.
+		item* gray;			//Gray list.
+		item* remembered;		//Old objects that may reference young objects.
+		phase_t phase;
+		bool minor;			//Minor collection in progress.
+		bool major_requested;
+		item* cursor;			//Root scan / sweep position.
+		bool cursor_young;		//Root scan is in young generation.
+		size_t old_limit;
+	} st;
 }
 
+struct collector
+{
+	static gen_list& gen_of(item* i)
+	{
+		return (i->generation == st.young_serial) ? st.young : st.old;
+	}
+	static void link(item* i)
+	{
+		gen_list& g = st.young;
+		i->generation = st.young_serial;
+		i->prev = NULL;
+		i->next = g.head;
+		if(g.head)
+			g.head->prev = i;
+		else
+			g.tail = i;
+		g.head = i;
+		g.count++;
+	}
+	static void unlink(item* i)
+	{
+		gen_list& g = gen_of(i);
+		if(i->prev)
+			i->prev->next = i->next;
+		else
+			g.head = i->next;
+		if(i->next)
+			i->next->prev = i->prev;
+		else
+			g.tail = i->prev;
+		g.count--;
+	}
+	//Move the whole young generation to the old one.
+	static void promote()
+	{
+		if(st.young.head) {
+			st.young.tail->next = st.old.head;
+			if(st.old.head)
+				st.old.head->prev = st.young.tail;
+			else
+				st.old.tail = st.young.tail;
+			st.old.head = st.young.head;
+			st.old.count += st.young.count;
+		}
+		st.young.head = st.young.tail = NULL;
+		st.young.count = 0;
+		st.young_serial++;
+		//No young objects left, so nothing to remember.
+		while(st.remembered) {
+			item* i = st.remembered;
+			st.remembered = i->remembered_next;
+			i->remembered = false;
+		}
+	}
+	static bool marking()
+	{
+		return st.phase == ROOTS || st.phase == MARK;
+	}
+	static void push_gray(item* i)
+	{
+		i->gray = true;
+		i->gray_next = st.gray;
+		st.gray = i;
+	}
+	static item* pop_gray()
+	{
+		item* i = st.gray;
+		st.gray = i->gray_next;
+		i->gray = false;
+		return i;
+	}
+	static void shade(item* i)
+	{
+		if(i->epoch == st.epoch)
+			return;
+		i->epoch = st.epoch;
+		push_gray(i);
+	}
+	static void remove_from(item*& list, item* i, item* item::*link)
+	{
+		for(item** p = &list; *p; p = &((*p)->*link))
+			if(*p == i) {
+				*p = i->*link;
+				return;
+			}
+	}
+	static void minor()
+	{
+		st.epoch++;
+		st.minor = true;
+		for(item* i = st.young.head; i; i = i->next)
+			if(i->root_count)
+				shade(i);
+		for(item* i = st.remembered; i; i = i->remembered_next)
+			i->trace();
+		while(st.gray)
+			pop_gray()->trace();
+		st.minor = false;
+		for(item* i = st.young.head; i;) {
+			item* n = i->next;
+			if(i->epoch != st.epoch)
+				delete i;
+			i = n;
+		}
+		promote();
+	}
+	static void start_major()
+	{
+		st.epoch++;
+		st.phase = ROOTS;
+		st.cursor = st.old.head;
+		st.cursor_young = false;
+		st.major_requested = false;
+	}
+	static void step()
+	{
+		switch(st.phase) {
+		case IDLE:
+			return;
+		case ROOTS:
+			if(!st.cursor) {
+				if(st.cursor_young)
+					st.phase = MARK;
+				else {
+					st.cursor_young = true;
+					st.cursor = st.young.head;
+				}
+				return;
+			} else {
+				item* i = st.cursor;
+				st.cursor = i->next;
+				if(i->root_count)
+					shade(i);
+			}
+			return;
+		case MARK:
+			if(st.gray)
+				pop_gray()->trace();
+			else {
+				//Everything reachable is marked. Anything created from now on is live until next
+				//collection.
+				promote();
+				st.phase = SWEEP;
+				st.cursor = st.old.head;
+			}
+			return;
+		case SWEEP:
+			if(!st.cursor) {
+				st.phase = IDLE;
+				st.old_limit = 2 * st.old.count;
+			} else {
+				item* i = st.cursor;
+				st.cursor = i->next;
+				if(i->epoch != st.epoch)
+					delete i;
+			}
+			return;
+		}
+	}
+};
+
 item::item()
 {
-	if(!gc_items) gc_items = new std::set<item*>;
-	gc_items->insert(this);
 	root_count = 1;
+	gray = false;
+	remembered = false;
+	collector::link(this);
+	epoch = st.epoch;
+	//Objects created while marking might get references to objects not yet marked.
+	if(collector::marking())
+		collector::push_gray(this);
 }
 
 item::~item()
 {
-	gc_items->erase(this);
+	if(st.cursor == this)
+		st.cursor = next;
+	collector::unlink(this);
+	if(gray)
+		collector::remove_from(st.gray, this, &item::gray_next);
+	if(remembered)
+		collector::remove_from(st.remembered, this, &item::remembered_next);
 }
 
 void item::mark_root()
 {
 	root_count++;
+	if(collector::marking())
+		collector::shade(this);
 }
 
 void item::unmark_root()
@@ -32,32 +239,52 @@ void item::unmark_root()
 	if(root_count) root_count--;
 }
 
-void item::do_gc()
+void item::write_barrier()
 {
-	if(!gc_items) return;
-	for(auto i : *gc_items)
-		i->reachable = false;
-	for(auto i : *gc_items) {
-		if(i->root_count) {
-			i->mark();
-		}
-	}
-	for(auto i = gc_items->begin(); i != gc_items->end();) {
-		if(!(*i)->reachable) {
-			auto ptr = i;
-			i++;
-			delete *ptr;
-		} else
-			i++;
+	if(generation != st.young_serial && !remembered) {
+		remembered = true;
+		remembered_next = st.remembered;
+		st.remembered = this;
 	}
+	//Already traced objects need to be traced again.
+	if(collector::marking() && epoch == st.epoch && !gray)
+		collector::push_gray(this);
 }
 
 void item::mark()
 {
-	bool was_reachable = reachable;
-	reachable = true;
-	if(!was_reachable) {
-		trace();
+	//Minor collections do not trace through the old generation, the remembered set covers it.
+	if(st.minor && generation != st.young_serial)
+		return;
+	collector::shade(this);
+}
+
+void item::do_gc()
+{
+	while(st.phase != IDLE)
+		collector::step();
+	collector::start_major();
+	while(st.phase != IDLE)
+		collector::step();
+}
+
+void item::request_gc()
+{
+	st.major_requested = true;
+}
+
+bool item::gc_step(size_t budget)
+{
+	if(st.phase == IDLE) {
+		if(st.young.count >= young_limit)
+			collector::minor();
+		size_t limit = (st.old_limit > min_old_limit) ? st.old_limit : min_old_limit;
+		if(!st.major_requested && st.old.count <= limit)
+			return false;
+		collector::start_major();
 	}
+	for(size_t i = 0; i < budget && st.phase != IDLE; i++)
+		collector::step();
+	return (st.phase != IDLE);
 }
 }
@@ -776,13 +776,13 @@ namespace
 			}
 			throw error(error::INTERNAL, "Internal error (shouldn't be here)");
 		}
-		static expr_val op_lnot(std::vector<std::function<expr_val&()>> promises)
+		static expr_val op_lnot(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			if(promises.size() != 1)
 				throw error(error::ARGCOUNT, "logical not takes 1 argument");
 			return expr_val(boolean_tag(), !(promises[0]().toboolean()));
 		}
-		static expr_val op_lor(std::vector<std::function<expr_val&()>> promises)
+		static expr_val op_lor(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			if(promises.size() != 2)
 				throw error(error::ARGCOUNT, "logical or takes 2 arguments");
@@ -790,7 +790,7 @@ namespace
 				return expr_val(boolean_tag(), true);
 			return expr_val(boolean_tag(), promises[1]().toboolean());
 		}
-		static expr_val op_land(std::vector<std::function<expr_val&()>> promises)
+		static expr_val op_land(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			if(promises.size() != 2)
 				throw error(error::ARGCOUNT, "logical and takes 2 arguments");
@@ -798,7 +798,7 @@ namespace
 				return expr_val(boolean_tag(), false);
 			return expr_val(boolean_tag(), promises[1]().toboolean());
 		}
-		static expr_val fun_if(std::vector<std::function<expr_val&()>> promises)
+		static expr_val fun_if(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			if(promises.size() == 2) {
 				if((promises[0]().toboolean()))
@@ -813,7 +813,7 @@ namespace
 			} else
 				throw error(error::ARGCOUNT, "if takes 2 or 3 arguments");
 		}
-		static expr_val fun_select(std::vector<std::function<expr_val&()>> promises)
+		static expr_val fun_select(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			for(auto& i : promises) {
 				expr_val v = i();
@@ -822,7 +822,7 @@ namespace
 			}
 			return expr_val(boolean_tag(), false);
 		}
-		static expr_val fun_pyth(std::vector<std::function<expr_val&()>> promises)
+		static expr_val fun_pyth(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			std::vector<expr_val> v;
 			for(auto& i : promises)
@@ -837,7 +837,7 @@ namespace
 			return n.sqrt();
 		}
 		template<expr_val (*T)(expr_val& a, expr_val& b)>
-		static expr_val fun_fold(std::vector<std::function<expr_val&()>> promises)
+		static expr_val fun_fold(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			if(!promises.size())
 				return expr_val(boolean_tag(), false);
@@ -873,7 +873,7 @@ namespace
 			return mul(a, b);
 		}
 		template<expr_val (*T)(expr_val a, expr_val b)>
-		static expr_val op_binary(std::vector<std::function<expr_val&()>> promises)
+		static expr_val op_binary(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			if(promises.size() != 2)
 				throw error(error::ARGCOUNT, "Operation takes 2 arguments");
@@ -882,7 +882,7 @@ namespace
 			return T(a, b);
 		}
 		template<expr_val (*T)(expr_val a)>
-		static expr_val op_unary(std::vector<std::function<expr_val&()>> promises)
+		static expr_val op_unary(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			if(promises.size() != 1)
 				throw error(error::ARGCOUNT, "Operation takes 1 argument");
@@ -890,7 +890,7 @@ namespace
 			return T(a);
 		}
 		template<expr_val (*T)(expr_val a),expr_val (*U)(expr_val a, expr_val b)>
-		static expr_val op_unary_binary(std::vector<std::function<expr_val&()>> promises)
+		static expr_val op_unary_binary(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			if(promises.size() == 1)
 				return T(promises[0]());
@@ -936,7 +936,7 @@ namespace
 		{
 			return expr_val_numeric::shift(a.as_numeric(), b.as_numeric(), true);
 		}
-		static expr_val op_pi(std::vector<std::function<expr_val&()>> promises)
+		static expr_val op_pi(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			return expr_val_numeric::op_pi();
 		}
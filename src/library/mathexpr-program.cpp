@@ -0,0 +1,161 @@
+#include "mathexpr-program.hpp"
+
+namespace mathexpr
+{
+program::program()
+{
+	round = 1;
+}
+
+program::~program()
+{
+	for(auto& i : code) {
+		if(i.prepared)
+			i.fn->unprepare(i.prepared);
+		if(i.reg)
+			i.type->deallocate(i.reg);
+	}
+}
+
+unsigned program::add(GC::pointer<mathexpr> root)
+{
+	roots.push_back(root);
+	return compile(root.as_pointer());
+}
+
+void program::reset()
+{
+	round++;
+}
+
+value program::evaluate(unsigned entry)
+{
+	return eval(entry);
+}
+
+unsigned program::compile(mathexpr* node)
+{
+	if(compiled.count(node))
+		return compiled[node];
+	//Reserve the slot first, so that circular references terminate.
+	unsigned idx = code.size();
+	compiled[node] = idx;
+	insn i;
+	i.type = &node->type;
+	i.fn = NULL;
+	i.prepared = NULL;
+	i.reg = NULL;
+	i.result.type = &node->type;
+	i.result._value = NULL;
+	i.round = 0;
+	i.state = S_DONE;
+	i.errcode = error::UNKNOWN;
+	switch(node->state) {
+	case mathexpr::FIXED:
+		i.op = OP_FIXED;
+		i.result._value = node->_value;
+		break;
+	case mathexpr::UNDEFINED:
+		i.op = OP_UNDEFINED;
+		break;
+	case mathexpr::FORWARD:
+	case mathexpr::FORWARD_EVALING:
+	case mathexpr::FORWARD_EVALD:
+		i.op = OP_FORWARD;
+		break;
+	default:
+		i.op = OP_CALL;
+		i.fn = node->fn;
+		for(auto j : node->arguments)
+			if(&j->type != &node->type)
+				i.op = OP_TYPEERROR;
+		break;
+	}
+	code.push_back(i);
+	if(code[idx].op == OP_UNDEFINED || code[idx].op == OP_FIXED || code[idx].op == OP_TYPEERROR)
+		return idx;
+	//Compiling the arguments may reallocate the code array.
+	std::vector<unsigned> args;
+	for(auto j : node->arguments)
+		args.push_back(compile(j));
+	insn& c = code[idx];
+	c.args = args;
+	if(c.op == OP_CALL) {
+		c.reg = c.type->allocate();
+		c.result._value = c.reg;
+		std::vector<std::function<value()>> promises;
+		for(auto j : args)
+			promises.push_back([this, j]() { return eval(j); });
+		c.prepared = c.fn->prepare(promises);
+		fold(idx);
+	}
+	return idx;
+}
+
+void program::fold(unsigned i)
+{
+	insn& c = code[i];
+	if(!c.fn->is_pure())
+		return;
+	for(auto j : c.args)
+		if(code[j].op != OP_FIXED)
+			return;
+	try {
+		c.fn->evaluate_prepared(c.result, c.prepared);
+		c.op = OP_FIXED;
+	} catch(...) {
+		//Leave it to be evaluated (and fail) at runtime.
+	}
+}
+
+value program::eval(unsigned i)
+{
+	insn& c = code[i];
+	switch(c.op) {
+	case OP_FIXED:
+		return c.result;
+	case OP_UNDEFINED:
+		throw error(error::UNDEFINED, "Undefined variable");
+	case OP_TYPEERROR:
+		throw error(error::TYPE_MISMATCH, "Types for function mismatch");
+	case OP_FORWARD:
+	case OP_CALL:
+		break;
+	}
+	if(c.round == round) {
+		if(c.state == S_DONE)
+			return c.result;
+		if(c.state == S_BUSY) {
+			c.state = S_FAILED;
+			c.errcode = error::CIRCULAR;
+			c.errmsg = "Circular dependency";
+		}
+		throw error(c.errcode, c.errmsg);
+	}
+	c.round = round;
+	c.state = S_BUSY;
+	try {
+		if(c.op == OP_FORWARD)
+			c.result = eval(c.args[0]);
+		else
+			c.fn->evaluate_prepared(c.result, c.prepared);
+		c.state = S_DONE;
+		return c.result;
+	} catch(error& e) {
+		c.state = S_FAILED;
+		c.errcode = e.get_code();
+		c.errmsg = e.what();
+		throw;
+	} catch(std::exception& e) {
+		c.state = S_FAILED;
+		c.errcode = error::UNKNOWN;
+		c.errmsg = e.what();
+		throw;
+	} catch(...) {
+		c.state = S_FAILED;
+		c.errcode = error::UNKNOWN;
+		c.errmsg = "Unknown error";
+		throw;
+	}
+}
+}
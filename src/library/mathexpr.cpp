@@ -18,6 +18,26 @@ operinfo::~operinfo()
 {
 }
 
+void* operinfo::prepare(const std::vector<std::function<value()>>& promises)
+{
+	return new std::vector<std::function<value()>>(promises);
+}
+
+void operinfo::evaluate_prepared(value target, void* prepared)
+{
+	evaluate(target, *(std::vector<std::function<value()>>*)prepared);
+}
+
+void operinfo::unprepare(void* prepared)
+{
+	delete (std::vector<std::function<value()>>*)prepared;
+}
+
+bool operinfo::is_pure()
+{
+	return false;
+}
+
 typeinfo::~typeinfo()
 {
 }
@@ -124,6 +144,7 @@ mathexpr& mathexpr::operator=(const mathexpr& m)
 	m.owns_operator = false;
 	std::swap(arguments, _arguments);
 	std::swap(_error, _xerror);
+	write_barrier();
 	return *this;
 }
 
@@ -3,10 +3,49 @@
 #include "serialization.hpp"
 #include "int24.hpp"
 #include "string.hpp"
+#include "sha256.hpp"
 #include <algorithm>
 
 namespace
 {
+	//Lookup pages cover addresses below lookup_limit.
+	const unsigned lookup_page_shift = 12;
+	const uint64_t lookup_limit = 1ULL << 25;
+	const uint32_t no_page = 0xFFFFFFFFU;
+
+	std::atomic<uint64_t> next_snapshot_serial(1);
+
+	//Last region found by lookups of this thread. Serials are never reused, so stale entries never match.
+	struct last_hit
+	{
+		uint64_t serial;
+		memory_space::region* r;
+		uint64_t base;
+	};
+	thread_local last_hit last_phys;
+	thread_local last_hit last_linear;
+
+	//Fill lookup page table for sorted ranges.
+	void build_pages(std::vector<uint32_t>& pages, const std::vector<std::pair<uint64_t, uint64_t>>& ranges)
+	{
+		uint64_t limit = 0;
+		for(auto& i : ranges)
+			if(i.first < lookup_limit)
+				limit = max(limit, min(i.first + i.second, lookup_limit));
+		pages.clear();
+		pages.resize((limit + (1ULL << lookup_page_shift) - 1) >> lookup_page_shift, no_page);
+		for(size_t i = 0; i < ranges.size(); i++) {
+			if(ranges[i].first >= lookup_limit)
+				continue;
+			uint64_t end = min(ranges[i].first + ranges[i].second, lookup_limit);
+			//Only pages fully inside the range.
+			uint64_t first = (ranges[i].first + (1ULL << lookup_page_shift) - 1) >> lookup_page_shift;
+			uint64_t last = end >> lookup_page_shift;
+			for(uint64_t j = first; j < last; j++)
+				pages[j] = i;
+		}
+	}
+
 	template<typename T, bool linear> inline T internal_read(memory_space& m, uint64_t addr)
 	{
 		std::pair<memory_space::region*, uint64_t> g;
@@ -34,9 +73,10 @@ namespace
 			g = m.lookup(addr);
 		if(!g.first || g.first->readonly || g.second + sizeof(T) > g.first->size)
 			return false;
-		if(g.first->direct_map)
+		if(g.first->direct_map) {
 			serialization::write_endian(g.first->direct_map + g.second, value, g.first->endian);
-		else {
+			g.first->mark_dirty(g.second, sizeof(T));
+		} else {
 			T buf;
 			serialization::write_endian(&buf, value, g.first->endian);
 			g.first->write(g.second, &buf, sizeof(T));
@@ -68,6 +108,7 @@ namespace
 				return false;
 			uint64_t maxcopy = min(static_cast<uint64_t>(bsize), r.size - offset);
 			memcpy(r.direct_map + offset, buffer, maxcopy);
+			r.mark_dirty(offset, maxcopy);
 			return true;
 		} else
 			return r.write(offset, buffer, bsize);
@@ -96,49 +137,104 @@ bool memory_space::region::write(uint64_t offset, const void* buffer, size_t tsi
 		return false;
 	uint64_t maxcopy = min(static_cast<uint64_t>(tsize), size - offset);
 	memcpy(direct_map + offset, buffer, maxcopy);
+	mark_dirty(offset, maxcopy);
 	return true;
 }
 
+void memory_space::region::mark_dirty(uint64_t offset, uint64_t tsize)
+{
+	if(!dirty_gen || !tsize || offset >= size)
+		return;
+	uint64_t last = min(offset + tsize, size) - 1;
+	for(uint64_t i = offset >> page_hash::page_shift; i <= (last >> page_hash::page_shift); i++)
+		dirty_gen[i]++;
+}
+
+memory_space::memory_space()
+{
+	snapshot* s = new snapshot;
+	s->serial = next_snapshot_serial++;
+	s->linear_bases.push_back(0);
+	s->linear_size = 0;
+	snapshots.push_back(s);
+	current.store(s, std::memory_order_release);
+}
+
+memory_space::~memory_space()
+{
+	for(auto i : snapshots)
+		delete i;
+}
+
 std::pair<memory_space::region*, uint64_t> memory_space::lookup(uint64_t address)
 {
-	threads::alock m(mlock);
-	size_t lb = 0;
-	size_t ub = u_regions.size();
-	while(lb < ub) {
-		size_t mb = (lb + ub) / 2;
-		if(u_regions[mb]->base > address) {
-			ub = mb;
-			continue;
-		}
-		if(u_regions[mb]->last_address() < address) {
-			lb = mb + 1;
-			continue;
+	snapshot* s = current.load(std::memory_order_acquire);
+	if(last_phys.serial == s->serial && address - last_phys.base < last_phys.r->size)
+		return std::make_pair(last_phys.r, address - last_phys.base);
+	size_t idx = no_page;
+	uint64_t page = address >> lookup_page_shift;
+	if(page < s->pages.size())
+		idx = s->pages[page];
+	if(idx == no_page) {
+		size_t lb = 0;
+		size_t ub = s->regions.size();
+		while(lb < ub) {
+			size_t mb = (lb + ub) / 2;
+			if(s->regions[mb]->base > address) {
+				ub = mb;
+				continue;
+			}
+			if(s->regions[mb]->last_address() < address) {
+				lb = mb + 1;
+				continue;
+			}
+			idx = mb;
+			break;
 		}
-		return std::make_pair(u_regions[mb], address - u_regions[mb]->base);
+		if(idx == no_page)
+			return std::make_pair(reinterpret_cast<region*>(NULL), 0);
 	}
-	return std::make_pair(reinterpret_cast<region*>(NULL), 0);
+	region* r = s->regions[idx];
+	last_phys.serial = s->serial;
+	last_phys.r = r;
+	last_phys.base = r->base;
+	return std::make_pair(r, address - r->base);
 }
 
 std::pair<memory_space::region*, uint64_t> memory_space::lookup_linear(uint64_t linear)
 {
-	threads::alock m(mlock);
-	if(linear >= linear_size)
+	snapshot* s = current.load(std::memory_order_acquire);
+	if(linear >= s->linear_size)
 		return std::make_pair(reinterpret_cast<region*>(NULL), 0);
-	size_t lb = 0;
-	size_t ub = linear_bases.size() - 1;
-	while(lb < ub) {
-		size_t mb = (lb + ub) / 2;
-		if(linear_bases[mb] > linear) {
-			ub = mb;
-			continue;
-		}
-		if(linear_bases[mb + 1] <= linear) {
-			lb = mb + 1;
-			continue;
+	if(last_linear.serial == s->serial && linear - last_linear.base < last_linear.r->size)
+		return std::make_pair(last_linear.r, linear - last_linear.base);
+	size_t idx = no_page;
+	uint64_t page = linear >> lookup_page_shift;
+	if(page < s->lpages.size())
+		idx = s->lpages[page];
+	if(idx == no_page) {
+		size_t lb = 0;
+		size_t ub = s->linear_bases.size() - 1;
+		while(lb < ub) {
+			size_t mb = (lb + ub) / 2;
+			if(s->linear_bases[mb] > linear) {
+				ub = mb;
+				continue;
+			}
+			if(s->linear_bases[mb + 1] <= linear) {
+				lb = mb + 1;
+				continue;
+			}
+			idx = mb;
+			break;
 		}
-		return std::make_pair(u_lregions[mb], linear - linear_bases[mb]);
+		if(idx == no_page)
+			return std::make_pair(reinterpret_cast<region*>(NULL), 0);
 	}
-	return std::make_pair(reinterpret_cast<region*>(NULL), 0);
+	last_linear.serial = s->serial;
+	last_linear.r = s->lregions[idx];
+	last_linear.base = s->linear_bases[idx];
+	return std::make_pair(s->lregions[idx], linear - s->linear_bases[idx]);
 }
 
 void memory_space::read_all_linear_memory(uint8_t* buffer)
@@ -244,18 +340,18 @@ bool memory_space::write_range_linear(uint64_t address, const void* buffer, size
 
 memory_space::region* memory_space::lookup_n(size_t n)
 {
-	threads::alock m(mlock);
-	if(n >= u_regions.size())
+	snapshot* s = current.load(std::memory_order_acquire);
+	if(n >= s->regions.size())
 		return NULL;
-	return u_regions[n];
+	return s->regions[n];
 }
 
 
 std::list<memory_space::region*> memory_space::get_regions()
 {
-	threads::alock m(mlock);
+	snapshot* s = current.load(std::memory_order_acquire);
 	std::list<region*> r;
-	for(auto i : u_regions)
+	for(auto i : s->regions)
 		r.push_back(i);
 	return r;
 }
@@ -278,42 +374,57 @@ char* memory_space::get_physical_mapping(uint64_t base, uint64_t size)
 void memory_space::set_regions(const std::list<memory_space::region*>& regions)
 {
 	threads::alock m(mlock);
-	std::vector<region*> n_regions;
-	std::vector<region*> n_lregions;
-	std::vector<uint64_t> n_linear_bases;
-	//Calculate array sizes.
-	n_regions.resize(regions.size());
-	size_t linear_c = 0;
-	for(auto i : regions)
-		if(!i->readonly && !i->special)
-			linear_c++;
-	n_lregions.resize(linear_c);
-	n_linear_bases.resize(linear_c + 1);
-
-	//Fill the main array (it must be sorted!).
-	size_t i = 0;
-	for(auto j : regions)
-		n_regions[i++] = j;
-	std::sort(n_regions.begin(), n_regions.end(),
-		[](region* a, region* b) -> bool { return a->base < b->base; });
-
-	//Fill linear address arrays from the main array.
-	i = 0;
-	uint64_t base = 0;
-	for(auto j : n_regions) {
-		if(j->readonly || j->special)
-			continue;
-		n_lregions[i] = j;
+	snapshot* s = new snapshot;
+	std::vector<region*>& n_regions = s->regions;
+	std::vector<region*>& n_lregions = s->lregions;
+	std::vector<uint64_t>& n_linear_bases = s->linear_bases;
+	try {
+		//Calculate array sizes.
+		n_regions.resize(regions.size());
+		size_t linear_c = 0;
+		for(auto i : regions)
+			if(!i->readonly && !i->special)
+				linear_c++;
+		n_lregions.resize(linear_c);
+		n_linear_bases.resize(linear_c + 1);
+
+		//Fill the main array (it must be sorted!).
+		size_t i = 0;
+		for(auto j : regions)
+			n_regions[i++] = j;
+		std::sort(n_regions.begin(), n_regions.end(),
+			[](region* a, region* b) -> bool { return a->base < b->base; });
+
+		//Fill linear address arrays from the main array.
+		i = 0;
+		uint64_t base = 0;
+		for(auto j : n_regions) {
+			if(j->readonly || j->special)
+				continue;
+			n_lregions[i] = j;
+			n_linear_bases[i] = base;
+			base = base + j->size;
+			i++;
+		}
 		n_linear_bases[i] = base;
-		base = base + j->size;
-		i++;
+		s->linear_size = base;
+
+		std::vector<std::pair<uint64_t, uint64_t>> ranges;
+		for(auto j : n_regions)
+			ranges.push_back(std::make_pair(j->base, j->size));
+		build_pages(s->pages, ranges);
+		ranges.clear();
+		for(size_t j = 0; j < n_lregions.size(); j++)
+			ranges.push_back(std::make_pair(n_linear_bases[j], n_lregions[j]->size));
+		build_pages(s->lpages, ranges);
+	} catch(...) {
+		delete s;
+		throw;
 	}
-	n_linear_bases[i] = base;
-
-	std::swap(u_regions, n_regions);
-	std::swap(u_lregions, n_lregions);
-	std::swap(linear_bases, n_linear_bases);
-	linear_size = base;
+	s->serial = next_snapshot_serial++;
+	snapshots.push_back(s);
+	current.store(s, std::memory_order_release);
+	page_hashes.clear();
 }
 
 int memory_space::_get_system_endian()
@@ -328,8 +439,8 @@ int memory_space::sysendian = 0;
 
 std::string memory_space::address_to_textual(uint64_t addr)
 {
-	threads::alock m(mlock);
-	for(auto i : u_regions) {
+	snapshot* s = current.load(std::memory_order_acquire);
+	for(auto i : s->regions) {
 		if(addr >= i->base && addr <= i->last_address()) {
 			return (stringfmt() << i->name << "+" << std::hex << (addr - i->base)).str();
 		}
@@ -338,7 +449,7 @@ std::string memory_space::address_to_textual(uint64_t addr)
 }
 
 memory_space::region_direct::region_direct(const std::string& _name, uint64_t _base, int _endian,
-	unsigned char* _memory, size_t _size, bool _readonly)
+	unsigned char* _memory, size_t _size, bool _readonly, uint64_t* _dirty_gen)
 {
 	name = _name;
 	base = _base;
@@ -347,10 +458,33 @@ memory_space::region_direct::region_direct(const std::string& _name, uint64_t _b
 	size = _size;
 	readonly = _readonly;
 	special = false;
+	dirty_gen = _dirty_gen;
 }
 
 memory_space::region_direct::~region_direct() throw() {}
 
+bool memory_space::hash_linear_incremental(uint8_t* hashout)
+{
+	threads::alock m(mlock);
+	snapshot* s = current.load(std::memory_order_acquire);
+	if(s->lregions.empty())
+		return false;
+	for(auto i : s->lregions)
+		if(!i->direct_map || !i->dirty_gen)
+			return false;
+	sha256 h;
+	for(auto i : s->lregions) {
+		uint8_t rhash[32];
+		page_hash& p = page_hashes[i];
+		p.update(i->direct_map, i->size, i->dirty_gen);
+		p.read(rhash);
+		h.write(i->name.c_str(), i->name.length() + 1);
+		h.write(rhash, 32);
+	}
+	h.read(hashout);
+	return true;
+}
+
 namespace
 {
 	const static uint64_t p63 = 0x8000000000000000ULL;
@@ -5,6 +5,7 @@
 #include "mathexpr-error.hpp"
 #include "mathexpr.hpp"
 #include <functional>
+#include <cstring>
 #include <sstream>
 #include "string.hpp"
 
@@ -25,7 +26,7 @@ memread_oper::memread_oper()
 
 memread_oper::~memread_oper() {}
 
-void memread_oper::evaluate(mathexpr::value target, std::vector<std::function<mathexpr::value()>> promises)
+void memread_oper::evaluate(mathexpr::value target, const std::vector<std::function<mathexpr::value()>>& promises)
 {
 	if(promises.size() != 1)
 		throw mathexpr::error(mathexpr::error::ARGCOUNT, "Memory read operator takes 1 argument");
@@ -45,7 +46,12 @@ void memread_oper::evaluate(mathexpr::value target, std::vector<std::function<ma
 	if(bytes > 8)
 		throw mathexpr::error(mathexpr::error::SIZE, "Memory read size out of range");
 	char buf[8];
-	mspace->read_range(addr, buf, bytes);
+	//Read directly from direct-mapped regions, bypassing the generic read path.
+	auto g = mspace->lookup(addr);
+	if(g.first && g.first->direct_map && g.second + bytes <= g.first->size)
+		memcpy(buf, g.first->direct_map + g.second, bytes);
+	else
+		mspace->read_range(addr, buf, bytes);
 	//Endian swap if needed.
 	if(endianess && system_endian != endianess)
 		for(unsigned i = 0; i < bytes / 2; i++)
@@ -144,11 +150,14 @@ void item_printer::trace()
 
 std::string item::get_value()
 {
+	auto evaluate = [this]() -> mathexpr::value {
+		return program ? program->evaluate(program_entry) : expr->evaluate();
+	};
 	if(format == "") {
 		//Default.
 		mathexpr::_format fmt;
 		fmt.type = mathexpr::_format::DEFAULT;
-		mathexpr::value v = expr->evaluate();
+		mathexpr::value v = evaluate();
 		return v.type->format(v._value, fmt);
 	}
 	std::ostringstream out;
@@ -204,7 +213,7 @@ std::string item::get_value()
 			case 'x': fmt.type = mathexpr::_format::HEXADECIMAL; break;
 			case 'X': fmt.type = mathexpr::_format::HEXADECIMAL; fmt.uppercasehex = true; break;
 			}
-			mathexpr::value v = expr->evaluate();
+			mathexpr::value v = evaluate();
 			out << v.type->format(v._value, fmt);
 		}
 	}
@@ -228,10 +237,16 @@ void item::show(const std::string& n)
 }
 
 
+set::set()
+{
+	program = NULL;
+}
+
 set::~set()
 {
+	discard_program();
 	roots.clear();
-	GC::item::do_gc();
+	GC::item::request_gc();
 }
 
 void set::reset()
@@ -241,12 +256,14 @@ void set::reset()
 			i.second.printer->reset();
 		i.second.expr->reset();
 	}
+	if(program)
+		program->reset();
 }
 
 void set::refresh()
 {
-	for(auto& i : roots)
-		i.second.expr->reset();
+	compile();
+	program->reset();
 	for(auto& i : roots)
 		i.second.show(i.first);
 }
@@ -276,16 +293,20 @@ item* set::get_soft(const std::string& name)
 
 item* set::create(const std::string& name, item& item)
 {
+	discard_program();
 	roots.insert(std::make_pair(name, item));
-	return &(roots.find(name)->second);
+	auto& i = roots.find(name)->second;
+	i.program = NULL;
+	return &i;
 }
 
 void set::destroy(const std::string& name)
 {
 	if(!roots.count(name))
 		return;
+	discard_program();
 	roots.erase(name);
-	GC::item::do_gc();
+	GC::item::request_gc();
 }
 
 const std::string& set::get_longest_name(std::function<size_t(const std::string& n)> rate)
@@ -317,5 +338,25 @@ void set::foreach(std::function<void(item& item)> cb)
 void set::swap(set& s) throw()
 {
 	std::swap(roots, s.roots);
+	std::swap(program, s.program);
+}
+
+void set::compile()
+{
+	if(program)
+		return;
+	program = new mathexpr::program;
+	for(auto& i : roots) {
+		i.second.program = program;
+		i.second.program_entry = program->add(i.second.expr);
+	}
+}
+
+void set::discard_program()
+{
+	for(auto& i : roots)
+		i.second.program = NULL;
+	delete program;
+	program = NULL;
 }
 }
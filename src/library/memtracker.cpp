@@ -1,29 +1,148 @@
 #include "memtracker.hpp"
 
-void memtracker::operator()(const char* category, ssize_t change)
+struct memtracker::slab
 {
-	if(invalid) return;
-	std::string cat = category;
+	//Padding keeps counters of different threads on different cache lines.
+	char pad0[64];
+	std::atomic<int64_t> count[max_categories];
+	char pad1[64];
+};
+
+namespace
+{
+	threads::lock& registry_lock()
+	{
+		static threads::lock* m = new threads::lock();
+		return *m;
+	}
+
+	//Trackers alive, by serial. Serials are never reused.
+	std::map<uint64_t, memtracker*>& live_trackers()
+	{
+		static std::map<uint64_t, memtracker*>* x = new std::map<uint64_t, memtracker*>();
+		return *x;
+	}
+	uint64_t next_serial = 1;
+}
+
+//Slabs used by a thread. The slabs are returned to their trackers when the thread exits.
+struct memtracker_tls
+{
+	~memtracker_tls()
+	{
+		threads::alock h(registry_lock());
+		auto& live = live_trackers();
+		for(auto& i : slabs)
+			if(live.count(i.first))
+				live[i.first]->release_slab(i.second);
+	}
+	std::vector<std::pair<uint64_t, memtracker::slab*>> slabs;
+	//Cache of last slab used, to avoid thread-local initialization checks.
+	static thread_local uint64_t last_serial;
+	static thread_local memtracker::slab* last_slab;
+};
+
+thread_local uint64_t memtracker_tls::last_serial;
+thread_local memtracker::slab* memtracker_tls::last_slab;
+
+namespace
+{
+	thread_local memtracker_tls tls;
+}
+
+memtracker::slab* memtracker::get_slab()
+{
+	if(memtracker_tls::last_serial == serial)
+		return memtracker_tls::last_slab;
+	slab* s = NULL;
+	for(auto& i : tls.slabs)
+		if(i.first == serial)
+			s = i.second;
+	if(!s) {
+		threads::alock h(mut);
+		if(free_slabs.empty()) {
+			s = new slab;
+			for(unsigned i = 0; i < max_categories; i++)
+				s->count[i].store(0, std::memory_order_relaxed);
+			slabs.push_back(s);
+		} else {
+			s = free_slabs.back();
+			free_slabs.pop_back();
+		}
+		tls.slabs.push_back(std::make_pair(serial, s));
+	}
+	memtracker_tls::last_serial = serial;
+	memtracker_tls::last_slab = s;
+	return s;
+}
+
+void memtracker::release_slab(slab* s)
+{
+	threads::alock h(mut);
+	for(unsigned i = 0; i < max_categories; i++) {
+		retired[i] += s->count[i].load(std::memory_order_relaxed);
+		s->count[i].store(0, std::memory_order_relaxed);
+	}
+	free_slabs.push_back(s);
+}
+
+int64_t memtracker::total(unsigned category)
+{
+	//Caller holds the lock.
+	int64_t t = retired[category];
+	for(auto i : slabs)
+		t += i->count[category].load(std::memory_order_relaxed);
+	return t;
+}
+
+unsigned memtracker::intern(const char* category)
+{
+	size_t hash = (reinterpret_cast<uintptr_t>(category) >> 3) % ptr_cache_size;
+	for(unsigned i = 0; i < ptr_cache_size; i++) {
+		size_t j = (hash + i) % ptr_cache_size;
+		const char* k = ptr_keys[j].load(std::memory_order_acquire);
+		if(k == category)
+			return ptr_vals[j].load(std::memory_order_relaxed);
+		if(!k)
+			break;
+	}
 	threads::alock h(mut);
-	if(change > 0) {
-		if(data.count(cat))
-			data[cat] = data[cat] + change;
-		else
-			data[cat] = change;
-	} else if(change < 0 && data.count(cat)) {
-		if(data[cat] <= (size_t)-change)
-			data[cat] = 0;
-		else
-			data[cat] = data[cat] + change;
+	std::string name = category;
+	if(!ids.count(name) && names.size() >= max_categories - 1)
+		name = "(other)";	//Out of IDs.
+	if(!ids.count(name)) {
+		ids[name] = names.size();
+		names.push_back(name);
+	}
+	unsigned id = ids[name];
+	for(unsigned i = 0; i < ptr_cache_size; i++) {
+		size_t j = (hash + i) % ptr_cache_size;
+		const char* k = ptr_keys[j].load(std::memory_order_relaxed);
+		if(k == category)
+			break;
+		if(!k) {
+			ptr_vals[j].store(id, std::memory_order_relaxed);
+			ptr_keys[j].store(category, std::memory_order_release);
+			break;
+		}
 	}
+	return id;
+}
+
+void memtracker::operator()(unsigned category, ssize_t change)
+{
+	if(invalid || category >= max_categories) return;
+	//Only this thread writes to the counter, so no need for atomic read-modify-write.
+	std::atomic<int64_t>& c = get_slab()->count[category];
+	c.store(c.load(std::memory_order_relaxed) + change, std::memory_order_relaxed);
 }
 
 void memtracker::reset(const char* category, size_t value)
 {
 	if(invalid) return;
-	std::string cat = category;
+	unsigned id = intern(category);
 	threads::alock h(mut);
-	data[cat] = value;
+	retired[id] += (int64_t)value - total(id);
 }
 
 std::map<std::string, size_t> memtracker::report()
@@ -31,7 +150,10 @@ std::map<std::string, size_t> memtracker::report()
 	std::map<std::string, size_t> ret;
 	if(!invalid) {
 		threads::alock h(mut);
-		ret = data;
+		for(unsigned i = 0; i < names.size(); i++) {
+			int64_t t = total(i);
+			ret[names[i]] = (t > 0) ? t : 0;
+		}
 	}
 	return ret;
 }
@@ -39,10 +161,26 @@ std::map<std::string, size_t> memtracker::report()
 memtracker::memtracker()
 {
 	invalid = false;
+	for(unsigned i = 0; i < ptr_cache_size; i++) {
+		ptr_keys[i].store(NULL, std::memory_order_relaxed);
+		ptr_vals[i].store(0, std::memory_order_relaxed);
+	}
+	for(unsigned i = 0; i < max_categories; i++)
+		retired[i] = 0;
+	threads::alock h(registry_lock());
+	serial = next_serial++;
+	live_trackers()[serial] = this;
 }
+
 memtracker::~memtracker()
 {
 	invalid = true;
+	{
+		threads::alock h(registry_lock());
+		live_trackers().erase(serial);
+	}
+	for(auto i : slabs)
+		delete i;
 }
 
 memtracker& memtracker::singleton()
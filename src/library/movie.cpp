@@ -84,7 +84,7 @@ portctrl::frame movie::get_controls() throw()
 	for(size_t i = 0; i < movie_data->get_types().indices(); i++) {
 		uint32_t polls = pollcounters.get_polls(i);
 		uint32_t index = (changes > polls) ? polls : changes - 1;
-		c.axis2(i, (*movie_data)[current_frame_first_subframe + index].axis2(i));
+		c.axis2(i, movie_data->read_axis2(current_frame_first_subframe + index, i));
 	}
 	return c;
 }
@@ -161,7 +161,7 @@ short movie::next_input(unsigned port, unsigned controller, unsigned ctrl)
 		uint32_t changes = count_changes(current_frame_first_subframe);
 		uint32_t polls = pollcounters.get_polls(port, controller, ctrl);
 		uint32_t index = (changes > polls) ? polls : changes - 1;
-		int16_t data = (*movie_data)[current_frame_first_subframe + index].axis3(port, controller, ctrl);
+		int16_t data = movie_data->read_axis3(current_frame_first_subframe + index, port, controller, ctrl);
 		pollcounters.increment_polls(port, controller, ctrl);
 		return data;
 	} else {
@@ -175,7 +175,7 @@ short movie::next_input(unsigned port, unsigned controller, unsigned ctrl)
 			movie_data->append(current_controls.copy(true));
 			//current_frame_first_subframe should be movie_data->size(), so it is right.
 			pollcounters.increment_polls(port, controller, ctrl);
-			return (*movie_data)[current_frame_first_subframe].axis3(port, controller, ctrl);
+			return movie_data->read_axis3(current_frame_first_subframe, port, controller, ctrl);
 		}
 		short new_value = current_controls.axis3(port, controller, ctrl);
 		frob_with_value(port, controller, ctrl, new_value);
@@ -186,11 +186,11 @@ short movie::next_input(unsigned port, unsigned controller, unsigned ctrl)
 			//subframes.
 			for(uint64_t i = current_frame_first_subframe + pollcounter; i < movie_data->size(); i++)
 				(*movie_data)[i].axis3(port, controller, ctrl, new_value);
-		} else if(new_value != (*movie_data)[movie_data->size() - 1].axis3(port, controller, ctrl)) {
+		} else if(new_value != movie_data->read_axis3(movie_data->size() - 1, port, controller, ctrl)) {
 			//The index is not within existing size and value does not match. We need to create a new
 			//subframes(s), copying the last subframe.
 			while(current_frame_first_subframe + pollcounter >= movie_data->size())
-				movie_data->append((*movie_data)[movie_data->size() - 1].copy(false));
+				movie_data->append(movie_data->get(movie_data->size() - 1).copy(false));
 			(*movie_data)[current_frame_first_subframe + pollcounter].axis3(port, controller, ctrl,
 				new_value);
 		}
@@ -217,7 +217,7 @@ movie::movie()
 
 void movie::load(const std::string& rerecs, const std::string& project_id, portctrl::frame_vector& input)
 {
-	if(input.size() > 0 && !input[0].sync())
+	if(input.size() > 0 && !input.is_sync(0))
 		throw std::runtime_error("First subframe MUST have frame sync flag set");
 	seqno++;
 	clear_caches();
@@ -273,7 +273,7 @@ void movie::readonly_mode(bool enable)
 			uint32_t polls = pollcounters.get_polls(i);
 			polls = polls ? polls : 1;
 			for(uint64_t j = current_frame_first_subframe + polls; j < next_frame_first_subframe; j++)
-				(*movie_data)[j].axis2(i, (*movie_data)[current_frame_first_subframe + polls - 1].
+				(*movie_data)[j].axis2(i, movie_data->get(current_frame_first_subframe + polls - 1).
 					axis2(i));
 		}
 	}
@@ -345,7 +345,7 @@ portctrl::frame movie::read_subframe(uint64_t frame, uint64_t subframe) throw()
 	}
 	if(max <= subframe)
 		subframe = max - 1;
-	return (*movie_data)[p + subframe];
+	return movie_data->get(p + subframe);
 }
 
 void movie::reset_state() throw()
@@ -366,14 +366,18 @@ void movie::fast_save(uint64_t& _frame, uint64_t& _ptr, uint64_t& _lagc, std::ve
 	_lagc = lag_frames;
 }
 
-void movie::fast_load(uint64_t& _frame, uint64_t& _ptr, uint64_t& _lagc, std::vector<uint32_t>& _counters)
+void movie::fast_load(uint64_t& _frame, uint64_t& _ptr, uint64_t& _lagc, std::vector<uint32_t>& _counters,
+	bool keep_readonly)
 {
 	readonly = true;
 	current_frame = _frame;
 	current_frame_first_subframe = (_ptr <= movie_data->size()) ? _ptr : movie_data->size();
 	lag_frames = _lagc;
 	pollcounters.load_state(_counters);
-	readonly_mode(false);
+	if(keep_readonly)
+		clear_caches();
+	else
+		readonly_mode(false);
 }
 
 void movie::set_pflag_handler(poll_flag* handler)
@@ -388,7 +392,7 @@ int16_t movie::read_subframe_at_index(uint32_t subframe, unsigned port, unsigned
 		return 0;
 	uint32_t changes = count_changes(current_frame_first_subframe);
 	uint32_t index = (changes > subframe) ? subframe : changes - 1;
-	return (*movie_data)[current_frame_first_subframe + index].axis3(port, controller, ctrl);
+	return movie_data->read_axis3(current_frame_first_subframe + index, port, controller, ctrl);
 }
 
 void movie::write_subframe_at_index(uint32_t subframe, unsigned port, unsigned controller, unsigned ctrl,
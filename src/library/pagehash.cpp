@@ -0,0 +1,115 @@
+#include "pagehash.hpp"
+#include "sha256.hpp"
+#include "serialization.hpp"
+#include "minmax.hpp"
+
+namespace
+{
+	//Domain separation tags, so leaf hashes can't collide with node hashes.
+	const uint8_t tag_leaf = 0;
+	const uint8_t tag_node = 1;
+	const uint8_t tag_root = 2;
+	//Number of leaves hashed at once.
+	const size_t leaf_batch = 8;
+}
+
+page_hash::page_hash()
+{
+	memsize = 0;
+	valid = false;
+}
+
+void page_hash::reset()
+{
+	valid = false;
+}
+
+uint64_t page_hash::update(const uint8_t* mem, uint64_t size, const uint64_t* gens)
+{
+	uint64_t pages = pages_for(size);
+	bool force = !valid || size != memsize;
+	if(force) {
+		//Rebuild the tree shape.
+		levels.clear();
+		stale.clear();
+		seen.resize(pages);
+		uint64_t n = pages;
+		while(true) {
+			levels.push_back(std::vector<uint8_t>(32 * n));
+			stale.push_back(std::vector<bool>(n, true));
+			if(n <= 1)
+				break;
+			n = (n + 1) / 2;
+		}
+		memsize = size;
+		valid = true;
+	}
+	uint64_t rehashed = 0;
+	std::vector<uint64_t> todo;
+	for(uint64_t i = 0; i < pages; i++) {
+		if(!force && gens && gens[i] == seen[i])
+			continue;
+		if(gens)
+			seen[i] = gens[i];
+		todo.push_back(i);
+	}
+	//Hash the leaves in batches, so multi-buffer hashing can be used. The last page may be partial.
+	for(size_t j = 0; j < todo.size(); j += leaf_batch) {
+		sha256 h[leaf_batch];
+		sha256* hp[leaf_batch];
+		const uint8_t* data[leaf_batch];
+		size_t n = 0;
+		for(; n < leaf_batch && j + n < todo.size(); n++) {
+			uint64_t off = todo[j + n] << page_shift;
+			if(size - off < page_size)
+				break;
+			hp[n] = &h[n];
+			data[n] = mem + off;
+			h[n].write(&tag_leaf, 1);
+		}
+		sha256::write_multi(hp, data, page_size, n);
+		if(n < leaf_batch && j + n < todo.size()) {
+			uint64_t off = todo[j + n] << page_shift;
+			h[n].write(&tag_leaf, 1);
+			h[n].write(mem + off, size - off);
+			n++;
+		}
+		for(size_t k = 0; k < n; k++) {
+			uint64_t i = todo[j + k];
+			h[k].read(&levels[0][32 * i]);
+			stale[0][i] = true;
+			rehashed++;
+		}
+	}
+	//Propagate changed nodes upwards.
+	for(size_t l = 1; l < levels.size(); l++) {
+		size_t children = levels[l - 1].size() / 32;
+		for(size_t i = 0; i < levels[l].size() / 32; i++) {
+			bool left = stale[l - 1][2 * i];
+			bool right = (2 * i + 1 < children) && stale[l - 1][2 * i + 1];
+			if(!left && !right)
+				continue;
+			sha256 h;
+			h.write(&tag_node, 1);
+			h.write(&levels[l - 1][64 * i], (2 * i + 1 < children) ? 64 : 32);
+			h.read(&levels[l][32 * i]);
+			stale[l][i] = true;
+		}
+		stale[l - 1].assign(stale[l - 1].size(), false);
+	}
+	return rehashed;
+}
+
+void page_hash::read(uint8_t* hashout)
+{
+	uint8_t sbuf[8];
+	serialization::u64l(sbuf, memsize);
+	sha256 h;
+	h.write(&tag_root, 1);
+	h.write(sbuf, 8);
+	if(valid && !levels.back().empty())
+		h.write(&levels.back()[0], 32);
+	h.read(hashout);
+	if(valid)
+		stale.back().assign(stale.back().size(), false);
+}
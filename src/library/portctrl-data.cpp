@@ -6,12 +6,14 @@
 #include "serialization.hpp"
 #include "string.hpp"
 #include "sha256.hpp"
+#include "exrethrow.hpp"
 #include <iostream>
 #include <sys/time.h>
 #include <sstream>
 #include <list>
 #include <deque>
 #include <complex>
+#include <functional>
 
 namespace portctrl
 {
@@ -81,6 +83,12 @@ type& get_default_system_port_type()
 type::type(const std::string& iname, const std::string& _hname, size_t ssize)
 	: hname(_hname), storage_size(ssize), name(iname)
 {
+	//Types with faster way to do this replace it.
+	read_range = [](const type* _this, const unsigned char* buffer, size_t stride, size_t count, unsigned idx,
+		unsigned ctrl, short* out) -> void {
+		for(size_t i = 0; i < count; i++)
+			out[i] = _this->read(_this, buffer + i * stride, idx, ctrl);
+	};
 }
 
 type::~type() throw()
@@ -195,6 +203,38 @@ type_set::type_set(std::vector<class type*> types, struct index_map control_map)
 	}
 }
 
+size_t type_set::serialize(const unsigned char* buffer, size_t stride, size_t count, char* textbuf) const throw()
+{
+	size_t offset = 0;
+	for(size_t k = 0; k < count; k++, buffer += stride) {
+		for(unsigned i = 0; i < port_count; i++) {
+			auto& t = *port_types[i];
+			offset += t.serialize(&t, buffer + port_offsets[i], textbuf + offset);
+		}
+		textbuf[offset++] = '\n';
+	}
+	return offset;
+}
+
+void type_set::deserialize(unsigned char* buffer, size_t stride, size_t count, const char* const* lines) const
+{
+	for(size_t k = 0; k < count; k++, buffer += stride) {
+		const char* buf = lines[k];
+		size_t offset = 0;
+		for(unsigned i = 0; i < port_count; i++) {
+			auto& t = *port_types[i];
+			size_t s = t.deserialize(&t, buffer + port_offsets[i], buf + offset);
+			if(s != DESERIALIZE_SPECIAL_BLANK) {
+				offset += s;
+				while(is_nonterminator(buf[offset]))
+					offset++;
+				if(buf[offset] == '|')
+					offset++;
+			}
+		}
+	}
+}
+
 short read_axis_value(const char* buf, size_t& idx) throw()
 {
 		char ch;
@@ -263,12 +303,40 @@ namespace
 
 	uint64_t find_next_sync(frame_vector& movie, uint64_t after)
 	{
-		if(after >= movie.size())
-			return after;
-		do {
-			after++;
-		} while(after < movie.size() && !movie[after].sync());
-		return after;
+		return movie.walk_sync(after);
+	}
+
+	//Split [0, n) into chunks of at least min_chunk items and call fn(chunk, first, last) for each chunk, in
+	//parallel. Returns number of chunks. Exceptions are rethrown in the calling thread.
+	size_t parallel_chunks(size_t n, size_t min_chunk, std::function<void(size_t, size_t, size_t)> fn)
+	{
+		size_t chunks = threads::thread::hardware_concurrency();
+		chunks = max(min(chunks, n / min_chunk), (size_t)1);
+		std::vector<exrethrow::storage> errors(chunks);
+		auto run = [&fn, &errors, n, chunks](size_t i) {
+			try {
+				fn(i, n * i / chunks, n * (i + 1) / chunks);
+			} catch(std::exception& e) {
+				errors[i] = exrethrow::storage(e);
+			}
+		};
+		std::vector<threads::thread*> workers;
+		try {
+			for(size_t i = 1; i < chunks; i++)
+				workers.push_back(new threads::thread(run, i));
+		} catch(...) {
+			//Run the rest in this thread.
+			for(size_t i = workers.size() + 1; i < chunks; i++)
+				run(i);
+		}
+		run(0);
+		for(auto i : workers) {
+			i->join();
+			delete i;
+		}
+		for(auto& i : errors)
+			if(i) i.rethrow();
+		return chunks;
 	}
 }
 
@@ -488,19 +556,15 @@ size_t frame_vector::walk_helper(size_t frame, bool sflag) throw()
 	size_t page = frame / frames_per_page;
 	size_t offset = frame_size * (frame % frames_per_page);
 	size_t index = frame % frames_per_page;
-	if(cache_page_num != page) {
-		cache_page = &pages[page];
-		cache_page_num = page;
-	}
+	const unsigned char* content = (frame < frames) ? readable_page(page).content : NULL;
 	while(frame < frames) {
 		if(index == frames_per_page) {
 			page++;
-			cache_page = &pages[page];
-			cache_page_num = page;
+			content = readable_page(page).content;
 			index = 0;
 			offset = 0;
 		}
-		if(frame::sync(cache_page->content + offset))
+		if(frame::sync(content + offset))
 			break;
 		index++;
 		offset += frame_size;
@@ -516,18 +580,18 @@ size_t frame_vector::recount_frames() throw()
 	size_t ret = 0;
 	if(!frames)
 		return 0;
-	cache_page_num = 0;
-	cache_page = &pages[0];
+	size_t pagenum = 0;
+	const unsigned char* content = readable_page(0).content;
 	size_t offset = 0;
 	size_t index = 0;
 	for(size_t i = 0; i < frames; i++) {
 		if(index == frames_per_page) {
-			cache_page_num++;
-			cache_page = &pages[cache_page_num];
+			pagenum++;
+			content = readable_page(pagenum).content;
 			index = 0;
 			offset = 0;
 		}
-		if(frame::sync(cache_page->content + offset))
+		if(frame::sync(content + offset))
 			ret++;
 		index++;
 		offset += frame_size;
@@ -551,6 +615,18 @@ void frame_vector::clear(const type_set& p)
 	call_framecount_notification(old_frame_count);
 }
 
+frame_vector::page& frame_vector::writable_page(size_t n)
+{
+	std::shared_ptr<page>& p = pages[n];
+	if(rcache_page_num == n)
+		clear_read_cache();
+	if(!p)
+		p.reset(new page);
+	else if(p.use_count() > 1)
+		p.reset(new page(*p));	//Shared with some other vector, make private copy.
+	return *p;
+}
+
 frame_vector::~frame_vector() throw()
 {
 	pages.clear();
@@ -578,22 +654,212 @@ void frame_vector::append(frame cframe)
 	frame check(*types);
 	if(!check.types_match(cframe))
 		throw std::runtime_error("frame_vector::append: Type mismatch");
-	if(frames % frames_per_page == 0) {
-		//Create new page.
-		pages[frames / frames_per_page];
-	}
-	//Write the entry.
+	//Write the entry (creating new page if needed).
 	size_t page = frames / frames_per_page;
 	size_t offset = frame_size * (frames % frames_per_page);
 	if(cache_page_num != page) {
+		cache_page = &writable_page(page);
 		cache_page_num = page;
-		cache_page = &pages[page];
 	}
 	frame(cache_page->content + offset, *types) = cframe;
 	if(cframe.sync()) real_frame_count++;
 	frames++;
 }
 
+void frame_vector::copy_frames(size_t dst, frame_vector& src, size_t srcidx, size_t count, bool backwards)
+{
+	if(types != src.types)
+		throw std::runtime_error("frame_vector::copy_frames: Type mismatch");
+	if(dst + count < dst || dst + count > frames || srcidx + count < srcidx || srcidx + count > src.frames)
+		throw std::runtime_error("frame_vector::copy_frames: Illegal index");
+	uint64_t old_frame_count = real_frame_count;
+	//If the ranges do not overlap, the copy direction does not matter, and whole pages can be shared if the
+	//subframes are at the same position within the pages.
+	bool overlap = (&src == this && dst < srcidx + count && srcidx < dst + count);
+	bool share = !overlap && (dst % frames_per_page) == (srcidx % frames_per_page);
+	if(!overlap)
+		backwards = false;
+	for(size_t k = 0; k < count;) {
+		size_t i = backwards ? (count - 1 - k) : k;
+		size_t d = dst + i;
+		size_t s = srcidx + i;
+		size_t dpage = d / frames_per_page;
+		if(share && d % frames_per_page == 0 && count - i >= frames_per_page) {
+			size_t spage = s / frames_per_page;
+			const unsigned char* oldc = readable_page(dpage).content;
+			const unsigned char* newc = src.readable_page(spage).content;
+			for(size_t j = 0; j < frames_per_page * frame_size; j += frame_size) {
+				if(frame::sync(oldc + j)) real_frame_count--;
+				if(frame::sync(newc + j)) real_frame_count++;
+			}
+			//The page becomes shared, so it can't be cached for writing in either vector.
+			if(cache_page_num == dpage || rcache_page_num == dpage)
+				clear_cache();
+			if(src.cache_page_num == spage)
+				src.clear_cache();
+			pages[dpage] = src.pages[spage];
+			k += frames_per_page;
+			continue;
+		}
+		if(cache_page_num != dpage) {
+			cache_page = &writable_page(dpage);
+			cache_page_num = dpage;
+		}
+		unsigned char* w = cache_page->content + frame_size * (d % frames_per_page);
+		const unsigned char* r = src.frame_data(s);
+		if(frame::sync(w)) real_frame_count--;
+		if(frame::sync(r)) real_frame_count++;
+		memmove(w, r, frame_size);
+		k++;
+	}
+	if(!freeze_count && real_frame_count != old_frame_count)
+		call_framecount_notification(old_frame_count);
+}
+
+void frame_vector::load_text(const char* buf, size_t len)
+{
+	//Find the nonempty lines. Lines with only CRs count as empty. If the last line is not terminated, it has
+	//to be copied, as the deserializer reads up to terminator.
+	std::vector<const char*> lines;
+	std::string lastline;
+	size_t i = 0;
+	while(i < len) {
+		const char* nl = reinterpret_cast<const char*>(memchr(buf + i, '\n', len - i));
+		size_t end = nl ? (nl - buf) : len;
+		size_t j = i;
+		while(j < end && buf[j] == '\r')
+			j++;
+		if(j < end) {
+			if(nl)
+				lines.push_back(buf + i);
+			else {
+				lastline.assign(buf + i, end - i);
+				lines.push_back(lastline.c_str());
+			}
+		}
+		i = end + 1;
+	}
+	if(lines.empty())
+		return;
+
+	size_t oldsize = frames;
+	resize(oldsize + lines.size());
+	//Look up the pages beforehand, so the decoding threads don't need to touch the page map.
+	size_t firstpage = oldsize / frames_per_page;
+	size_t lastpage = (frames - 1) / frames_per_page;
+	std::vector<unsigned char*> pagebufs;
+	for(size_t p = firstpage; p <= lastpage; p++)
+		pagebufs.push_back(writable_page(p).content);
+	try {
+		parallel_chunks(lines.size(), 4096, [this, &lines, &pagebufs, oldsize, firstpage](size_t c,
+			size_t first, size_t last) {
+			//Decode a page at a time.
+			for(size_t k = first; k < last;) {
+				size_t n = oldsize + k;
+				size_t cnt = min(last - k, frames_per_page - n % frames_per_page);
+				unsigned char* mem = pagebufs[n / frames_per_page - firstpage] + frame_size *
+					(n % frames_per_page);
+				types->deserialize(mem, frame_size, cnt, &lines[k]);
+				k += cnt;
+			}
+		});
+	} catch(...) {
+		//The frame count was not updated for the partially loaded frames.
+		resize(oldsize);
+		recount_frames();
+		throw;
+	}
+	recount_frames();
+}
+
+void frame_vector::save_text(std::vector<char>& out)
+{
+	//The first chunk goes straight to the output, so with one chunk nothing is copied.
+	std::vector<std::vector<char>> parts(threads::thread::hardware_concurrency() + 1);
+	out.clear();
+	size_t chunks = parallel_chunks(frames, 4096, [this, &parts, &out](size_t c, size_t first, size_t last) {
+		serialize_frames(first, last - first, c ? parts[c] : out);
+	});
+	size_t total = out.size();
+	for(size_t c = 1; c < chunks; c++)
+		total += parts[c].size();
+	out.reserve(total);
+	for(size_t c = 1; c < chunks; c++) {
+		out.insert(out.end(), parts[c].begin(), parts[c].end());
+		std::vector<char>().swap(parts[c]);
+	}
+}
+
+void frame_vector::serialize_frames(size_t first, size_t count, std::vector<char>& out) const
+{
+	//Frames to serialize in one go.
+	const size_t batch = 256;
+	if(first + count < first || first + count > frames)
+		throw std::runtime_error("frame_vector::serialize_frames: Illegal index");
+	//Serialize straight into the output. The lines of a movie tend to be about the same length, so once some
+	//frames have been serialized, the output is sized for the rest of them at that rate, with some slack. The
+	//unused tail is cut off at end.
+	size_t start = out.size();
+	size_t used = start;
+	for(size_t i = first; i < first + count;) {
+		size_t n = min(min(first + count - i, frames_per_page - i % frames_per_page), batch);
+		size_t need = used + n * MAX_SERIALIZED_SIZE;
+		if(out.size() < need) {
+			size_t estimate = 0;
+			if(i > first)
+				estimate = used + (used - start) / (i - first) * (first + count - i) * 9 / 8;
+			out.resize(max(need, estimate));
+		}
+		used += types->serialize(frame_data(i), frame_size, n, &out[used]);
+		i += n;
+	}
+	out.resize(used);
+}
+
+size_t frame_vector::first_difference(const frame_vector& with, size_t first, size_t count) const
+{
+	if(types != with.types)
+		throw std::runtime_error("frame_vector::first_difference: Type mismatch");
+	if(first + count < first || first + count > frames || first + count > with.frames)
+		throw std::runtime_error("frame_vector::first_difference: Illegal index");
+	for(size_t i = first; i < first + count;) {
+		size_t pageoffset = i % frames_per_page;
+		size_t n = min(first + count - i, frames_per_page - pageoffset);
+		const unsigned char* x = readable_page(i / frames_per_page).content;
+		const unsigned char* y = with.readable_page(i / frames_per_page).content;
+		//Shared pages are equal.
+		if(x != y) {
+			x += frame_size * pageoffset;
+			y += frame_size * pageoffset;
+			if(memcmp(x, y, n * frame_size))
+				for(size_t j = 0; j < n; j++)
+					if(memcmp(x + j * frame_size, y + j * frame_size, frame_size))
+						return i + j;
+		}
+		i += n;
+	}
+	return first + count;
+}
+
+void frame_vector::read_column(size_t first, size_t count, unsigned idx, short* out) const
+{
+	if(first + count < first || first + count > frames)
+		throw std::runtime_error("frame_vector::read_column: Illegal index");
+	index_triple t = types->index_to_triple(idx);
+	if(!t.valid) {
+		for(size_t i = 0; i < count; i++)
+			out[i] = 0;
+		return;
+	}
+	const type& pt = types->port_type(t.port);
+	size_t poffset = types->port_offset(t.port);
+	for(size_t i = first; i < first + count;) {
+		size_t n = min(first + count - i, frames_per_page - i % frames_per_page);
+		pt.read_range(&pt, frame_data(i) + poffset, frame_size, n, t.controller, t.control, out + (i - first));
+		i += n;
+	}
+}
+
 frame_vector::frame_vector(const frame_vector& vector)
 	: tracker(memtracker::singleton(), movie_page_id, sizeof(*this))
 {
@@ -608,22 +874,18 @@ frame_vector& frame_vector::operator=(const frame_vector& v)
 	if(this == &v)
 		return *this;
 	uint64_t old_frame_count = real_frame_count;
-	resize(v.frames);
+	//Share the pages. The source may have cached one of these for writing, so it has to drop that.
+	std::map<size_t, std::shared_ptr<page>> npages = v.pages;
+	v.clear_cache();
 	clear_cache();
+	pages.swap(npages);
 
 	//Copy the fields.
+	frames = v.frames;
 	frame_size = v.frame_size;
 	frames_per_page = v.frames_per_page;
 	types = v.types;
 	real_frame_count = v.real_frame_count;
-
-	//This can't fail anymore. Copy the raw page contents.
-	size_t pagecount = (frames + frames_per_page - 1) / frames_per_page;
-	for(size_t i = 0; i < pagecount; i++) {
-		page& pg = pages[i];
-		const page& pg2 = v.pages.find(i)->second;
-		pg = pg2;
-	}
 	call_framecount_notification(old_frame_count);
 	return *this;
 }
@@ -637,7 +899,7 @@ void frame_vector::resize(size_t newsize)
 		//Shrink movie.
 		uint64_t old_frame_count = real_frame_count;
 		for(size_t i = newsize; i < frames; i++)
-			if((*this)[i].sync()) real_frame_count--;
+			if(frame::sync(frame_data(i))) real_frame_count--;
 		size_t current_pages = (frames + frames_per_page - 1) / frames_per_page;
 		size_t pages_needed = (newsize + frames_per_page - 1) / frames_per_page;
 		for(size_t i = pages_needed; i < current_pages; i++)
@@ -645,7 +907,7 @@ void frame_vector::resize(size_t newsize)
 		//Now zeroize the excess memory.
 		if(newsize < pages_needed * frames_per_page) {
 			size_t offset = frame_size * (newsize % frames_per_page);
-			memset(pages[pages_needed - 1].content + offset, 0, CONTROLLER_PAGE_SIZE - offset);
+			memset(writable_page(pages_needed - 1).content + offset, 0, CONTROLLER_PAGE_SIZE - offset);
 		}
 		frames = newsize;
 		call_framecount_notification(old_frame_count);
@@ -656,7 +918,7 @@ void frame_vector::resize(size_t newsize)
 		//Create the needed pages.
 		for(size_t i = current_pages; i < pages_needed; i++) {
 			try {
-				pages[i];
+				pages[i].reset(new page);
 			} catch(...) {
 				for(size_t i = current_pages; i < pages_needed; i++)
 					if(pages.count(i))
@@ -685,28 +947,25 @@ bool frame_vector::compatible(frame_vector& with, uint64_t nframe, const uint32_
 	uint64_t frames_read = 0;
 	size_t old_size = size();
 	size_t new_size = with.size();
-	size_t pagenum = 0;
-	size_t ocomplete_pages = old_size / frames_per_page;  //Round DOWN
-	size_t ncomplete_pages = new_size / frames_per_page;  //Round DOWN
-	size_t complete_pages = min(ocomplete_pages, ncomplete_pages);
-	while(syncs_seen + frames_per_page < nframe - 1 && pagenum < complete_pages) {
-		//Fast process page. The above condition guarantees that these pages are completely used.
-		auto opagedata = pages[pagenum].content;
-		auto npagedata = with.pages[pagenum].content;
-		size_t pagedataamt = frames_per_page * frame_size;
-		if(memcmp(opagedata, npagedata, pagedataamt))
-			return false;
-		frames_read += frames_per_page;
-		pagenum++;
-		for(size_t i = 0; i < pagedataamt; i += frame_size)
-			if(opagedata[i] & 1) syncs_seen++;
+	size_t common_size = min(old_size, new_size);
+	while(syncs_seen < nframe - 1 && frames_read < common_size) {
+		//Compare the part both movies have a page at a time, and count the syncs in the part that matches.
+		size_t start = frames_read;
+		size_t end = start + min(common_size - start, frames_per_page - start % frames_per_page);
+		size_t diff = first_difference(with, start, end - start);
+		const unsigned char* p = with.frame_data(start);
+		for(; frames_read < diff && syncs_seen < nframe - 1; frames_read++, p += frame_size)
+			if(frame::sync(p))
+				syncs_seen++;
+		if(syncs_seen < nframe - 1 && frames_read < end)
+			return false;	//Mismatch.
 	}
 	while(syncs_seen < nframe - 1) {
 		frame oldc = blank_frame(true), newc = with.blank_frame(true);
 		if(frames_read < old_size)
-			oldc = (*this)[frames_read];
+			oldc = frame(const_cast<unsigned char*>(frame_data(frames_read)), *types);
 		if(frames_read < new_size)
-			newc = with[frames_read];
+			newc = frame(const_cast<unsigned char*>(with.frame_data(frames_read)), *with.types);
 		if(oldc != newc)
 			return false;	//Mismatch.
 		frames_read++;
@@ -723,15 +982,24 @@ bool frame_vector::compatible(frame_vector& with, uint64_t nframe, const uint32_
 		readable_old_subframes = oldlen - frames_read;
 	if(frames_read < newlen)
 		readable_new_subframes = newlen - frames_read;
-	//Then rest of the stuff.
+	//Then rest of the stuff. Past the end of frame, the last value read stays.
+	std::vector<short> ovals, nvals;
 	for(unsigned i = 0; i < pset.indices(); i++) {
 		uint32_t p = polls[i] & 0x7FFFFFFFUL;
+		size_t ocount = min(static_cast<uint64_t>(p), readable_old_subframes);
+		size_t ncount = min(static_cast<uint64_t>(p), readable_new_subframes);
+		ovals.resize(ocount);
+		nvals.resize(ncount);
+		if(ocount)
+			read_column(frames_read, ocount, i, &ovals[0]);
+		if(ncount)
+			with.read_column(frames_read, ncount, i, &nvals[0]);
 		short ov = 0, nv = 0;
-		for(uint32_t j = 0; j < p; j++) {
-			if(j < readable_old_subframes)
-				ov = (*this)[j + frames_read].axis2(i);
-			if(j < readable_new_subframes)
-				nv = with[j + frames_read].axis2(i);
+		for(size_t j = 0; j < max(ocount, ncount); j++) {
+			if(j < ocount)
+				ov = ovals[j];
+			if(j < ncount)
+				nv = nvals[j];
 			if(ov != nv)
 				return false;
 		}
@@ -753,7 +1021,7 @@ void frame_vector::save_binary(binarystream::output& stream) const
 	while(vsize > 0) {
 		uint64_t count = (vsize > pageframes) ? pageframes : vsize;
 		size_t bytes = count * stride;
-		const unsigned char* content = get_page_buffer(pagenum++);
+		const unsigned char* content = readable_page(pagenum++).content;
 		stream.raw(content, bytes);
 		vsize -= count;
 	}
@@ -788,6 +1056,8 @@ void frame_vector::swap_data(frame_vector& v) throw()
 	std::swap(types, v.types);
 	std::swap(cache_page_num, v.cache_page_num);
 	std::swap(cache_page, v.cache_page);
+	std::swap(rcache_page_num, v.rcache_page_num);
+	std::swap(rcache_page, v.rcache_page);
 	std::swap(real_frame_count, v.real_frame_count);
 	if(!freeze_count)
 		call_framecount_notification(toldsize);
@@ -804,7 +1074,7 @@ int64_t frame_vector::find_frame(uint64_t n)
 	size_t pagenum = 0;
 	while(vsize > 0) {
 		uint64_t count = (vsize > pageframes) ? pageframes : vsize;
-		const unsigned char* content = get_page_buffer(pagenum++);
+		const unsigned char* content = readable_page(pagenum++).content;
 		size_t offset = 0;
 		for(unsigned i = 0; i < count; i++) {
 			if(frame::sync(content + offset)) n--;
@@ -826,7 +1096,7 @@ int64_t frame_vector::subframe_to_frame(uint64_t n)
 	size_t pagenum = 0;
 	size_t cpage = n / pageframes;
 	for(uint64_t p = 0; p < cpage; p++) {
-		const unsigned char* content = get_page_buffer(pagenum++);
+		const unsigned char* content = readable_page(pagenum++).content;
 		size_t offset = 0;
 		for(unsigned i = 0; i < pageframes; i++) {
 			if(frame::sync(content + offset)) ret++;
@@ -834,7 +1104,7 @@ int64_t frame_vector::subframe_to_frame(uint64_t n)
 		}
 	}
 	{
-		const unsigned char* content = get_page_buffer(pagenum++);
+		const unsigned char* content = readable_page(pagenum++).content;
 		size_t offset = 0;
 		unsigned idx = n % pageframes;
 		for(unsigned i = 0; i < idx; i++) {
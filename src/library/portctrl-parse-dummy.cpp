@@ -134,5 +134,33 @@ template<> void emit_write_axis(dummyarch& a, assembler::label_list& labels, ass
 {
 	throw std::runtime_error("ASM on this arch not supported");
 }
+
+template<> void emit_read_range_prologue(dummyarch& a, assembler::label_list& labels)
+{
+	throw std::runtime_error("ASM on this arch not supported");
+}
+
+template<> void emit_read_range_epilogue(dummyarch& a, assembler::label_list& labels)
+{
+	throw std::runtime_error("ASM on this arch not supported");
+}
+
+template<> void emit_read_range_button(dummyarch& a, assembler::label_list& labels, assembler::label& l,
+	assembler::label& end, int32_t offset, uint8_t mask)
+{
+	throw std::runtime_error("ASM on this arch not supported");
+}
+
+template<> void emit_read_range_axis(dummyarch& a, assembler::label_list& labels, assembler::label& l,
+	assembler::label& end, int32_t offset)
+{
+	throw std::runtime_error("ASM on this arch not supported");
+}
+
+template<> void emit_read_range_blank(dummyarch& a, assembler::label_list& labels, assembler::label& l,
+	assembler::label& end)
+{
+	throw std::runtime_error("ASM on this arch not supported");
+}
 }
 }
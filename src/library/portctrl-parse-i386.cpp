@@ -406,5 +406,124 @@ template<> void emit_write_axis(I386& a, assembler::label_list& labels, assemble
 	//Jump to epilogue.
 	a.jmp_long(end);
 }
+
+//Register holding the distance between frames in range read.
+I386::reg range_stride_reg(I386& a)
+{
+	return a.is_amd64() ? I386::reg_r10 : I386::reg_bx;
+}
+
+//Register holding the number of frames left in range read.
+I386::reg range_count_reg(I386& a)
+{
+	return a.is_amd64() ? I386::reg_r11 : I386::reg_bp;
+}
+
+template<> void emit_read_range_prologue(I386& a, assembler::label_list& labels)
+{
+	//Variable assignments:
+	//SI: State block of current frame.
+	//DI: Output position.
+	//R10/BX: Distance between frames.
+	//R11/BP: Frames left.
+	//DX: Controller number
+	//CX: Button index.
+	//AX: Pending value.
+
+	if(a.is_i386()) {
+		//Save registers and load the parameters from stack into variables. BX and BP are callee-save.
+		a.push_reg(I386::reg_si);
+		a.push_reg(I386::reg_di);
+		a.push_reg(I386::reg_bx);
+		a.push_reg(I386::reg_bp);
+		a.mov_reg_regmem(I386::reg_si, I386::reg_sp[24]);
+		a.mov_reg_regmem(I386::reg_bx, I386::reg_sp[28]);
+		a.mov_reg_regmem(I386::reg_bp, I386::reg_sp[32]);
+		a.mov_reg_regmem(I386::reg_dx, I386::reg_sp[36]);
+		a.mov_reg_regmem(I386::reg_cx, I386::reg_sp[40]);
+		a.mov_reg_regmem(I386::reg_di, I386::reg_sp[44]);
+	} else {
+		//On amd64, the stride and count come in DX and CX, which the dispatch needs. Move those out of the
+		//way first. The seventh parameter is on stack, just above the return address.
+		a.mov_reg_regmem(I386::reg_r10, I386::reg_dx);
+		a.mov_reg_regmem(I386::reg_r11, I386::reg_cx);
+		a.mov_reg_regmem(I386::reg_dx, I386::reg_r8);
+		a.mov_reg_regmem(I386::reg_cx, I386::reg_r9);
+		a.mov_reg_regmem(I386::reg_di, I386::reg_sp[8]);
+	}
+	//Zero out the pending value.
+	a.xor_reg_regmem(I386::reg_ax, I386::reg_ax);
+}
+
+template<> void emit_read_range_epilogue(I386& a, assembler::label_list& labels)
+{
+	//Restore the saved registers on i386.
+	if(a.is_i386()) a.pop_reg(I386::reg_bp);
+	if(a.is_i386()) a.pop_reg(I386::reg_bx);
+	if(a.is_i386()) a.pop_reg(I386::reg_di);
+	if(a.is_i386()) a.pop_reg(I386::reg_si);
+	//Return. This function has no return value.
+	a.ret();
+}
+
+//Emit the loop tail: Advance to next frame and output element, and loop back to <loop> if any frames are left.
+void emit_read_range_advance(I386& a, assembler::label& loop)
+{
+	a.add_reg_regmem(I386::reg_si, range_stride_reg(a));
+	a.add_regmem_imm(I386::reg_di, 2);
+	//Decrementing the count sets ZF when the last frame has been done.
+	a.add_regmem_imm(range_count_reg(a), -1);
+	a.jnz_short(loop);
+}
+
+template<> void emit_read_range_button(I386& a, assembler::label_list& labels, assembler::label& l,
+	assembler::label& end, int32_t offset, uint8_t mask)
+{
+	assembler::label& loop = labels;
+	//Label jumping to this code. If there are no frames, return immediately.
+	a.label(l);
+	a.cmp_regmem_imm(range_count_reg(a), 0);
+	a.jz_long(end);
+	a.label(loop);
+	//Set AX to 1 if the button bit is set, 0 otherwise and write it.
+	a.xor_reg_regmem(I386::reg_ax, I386::reg_ax);
+	a.test_regmem_imm8(I386::reg_si[offset], mask);
+	a.setnz_regmem(I386::reg_ax);	//Really AL.
+	a.mov_regmem_reg16(I386::reg_di[0], I386::reg_ax);
+	emit_read_range_advance(a, loop);
+	//Jump to epilogue.
+	a.jmp_long(end);
+}
+
+template<> void emit_read_range_axis(I386& a, assembler::label_list& labels, assembler::label& l,
+	assembler::label& end, int32_t offset)
+{
+	assembler::label& loop = labels;
+	//Label jumping to this code. If there are no frames, return immediately.
+	a.label(l);
+	a.cmp_regmem_imm(range_count_reg(a), 0);
+	a.jz_long(end);
+	a.label(loop);
+	//Copy the axis value. i386/amd64 is LE, so endianess is correct.
+	a.mov_reg_regmem16(I386::reg_ax, I386::reg_si[offset]);
+	a.mov_regmem_reg16(I386::reg_di[0], I386::reg_ax);
+	emit_read_range_advance(a, loop);
+	//Jump to epilogue.
+	a.jmp_long(end);
+}
+
+template<> void emit_read_range_blank(I386& a, assembler::label_list& labels, assembler::label& l,
+	assembler::label& end)
+{
+	assembler::label& loop = labels;
+	//Label jumping to this code. If there are no frames, return immediately.
+	a.label(l);
+	a.cmp_regmem_imm(range_count_reg(a), 0);
+	a.jz_long(end);
+	a.label(loop);
+	//The pending value is 0, write it. The state pointer is advanced too, but that does not matter.
+	a.mov_regmem_reg16(I386::reg_di[0], I386::reg_ax);
+	emit_read_range_advance(a, loop);
+}
 }
 }
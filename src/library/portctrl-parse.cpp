@@ -755,6 +755,9 @@ void type_generic::make_dynamic_blocks()
 			serialize = (size_t(*)(const type*, const unsigned char*, char*))m["serialize"];
 		if(m.count("deserialize"))
 			deserialize = (size_t(*)(const type*, unsigned char*, const char*))m["deserialize"];
+		if(m.count("read_range"))
+			read_range = (void(*)(const type*, const unsigned char*, size_t, size_t, unsigned, unsigned,
+				short*))m["read_range"];
 	} catch(std::exception& e) {
 		std::cerr << "Error assembling block: " << e.what() << std::endl;
 		delete reinterpret_cast<assembler::dynamic_code*>(dyncode_block);
@@ -936,6 +939,52 @@ void type_generic::make_routines(assembler::assembler& a, assembler::label_list&
 	}
 	a._label(wend);
 	codegen::emit_write_epilogue(as, labels);
+
+	a._label(labels, "read_range");
+	codegen::emit_read_range_prologue(as, labels);
+	assembler::label& rrend = labels;
+	assembler::label& rrblank = labels;
+	//Invalid controls fill the output with zeroes.
+	codegen::emit_read_dispatch(as, labels, controller_info->controllers.size(), ilog2controls, rrblank);
+	xlabels.clear();
+	for(size_t i = 0; i < controller_info->controllers.size(); i++) {
+		size_t cnt = controller_info->controllers[i].buttons.size();
+		for(size_t j = 0; j < cnt; j++) {
+			auto& c = indexinfo[indexbase[i] + j];
+			switch(c.type) {
+			case 0:
+				codegen::emit_read_label_bad(as, labels, rrblank);
+				break;
+			case 1:
+			case 2:
+				xlabels.push_back(&codegen::emit_read_label(as, labels));
+				break;
+			};
+		}
+		for(size_t j = cnt; j < mcontrols; j++)
+			codegen::emit_read_label_bad(as, labels, rrblank);
+	}
+	//Emit Routines.
+	lidx = 0;
+	for(size_t i = 0; i < controller_info->controllers.size(); i++) {
+		size_t cnt = controller_info->controllers[i].buttons.size();
+		for(size_t j = 0; j < cnt; j++) {
+			auto& c = indexinfo[indexbase[i] + j];
+			switch(c.type) {
+			case 0:
+				break;
+			case 1:
+				codegen::emit_read_range_button(as, labels, *xlabels[lidx++], rrend, c.offset, c.mask);
+				break;
+			case 2:
+				codegen::emit_read_range_axis(as, labels, *xlabels[lidx++], rrend, c.offset);
+				break;
+			};
+		}
+	}
+	codegen::emit_read_range_blank(as, labels, rrblank, rrend);
+	a._label(rrend);
+	codegen::emit_read_range_epilogue(as, labels);
 #endif
 }
 }
@@ -5,9 +5,15 @@
 #include <iostream>
 #include <iomanip>
 #include "arch-detect.hpp"
+#include "minmax.hpp"
+#if defined(ARCH_IS_I386) && defined(__GNUC__)
+#define SHA256_X86_KERNELS
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 
-//Since this isn't used for anything too performance-sensitive, just write a implementation, no need to specially
-//optimize.
+//The portable implementation is the fallback. On x86 CPUs supporting SHA extensions, those are used for single
+//hashes, and AVX2 is used to hash 8 messages at once in write_multi().
 
 namespace
 {
@@ -107,35 +113,246 @@ namespace
 	ROUND(b, c, d, e, f, g, h, a, i, 7)
 
 
-	void compress_sha256(uint32_t* state, uint32_t* datablock, unsigned& blockbytes)
-	{
-		uint32_t a = state[0];
-		uint32_t b = state[1];
-		uint32_t c = state[2];
-		uint32_t d = state[3];
-		uint32_t e = state[4];
-		uint32_t f = state[5];
-		uint32_t g = state[6];
-		uint32_t h = state[7];
-		uint32_t X, Xsigma0, Xsigma1;
-		ROUND8A(a, b, c, d, e, f, g, h, 0);
-		ROUND8A(a, b, c, d, e, f, g, h, 8);
-		ROUND8B(a, b, c, d, e, f, g, h, 16);
-		ROUND8B(a, b, c, d, e, f, g, h, 24);
-		ROUND8B(a, b, c, d, e, f, g, h, 32);
-		ROUND8B(a, b, c, d, e, f, g, h, 40);
-		ROUND8B(a, b, c, d, e, f, g, h, 48);
-		ROUND8B(a, b, c, d, e, f, g, h, 56);
-		state[0] += a;
-		state[1] += b;
-		state[2] += c;
-		state[3] += d;
-		state[4] += e;
-		state[5] += f;
-		state[6] += g;
-		state[7] += h;
-		memset(datablock, 0, 64);
-		blockbytes = 0;
+
+	void compress_portable(uint32_t* state, const uint8_t* data, size_t blocks)
+	{
+		uint32_t datablock[16];
+		for(; blocks; blocks--, data += 64) {
+			for(unsigned i = 0; i < 16; i++)
+				datablock[i] = (static_cast<uint32_t>(data[4 * i]) << 24) |
+					(static_cast<uint32_t>(data[4 * i + 1]) << 16) |
+					(static_cast<uint32_t>(data[4 * i + 2]) << 8) |
+					static_cast<uint32_t>(data[4 * i + 3]);
+			uint32_t a = state[0];
+			uint32_t b = state[1];
+			uint32_t c = state[2];
+			uint32_t d = state[3];
+			uint32_t e = state[4];
+			uint32_t f = state[5];
+			uint32_t g = state[6];
+			uint32_t h = state[7];
+			uint32_t X, Xsigma0, Xsigma1;
+			ROUND8A(a, b, c, d, e, f, g, h, 0);
+			ROUND8A(a, b, c, d, e, f, g, h, 8);
+			ROUND8B(a, b, c, d, e, f, g, h, 16);
+			ROUND8B(a, b, c, d, e, f, g, h, 24);
+			ROUND8B(a, b, c, d, e, f, g, h, 32);
+			ROUND8B(a, b, c, d, e, f, g, h, 40);
+			ROUND8B(a, b, c, d, e, f, g, h, 48);
+			ROUND8B(a, b, c, d, e, f, g, h, 56);
+			state[0] += a;
+			state[1] += b;
+			state[2] += c;
+			state[3] += d;
+			state[4] += e;
+			state[5] += f;
+			state[6] += g;
+			state[7] += h;
+		}
+	}
+
+#ifdef SHA256_X86_KERNELS
+	__attribute__((target("sha,sse4.1,ssse3")))
+	void compress_shani(uint32_t* state, const uint8_t* data, size_t blocks)
+	{
+		const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+		__m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state));
+		__m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4));
+		tmp = _mm_shuffle_epi32(tmp, 0xB1);			//CDAB
+		state1 = _mm_shuffle_epi32(state1, 0x1B);		//EFGH
+		__m128i state0 = _mm_alignr_epi8(tmp, state1, 8);	//ABEF
+		state1 = _mm_blend_epi16(state1, tmp, 0xF0);		//CDGH
+		for(; blocks; blocks--, data += 64) {
+			__m128i save0 = state0;
+			__m128i save1 = state1;
+			__m128i w[4];
+			for(unsigned i = 0; i < 4; i++)
+				w[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i)),
+					bswap);
+			for(unsigned r = 0; r < 16; r++) {
+				if(r >= 4) {
+					//w[r & 3] holds words 4r-16...4r-13, overwrite with words 4r...4r+3.
+					__m128i t = _mm_sha256msg1_epu32(w[r & 3], w[(r + 1) & 3]);
+					t = _mm_add_epi32(t, _mm_alignr_epi8(w[(r + 3) & 3], w[(r + 2) & 3], 4));
+					w[r & 3] = _mm_sha256msg2_epu32(t, w[(r + 3) & 3]);
+				}
+				__m128i msg = _mm_add_epi32(w[r & 3], _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+					k + 4 * r)));
+				state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+				msg = _mm_shuffle_epi32(msg, 0x0E);
+				state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+			}
+			state0 = _mm_add_epi32(state0, save0);
+			state1 = _mm_add_epi32(state1, save1);
+		}
+		tmp = _mm_shuffle_epi32(state0, 0x1B);			//FEBA
+		state1 = _mm_shuffle_epi32(state1, 0xB1);		//DCHG
+		state0 = _mm_blend_epi16(tmp, state1, 0xF0);		//DCBA
+		state1 = _mm_alignr_epi8(state1, tmp, 8);		//ABEF
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(state), state0);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), state1);
+	}
+
+#define VROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n))
+
+	//Transpose 8x8 matrix of 32-bit words.
+	__attribute__((target("avx2")))
+	inline void transpose8(__m256i* r)
+	{
+		__m256i t[8], u[8];
+		for(unsigned i = 0; i < 8; i += 4) {
+			t[i + 0] = _mm256_unpacklo_epi32(r[i + 0], r[i + 1]);
+			t[i + 1] = _mm256_unpackhi_epi32(r[i + 0], r[i + 1]);
+			t[i + 2] = _mm256_unpacklo_epi32(r[i + 2], r[i + 3]);
+			t[i + 3] = _mm256_unpackhi_epi32(r[i + 2], r[i + 3]);
+			u[i + 0] = _mm256_unpacklo_epi64(t[i + 0], t[i + 2]);
+			u[i + 1] = _mm256_unpackhi_epi64(t[i + 0], t[i + 2]);
+			u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+			u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+		}
+		for(unsigned i = 0; i < 4; i++) {
+			r[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+			r[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+		}
+	}
+
+	//Compress one block for each of 8 independent states.
+	__attribute__((target("avx2")))
+	void compress_avx2_x8(uint32_t* const* states, const uint8_t* const* data)
+	{
+		const __m256i bswap = _mm256_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL,
+			0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+		__m256i s[8], w[16];
+		for(unsigned i = 0; i < 8; i++)
+			s[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(states[i]));
+		transpose8(s);
+		for(unsigned i = 0; i < 8; i++) {
+			w[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data[i]));
+			w[i + 8] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data[i] + 32));
+		}
+		transpose8(w);
+		transpose8(w + 8);
+		for(unsigned i = 0; i < 16; i++)
+			w[i] = _mm256_shuffle_epi8(w[i], bswap);
+		__m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+		for(unsigned i = 0; i < 64; i++) {
+			if(i >= 16) {
+				__m256i w1 = w[(i + 1) & 15];
+				__m256i w14 = w[(i + 14) & 15];
+				__m256i es0 = _mm256_xor_si256(_mm256_xor_si256(VROTR(w1, 7), VROTR(w1, 18)),
+					_mm256_srli_epi32(w1, 3));
+				__m256i es1 = _mm256_xor_si256(_mm256_xor_si256(VROTR(w14, 17), VROTR(w14, 19)),
+					_mm256_srli_epi32(w14, 10));
+				w[i & 15] = _mm256_add_epi32(_mm256_add_epi32(w[i & 15], w[(i + 9) & 15]),
+					_mm256_add_epi32(es0, es1));
+			}
+			__m256i s1 = _mm256_xor_si256(_mm256_xor_si256(VROTR(e, 6), VROTR(e, 11)), VROTR(e, 25));
+			__m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+			__m256i X = _mm256_add_epi32(_mm256_add_epi32(h, s1), _mm256_add_epi32(ch,
+				_mm256_add_epi32(w[i & 15], _mm256_set1_epi32(k[i]))));
+			__m256i s0 = _mm256_xor_si256(_mm256_xor_si256(VROTR(a, 2), VROTR(a, 13)), VROTR(a, 22));
+			__m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a,
+				b)));
+			h = g;
+			g = f;
+			f = e;
+			e = _mm256_add_epi32(d, X);
+			d = c;
+			c = b;
+			b = a;
+			a = _mm256_add_epi32(X, _mm256_add_epi32(s0, maj));
+		}
+		s[0] = _mm256_add_epi32(s[0], a);
+		s[1] = _mm256_add_epi32(s[1], b);
+		s[2] = _mm256_add_epi32(s[2], c);
+		s[3] = _mm256_add_epi32(s[3], d);
+		s[4] = _mm256_add_epi32(s[4], e);
+		s[5] = _mm256_add_epi32(s[5], f);
+		s[6] = _mm256_add_epi32(s[6], g);
+		s[7] = _mm256_add_epi32(s[7], h);
+		transpose8(s);
+		for(unsigned i = 0; i < 8; i++)
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(states[i]), s[i]);
+	}
+
+	bool cpu_has_shani()
+	{
+		unsigned a, b, c, d;
+		if(!__get_cpuid(1, &a, &b, &c, &d) || !(c & bit_SSSE3) || !(c & bit_SSE4_1))
+			return false;
+		if(__get_cpuid_max(0, NULL) < 7)
+			return false;
+		__cpuid_count(7, 0, a, b, c, d);
+		return (b >> 29) & 1;
+	}
+
+	bool cpu_has_avx2()
+	{
+		unsigned a, b, c, d;
+		if(!__get_cpuid(1, &a, &b, &c, &d) || !(c & bit_OSXSAVE) || !(c & bit_AVX))
+			return false;
+		//The OS must save YMM state.
+		uint32_t xcr0_lo, xcr0_hi;
+		asm volatile(".byte 0x0f, 0x01, 0xd0" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+		if((xcr0_lo & 6) != 6)
+			return false;
+		if(__get_cpuid_max(0, NULL) < 7)
+			return false;
+		__cpuid_count(7, 0, a, b, c, d);
+		return (b >> 5) & 1;
+	}
+#endif
+
+	struct backend
+	{
+		const char* name;
+		//Compress consequtive blocks.
+		void (*compress)(uint32_t* state, const uint8_t* data, size_t blocks);
+		//Compress one block for each of 8 states. NULL if not supported.
+		void (*compress_x8)(uint32_t* const* states, const uint8_t* const* data);
+	};
+
+	bool make_backend(backend& b, const std::string& name)
+	{
+		if(name == "portable") {
+			b.name = "portable";
+			b.compress = compress_portable;
+			b.compress_x8 = NULL;
+			return true;
+		}
+#ifdef SHA256_X86_KERNELS
+		if(name == "shani" && cpu_has_shani()) {
+			b.name = "shani";
+			b.compress = compress_shani;
+			b.compress_x8 = NULL;
+			return true;
+		}
+		if(name == "avx2" && cpu_has_avx2()) {
+			b.name = "avx2";
+			b.compress = compress_portable;
+			b.compress_x8 = compress_avx2_x8;
+			return true;
+		}
+#endif
+		if(name == "auto") {
+			//SHA extensions are faster than multi-buffer AVX2, so prefer them.
+			return make_backend(b, "shani") || make_backend(b, "avx2") || make_backend(b, "portable");
+		}
+		return false;
+	}
+
+	backend& current_backend()
+	{
+		static backend b;
+		static bool init = (make_backend(b, "auto"), true);
+		(void)init;
+		return b;
+	}
+
+	void store_hash(uint8_t* hash, const uint32_t* state)
+	{
+		for(unsigned i = 0; i < 32; i++)
+			hash[i] = state[i / 4] >> (24 - i % 4 * 8);
 	}
 }
 
@@ -143,7 +360,6 @@ void sha256::real_init()
 {
 	for(unsigned i = 0; i < 8; i++)
 		state[i] = sha256_initial_state[i];
-	memset(datablock, 0, sizeof(datablock));
 	blockbytes = 0;
 	totalbytes = 0;
 }
@@ -154,60 +370,107 @@ void sha256::real_destroy()
 
 void sha256::real_finish(uint8_t* hash)
 {
-	datablock[blockbytes / 4] |= (static_cast<uint32_t>(0x80) << (24 - blockbytes % 4 * 8));
-	if(blockbytes > 55)
+	backend& b = current_backend();
+	datablock[blockbytes++] = 0x80;
+	if(blockbytes > 56) {
 		//We can't fit the length into this block.
-		compress_sha256(state, datablock, blockbytes);
+		memset(datablock + blockbytes, 0, 64 - blockbytes);
+		b.compress(state, datablock, 1);
+		blockbytes = 0;
+	}
+	memset(datablock + blockbytes, 0, 56 - blockbytes);
 	//Write the length.
-	datablock[14] = totalbytes >> 29;
-	datablock[15] = totalbytes << 3;
-	compress_sha256(state, datablock, blockbytes);
-	for(unsigned i = 0; i < 32; i++)
-		hash[i] = state[i / 4] >> (24 - i % 4 * 8);
+	for(unsigned i = 0; i < 8; i++)
+		datablock[56 + i] = (totalbytes << 3) >> (56 - 8 * i);
+	b.compress(state, datablock, 1);
+	blockbytes = 0;
+	store_hash(hash, state);
 }
 
 void sha256::real_write(const uint8_t* data, size_t datalen)
 {
-#ifdef ARCH_IS_I386
-	//First pad blockbytes to multiple of four.
+	backend& b = current_backend();
+	totalbytes += datalen;
+	//First fill partial block.
+	if(blockbytes) {
+		size_t fill = min(datalen, static_cast<size_t>(64 - blockbytes));
+		memcpy(datablock + blockbytes, data, fill);
+		blockbytes += fill;
+		data += fill;
+		datalen -= fill;
+		if(blockbytes < 64)
+			return;
+		b.compress(state, datablock, 1);
+		blockbytes = 0;
+	}
+	//Then process full blocks directly from the input.
+	if(datalen >= 64) {
+		b.compress(state, data, datalen / 64);
+		data += datalen & ~static_cast<size_t>(63);
+		datalen &= 63;
+	}
+	//And finally buffer the tail.
+	memcpy(datablock, data, datalen);
+	blockbytes = datalen;
+}
+
+void sha256::write_multi(sha256* const* ctx, const uint8_t* const* data, size_t datalen, size_t count) throw()
+{
+	backend& b = current_backend();
 	size_t i = 0;
-	while(blockbytes & 3 && i < datalen) {
-		datablock[blockbytes / 4] |= (static_cast<uint32_t>(data[i]) << (24 - blockbytes % 4 * 8));
-		blockbytes++;
-		if(blockbytes == 64)
-			compress_sha256(state, datablock, blockbytes);
-		i++;
-	}
-	size_t blocks = (datalen - i) / 4;
-	unsigned ptr = blockbytes / 4;
-	//Then process four bytes ata time.
-	for(size_t j = 0; j < blocks; j++) {
-		uint32_t x = *reinterpret_cast<const uint32_t*>(data + i);
-		asm("bswap %0" : "+r"(x));
-		datablock[ptr] = x;
-		ptr = (ptr + 1) & 15;
-		i += 4;
-		blockbytes += 4;
-		if(blockbytes == 64)
-			compress_sha256(state, datablock, blockbytes);
-	}
-	//And finally process tail.
-	while(i < datalen) {
-		datablock[blockbytes / 4] |= (static_cast<uint32_t>(data[i]) << (24 - blockbytes % 4 * 8));
-		blockbytes++;
-		if(blockbytes == 64)
-			compress_sha256(state, datablock, blockbytes);
-		i++;
-	}
-#else
-	for(size_t i = 0; i < datalen; i++) {
-		datablock[blockbytes / 4] |= (static_cast<uint32_t>(data[i]) << (24 - blockbytes % 4 * 8));
-		blockbytes++;
-		if(blockbytes == 64)
-			compress_sha256(state, datablock, blockbytes);
+	if(b.compress_x8) {
+		//Contexts processed in lockstep must have the same amount of data buffered.
+		for(; i + 1 < count; i += 8) {
+			size_t lanes = min(count - i, static_cast<size_t>(8));
+			bool ok = true;
+			for(size_t j = 0; j < lanes; j++)
+				ok = ok && !ctx[i + j]->finished && ctx[i + j]->blockbytes == ctx[i]->blockbytes;
+			if(!ok || lanes < 2)
+				break;
+			uint32_t dummy_state[8];
+			uint32_t* states[8];
+			const uint8_t* blocks[8];
+			for(size_t j = 0; j < 8; j++)
+				states[j] = (j < lanes) ? ctx[i + j]->state : dummy_state;
+			size_t bb = ctx[i]->blockbytes;
+			size_t off = 0;
+			while(datalen - off >= 64 - bb) {
+				for(size_t j = 0; j < lanes; j++) {
+					if(bb) {
+						memcpy(ctx[i + j]->datablock + bb, data[i + j], 64 - bb);
+						blocks[j] = ctx[i + j]->datablock;
+					} else
+						blocks[j] = data[i + j] + off;
+				}
+				for(size_t j = lanes; j < 8; j++)
+					blocks[j] = blocks[0];
+				b.compress_x8(states, blocks);
+				off += 64 - bb;
+				bb = 0;
+			}
+			for(size_t j = 0; j < lanes; j++) {
+				memcpy(ctx[i + j]->datablock + bb, data[i + j] + off, datalen - off);
+				ctx[i + j]->blockbytes = bb + datalen - off;
+				ctx[i + j]->totalbytes += datalen;
+			}
+		}
 	}
-#endif
-	totalbytes += datalen;
+	for(; i < count; i++)
+		ctx[i]->write(data[i], datalen);
+}
+
+std::string sha256::get_backend()
+{
+	return current_backend().name;
+}
+
+bool sha256::set_backend(const std::string& name)
+{
+	backend b;
+	if(!make_backend(b, name))
+		return false;
+	current_backend() = b;
+	return true;
 }
 
 #ifdef SHA256_SELFTEST
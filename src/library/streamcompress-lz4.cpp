@@ -0,0 +1,99 @@
+#ifdef LIBLZ4_AVAILABLE
+#include "streamcompress.hpp"
+#include "string.hpp"
+#include <lz4frame.h>
+#include <lz4hc.h>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+	//Amount of input compressed at once.
+	const size_t chunk_size = 65536;
+
+	struct lz4 : public streamcompress::base
+	{
+		lz4(int level)
+		{
+			if(LZ4F_isError(LZ4F_createCompressionContext(&ctx, LZ4F_VERSION)))
+				throw std::bad_alloc();
+			memset(&prefs, 0, sizeof(prefs));
+			prefs.compressionLevel = level;
+			prefs.frameInfo.blockSizeID = LZ4F_max4MB;
+			prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+			pending_pos = 0;
+			started = false;
+			ended = false;
+		}
+		~lz4()
+		{
+			LZ4F_freeCompressionContext(ctx);
+		}
+		bool process(uint8_t*& in, size_t& insize, uint8_t*& out, size_t& outsize, bool final)
+		{
+			//The frame API needs output space for the worst case, so compress to internal buffer and
+			//copy from there.
+			while(true) {
+				size_t tocopy = min(pending.size() - pending_pos, outsize);
+				memcpy(out, pending.data() + pending_pos, tocopy);
+				out += tocopy;
+				outsize -= tocopy;
+				pending_pos += tocopy;
+				if(pending_pos < pending.size())
+					return false;
+				pending.clear();
+				pending_pos = 0;
+				if(ended)
+					return true;
+				if(!started) {
+					pending.resize(LZ4F_HEADER_SIZE_MAX);
+					pending.resize(check(LZ4F_compressBegin(ctx, &pending[0], pending.size(),
+						&prefs)));
+					started = true;
+				} else if(insize) {
+					size_t amount = min(insize, chunk_size);
+					pending.resize(LZ4F_compressBound(amount, &prefs));
+					pending.resize(check(LZ4F_compressUpdate(ctx, &pending[0], pending.size(), in,
+						amount, NULL)));
+					in += amount;
+					insize -= amount;
+				} else if(final) {
+					pending.resize(LZ4F_compressBound(0, &prefs));
+					pending.resize(check(LZ4F_compressEnd(ctx, &pending[0], pending.size(), NULL)));
+					ended = true;
+				} else
+					return false;
+			}
+		}
+	private:
+		static size_t check(size_t r)
+		{
+			if(LZ4F_isError(r))
+				throw std::runtime_error(std::string("lz4: ") + LZ4F_getErrorName(r));
+			return r;
+		}
+		LZ4F_compressionContext_t ctx;
+		LZ4F_preferences_t prefs;
+		std::vector<uint8_t> pending;
+		size_t pending_pos;
+		bool started;
+		bool ended;
+	};
+
+	struct foo {
+		foo() {
+			streamcompress::base::do_register("lz4", [](const std::string& v) -> streamcompress::base* {
+				auto a = streamcompress::parse_attributes(v);
+				//Levels 0-2 are fast mode, 3 and up use the HC compressor.
+				int level = 0;
+				if(a.count("level")) level = parse_value<int>(a["level"]);
+				if(level > LZ4HC_CLEVEL_MAX) level = LZ4HC_CLEVEL_MAX;
+				return new lz4(level);
+			});
+		}
+		~foo() {
+			streamcompress::base::do_unregister("lz4");
+		}
+	} _foo;
+}
+#endif
@@ -13,11 +13,17 @@
 #include <lzma.h>
 #include <stdexcept>
 
+//Multithreaded encoder is available since liblzma 5.2.0.
+#if LZMA_VERSION >= 50020002
+#define LZMA_HAS_MT
+#endif
+
 namespace
 {
 	struct lzma_options
 	{
 		bool xz;
+		uint32_t threads;
 		lzma_filter* fchain;
 		lzma_check check;
 		lzma_options_lzma lzmaopts;
@@ -30,7 +36,17 @@ namespace
 			memset(&strm, 0, sizeof(strm));
 			lzma_ret r;
 			if(opts.xz) {
-				r = lzma_stream_encoder(&strm, opts.fchain, opts.check);
+#ifdef LZMA_HAS_MT
+				if(opts.threads != 1) {
+					lzma_mt mt;
+					memset(&mt, 0, sizeof(mt));
+					mt.threads = opts.threads;
+					mt.filters = opts.fchain;
+					mt.check = opts.check;
+					r = lzma_stream_encoder_mt(&strm, &mt);
+				} else
+#endif
+					r = lzma_stream_encoder(&strm, opts.fchain, opts.check);
 			} else {
 				r = lzma_alone_encoder(&strm, &opts.lzmaopts);
 			}
@@ -86,8 +102,9 @@ namespace
 				bool extreme = false;
 				if(a.count("level")) level = parse_value<unsigned>(a["level"]);
 				if(level > 9) level = 9;
-				if(a.count("extreme")) extreme  = parse_value<bool>(a["level"]);
+				if(a.count("extreme")) extreme = (string_to_bool(a["extreme"]) == 1);
 				opts.xz = false;
+				opts.threads = 1;
 				lzma_lzma_preset(&opts.lzmaopts, level | (extreme ? LZMA_PRESET_EXTREME : 0));
 				return new lzma(opts);
 			});
@@ -96,10 +113,18 @@ namespace
 				auto a = streamcompress::parse_attributes(v);
 				unsigned level = 7;
 				bool extreme = false;
+				//Single-threaded unless asked for, as multithreaded output differs and takes more memory.
+				unsigned threads = 1;
 				lzma_options_lzma opt_lzma2;
 				if(a.count("level")) level = parse_value<unsigned>(a["level"]);
 				if(level > 9) level = 9;
-				if(a.count("extreme")) extreme  = parse_value<bool>(a["level"]);
+				if(a.count("extreme")) extreme = (string_to_bool(a["extreme"]) == 1);
+				//0 => One thread per processor.
+				if(a.count("threads")) threads = parse_value<unsigned>(a["threads"]);
+#ifdef LZMA_HAS_MT
+				if(!threads) threads = lzma_cputhreads();
+#endif
+				if(!threads) threads = 1;
 				lzma_lzma_preset(&opt_lzma2, level | (extreme ? LZMA_PRESET_EXTREME : 0));
 				lzma_filter filterchain[] = {
 					{ LZMA_FILTER_LZMA2, &opt_lzma2 },
@@ -108,6 +133,7 @@ namespace
 				opts.fchain = filterchain;
 				opts.check = LZMA_CHECK_CRC64;
 				opts.xz = true;
+				opts.threads = threads;
 				return new lzma(opts);
 			});
 		}
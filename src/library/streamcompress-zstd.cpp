@@ -0,0 +1,77 @@
+#ifdef LIBZSTD_AVAILABLE
+#include "streamcompress.hpp"
+#include "string.hpp"
+#include "threads.hpp"
+#include <zstd.h>
+#include <stdexcept>
+
+namespace
+{
+	struct zstd : public streamcompress::base
+	{
+		zstd(int level, unsigned threads, bool long_matching)
+		{
+			ctx = ZSTD_createCCtx();
+			if(!ctx)
+				throw std::bad_alloc();
+			try {
+				check(ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, level));
+				check(ZSTD_CCtx_setParameter(ctx, ZSTD_c_enableLongDistanceMatching,
+					long_matching ? 1 : 0));
+				//Library built without thread support refuses nbWorkers, just compress in one thread
+				//then.
+				if(threads > 1)
+					ZSTD_CCtx_setParameter(ctx, ZSTD_c_nbWorkers, threads);
+			} catch(...) {
+				ZSTD_freeCCtx(ctx);
+				throw;
+			}
+		}
+		~zstd()
+		{
+			ZSTD_freeCCtx(ctx);
+		}
+		bool process(uint8_t*& in, size_t& insize, uint8_t*& out, size_t& outsize, bool final)
+		{
+			ZSTD_inBuffer ib = {in, insize, 0};
+			ZSTD_outBuffer ob = {out, outsize, 0};
+			size_t r = check(ZSTD_compressStream2(ctx, &ob, &ib, final ? ZSTD_e_end : ZSTD_e_continue));
+			in += ib.pos;
+			insize -= ib.pos;
+			out += ob.pos;
+			outsize -= ob.pos;
+			//With ZSTD_e_end, 0 means frame is complete and flushed.
+			return final && !insize && !r;
+		}
+	private:
+		static size_t check(size_t r)
+		{
+			if(ZSTD_isError(r))
+				throw std::runtime_error(std::string("zstd: ") + ZSTD_getErrorName(r));
+			return r;
+		}
+		ZSTD_CCtx* ctx;
+	};
+
+	struct foo {
+		foo() {
+			streamcompress::base::do_register("zstd", [](const std::string& v) -> streamcompress::base* {
+				auto a = streamcompress::parse_attributes(v);
+				int level = 9;
+				unsigned nthreads = 0;
+				bool long_matching = false;
+				if(a.count("level")) level = parse_value<int>(a["level"]);
+				if(level > ZSTD_maxCLevel()) level = ZSTD_maxCLevel();
+				//0 => One thread per processor.
+				if(a.count("threads")) nthreads = parse_value<unsigned>(a["threads"]);
+				if(!nthreads) nthreads = threads::thread::hardware_concurrency();
+				if(a.count("long")) long_matching = (string_to_bool(a["long"]) == 1);
+				return new zstd(level, nthreads, long_matching);
+			});
+		}
+		~foo() {
+			streamcompress::base::do_unregister("zstd");
+		}
+	} _foo;
+}
+#endif
@@ -384,7 +384,40 @@ bool reader::read_linefile(const std::string& member, std::string& out, bool con
 
 void reader::read_raw_file(const std::string& member, std::vector<char>& out)
 {
+	if(!offsets.count(member))
+		throw std::runtime_error("No such file '" + member + "' in zip archive");
+	zipstream->clear();
+	zipstream->seekg(offsets[member], std::ios::beg);
+	zipfile_member_info info = parse_member(*zipstream);
+	if(info.compression == 8) {
+		//The size is known, so inflate the whole member in one go, instead of streaming it. The extra output
+		//byte catches members that are longer than they should be (and zlib does not allow empty output).
+		std::vector<char> in(info.compressed_size);
+		std::vector<char> _out(info.uncompressed_size + 1);
+		zipstream->clear();
+		zipstream->seekg(info.data_offset, std::ios::beg);
+		if(in.size())
+			zipstream->read(&in[0], in.size());
+		if(!*zipstream)
+			throw std::runtime_error("Can't read compressed data from ZIP file");
+		z_stream z;
+		memset(&z, 0, sizeof(z));
+		if(inflateInit2(&z, -MAX_WBITS) != Z_OK)
+			throw std::runtime_error("Can't initialize decompressor");
+		z.next_in = reinterpret_cast<Bytef*>(in.size() ? &in[0] : NULL);
+		z.avail_in = in.size();
+		z.next_out = reinterpret_cast<Bytef*>(&_out[0]);
+		z.avail_out = _out.size();
+		int r = inflate(&z, Z_FINISH);
+		inflateEnd(&z);
+		if(r != Z_STREAM_END || z.total_out != info.uncompressed_size)
+			throw std::runtime_error("ZIP archive corrupt: Bad compressed data");
+		_out.resize(info.uncompressed_size);
+		std::swap(out, _out);
+		return;
+	}
 	std::vector<char> _out;
+	_out.reserve(info.uncompressed_size);
 	std::istream& m = (*this)[member];
 	try {
 		boost::iostreams::back_insert_device<std::vector<char>> rd(_out);
@@ -394,7 +427,7 @@ void reader::read_raw_file(const std::string& member, std::vector<char>& out)
 		delete &m;
 		throw;
 	}
-	out = _out;
+	std::swap(out, _out);
 }
 
 writer::writer(const std::string& zipfile, unsigned _compression)
@@ -562,7 +595,8 @@ void writer::write_raw_file(const std::string& member, const std::vector<char>&
 {
 	std::ostream& m = create_file(member);
 	try {
-		m.write(&content[0], content.size());
+		if(content.size())
+			m.write(&content[0], content.size());
 		if(!m)
 			throw std::runtime_error("Can't write ZIP file member");
 		close_file();
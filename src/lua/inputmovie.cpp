@@ -184,7 +184,7 @@ namespace
 
 		if(n >= v.size())
 			throw std::runtime_error("Requested frame outside movie");
-		portctrl::frame _f = v[n];
+		portctrl::frame _f = v.get(n);
 		lua::_class<lua_inputframe>::create(L, _f);
 		return 1;
 	}
@@ -297,7 +297,7 @@ namespace
 		}
 		v[v.size() - 1] = f->get_frame();
 		if(&v == core.mlogic->get_mfile().input) {
-			if(!v[v.size() - 1].sync()) {
+			if(!v.is_sync(v.size() - 1)) {
 				core.supdater->update();
 			}
 			core.dispatch->status_update();
@@ -374,11 +374,10 @@ namespace
 		{
 			portctrl::frame_vector::notify_freeze freeze(dstv);
 			//Add enough blank frames to make the copy.
-			while(dst + count > dstv.size())
-				dstv.append(dstv.blank_frame(false));
+			if(dst + count > dstv.size())
+				dstv.resize(dst + count);
 
-			for(uint64_t i = backwards ? (count - 1) : 0; i < count; i = backwards ? (i - 1) : (i + 1))
-				dstv[dst + i] = srcv[src + i];
+			dstv.copy_frames(dst, srcv, src, count, backwards);
 		}
 		if(&dstv == core.mlogic->get_mfile().input) {
 			core.supdater->update();
@@ -407,14 +406,15 @@ namespace
 			while(vsize > 0) {
 				uint64_t count = (vsize > pageframes) ? pageframes : vsize;
 				size_t bytes = count * stride;
-				unsigned char* content = v.get_page_buffer(pagenum++);
-				file.write(reinterpret_cast<char*>(content), bytes);
+				const unsigned char* content = const_cast<const portctrl::frame_vector&>(v).
+					get_page_buffer(pagenum++);
+				file.write(reinterpret_cast<const char*>(content), bytes);
 				vsize -= count;
 			}
 		} else {
 			char buf[MAX_SERIALIZED_SIZE];
 			for(uint64_t i = 0; i < v.size(); i++) {
-				v[i].serialize(buf);
+				v.get(i).serialize(buf);
 				file << buf << std::endl;
 			}
 		}
@@ -488,7 +488,7 @@ namespace
 		{
 			char buf[MAX_SERIALIZED_SIZE];
 			for(uint64_t i = 0; i < v.size(); i++) {
-				v[i].serialize(buf);
+				v.get(i).serialize(buf);
 				messages << buf << std::endl;
 			}
 			return 0;
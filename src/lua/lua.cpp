@@ -36,6 +36,7 @@ lua::class_group lua_class_pure;
 lua::class_group lua_class_movie;
 lua::class_group lua_class_memory;
 lua::class_group lua_class_fileio;
+lua::class_group lua_class_worker;
 
 namespace
 {
@@ -300,6 +301,16 @@ void lua_state::callback_do_rewind() throw()
 	run_callback(*on_rewind);
 }
 
+void lua_state::callback_pre_rewind() throw()
+{
+	run_callback(*on_pre_rewind);
+}
+
+void lua_state::callback_post_rewind() throw()
+{
+	run_callback(*on_post_rewind);
+}
+
 void lua_state::callback_do_idle() throw()
 {
 	idle_hook_time = 0x7EFFFFFFFFFFFFFFULL;
@@ -437,6 +448,7 @@ void init_lua(emulator_instance& core) throw()
 		core.lua->add_class_group(lua_class_movie);
 		core.lua->add_class_group(lua_class_memory);
 		core.lua->add_class_group(lua_class_fileio);
+		core.lua->add_class_group(lua_class_worker);
 	} catch(std::exception& e) {
 		messages << "Can't initialize Lua." << std::endl;
 		fatal_error();
@@ -639,12 +639,24 @@ namespace
 	int hash_state(lua::state& L, lua::parameters& P)
 	{
 		auto& core = CORE();
-		auto x = core.rom->save_core_state();
-		size_t offset = x.size() - 32;
+		//Scripts hash state every frame, so keep the buffer around.
+		thread_local std::vector<char> x;
+		size_t offset = core.rom->save_core_state(x) - 32;
 		L.pushlstring(hex::b_to((uint8_t*)&x[offset], 32));
 		return 1;
 	}
 
+	int hash_state_incremental(lua::state& L, lua::parameters& P)
+	{
+		auto& core = CORE();
+		uint8_t hash[32];
+		//Without modified page tracking, the memory areas might not hold all of the state.
+		if(!core.memory->hash_linear_incremental(hash))
+			return hash_state(L, P);
+		L.pushlstring(hex::b_to(hash, 32));
+		return 1;
+	}
+
 	template<typename H, void(*update)(H& state, const char* mem, size_t memsize),
 		std::string(*read)(H& state), bool extra>
 	int hash_core(H& state, lua::state& L, lua::parameters& P)
@@ -847,6 +859,7 @@ namespace
 		{"read_vma", read_vma},
 		{"find_vma", find_vma},
 		{"hash_state", hash_state},
+		{"hash_state_incremental", hash_state_incremental},
 		{"hash_region", hash_region<false>},
 		{"hash_region2", hash_region<true>},
 		{"hash_region_skein", hash_region_skein},
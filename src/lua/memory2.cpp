@@ -349,6 +349,7 @@ namespace
 				if(addr + i >= vmasize)
 					throw std::runtime_error("Write out of range");
 				vmabuf[addr + i] = L.tointeger(-1);
+				g.first->mark_dirty(addr + i, 1);
 				L.pop(1);
 			}
 		} else {
@@ -123,7 +123,7 @@ namespace
 		while(++f < u2->console_state.save_frame) {
 			if(u2->ptr < s)
 				u2->ptr++;
-			while(u2->ptr < s && !(*mfile.input)[u2->ptr].sync())
+			while(u2->ptr < s && !mfile.input->is_sync(u2->ptr))
 				u2->ptr++;
 		}
 		return 1;
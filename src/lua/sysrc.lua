@@ -69,6 +69,8 @@ gui.image = classes.IMAGELOADER;
 gui.font = classes.CUSTOMFONT;
 iconv = classes.ICONV;
 filereader = classes.FILEREADER;
+lua = lua or {};
+lua.worker = classes.WORKER;
 
 -- Some ctors
 memory2=classes.VMALIST.new();
@@ -86,6 +88,7 @@ iconv_new = classes.ICONV.new;
 create_ibind = classes.INVERSEBIND.new;
 create_command = classes.COMMANDBIND.new;
 open_file = classes.FILEREADER.open;
+lua.spawn_worker = classes.WORKER.new;
 
 local do_arg_err = function(what, n, name)
 	error("Expected "..what.." as argument #"..n.." of "..name);
@@ -0,0 +1,626 @@
+#include "lua/internal.hpp"
+#include "core/instance.hpp"
+#include "core/messages.hpp"
+#include "core/queue.hpp"
+#include "library/serialization.hpp"
+#include "library/string.hpp"
+#include "library/threads.hpp"
+#include <list>
+#include <set>
+#include <memory>
+#include <cstring>
+extern "C" {
+#include <lualib.h>
+}
+
+/*
+ * Lua workers run Lua code in independent Lua states on a pool of threads. The worker states only get the pure
+ * functions and classes (no gui, memory, input, ...), and the only way to communicate with the main state is
+ * by passing serialized values.
+ */
+namespace
+{
+	//Maximum nesting depth of tables in passed values.
+	const unsigned max_value_depth = 64;
+	//How often (in Lua VM instructions) running workers check for termination.
+	const int quit_check_interval = 10000;
+
+	char worker_registry_key;
+
+	lua::function_group lua_func_worker;
+
+	const char* worker_prelude = "\
+string.byteU=_lsnes_string_byteU;\
+string.charU=_lsnes_string_charU;\
+string.regex=_lsnes_string_regex;\
+string.hex=_lsnes_string_hex;\
+string.lpad=_lsnes_string_lpad;\
+string.rpad=_lsnes_string_rpad;\
+loadfile=loadfile2;\
+dofile=dofile2;\
+";
+
+	void serialize_value(lua::state& L, int idx, std::string& out, unsigned depth)
+	{
+		char buf[9];
+		if(idx < 0)
+			idx = L.gettop() + idx + 1;
+		switch(L.type(idx)) {
+		case LUA_TNIL:
+			out.push_back('n');
+			break;
+		case LUA_TBOOLEAN:
+			out.push_back(L.toboolean(idx) ? 't' : 'f');
+			break;
+		case LUA_TNUMBER:
+#ifdef LUA_SUPPORTS_INTEGERS
+			if(lua_isinteger(L.handle(), idx)) {
+				buf[0] = 'i';
+				serialization::s64l(buf + 1, L.tointeger(idx));
+				out.append(buf, 9);
+				break;
+			}
+#endif
+			{
+				double v = L.tonumber(idx);
+				uint64_t raw;
+				memcpy(&raw, &v, sizeof(raw));
+				buf[0] = 'd';
+				serialization::u64l(buf + 1, raw);
+				out.append(buf, 9);
+			}
+			break;
+		case LUA_TSTRING: {
+			size_t len;
+			const char* s = L.tolstring(idx, len);
+			buf[0] = 's';
+			serialization::u64l(buf + 1, len);
+			out.append(buf, 9);
+			out.append(s, len);
+			break;
+		}
+		case LUA_TTABLE:
+			if(depth >= max_value_depth)
+				throw std::runtime_error("Value passed to worker nested too deeply (cyclic table?)");
+			out.push_back('{');
+			L.pushnil();
+			while(L.next(idx)) {
+				serialize_value(L, -2, out, depth + 1);
+				serialize_value(L, -1, out, depth + 1);
+				L.pop(1);
+			}
+			out.push_back('}');
+			break;
+		default:
+			(stringfmt() << "Can't pass value of type " << lua_typename(L.handle(), L.type(idx))
+				<< " to/from worker").throwex();
+		}
+	}
+
+	std::string serialize_value(lua::state& L, int idx)
+	{
+		std::string out;
+		serialize_value(L, idx, out, 0);
+		return out;
+	}
+
+	void push_value(lua::state& L, const std::string& in, size_t& ptr, unsigned depth)
+	{
+		if(ptr >= in.length())
+			throw std::runtime_error("Truncated worker message");
+		char type = in[ptr++];
+		if(type != 'n' && type != 't' && type != 'f' && type != '{' && ptr + 8 > in.length())
+			throw std::runtime_error("Truncated worker message");
+		switch(type) {
+		case 'n':
+			L.pushnil();
+			break;
+		case 't':
+		case 'f':
+			L.pushboolean(type == 't');
+			break;
+		case 'i':
+#ifdef LUA_SUPPORTS_INTEGERS
+			lua_pushinteger(L.handle(), serialization::s64l(&in[ptr]));
+#else
+			L.pushnumber(static_cast<double>(serialization::s64l(&in[ptr])));
+#endif
+			ptr += 8;
+			break;
+		case 'd': {
+			uint64_t raw = serialization::u64l(&in[ptr]);
+			double v;
+			memcpy(&v, &raw, sizeof(v));
+			L.pushnumber(v);
+			ptr += 8;
+			break;
+		}
+		case 's': {
+			uint64_t len = serialization::u64l(&in[ptr]);
+			ptr += 8;
+			if(len > in.length() - ptr)
+				throw std::runtime_error("Truncated worker message");
+			L.pushlstring(&in[ptr], len);
+			ptr += len;
+			break;
+		}
+		case '{':
+			if(depth >= max_value_depth)
+				throw std::runtime_error("Worker message nested too deeply");
+			L.newtable();
+			while(ptr < in.length() && in[ptr] != '}') {
+				push_value(L, in, ptr, depth + 1);
+				push_value(L, in, ptr, depth + 1);
+				if(L.type(-2) == LUA_TNIL)
+					L.pop(2);
+				else
+					L.rawset(-3);
+			}
+			if(ptr >= in.length())
+				throw std::runtime_error("Truncated worker message");
+			ptr++;
+			break;
+		default:
+			throw std::runtime_error("Bad worker message");
+		}
+	}
+
+	void push_value(lua::state& L, const std::string& in)
+	{
+		size_t ptr = 0;
+		push_value(L, in, ptr, 0);
+	}
+
+	struct worker_shared
+	{
+		worker_shared(emulator_instance& _core, const std::string& _code, bool _has_handler)
+			: core(_core), code(_code), has_handler(_has_handler)
+		{
+			quit = false;
+			detached = false;
+			status = status_queued;
+		}
+		enum worker_status
+		{
+			status_queued,
+			status_running,
+			status_finished,
+			status_failed
+		};
+		//Worker side: Send message to the main state.
+		void post(std::shared_ptr<worker_shared> self, const std::string& msg);
+		//Worker side: Wait for message from the main state. Returns false on timeout or termination.
+		bool receive(std::string& msg, int64_t timeout);
+		//Either side: Request worker to terminate.
+		void request_quit()
+		{
+			threads::alock h(mlock);
+			quit = true;
+			cv.notify_all();
+		}
+		bool quit_requested()
+		{
+			threads::alock h(mlock);
+			return quit;
+		}
+		emulator_instance& core;
+		const std::string code;
+		const bool has_handler;
+		std::string arg;
+		threads::lock mlock;
+		threads::cv cv;
+		std::list<std::string> inbox;
+		std::list<std::string> outbox;
+		bool quit;
+		bool detached;
+		worker_status status;
+		std::string error;
+	};
+
+	void deliver_message(std::shared_ptr<worker_shared> w, const std::string& msg)
+	{
+		//Runs in emulator thread, same as everything else touching the main Lua state.
+		lua::state& L = *w->core.lua;
+		{
+			threads::alock h(w->mlock);
+			if(w->detached)
+				return;
+		}
+		L.pushlightuserdata(w.get());
+		L.rawget(LUA_REGISTRYINDEX);
+		if(L.type(-1) != LUA_TFUNCTION) {
+			L.pop(1);
+			return;
+		}
+		try {
+			push_value(L, msg);
+		} catch(std::exception& e) {
+			L.pop(1);
+			messages << "Error in Lua worker message: " << e.what() << std::endl;
+			return;
+		}
+		int ret = L.pcall(1, 0, 0);
+		if(ret == LUA_ERRRUN)
+			messages << "Error in Lua worker handler: " << L.as_string(-1) << std::endl;
+		else if(ret == LUA_ERRMEM)
+			messages << "Error in Lua worker handler (Out of memory)" << std::endl;
+		else if(ret)
+			messages << "Error in Lua worker handler (Double fault)" << std::endl;
+		//Every failure leaves the error object on the stack.
+		if(ret)
+			L.pop(1);
+	}
+
+	void worker_shared::post(std::shared_ptr<worker_shared> self, const std::string& msg)
+	{
+		if(has_handler) {
+			{
+				threads::alock h(mlock);
+				if(detached)
+					return;
+			}
+			core.iqueue->run_async([self, msg]() { deliver_message(self, msg); },
+				[](std::exception& e) {});
+		} else {
+			threads::alock h(mlock);
+			outbox.push_back(msg);
+		}
+	}
+
+	bool worker_shared::receive(std::string& msg, int64_t timeout)
+	{
+		threads::alock h(mlock);
+		if(timeout >= 0) {
+			if(inbox.empty() && !quit)
+				threads::cv_timed_wait(cv, h, threads::ustime(timeout));
+		} else {
+			while(inbox.empty() && !quit)
+				cv.wait(h);
+		}
+		if(inbox.empty() || quit)
+			return false;
+		msg = inbox.front();
+		inbox.pop_front();
+		return true;
+	}
+
+	std::shared_ptr<worker_shared>& worker_of(lua::state& L)
+	{
+		L.pushlightuserdata(&worker_registry_key);
+		L.rawget(LUA_REGISTRYINDEX);
+		auto w = reinterpret_cast<std::shared_ptr<worker_shared>*>(L.touserdata(-1));
+		L.pop(1);
+		if(!w)
+			throw std::runtime_error("Not running in worker");
+		return *w;
+	}
+
+	void quit_check_hook(lua_State* L, lua_Debug* ar)
+	{
+		lua_pushlightuserdata(L, &worker_registry_key);
+		lua_rawget(L, LUA_REGISTRYINDEX);
+		auto w = reinterpret_cast<std::shared_ptr<worker_shared>*>(lua_touserdata(L, -1));
+		lua_pop(L, 1);
+		if(w && (*w)->quit_requested()) {
+			lua_pushstring(L, "Worker terminated");
+			lua_error(L);
+		}
+	}
+
+	const char* string_reader(lua_State* L, void* data, size_t* size)
+	{
+		const std::string** s = reinterpret_cast<const std::string**>(data);
+		if(!*s) {
+			*size = 0;
+			return NULL;
+		}
+		*size = (*s)->length();
+		const char* ret = (*s)->c_str();
+		*s = NULL;
+		return ret;
+	}
+
+	void run_worker(std::shared_ptr<worker_shared> w)
+	{
+		std::string err;
+		//Must outlive the Lua state, as the state refers to it.
+		std::shared_ptr<worker_shared> self = w;
+		try {
+			lua::state L;
+			L.reset();
+			L.add_function_group(lua_func_bit);
+			L.add_function_group(lua_func_load);
+			L.add_function_group(lua_func_zip);
+			L.add_function_group(lua_func_worker);
+			L.add_class_group(lua_class_pure);
+			L.add_class_group(lua_class_fileio);
+			luaL_openlibs(L.handle());
+			L.pushlightuserdata(&worker_registry_key);
+			L.pushlightuserdata(&self);
+			L.rawset(LUA_REGISTRYINDEX);
+			lua_sethook(L.handle(), quit_check_hook, LUA_MASKCOUNT, quit_check_interval);
+			const std::string* src = &w->code;
+			std::string prelude_str = worker_prelude;
+			const std::string* prelude = &prelude_str;
+			int ret = L.load(string_reader, &prelude, "worker_prelude", "t");
+			if(!ret)
+				ret = L.pcall(0, 0, 0);
+			if(!ret)
+				ret = L.load(string_reader, &src, "worker", "t");
+			int args = 0;
+			if(!ret && w->arg != "") {
+				push_value(L, w->arg);
+				args = 1;
+			}
+			if(!ret)
+				ret = L.pcall(args, 0, 0);
+			if(ret) {
+				err = L.tostring(-1) ? L.tostring(-1) : "Unknown error";
+				L.pop(1);
+			}
+		} catch(std::bad_alloc& e) {
+			err = "Out of memory";
+		} catch(std::exception& e) {
+			err = e.what();
+		}
+		threads::alock h(w->mlock);
+		w->status = err.length() ? worker_shared::status_failed : worker_shared::status_finished;
+		w->error = err;
+	}
+
+	class worker_pool
+	{
+	public:
+		worker_pool()
+		{
+			max_threads = threads::thread::hardware_concurrency();
+			if(!max_threads)
+				max_threads = 1;
+			idle = 0;
+			quitting = false;
+		}
+		~worker_pool()
+		{
+			{
+				threads::alock h(mlock);
+				quitting = true;
+				pending.clear();
+				for(auto i : active)
+					i->request_quit();
+				cv.notify_all();
+			}
+			for(auto i : workers) {
+				i->join();
+				delete i;
+			}
+		}
+		void submit(std::shared_ptr<worker_shared> w)
+		{
+			threads::alock h(mlock);
+			if(quitting)
+				throw std::runtime_error("Worker pool is shutting down");
+			pending.push_back(w);
+			if(idle < pending.size() && workers.size() < max_threads)
+				workers.push_back(new threads::thread(trampoline, this));
+			else
+				cv.notify_one();
+		}
+		static worker_pool& get()
+		{
+			static worker_pool pool;
+			return pool;
+		}
+	private:
+		static int trampoline(worker_pool* pool)
+		{
+			pool->thread_main();
+			return 0;
+		}
+		void thread_main()
+		{
+			threads::alock h(mlock);
+			while(true) {
+				while(!quitting && pending.empty()) {
+					idle++;
+					cv.wait(h);
+					idle--;
+				}
+				if(quitting)
+					return;
+				std::shared_ptr<worker_shared> w = pending.front();
+				pending.pop_front();
+				active.insert(w);
+				{
+					threads::alock h2(w->mlock);
+					if(w->quit) {
+						w->status = worker_shared::status_finished;
+						active.erase(w);
+						continue;
+					}
+					w->status = worker_shared::status_running;
+				}
+				h.unlock();
+				run_worker(w);
+				h.lock();
+				active.erase(w);
+			}
+		}
+		threads::lock mlock;
+		threads::cv cv;
+		std::list<std::shared_ptr<worker_shared>> pending;
+		std::set<std::shared_ptr<worker_shared>> active;
+		std::list<threads::thread*> workers;
+		size_t max_threads;
+		size_t idle;
+		bool quitting;
+	};
+
+	int worker_post(lua::state& L, lua::parameters& P)
+	{
+		auto& w = worker_of(L);
+		std::string msg = serialize_value(L, 1);
+		w->post(w, msg);
+		return 0;
+	}
+
+	int worker_receive(lua::state& L, lua::parameters& P)
+	{
+		int64_t timeout;
+		std::string msg;
+
+		P(P.optional(timeout, -1));
+
+		auto& w = worker_of(L);
+		if(!w->receive(msg, timeout))
+			return 0;
+		push_value(L, msg);
+		return 1;
+	}
+
+	int worker_closing(lua::state& L, lua::parameters& P)
+	{
+		L.pushboolean(worker_of(L)->quit_requested());
+		return 1;
+	}
+
+	lua::functions LUA_worker_fns(lua_func_worker, "worker", {
+		{"post", worker_post},
+		{"receive", worker_receive},
+		{"closing", worker_closing},
+	});
+
+	class lua_worker
+	{
+	public:
+		lua_worker(lua::state& L, const std::string& code, int handler, int arg);
+		static size_t overcommit(const std::string& code, int handler, int arg) { return 0; }
+		~lua_worker() throw();
+		static int create(lua::state& L, lua::parameters& P);
+		int send(lua::state& L, lua::parameters& P);
+		int receive(lua::state& L, lua::parameters& P);
+		int close(lua::state& L, lua::parameters& P);
+		int status(lua::state& L, lua::parameters& P);
+		std::string print()
+		{
+			threads::alock h(w->mlock);
+			switch(w->status) {
+			case worker_shared::status_queued:	return "queued";
+			case worker_shared::status_running:	return "running";
+			case worker_shared::status_finished:	return "finished";
+			default:				return "failed";
+			}
+		}
+	private:
+		lua::state* L;
+		std::shared_ptr<worker_shared> w;
+	};
+
+	lua::_class<lua_worker> LUA_class_worker(lua_class_worker, "WORKER", {
+		{"new", lua_worker::create},
+	}, {
+		{"send", &lua_worker::send},
+		{"receive", &lua_worker::receive},
+		{"close", &lua_worker::close},
+		{"status", &lua_worker::status},
+	}, &lua_worker::print);
+
+	lua_worker::lua_worker(lua::state& _L, const std::string& code, int handler, int arg)
+		: L(&_L.get_master())
+	{
+		w.reset(new worker_shared(CORE(), code, handler != 0));
+		if(arg)
+			w->arg = serialize_value(_L, arg);
+		if(handler) {
+			_L.pushlightuserdata(w.get());
+			_L.pushvalue(handler);
+			_L.rawset(LUA_REGISTRYINDEX);
+		}
+		try {
+			worker_pool::get().submit(w);
+		} catch(...) {
+			_L.pushlightuserdata(w.get());
+			_L.pushnil();
+			_L.rawset(LUA_REGISTRYINDEX);
+			throw;
+		}
+	}
+
+	lua_worker::~lua_worker() throw()
+	{
+		{
+			threads::alock h(w->mlock);
+			w->detached = true;
+		}
+		w->request_quit();
+		L->pushlightuserdata(w.get());
+		L->pushnil();
+		L->rawset(LUA_REGISTRYINDEX);
+	}
+
+	int lua_worker::create(lua::state& L, lua::parameters& P)
+	{
+		std::string code;
+		int handler = 0;
+		int arg = 0;
+
+		P(code);
+		if(P.is_function())
+			P(P.function(handler));
+		else if(P.is_novalue())
+			P(P.skipped());
+		else
+			P.expected("function or nil");
+		if(!P.is_none())
+			arg = 3;
+
+		lua::_class<lua_worker>::create(L, code, handler, arg);
+		return 1;
+	}
+
+	int lua_worker::send(lua::state& L, lua::parameters& P)
+	{
+		std::string msg = serialize_value(L, 2);
+		threads::alock h(w->mlock);
+		if(w->quit)
+			throw std::runtime_error("Worker has been closed");
+		w->inbox.push_back(msg);
+		w->cv.notify_all();
+		return 0;
+	}
+
+	int lua_worker::receive(lua::state& L, lua::parameters& P)
+	{
+		std::string msg;
+		{
+			threads::alock h(w->mlock);
+			if(w->outbox.empty())
+				return 0;
+			msg = w->outbox.front();
+			w->outbox.pop_front();
+		}
+		push_value(L, msg);
+		return 1;
+	}
+
+	int lua_worker::close(lua::state& L, lua::parameters& P)
+	{
+		w->request_quit();
+		return 0;
+	}
+
+	int lua_worker::status(lua::state& L, lua::parameters& P)
+	{
+		std::string s = print();
+		std::string err;
+		{
+			threads::alock h(w->mlock);
+			err = w->error;
+		}
+		L.pushlstring(s);
+		if(err.length()) {
+			L.pushlstring(err);
+			return 2;
+		}
+		return 1;
+	}
+}
@@ -5,6 +5,7 @@
 #include <wx/clipbrd.h>
 
 #include "core/framebuffer.hpp"
+#include "core/greenzone.hpp"
 #include "core/instance.hpp"
 #include "core/instance-map.hpp"
 #include "core/moviedata.hpp"
@@ -201,6 +202,7 @@ public:
 	frame_controls();
 	void set_types(portctrl::frame& f);
 	short read_index(portctrl::frame& f, unsigned idx);
+	void read_index_range(portctrl::frame_vector& fv, uint64_t first, size_t count, unsigned idx, short* out);
 	void write_index(portctrl::frame& f, unsigned idx, short value);
 	uint32_t read_pollcount(portctrl::counters& v, unsigned idx);
 	const std::list<control_info>& get_controlinfo() { return controlinfo; }
@@ -277,6 +279,17 @@ short frame_controls::read_index(portctrl::frame& f, unsigned idx)
 	return f.axis2(idx);
 }
 
+void frame_controls::read_index_range(portctrl::frame_vector& fv, uint64_t first, size_t count, unsigned idx,
+	short* out)
+{
+	if(idx == 0) {
+		for(size_t i = 0; i < count; i++)
+			out[i] = fv.is_sync(first + i) ? 1 : 0;
+		return;
+	}
+	fv.read_column(first, count, idx, out);
+}
+
 void frame_controls::write_index(portctrl::frame& f, unsigned idx, short value)
 {
 	if(idx == 0)
@@ -462,7 +475,7 @@ namespace
 		std::ostringstream x;
 		x << "lsnes-moviedata-whole" << std::endl;
 		for(uint64_t i = start; i < end; i++) {
-			portctrl::frame tmp = fv[i];
+			portctrl::frame tmp = fv.get(i);
 			x << encode_line(tmp) << std::endl;
 		}
 		return x.str();
@@ -474,7 +487,7 @@ namespace
 		std::ostringstream x;
 		x << "lsnes-moviedata-controller" << std::endl;
 		for(uint64_t i = start; i < end; i++) {
-			portctrl::frame tmp = fv[i];
+			portctrl::frame tmp = fv.get(i);
 			x << encode_line(info, tmp, port, controller) << std::endl;
 		}
 		return x.str();
@@ -515,7 +528,7 @@ namespace
 			//Copy forwards.
 			uint64_t shift = src - dst;
 			for(uint64_t i = dst; i < dst + len; i++) {
-				portctrl::frame _src = fv[i + shift];
+				portctrl::frame _src = fv.get(i + shift);
 				portctrl::frame _dst = fv[i];
 				for(auto j : indices)
 					info.write_index(_dst, j, info.read_index(_src, j));
@@ -524,7 +537,7 @@ namespace
 			//Copy backwards.
 			uint64_t shift = dst - src;
 			for(uint64_t i = src + len - 1; i >= src && i < src + len; i--) {
-				portctrl::frame _src = fv[i];
+				portctrl::frame _src = fv.get(i);
 				portctrl::frame _dst = fv[i + shift];
 				for(auto j : indices)
 					info.write_index(_dst, j, info.read_index(_src, j));
@@ -812,7 +825,7 @@ private:
 		int width(portctrl::frame& f);
 		std::u32string render_line1(portctrl::frame& f);
 		std::u32string render_line2(portctrl::frame& f);
-		void render_linen(text_framebuffer& fb, portctrl::frame& f, uint64_t sfn, int y);
+		void render_linen(text_framebuffer& fb, size_t row, uint64_t sfn, int y);
 		emulator_instance& inst;
 		unsigned long long spos;
 		void* prev_obj;
@@ -821,6 +834,7 @@ private:
 		std::map<uint64_t, uint64_t> subframe_to_frame;
 		uint64_t max_subframe;
 		frame_controls fcontrols;
+		std::vector<std::vector<short>> columns;
 		wxeditor_movie* m;
 		bool requested;
 		text_framebuffer fb;
@@ -861,7 +875,7 @@ namespace
 		uint64_t vsize = fv.size();
 		uint32_t pc = fc.read_pollcount(pv, idx);
 		for(uint32_t i = 1; i < pc; i++)
-			if(cffs + i >= vsize || fv[cffs + i].sync())
+			if(cffs + i >= vsize || fv.is_sync(cffs + i))
 				return cffs + i;
 		return cffs + pc;
 	}
@@ -882,7 +896,7 @@ namespace
 		portctrl::frame_vector& fv = *CORE().mlogic->get_mfile().input;
 		uint64_t vsize = fv.size();
 		for(uint32_t i = 0;; i++)
-			if(base + i >= vsize || fv[base + i].sync())
+			if(base + i >= vsize || fv.is_sync(base + i))
 				return base + i;
 	}
 }
@@ -931,8 +945,7 @@ void wxeditor_movie::_moviepanel::update_cache()
 		//Just process new subframes if any.
 		for(uint64_t i = max_subframe; i < fv.size(); i++) {
 			uint64_t prev = (i > 0) ? subframe_to_frame[i - 1] : 0;
-			portctrl::frame f = fv[i];
-			if(f.sync())
+			if(fv.is_sync(i))
 				subframe_to_frame[i] = prev + 1;
 			else
 				subframe_to_frame[i] = prev;
@@ -943,8 +956,7 @@ void wxeditor_movie::_moviepanel::update_cache()
 	//Reprocess all subframes.
 	for(uint64_t i = 0; i < fv.size(); i++) {
 		uint64_t prev = (i > 0) ? subframe_to_frame[i - 1] : 0;
-		portctrl::frame f = fv[i];
-		if(f.sync())
+		if(fv.is_sync(i))
 			subframe_to_frame[i] = prev + 1;
 		else
 			subframe_to_frame[i] = prev;
@@ -974,7 +986,7 @@ std::u32string wxeditor_movie::_moviepanel::render_line2(portctrl::frame& f)
 	return fcontrols.line2();
 }
 
-void wxeditor_movie::_moviepanel::render_linen(text_framebuffer& fb, portctrl::frame& f, uint64_t sfn, int y)
+void wxeditor_movie::_moviepanel::render_linen(text_framebuffer& fb, size_t row, uint64_t sfn, int y)
 {
 	update_cache();
 	size_t fbstride = fb.get_stride();
@@ -1006,7 +1018,9 @@ void wxeditor_movie::_moviepanel::render_linen(text_framebuffer& fb, portctrl::f
 	if(pressed)
 		xcord = press_x;
 
+	size_t column = 0;
 	for(auto i : ctrlinfo) {
+		const std::vector<short>& values = columns[column++];
 		int rpast = past;
 		unsigned off = divcnt + 1;
 		bool cselected = (xcord >= i.position_left + off && xcord < i.position_left + i.reserved + off);
@@ -1029,14 +1043,14 @@ void wxeditor_movie::_moviepanel::render_linen(text_framebuffer& fb, portctrl::f
 		} else if(i.type == 0) {
 			//Button.
 			char32_t c[2];
-			bool v = (fcontrols.read_index(f, i.index) != 0);
+			bool v = (values[row] != 0);
 			c[0] = i.ch;
 			c[1] = 0;
 			fb.write(c, 0, divcnt + 1 + i.position_left, y, v ? 0x000000 : 0xC8C8C8, bgc);
 		} else if(i.type == 1) {
 			//Axis.
 			char c[7];
-			sprintf(c, "%6d", fcontrols.read_index(f, i.index));
+			sprintf(c, "%6d", values[row]);
 			fb.write(c, 0, divcnt + 1 + i.position_left, y, 0x000000, bgc);
 		}
 	}
@@ -1060,6 +1074,17 @@ void wxeditor_movie::_moviepanel::render(text_framebuffer& fb, unsigned long lon
 	unsigned long long lines = fv.size();
 	unsigned long long i;
 	unsigned j;
+	//Read the displayed part of each control at once.
+	size_t visible = (pos < lines) ? min(lines - pos, (unsigned long long)lines_to_display) : 0;
+	const std::list<control_info>& ctrlinfo = fcontrols.get_controlinfo();
+	columns.resize(ctrlinfo.size());
+	size_t column = 0;
+	for(auto& c : ctrlinfo) {
+		std::vector<short>& values = columns[column++];
+		values.resize(visible);
+		if(visible && (c.type == 0 || c.type == 1))
+			fcontrols.read_index_range(fv, pos, visible, c.index, &values[0]);
+	}
 	for(i = pos, j = 3; i < pos + lines_to_display; i++, j++) {
 		text_framebuffer::element e;
 		if(i >= lines) {
@@ -1069,10 +1094,8 @@ void wxeditor_movie::_moviepanel::render(text_framebuffer& fb, unsigned long lon
 			e.ch = 32;
 			for(unsigned k = 0; k < fbsize.first; k++)
 				_fb[j * fbstride + k] = e;
-		} else {
-			portctrl::frame frame = fv[i];
-			render_linen(fb, frame, i, j);
-		}
+		} else
+			render_linen(fb, i - pos, i, j);
 	}
 }
 
@@ -1127,7 +1150,7 @@ void wxeditor_movie::_moviepanel::do_alter_axis(unsigned idx, uint64_t row1, uin
 			return;
 		}
 		portctrl::frame_vector::notify_freeze freeze(fv);
-		portctrl::frame cf = fv[line];
+		portctrl::frame cf = fv.get(line);
 		value = _fcontrols->read_index(cf, idx);
 	});
 	if(!valid)
@@ -1178,9 +1201,9 @@ void wxeditor_movie::_moviepanel::do_sweep_axis(unsigned idx, uint64_t row1, uin
 			valid = false;
 			return;
 		}
-		portctrl::frame cf = fv[line];
+		portctrl::frame cf = fv.get(line);
 		value = _fcontrols->read_index(cf, idx);
-		portctrl::frame cf2 = fv[line2];
+		portctrl::frame cf2 = fv.get(line2);
 		value2 = _fcontrols->read_index(cf2, idx);
 	});
 	if(!valid)
@@ -1261,7 +1284,7 @@ void wxeditor_movie::_moviepanel::do_insert_frame_after(uint64_t row, bool multi
 		//Find the start of the next frame.
 		uint64_t nframe = _row + 1;
 		uint64_t vsize = fv.size();
-		while(nframe < vsize && !fv[nframe].sync())
+		while(nframe < vsize && !fv.is_sync(nframe))
 			nframe++;
 		if(nframe < fedit)
 			return;
@@ -1271,7 +1294,7 @@ void wxeditor_movie::_moviepanel::do_insert_frame_after(uint64_t row, bool multi
 		if(nframe < vsize) {
 			//Okay, gotta copy all data after this point. nframe has to be at least 1.
 			for(uint64_t i = vsize - 1; i >= nframe; i--)
-				fv[i + multicount] = fv[i];
+				fv[i + multicount] = fv.get(i);
 			for(uint64_t k = 0; k < multicount; k++)
 				fv[nframe + k] = fv.blank_frame(true);
 		}
@@ -1304,22 +1327,22 @@ void wxeditor_movie::_moviepanel::do_delete_frame(uint64_t row1, uint64_t row2,
 			//Scan backwards for the first subframe of this frame and forwards for the last.
 			uint64_t fsf = row1;
 			uint64_t lsf = row2;
-			if(fv[_row2].sync())
+			if(fv.is_sync(_row2))
 				lsf++;		//Bump by one so it finds the end.
-			while(fsf < vsize && !fv[fsf].sync())
+			while(fsf < vsize && !fv.is_sync(fsf))
 				fsf--;
-			while(lsf < vsize && !fv[lsf].sync())
+			while(lsf < vsize && !fv.is_sync(lsf))
 				lsf++;
 			fsf = max(fsf, real_first_editable(*_fcontrols, 0));
 			uint64_t tonuke = lsf - fsf;
 			int64_t frames_tonuke = 0;
 			//Count frames nuked.
 			for(uint64_t i = fsf; i < lsf; i++)
-				if(fv[i].sync())
+				if(fv.is_sync(i))
 					frames_tonuke++;
 			//Nuke from fsf to lsf.
 			for(uint64_t i = fsf; i < vsize - tonuke; i++)
-				fv[i] = fv[i + tonuke];
+				fv[i] = fv.get(i + tonuke);
 			fv.resize(vsize - tonuke);
 		} else {
 			if(row2 < real_first_editable(*_fcontrols, 0))
@@ -1329,19 +1352,19 @@ void wxeditor_movie::_moviepanel::do_delete_frame(uint64_t row1, uint64_t row2,
 			//2) The subframe immediately after deleted region doesn't.
 			bool inherit_sync = false;
 			for(uint64_t i = row1; i <= row2; i++)
-				inherit_sync = inherit_sync || fv[i].sync();
-			inherit_sync = inherit_sync && (row2 + 1 < vsize && !fv[_row2 + 1].sync());
+				inherit_sync = inherit_sync || fv.is_sync(i);
+			inherit_sync = inherit_sync && (row2 + 1 < vsize && !fv.is_sync(_row2 + 1));
 			int64_t frames_tonuke = 0;
 			//Count frames nuked.
 			for(uint64_t i = row1; i <= row2; i++)
-				if(fv[i].sync())
+				if(fv.is_sync(i))
 					frames_tonuke++;
 			//If sync is inherited, one less frame is nuked.
 			if(inherit_sync) frames_tonuke--;
 			//Nuke the subframes.
 			uint64_t tonuke = row2 - row1 + 1;
 			for(uint64_t i = row1; i < vsize - tonuke; i++)
-				fv[i] = fv[i + tonuke];
+				fv[i] = fv.get(i + tonuke);
 			fv.resize(vsize - tonuke);
 			//Next subframe inherits the sync flag.
 			if(inherit_sync)
@@ -1367,7 +1390,7 @@ void wxeditor_movie::_moviepanel::do_truncate(uint64_t row)
 			return;
 		int64_t delete_count = 0;
 		for(uint64_t i = _row; i < vsize; i++)
-			if(fv[i].sync())
+			if(fv.is_sync(i))
 				delete_count--;
 		fv.resize(_row);
 	});
@@ -1381,8 +1404,10 @@ void wxeditor_movie::_moviepanel::do_set_stop_at_frame()
 	CHECK_UI_THREAD;
 	uint64_t curframe;
 	uint64_t frame;
-	inst.iqueue->run([&curframe]() {
+	bool seekable;
+	inst.iqueue->run([&curframe, &seekable]() {
 		curframe = CORE().mlogic->get_movie().get_current_frame();
+		seekable = CORE().mlogic->get_movie().readonly_mode() && CORE().gzone->enabled();
 	});
 	try {
 		std::string text = pick_text(m, "Frame", (stringfmt() << "Enter frame to stop at (currently at "
@@ -1394,12 +1419,13 @@ void wxeditor_movie::_moviepanel::do_set_stop_at_frame()
 		wxMessageBox(wxT("Invalid value"), _T("Error"), wxICON_EXCLAMATION | wxOK, m);
 		return;
 	}
-	if(frame < curframe) {
+	//In playback mode with greenzone enabled, earlier frames can be reached through the greenzone.
+	if(frame < curframe && !seekable) {
 		wxMessageBox(wxT("The movie is already past that point"), _T("Error"), wxICON_EXCLAMATION | wxOK, m);
 		return;
 	}
 	inst.iqueue->run([frame]() {
-		set_stop_at_frame(frame);
+		seek_to_frame(frame);
 	});
 }
 
@@ -2210,7 +2236,7 @@ void wxeditor_movie::_moviepanel::do_paste(uint64_t row, bool append)
 		for(uint64_t i = 0; i < gaplen; i++)
 			fv.append(fv.blank_frame(false));
 		for(uint64_t i = vsize - 1; i >= gapstart && i <= vsize; i--)
-			fv[i + gaplen] = fv[i];
+			fv[i + gaplen] = fv.get(i);
 		//Write the pasted frames.
 		{
 			std::istringstream y(cliptext);
@@ -2219,7 +2245,7 @@ void wxeditor_movie::_moviepanel::do_paste(uint64_t row, bool append)
 			uint64_t idx = gapstart;
 			while(std::getline(y, z)) {
 				fv[idx++].deserialize(z.c_str());
-				if(fv[idx - 1].sync())
+				if(fv.is_sync(idx - 1))
 					newframes++;
 			}
 		}
@@ -0,0 +1,131 @@
+#include "library/decimator.hpp"
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <sys/time.h>
+
+//Check decimator accuracy against the 64-sample averaging gambatte does without native rate output, decimating
+//Game Boy native rate (2MHz) to 32768Hz. Tones in passband should keep their amplitude, and tones above the output
+//Nyquist frequency should not alias back.
+//Syntax: decimator-test
+
+namespace
+{
+	const double in_rate = 2097152;
+	const unsigned factor = 64;
+	const double out_rate = in_rate / factor;
+	const size_t in_samples = 1 << 21;
+	const double amplitude = 16384;
+
+	uint64_t get_utime()
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+	}
+
+	std::vector<int16_t> tone(double freq)
+	{
+		std::vector<int16_t> r(2 * in_samples);
+		for(size_t i = 0; i < in_samples; i++) {
+			double v = amplitude * sin(2 * M_PI * freq * i / in_rate);
+			r[2 * i + 0] = floor(v + 0.5);
+			r[2 * i + 1] = floor(0.5 * v + 0.5);
+		}
+		return r;
+	}
+
+	//The existing path: average blocks of 64 samples.
+	std::vector<int16_t> average(const std::vector<int16_t>& in)
+	{
+		std::vector<int16_t> r;
+		for(size_t i = 0; i + factor <= in_samples; i += factor) {
+			int32_t l = 0, rr = 0;
+			for(size_t j = 0; j < factor; j++) {
+				l += in[2 * (i + j) + 0];
+				rr += in[2 * (i + j) + 1];
+			}
+			r.push_back(l / static_cast<int32_t>(factor));
+			r.push_back(rr / static_cast<int32_t>(factor));
+		}
+		return r;
+	}
+
+	std::vector<int16_t> decimate(const std::vector<int16_t>& in, uint64_t& t)
+	{
+		decimator d;
+		d.set_factor(factor);
+		std::vector<int16_t> r(2 * (in_samples / factor + 16));
+		size_t n = 0;
+		t = get_utime();
+		//Feed in frame-sized blocks like a core would.
+		for(size_t i = 0; i < in_samples; i += 35112) {
+			size_t c = (in_samples - i < 35112) ? (in_samples - i) : 35112;
+			n += d.process(&in[2 * i], c, true, &r[2 * n]);
+		}
+		t = get_utime() - t;
+		r.resize(2 * n);
+		return r;
+	}
+
+	//Amplitude of tone at freq in channel ch of output, skipping filter startup. Folds freq above Nyquist.
+	double measure(const std::vector<int16_t>& out, unsigned ch, double freq)
+	{
+		double f = fmod(freq, out_rate);
+		if(f > out_rate / 2)
+			f = out_rate - f;
+		double s = 0, c = 0;
+		size_t n = out.size() / 2;
+		size_t start = 256;
+		for(size_t i = start; i < n; i++) {
+			double ph = 2 * M_PI * f * i / out_rate;
+			s += out[2 * i + ch] * sin(ph);
+			c += out[2 * i + ch] * cos(ph);
+		}
+		return 2 * sqrt(s * s + c * c) / (n - start);
+	}
+
+	double db(double x)
+	{
+		return 20 * log10(x + 1e-9);
+	}
+}
+
+int main()
+{
+	bool ok = true;
+	const double passband[] = {100, 1000, 5000, 10000, 13000};
+	//These alias into passband (below 0.4 times output rate) with plain subsampling.
+	const double stopband[] = {20000, 30000, 45000, 100000, 300000};
+	uint64_t t;
+	std::cout << "Passband (gain dB, decimator / average):" << std::endl;
+	for(auto f : passband) {
+		auto in = tone(f);
+		auto d = decimate(in, t);
+		double gd = db(measure(d, 0, f) / amplitude);
+		double ga = db(measure(average(in), 0, f) / amplitude);
+		double gr = db(measure(d, 1, f) / (amplitude / 2));
+		std::cout << f << "Hz: " << gd << " / " << ga << std::endl;
+		if(fabs(gd) > 0.05 || fabs(gr) > 0.05) {
+			std::cout << "FAIL: Passband gain at " << f << "Hz is " << gd << "dB" << std::endl;
+			ok = false;
+		}
+	}
+	std::cout << "Aliasing (gain dB, decimator / average):" << std::endl;
+	for(auto f : stopband) {
+		auto in = tone(f);
+		auto d = decimate(in, t);
+		double gd = db(measure(d, 0, f) / amplitude);
+		double ga = db(measure(average(in), 0, f) / amplitude);
+		std::cout << f << "Hz: " << gd << " / " << ga << std::endl;
+		if(gd > -60) {
+			std::cout << "FAIL: Alias of " << f << "Hz at " << gd << "dB" << std::endl;
+			ok = false;
+		}
+	}
+	auto in = tone(1000);
+	decimate(in, t);
+	std::cout << "Speed: " << (t ? 1.0 * in_samples / t : 0) << "M stereo samples/s" << std::endl;
+	std::cout << (ok ? "OK" : "FAILED") << std::endl;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+#include "library/filesystem.hpp"
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <sys/time.h>
+
+//Randomized test of the cluster filesystem: write, append, read and delete files, compare against in-memory copies,
+//and check the contents survive reopening (with and without memory mapping).
+//Syntax: filesystem-test [<operations>]
+
+namespace
+{
+	struct file
+	{
+		uint32_t start;
+		uint32_t end_cluster;
+		uint32_t end_ptr;
+		std::vector<char> data;
+	};
+
+	bool verify(filesystem& fs, std::vector<file>& files)
+	{
+		for(auto& f : files) {
+			std::vector<char> buf(f.data.size() + 1);
+			uint32_t c = f.start;
+			uint32_t p = 0;
+			size_t r = fs.read_data(c, p, buf.data(), f.data.size());
+			if(r != f.data.size() || (r && memcmp(buf.data(), f.data.data(), r)))
+				return false;
+			//Reads from the middle.
+			if(f.data.size() > 100) {
+				size_t off = rand() % (f.data.size() - 50);
+				c = f.start;
+				p = 0;
+				fs.skip_data(c, p, off);
+				fs.read_data(c, p, buf.data(), 50);
+				if(memcmp(buf.data(), &f.data[off], 50))
+					return false;
+			}
+		}
+		return true;
+	}
+
+	uint64_t get_utime()
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t ops = (argc > 1) ? strtoul(argv[1], NULL, 10) : 20000;
+	std::string name = "filesystem-test.tmp";
+	remove(name.c_str());
+	std::vector<file> files;
+	srand(1);
+	uint64_t t = get_utime();
+	{
+		filesystem fs(name);
+		for(size_t op = 0; op < ops; op++) {
+			unsigned r = rand() % 100;
+			if(r < 10 || files.empty()) {
+				file f;
+				f.start = f.end_cluster = fs.allocate_cluster();
+				f.end_ptr = 0;
+				files.push_back(f);
+			} else if(r < 60) {
+				file& f = files[rand() % files.size()];
+				std::vector<char> d(rand() % 20000 + 1);
+				for(auto& i : d)
+					i = rand();
+				uint32_t rc, rp;
+				fs.write_data(f.end_cluster, f.end_ptr, d.data(), d.size(), rc, rp);
+				f.data.insert(f.data.end(), d.begin(), d.end());
+			} else if(r < 65) {
+				size_t i = rand() % files.size();
+				fs.free_cluster_chain(files[i].start);
+				files.erase(files.begin() + i);
+			} else if(r < 66) {
+				if(!verify(fs, files)) {
+					std::cout << "FAIL: Data mismatch (operation " << op << ")" << std::endl;
+					return 1;
+				}
+			}
+		}
+		if(!verify(fs, files)) {
+			std::cout << "FAIL: Data mismatch" << std::endl;
+			return 1;
+		}
+	}
+	t = get_utime() - t;
+	//Read everything in small pieces, like playback does.
+	uint64_t t2 = get_utime();
+	{
+		filesystem fs(name);
+		for(auto& f : files) {
+			char buf[100];
+			uint32_t c = f.start;
+			uint32_t p = 0;
+			for(size_t i = 0; i < f.data.size(); i += sizeof(buf))
+				fs.read_data(c, p, buf, sizeof(buf));
+		}
+	}
+	t2 = get_utime() - t2;
+	for(unsigned mode = 0; mode < 2; mode++) {
+		filesystem fs(name, mode == 1);
+		if(!verify(fs, files)) {
+			std::cout << "FAIL: Data mismatch after reopen" << (mode ? " (mmap)" : "") << std::endl;
+			return 1;
+		}
+		//Allocate, write and read back.
+		uint32_t c = fs.allocate_cluster();
+		uint32_t p = 0;
+		uint32_t rc, rp;
+		char x[100] = {1, 2, 3};
+		fs.write_data(c, p, x, sizeof(x), rc, rp);
+		c = rc;
+		p = 0;
+		char y[100];
+		fs.read_data(c, p, y, sizeof(y));
+		if(memcmp(x, y, sizeof(x))) {
+			std::cout << "FAIL: Written data not visible" << (mode ? " (mmap)" : "") << std::endl;
+			return 1;
+		}
+		fs.free_cluster_chain(rc);
+	}
+	remove(name.c_str());
+	std::cout << "OK: " << files.size() << " files, " << t / 1000 << "ms, small reads " << t2 / 1000 << "ms"
+		<< std::endl;
+	return 0;
+}
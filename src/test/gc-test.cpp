@@ -0,0 +1,137 @@
+#include "library/gc.hpp"
+#include <iostream>
+#include <vector>
+#include <set>
+#include <cstdlib>
+#include <sys/time.h>
+
+//Randomized test of the garbage collector: build and mutate an object graph while collecting incrementally, and
+//check that no reachable object is ever deleted and that all garbage is eventually deleted.
+//Syntax: gc-test [<operations>]
+
+namespace
+{
+	std::set<void*> alive;
+
+	struct node : public GC::item
+	{
+		node() { alive.insert(this); }
+		~node() { alive.erase(this); }
+		void set_child(size_t i, node* n)
+		{
+			if(children.size() <= i)
+				children.resize(i + 1);
+			children[i] = n;
+			write_barrier();
+		}
+		std::vector<node*> children;
+	protected:
+		void trace()
+		{
+			for(auto i : children)
+				if(i) i->mark();
+		}
+	};
+
+	//Check that everything reachable from the roots is alive.
+	bool check(std::vector<GC::pointer<node>>& roots)
+	{
+		std::set<node*> seen;
+		std::vector<node*> todo;
+		for(auto& i : roots)
+			if(i) todo.push_back(i.as_pointer());
+		while(!todo.empty()) {
+			node* n = todo.back();
+			todo.pop_back();
+			if(seen.count(n))
+				continue;
+			if(!alive.count(n))
+				return false;
+			seen.insert(n);
+			for(auto i : n->children)
+				if(i) todo.push_back(i);
+		}
+		return true;
+	}
+
+	size_t count_reachable(std::vector<GC::pointer<node>>& roots)
+	{
+		std::set<node*> seen;
+		std::vector<node*> todo;
+		for(auto& i : roots)
+			if(i) todo.push_back(i.as_pointer());
+		while(!todo.empty()) {
+			node* n = todo.back();
+			todo.pop_back();
+			if(seen.count(n))
+				continue;
+			seen.insert(n);
+			for(auto i : n->children)
+				if(i) todo.push_back(i);
+		}
+		return seen.size();
+	}
+
+	uint64_t get_utime()
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t ops = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+	std::vector<GC::pointer<node>> roots(64);
+	srand(1);
+	uint64_t worst_step = 0;
+	for(size_t op = 0; op < ops; op++) {
+		unsigned r = rand() % 100;
+		size_t a = rand() % roots.size();
+		size_t b = rand() % roots.size();
+		if(r < 40) {
+			//New object, referencing an existing one.
+			GC::pointer<node> n = GC::pointer<node>(new node);
+			if(roots[b])
+				n->set_child(0, roots[b].as_pointer());
+			roots[a] = n;
+		} else if(r < 60) {
+			//Link existing objects.
+			if(roots[a] && roots[b])
+				roots[a]->set_child(rand() % 4, roots[b].as_pointer());
+		} else if(r < 70) {
+			//Follow a link.
+			if(roots[a] && !roots[a]->children.empty() && roots[a]->children[0]) {
+				node* c = roots[a]->children[0];
+				c->mark_root();
+				GC::pointer<node> p(c);
+				roots[b] = p;
+			}
+		} else if(r < 80) {
+			roots[a] = GC::pointer<node>();
+		} else if(r < 81) {
+			GC::item::request_gc();
+		}
+		uint64_t t = get_utime();
+		GC::item::gc_step(100);
+		t = get_utime() - t;
+		if(t > worst_step) worst_step = t;
+		if(op % 1000 == 0 && !check(roots)) {
+			std::cout << "FAIL: Reachable object deleted (operation " << op << ")" << std::endl;
+			return 1;
+		}
+	}
+	if(!check(roots)) {
+		std::cout << "FAIL: Reachable object deleted" << std::endl;
+		return 1;
+	}
+	GC::item::do_gc();
+	size_t reachable = count_reachable(roots);
+	if(alive.size() != reachable) {
+		std::cout << "FAIL: " << alive.size() << " objects alive, " << reachable << " reachable" << std::endl;
+		return 1;
+	}
+	std::cout << "OK: " << reachable << " objects alive, worst step " << worst_step << "us" << std::endl;
+	return 0;
+}
@@ -0,0 +1,220 @@
+#include "lsnes.hpp"
+
+#include "core/advdumper.hpp"
+#include "core/command.hpp"
+#include "core/greenzone.hpp"
+#include "core/instance.hpp"
+#include "core/mainloop.hpp"
+#include "core/messages.hpp"
+#include "core/misc.hpp"
+#include "core/movie.hpp"
+#include "core/moviedata.hpp"
+#include "core/rom.hpp"
+#include "core/settings.hpp"
+#include "core/window.hpp"
+#include "interface/romtype.hpp"
+#include "library/crandom.hpp"
+#include "library/string.hpp"
+#include "lua/lua.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+//Check that seeking through the greenzone gives the same state as playing straight through. A random movie is
+//played to frame <from>, then seeked back to frame <to> and played to <from> again, for each seek in turn. The
+//states at <from> have to match, the seek has to restore a snapshot instead of replaying from the start, and it must
+//not count as a rerecord. The first seek goes back to the only snapshot taken so far.
+//Syntax: greenzone-test [<type>=<romfile>]
+//<type> is the internal name of the ROM type (default test).
+
+namespace
+{
+	const uint64_t movie_length = 300;
+	const unsigned interval = 10;
+	struct seek
+	{
+		uint64_t from;
+		uint64_t to;
+	};
+	const seek seeks[] = {{15, 12}, {200, 55}};
+	const size_t nseeks = sizeof(seeks) / sizeof(seeks[0]);
+
+	core_type& find_type(const std::string& name)
+	{
+		for(auto i : core_type::get_core_types())
+			if(i->get_iname() == name)
+				return *i;
+		throw std::runtime_error("No ROM type '" + name + "'");
+	}
+
+	void random_input(portctrl::frame_vector& v, uint64_t frames)
+	{
+		const portctrl::type_set& types = v.get_types();
+		for(uint64_t i = 0; i < frames; i++) {
+			portctrl::frame f = v.blank_frame(true);
+			for(unsigned j = 1; j < types.indices(); j++) {
+				portctrl::index_triple t = types.index_to_triple(j);
+				if(!t.valid)
+					continue;
+				portctrl::button* b = types.port_type(t.port).controller_info->controllers[t.controller].
+					get(t.control);
+				//Shadow controls include resets.
+				if(!b || b->shadow || b->type == portctrl::button::TYPE_NULL)
+					continue;
+				if(b->is_analog())
+					f.axis3(t.port, t.controller, t.control, b->rmin + rand() %
+						(static_cast<int32_t>(b->rmax) - b->rmin + 1));
+				else
+					f.axis3(t.port, t.controller, t.control, (rand() % 4 == 0) ? 1 : 0);
+			}
+			v.append(f);
+		}
+	}
+
+	//For each seek, saves the state at <from>, seeks back and saves the state at <from> again.
+	class seek_snoop : public dumper_base
+	{
+	public:
+		seek_snoop(const std::string* _first, const std::string* _second)
+			: first(_first), second(_second)
+		{
+			current = 0;
+			seeked = false;
+			frames_after_seek = 0;
+			for(size_t i = 0; i < nseeks; i++)
+				first_after_seek[i] = 0;
+			lsnes_instance.mdumper->add_dumper(*this);
+		}
+		~seek_snoop() throw()
+		{
+			lsnes_instance.mdumper->drop_dumper(*this);
+		}
+		void on_frame(struct framebuffer::raw& _frame, uint32_t fps_n, uint32_t fps_d)
+		{
+			auto& core = CORE();
+			uint64_t frame = core.mlogic->get_movie().get_current_frame();
+			if(done())
+				return;
+			if(seeked && !frames_after_seek++) {
+				first_after_seek[current] = frame;
+				//Keep running past the seek target.
+				set_stop_at_frame();
+			}
+			if(frame < seeks[current].from)
+				return;
+			if(!seeked) {
+				core.command->invoke("save-state-binary " + first[current]);
+				core.command->invoke((stringfmt() << "seek-frame " << seeks[current].to).str());
+				seeked = true;
+			} else {
+				core.command->invoke("save-state-binary " + second[current]);
+				seeked = false;
+				frames_after_seek = 0;
+				if(++current == nseeks)
+					core.command->invoke("quit-emulator");
+			}
+		}
+		void on_sample(short l, short r)
+		{
+		}
+		void on_rate_change(uint32_t n, uint32_t d)
+		{
+		}
+		void on_gameinfo_change(const master_dumper::gameinfo& gi)
+		{
+		}
+		void on_end()
+		{
+		}
+		bool done() { return current == nseeks; }
+		uint64_t first_after_seek[nseeks];
+	private:
+		size_t current;
+		bool seeked;
+		uint64_t frames_after_seek;
+		const std::string* first;
+		const std::string* second;
+	};
+}
+
+int main(int argc, char** argv)
+{
+	try {
+		crandom::init();
+	} catch(std::exception& e) {
+		std::cerr << "Error initializing system RNG" << std::endl;
+		return 1;
+	}
+
+	reached_main();
+	std::string type = "test", file;
+	if(argc > 1) {
+		regex_results r = regex("([^=]+)=(.*)", argv[1]);
+		if(!r) {
+			std::cerr << "Syntax: greenzone-test [<type>=<romfile>]" << std::endl;
+			return 2;
+		}
+		type = r[1];
+		file = r[2];
+	}
+
+	platform::init();
+	init_lua(lsnes_instance);
+	lsnes_instance.setcache->set("greenzone-interval", (stringfmt() << interval).str());
+
+	bool ok = true;
+	std::string first[nseeks], second[nseeks];
+	for(size_t i = 0; i < nseeks; i++) {
+		first[i] = get_temp_file();
+		second[i] = get_temp_file();
+	}
+	try {
+		core_type& ctype = find_type(type);
+		std::map<std::string, std::string> settings;
+		loaded_rom r(new rom_image(file, ctype));
+		r.load(settings, 1000000000, 0);
+		*lsnes_instance.rom = r;
+		moviefile* movie = new moviefile(r, settings, 1000000000, 0);
+		srand(42);
+		random_input(*movie->input, movie_length);
+		seek_snoop snoop(first, second);
+		main_loop(r, *movie, true);
+		if(!snoop.done())
+			throw std::runtime_error("Movie stopped before seeking");
+		for(size_t i = 0; i < nseeks; i++) {
+			moviefile a(first[i], ctype);
+			moviefile b(second[i], ctype);
+			uint64_t from = seeks[i].from, to = seeks[i].to;
+			if(a.dyn.save_frame != b.dyn.save_frame || a.dyn.savestate != b.dyn.savestate ||
+				a.dyn.pollcounters != b.dyn.pollcounters || a.dyn.lagged_frames != b.dyn.lagged_frames) {
+				std::cout << "FAIL: State at frame " << from << " differs after seek" << std::endl;
+				ok = false;
+			}
+			if(a.rerecords != b.rerecords) {
+				std::cout << "FAIL: Seek to " << to << " counted as a rerecord (" << a.rerecords << " -> "
+					<< b.rerecords << ")" << std::endl;
+				ok = false;
+			}
+			uint64_t resumed = snoop.first_after_seek[i];
+			if(resumed > to || resumed + interval < to) {
+				std::cout << "FAIL: Seek to " << to << " resumed at frame " << resumed
+					<< ", expected a snapshot before it" << std::endl;
+				ok = false;
+			}
+		}
+	} catch(std::bad_alloc& e) {
+		OOM_panic();
+	} catch(std::exception& e) {
+		std::cout << "FAIL: " << e.what() << std::endl;
+		ok = false;
+	}
+	for(size_t i = 0; i < nseeks; i++) {
+		remove(first[i].c_str());
+		remove(second[i].c_str());
+	}
+	quit_lua(lsnes_instance);
+	lsnes_instance.mlogic->release_memory();
+	std::cout << (ok ? "OK" : "FAILED") << std::endl;
+	return ok ? 0 : 1;
+}
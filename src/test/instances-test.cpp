@@ -0,0 +1,199 @@
+#include "lsnes.hpp"
+
+#include "core/instance.hpp"
+#include "core/messages.hpp"
+#include "core/misc.hpp"
+#include "core/rom.hpp"
+#include "core/window.hpp"
+#include "interface/callbacks.hpp"
+#include "interface/romtype.hpp"
+#include "library/crandom.hpp"
+#include "library/hex.hpp"
+#include "library/sha256.hpp"
+#include "library/string.hpp"
+#include "library/threads.hpp"
+
+#include <iostream>
+
+//Check that several emulator instances can run at once. The ROM is run headless in one instance for a fixed number
+//of frames with a fixed input pattern, then in two instances concurrently, each in its own thread. All three have
+//to end up in the same state.
+//Syntax: instances-test [--frames=<n>] [<type>=<romfile>]
+//<type> is the internal name of the ROM type (sky or test, default test).
+
+namespace
+{
+	//Frames emulated by the instance bound to this thread.
+	thread_local uint64_t frame;
+
+	//Shared by all instances, so everything here has to be per thread.
+	class test_callbacks : public emucore_callbacks
+	{
+	public:
+		~test_callbacks() throw()
+		{
+		}
+		int16_t get_input(unsigned port, unsigned index, unsigned control)
+		{
+			//Port 0 controller 0 is the system controller, which includes resets.
+			if(port == 0 && index == 0)
+				return 0;
+			uint64_t v = frame / 4;
+			v = v * 0x9E3779B97F4A7C15ULL + port;
+			v = v * 0x9E3779B97F4A7C15ULL + index;
+			v = v * 0x9E3779B97F4A7C15ULL + control;
+			v ^= v >> 29;
+			return ((v & 3) == 0) ? 1 : 0;
+		}
+		int16_t set_input(unsigned port, unsigned index, unsigned control, int16_t value)
+		{
+			return get_input(port, index, control);
+		}
+		void notify_latch(std::list<std::string>& l)
+		{
+		}
+		void timer_tick(uint32_t increment, uint32_t per_second)
+		{
+		}
+		std::string get_firmware_path()
+		{
+			return "";
+		}
+		std::string get_base_path()
+		{
+			return "";
+		}
+		time_t get_time()
+		{
+			return 1000000000;
+		}
+		time_t get_randomseed()
+		{
+			return 0;
+		}
+		void output_frame(framebuffer::raw& screen, uint32_t fps_n, uint32_t fps_d)
+		{
+			frame++;
+		}
+		void action_state_updated()
+		{
+		}
+		void memory_read(uint64_t addr, uint64_t value)
+		{
+		}
+		void memory_write(uint64_t addr, uint64_t value)
+		{
+		}
+		void memory_execute(uint64_t addr, uint64_t proc)
+		{
+		}
+		void memory_trace(uint64_t proc, const char* str, bool insn)
+		{
+		}
+	};
+
+	core_type& find_type(const std::string& name)
+	{
+		for(auto i : core_type::get_core_types())
+			if(i->get_iname() == name)
+				return *i;
+		throw std::runtime_error("No ROM type '" + name + "'");
+	}
+
+	//Load the ROM into instance. Loading switches the global current ROM type, so this is not done concurrently.
+	void load_rom(emulator_instance& inst, core_type& ctype, const std::string& file)
+	{
+		emulator_instance_binding bind(inst);
+		std::map<std::string, std::string> settings;
+		loaded_rom rom(new rom_image(file, ctype));
+		rom.load(settings, 1000000000, 0);
+		*inst.rom = rom;
+	}
+
+	//Run the ROM loaded into instance, storing hash of the final state, or error message.
+	void run_rom(emulator_instance* inst, uint64_t frames, std::string* result)
+	{
+		try {
+			emulator_instance_binding bind(*inst);
+			frame = 0;
+			for(uint64_t i = 0; i < frames; i++)
+				inst->rom->emulate();
+			inst->rom->runtosave();
+			std::vector<char> state;
+			size_t size = inst->rom->save_core_state(state, true);
+			uint8_t h[32];
+			sha256::hash(h, reinterpret_cast<const uint8_t*>(state.data()), size);
+			*result = hex::b_to(h, 32);
+		} catch(std::exception& e) {
+			*result = std::string("Error: ") + e.what();
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	try {
+		crandom::init();
+	} catch(std::exception& e) {
+		std::cerr << "Error initializing system RNG" << std::endl;
+		return 1;
+	}
+
+	reached_main();
+	uint64_t frames = 3600;
+	std::string type = "test", file;
+	for(int i = 1; i < argc; i++) {
+		regex_results r;
+		std::string a = argv[i];
+		try {
+			if(r = regex("--frames=(.*)", a))
+				frames = raw_lexical_cast<uint64_t>(r[1]);
+			else if(r = regex("([^-=][^=]*)=(.*)", a)) {
+				type = r[1];
+				file = r[2];
+			} else
+				throw std::runtime_error("Unknown argument");
+		} catch(std::exception& e) {
+			std::cerr << "Bad argument '" << a << "': " << e.what() << std::endl;
+			std::cerr << "Syntax: instances-test [--frames=<n>] [<type>=<romfile>]" << std::endl;
+			return 2;
+		}
+	}
+
+	platform::init();
+	test_callbacks cb;
+	ecore_callbacks = &cb;
+
+	bool ok = true;
+	try {
+		core_type& ctype = find_type(type);
+		emulator_instance second;
+		emulator_instance third;
+		load_rom(lsnes_instance, ctype, file);
+		load_rom(second, ctype, file);
+		load_rom(third, ctype, file);
+
+		std::string expected, a, b;
+		run_rom(&lsnes_instance, frames, &expected);
+		threads::thread t1(run_rom, &second, frames, &a);
+		threads::thread t2(run_rom, &third, frames, &b);
+		t1.join();
+		t2.join();
+		std::cout << "Expected: " << expected << std::endl;
+		std::cout << "Thread 1: " << a << std::endl;
+		std::cout << "Thread 2: " << b << std::endl;
+		if(expected.substr(0, 6) == "Error:")
+			throw std::runtime_error(expected.substr(7));
+		if(a != expected || b != expected) {
+			std::cout << "FAIL: Concurrent instances ended in different states" << std::endl;
+			ok = false;
+		}
+	} catch(std::bad_alloc& e) {
+		OOM_panic();
+	} catch(std::exception& e) {
+		std::cout << "FAIL: " << e.what() << std::endl;
+		ok = false;
+	}
+	std::cout << (ok ? "OK" : "FAILED") << std::endl;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+#include "library/memoryspace.hpp"
+#include "library/threads.hpp"
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <sys/time.h>
+
+//Check memory space lookups against brute force over a SNES-like region layout, and measure read speed from one
+//and several threads.
+//Syntax: memoryspace-bench [<reads> [<threads>]]
+
+namespace
+{
+	uint64_t get_utime()
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+	}
+
+	struct layout
+	{
+		const char* name;
+		uint64_t base;
+		size_t size;
+		bool readonly;
+	} regions[] = {
+		{"APURAM", 0x00000000, 65536, false},
+		{"VRAM", 0x00010000, 65536, false},
+		{"OAM", 0x00020000, 544, false},
+		{"CGRAM", 0x00021000, 512, false},
+		{"WRAM", 0x007E0000, 131072, false},
+		{"SRAM", 0x10000000, 8192, false},
+		{"ROM", 0x80000000, 1048576, true},
+	};
+
+	uint64_t random_address()
+	{
+		const layout& l = regions[rand() % (sizeof(regions) / sizeof(regions[0]))];
+		//Mostly inside regions, sometimes just outside.
+		return l.base + rand() % (l.size + 64) - ((rand() % 8) ? 0 : 32);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t reads = (argc > 1) ? strtoul(argv[1], NULL, 10) : 10000000;
+	unsigned nthreads = (argc > 2) ? strtoul(argv[2], NULL, 10) : 4;
+	memory_space mspace;
+	std::list<memory_space::region*> rlist;
+	std::vector<std::vector<unsigned char>> memory;
+	for(auto& i : regions) {
+		memory.push_back(std::vector<unsigned char>(i.size));
+		for(auto& j : memory.back())
+			j = rand();
+		rlist.push_back(new memory_space::region_direct(i.name, i.base, -1, &memory.back()[0], i.size,
+			i.readonly));
+	}
+	mspace.set_regions(rlist);
+
+	srand(1);
+	for(size_t n = 0; n < 1000000; n++) {
+		uint64_t addr = random_address();
+		auto g = mspace.lookup(addr);
+		memory_space::region* expect = NULL;
+		for(auto i : rlist)
+			if(addr >= i->base && addr <= i->last_address())
+				expect = i;
+		if(g.first != expect || (expect && g.second != addr - expect->base)) {
+			std::cout << "FAIL: Wrong region for address " << std::hex << addr << std::endl;
+			return 1;
+		}
+		uint64_t linear = rand() % (mspace.get_linear_size() + 16);
+		auto h = mspace.lookup_linear(linear);
+		uint64_t lbase = 0;
+		expect = NULL;
+		for(auto i : mspace.get_regions()) {
+			if(i->readonly || i->special)
+				continue;
+			if(linear >= lbase && linear < lbase + i->size) {
+				expect = i;
+				break;
+			}
+			lbase += i->size;
+		}
+		if(h.first != expect || (expect && h.second != linear - lbase)) {
+			std::cout << "FAIL: Wrong region for linear address " << std::hex << linear << std::endl;
+			return 1;
+		}
+	}
+
+	//Script-like access pattern: runs of reads from the same region.
+	std::vector<uint64_t> addrs;
+	for(size_t n = 0; n < 65536; n++) {
+		uint64_t base = random_address();
+		for(unsigned k = 0; k < 16; k++)
+			addrs.push_back(base + k);
+	}
+	uint64_t t = get_utime();
+	uint64_t sum = 0;
+	for(size_t n = 0; n < reads; n++)
+		sum += mspace.read<uint8_t>(addrs[n % addrs.size()]);
+	t = get_utime() - t;
+	uint64_t t2 = get_utime();
+	std::vector<threads::thread*> workers;
+	std::vector<uint64_t> sums(nthreads);
+	for(unsigned i = 0; i < nthreads; i++)
+		workers.push_back(new threads::thread([&mspace, &addrs, &sums, reads, nthreads, i]() {
+			uint64_t s = 0;
+			for(size_t n = i; n < reads; n += nthreads)
+				s += mspace.read<uint8_t>(addrs[n % addrs.size()]);
+			sums[i] = s;
+		}));
+	for(auto i : workers) {
+		i->join();
+		delete i;
+	}
+	t2 = get_utime() - t2;
+	uint64_t sum2 = 0;
+	for(auto i : sums)
+		sum2 += i;
+	if(sum != sum2) {
+		std::cout << "FAIL: Threaded reads differ" << std::endl;
+		return 1;
+	}
+	std::cout << "OK: " << reads << " reads " << 1000.0 * t / reads << "ns/read, " << nthreads << " threads "
+		<< 1000.0 * t2 / reads << "ns/read (checksum " << sum << ")" << std::endl;
+	for(auto i : rlist)
+		delete i;
+	return 0;
+}
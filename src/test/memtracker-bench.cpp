@@ -0,0 +1,86 @@
+#include "library/memtracker.hpp"
+#include <iostream>
+#include <string>
+#include <sys/time.h>
+
+//Measure memtracker update cost with increasing number of threads, against the old mutex+map implementation.
+//Syntax: memtracker-bench [<updates per thread>]
+
+namespace
+{
+	const char* cat_a = "Category A";
+	const char* cat_b = "Category B";
+
+	//The old implementation, for comparison.
+	class locked_tracker
+	{
+	public:
+		void operator()(const char* category, ssize_t change)
+		{
+			std::string cat = category;
+			threads::alock h(mut);
+			if(change > 0) {
+				if(data.count(cat))
+					data[cat] = data[cat] + change;
+				else
+					data[cat] = change;
+			} else if(change < 0 && data.count(cat)) {
+				if(data[cat] <= (size_t)-change)
+					data[cat] = 0;
+				else
+					data[cat] = data[cat] + change;
+			}
+		}
+	private:
+		threads::lock mut;
+		std::map<std::string, size_t> data;
+	};
+
+	uint64_t get_utime()
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+	}
+
+	template<class T> void worker(T* t, size_t updates)
+	{
+		for(size_t i = 0; i < updates; i++) {
+			(*t)(cat_a, 4096);
+			(*t)(cat_b, 100);
+			(*t)(cat_a, -4096);
+		}
+	}
+
+	template<class T> uint64_t run(T& t, unsigned threadcount, size_t updates)
+	{
+		std::vector<threads::thread*> th;
+		uint64_t start = get_utime();
+		for(unsigned i = 0; i < threadcount; i++)
+			th.push_back(new threads::thread(worker<T>, &t, updates));
+		for(auto i : th) {
+			i->join();
+			delete i;
+		}
+		return get_utime() - start;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t updates = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+	bool ok = true;
+	for(unsigned threadcount = 1; threadcount <= 8; threadcount *= 2) {
+		locked_tracker old;
+		memtracker current;
+		uint64_t t1 = run(old, threadcount, updates);
+		uint64_t t2 = run(current, threadcount, updates);
+		auto r = current.report();
+		bool good = r[cat_a] == 0 && r[cat_b] == 100 * updates * threadcount;
+		ok = ok && good;
+		std::cout << threadcount << " threads: old " << 1000.0 * t1 / (3 * updates * threadcount)
+			<< "ns/update, new " << 1000.0 * t2 / (3 * updates * threadcount) << "ns/update"
+			<< (good ? "" : " (WRONG TOTALS)") << std::endl;
+	}
+	return ok ? 0 : 1;
+}
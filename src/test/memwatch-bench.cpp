@@ -0,0 +1,124 @@
+#include "library/memorywatch.hpp"
+#include "library/memoryspace.hpp"
+#include "library/mathexpr-ntype.hpp"
+#include "library/string.hpp"
+#include <iostream>
+#include <cstdlib>
+#include <sys/time.h>
+
+//Check that compiled memory watches give the same results as evaluating the expression trees, and compare speed.
+//Syntax: memwatch-bench [<watches> [<frames>]]
+
+namespace
+{
+	struct recorder : public memorywatch::item_printer
+	{
+		recorder(std::map<std::string, std::string>* _out) : out(_out) {}
+		void show(const std::string& iname, const std::string& val) { (*out)[iname] = val; }
+		void reset() {}
+		std::map<std::string, std::string>* out;
+	};
+
+	uint64_t get_utime()
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+	}
+
+	std::string watch_expr(unsigned k)
+	{
+		//Mix of memory-derived addresses, references to earlier watches, constants and lazy operators.
+		std::ostringstream x;
+		switch(k % 4) {
+		case 0: x << (k * 2) << "+(3*5-15)"; break;
+		case 1: x << "($w" << (k - 1) << "&1023)+" << (k * 4); break;
+		case 2: x << "if($w" << (k - 1) << ">32767,$w" << (k - 2) << ",$w" << (k - 1) << "*2)&8191"; break;
+		case 3: x << "($w" << (k - 1) << "==0||$w" << (k - 3) << "!=0)+" << (k * 8) << "+max(1,2,3)"; break;
+		}
+		if(k == 7)
+			x << "+$nosuchvar";	//Undefined variable.
+		return x.str();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned watches = (argc > 1) ? strtoul(argv[1], NULL, 10) : 200;
+	unsigned frames = (argc > 2) ? strtoul(argv[2], NULL, 10) : 2000;
+	std::vector<unsigned char> ram(65536);
+	memory_space mspace;
+	std::list<memory_space::region*> regions;
+	regions.push_back(new memory_space::region_direct("RAM", 0, -1, &ram[0], ram.size()));
+	mspace.set_regions(regions);
+
+	std::map<std::string, std::string> tree_out, prog_out;
+	std::map<std::string, memorywatch::item> tree_items;
+	memorywatch::set wset;
+	{
+		std::map<std::string, GC::pointer<mathexpr::mathexpr>> vars;
+		auto vars_fn = [&vars](const std::string& n) -> GC::pointer<mathexpr::mathexpr> {
+			if(!vars.count(n))
+				vars[n] = GC::pointer<mathexpr::mathexpr>(GC::obj_tag(),
+					mathexpr::expression_value());
+			return vars[n];
+		};
+		GC::pointer<memorywatch::item_printer> printer(new recorder(&prog_out));
+		for(unsigned k = 0; k < watches; k++) {
+			std::string name = (stringfmt() << "w" << k).str();
+			memorywatch::memread_oper* o = new memorywatch::memread_oper;
+			o->bytes = 2;
+			o->signed_flag = false;
+			o->float_flag = false;
+			o->endianess = -1;
+			o->scale_div = 1;
+			o->addr_base = 0;
+			o->addr_size = 0;
+			o->mspace = &mspace;
+			std::vector<GC::pointer<mathexpr::mathexpr>> v;
+			v.push_back(mathexpr::mathexpr::parse(*mathexpr::expression_value(), watch_expr(k), vars_fn));
+			GC::pointer<mathexpr::mathexpr> e(GC::obj_tag(), mathexpr::expression_value(), o, v, true);
+			memorywatch::item it(*mathexpr::expression_value());
+			*vars_fn(name) = *e;
+			it.expr = vars_fn(name);
+			it.printer = printer;
+			it.format = (k % 2) ? "%04x" : "";
+			tree_items.insert(std::make_pair(name, it));
+			wset.create(name, it);
+		}
+	}
+
+	uint64_t t_tree = 0, t_prog = 0;
+	bool ok = true;
+	srand(1);
+	for(unsigned f = 0; f < frames; f++) {
+		for(unsigned i = 0; i < 256; i++)
+			ram[rand() % ram.size()] = rand();
+		uint64_t t1 = get_utime();
+		for(auto& i : tree_items)
+			i.second.expr->reset();
+		for(auto& i : tree_items) {
+			try {
+				tree_out[i.first] = i.second.get_value();
+			} catch(mathexpr::error& e) {
+				tree_out[i.first] = e.get_short_error();
+			}
+		}
+		uint64_t t2 = get_utime();
+		wset.refresh();
+		uint64_t t3 = get_utime();
+		t_tree += t2 - t1;
+		t_prog += t3 - t2;
+		if(tree_out != prog_out) {
+			for(auto& i : tree_out)
+				if(prog_out[i.first] != i.second)
+					std::cout << "Frame " << f << ": " << i.first << " tree=" << i.second
+						<< " compiled=" << prog_out[i.first] << std::endl;
+			ok = false;
+			break;
+		}
+	}
+	std::cout << watches << " watches: tree " << 1.0 * t_tree / frames << "us/frame, compiled "
+		<< 1.0 * t_prog / frames << "us/frame" << (ok ? "" : " (MISMATCH)") << std::endl;
+	return ok ? 0 : 1;
+}
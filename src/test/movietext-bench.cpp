@@ -0,0 +1,205 @@
+#include "interface/controller.hpp"
+#include "library/portctrl-parse.hpp"
+#include "library/json.hpp"
+#include "library/string.hpp"
+#include "library/zip.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstdio>
+#include <sys/time.h>
+
+//Benchmark text movie input load/save, comparing against line-at-a-time codec. The text codec and the whole save
+//or load through a ZIP file are timed separately, as compressing the text takes most of the time of saving.
+//Syntax: movietext-bench <ports.json> [<subframes>]
+
+uint64_t get_utime()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+void old_serialize(std::ostream& m, portctrl::frame_vector& input)
+{
+	char buffer[MAX_SERIALIZED_SIZE];
+	for(size_t i = 0; i < input.size(); i++) {
+		input[i].serialize(buffer);
+		m << buffer << std::endl;
+	}
+}
+
+void old_deserialize(std::istream& m, portctrl::frame_vector& input)
+{
+	portctrl::frame tmp = input.blank_frame(false);
+	std::string x;
+	while(std::getline(m, x)) {
+		istrip_CR(x);
+		if(x != "") {
+			tmp.deserialize(x.c_str());
+			input.append(tmp);
+		}
+	}
+}
+
+void old_save(zip::writer& w, const std::string& mname, portctrl::frame_vector& input)
+{
+	std::ostream& m = w.create_file(mname);
+	old_serialize(m, input);
+	w.close_file();
+}
+
+void new_save(zip::writer& w, const std::string& mname, portctrl::frame_vector& input)
+{
+	std::vector<char> text;
+	input.save_text(text);
+	w.write_raw_file(mname, text);
+}
+
+void old_load(zip::reader& r, const std::string& mname, portctrl::frame_vector& input)
+{
+	std::istream& m = r[mname];
+	old_deserialize(m, input);
+	delete &m;
+}
+
+void new_load(zip::reader& r, const std::string& mname, portctrl::frame_vector& input)
+{
+	std::vector<char> text;
+	r.read_raw_file(mname, text);
+	input.load_text(text.empty() ? "" : &text[0], text.size());
+}
+
+std::string read_file(const std::string& name)
+{
+	std::ifstream f(name, std::ios::binary);
+	std::ostringstream s;
+	s << f.rdbuf();
+	return s.str();
+}
+
+//Find the JSON pointer to the port type with the given symbol.
+std::string find_port(const JSON::node& root, const std::string& symbol)
+{
+	const JSON::node& ports = root["ports"];
+	for(size_t i = 0; i < ports.index_count(); i++)
+		if(ports.index(i)["symbol"].as_string8() == symbol)
+			return "ports/" + std::to_string(i);
+	throw std::runtime_error("No port type '" + symbol + "'");
+}
+
+bool same_vectors(portctrl::frame_vector& a, portctrl::frame_vector& b)
+{
+	if(a.size() != b.size() || a.count_frames() != b.count_frames())
+		return false;
+	for(size_t i = 0; i < a.size(); i++)
+		if(a.get(i) != b.get(i))
+			return false;
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2) {
+		std::cerr << "Syntax: " << argv[0] << " <ports.json> [<subframes>]" << std::endl;
+		return 1;
+	}
+	size_t subframes = (argc > 2) ? strtoul(argv[2], NULL, 10) : 1000000;
+
+	JSON::node portsdata;
+	std::string multitap16, psystem;
+	try {
+		portsdata = JSON::node(read_file(argv[1]));
+		multitap16 = find_port(portsdata, "multitap16");
+		psystem = find_port(portsdata, "psystem");
+	} catch(std::exception& e) {
+		std::cerr << "Bad ports file '" << argv[1] << "': " << e.what() << std::endl;
+		std::cerr << "Syntax: " << argv[0] << " <ports.json> [<subframes>]" << std::endl;
+		return 1;
+	}
+	portctrl::type_generic Smultitap16(portsdata, multitap16);
+	portctrl::type_generic Spsystem(portsdata, psystem);
+	controller_set s;
+	s.ports.push_back(&Spsystem);
+	s.ports.push_back(&Smultitap16);
+	s.ports.push_back(&Smultitap16);
+	for(unsigned i = 0; i < 8; i++)
+		s.logical_map.push_back(std::make_pair(i / 4 + 1, i % 4));
+	portctrl::type_set& types = portctrl::type_set::make(s.ports, s.portindex());
+
+	portctrl::frame_vector v(types);
+	portctrl::frame f = v.blank_frame(false);
+	srand(42);
+	for(size_t i = 0; i < subframes; i++) {
+		f.sync(rand() % 4 != 0);
+		for(unsigned j = 1; j < 3; j++)
+			for(unsigned k = 0; k < 4; k++)
+				for(unsigned b = 0; b < 16; b++)
+					f.axis3(j, k, b, (rand() % 8 == 0) ? 1 : 0);
+		v.append(f);
+	}
+
+	uint64_t t;
+	std::vector<char> text;
+	{
+		std::ostringstream m;
+		t = get_utime();
+		old_serialize(m, v);
+		std::cout << "Old serialize: " << (get_utime() - t) / 1000 << "ms" << std::endl;
+		t = get_utime();
+		v.save_text(text);
+		std::cout << "New serialize: " << (get_utime() - t) / 1000 << "ms" << std::endl;
+		if(m.str() != std::string(text.begin(), text.end())) {
+			std::cout << "Serialized text differs" << std::endl;
+			return 1;
+		}
+	}
+	{
+		std::istringstream m(std::string(text.begin(), text.end()));
+		portctrl::frame_vector v1(types), v2(types);
+		t = get_utime();
+		old_deserialize(m, v1);
+		std::cout << "Old deserialize: " << (get_utime() - t) / 1000 << "ms" << std::endl;
+		t = get_utime();
+		v2.load_text(&text[0], text.size());
+		std::cout << "New deserialize: " << (get_utime() - t) / 1000 << "ms" << std::endl;
+		if(!same_vectors(v, v1) || !same_vectors(v, v2)) {
+			std::cout << "Deserialized movies differ" << std::endl;
+			return 1;
+		}
+	}
+	std::vector<char>().swap(text);
+
+	{
+		zip::writer w("movietext-bench-old.zip", 9);
+		t = get_utime();
+		old_save(w, "input", v);
+		std::cout << "Old save: " << (get_utime() - t) / 1000 << "ms" << std::endl;
+		w.commit();
+	}
+	{
+		zip::writer w("movietext-bench-new.zip", 9);
+		t = get_utime();
+		new_save(w, "input", v);
+		std::cout << "New save: " << (get_utime() - t) / 1000 << "ms" << std::endl;
+		w.commit();
+	}
+	bool identical = (read_file("movietext-bench-old.zip") == read_file("movietext-bench-new.zip"));
+	std::cout << "Saved files identical: " << (identical ? "yes" : "NO") << std::endl;
+
+	zip::reader r("movietext-bench-old.zip");
+	portctrl::frame_vector v1(types), v2(types);
+	t = get_utime();
+	old_load(r, "input", v1);
+	std::cout << "Old load: " << (get_utime() - t) / 1000 << "ms" << std::endl;
+	t = get_utime();
+	new_load(r, "input", v2);
+	std::cout << "New load: " << (get_utime() - t) / 1000 << "ms" << std::endl;
+	bool same = same_vectors(v, v1) && same_vectors(v, v2);
+	std::cout << "Loaded movies identical: " << (same ? "yes" : "NO") << std::endl;
+
+	remove("movietext-bench-old.zip");
+	remove("movietext-bench-new.zip");
+	return (identical && same) ? 0 : 1;
+}
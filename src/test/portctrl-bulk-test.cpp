@@ -0,0 +1,263 @@
+#include "interface/controller.hpp"
+#include "library/portctrl-parse.hpp"
+#include "library/json.hpp"
+#include "library/minmax.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <sys/time.h>
+
+//Check bulk controller data routines (column reads, range compares and text codec) against frame-at-a-time
+//versions, and time them.
+//Syntax: portctrl-bulk-test <ports.json> [<subframes>]
+
+uint64_t get_utime()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+std::string read_file(const std::string& name)
+{
+	std::ifstream f(name, std::ios::binary);
+	std::ostringstream s;
+	s << f.rdbuf();
+	return s.str();
+}
+
+void random_frame(portctrl::frame& f, const portctrl::type_set& types)
+{
+	for(unsigned i = 1; i < types.indices(); i++) {
+		portctrl::index_triple t = types.index_to_triple(i);
+		if(!t.valid)
+			continue;
+		portctrl::button* b = types.port_type(t.port).controller_info->controllers[t.controller].get(t.control);
+		if(!b)
+			continue;
+		if(b->is_analog())
+			f.axis3(t.port, t.controller, t.control, b->rmin + rand() % (b->rmax - b->rmin + 1));
+		else
+			f.axis3(t.port, t.controller, t.control, (rand() % 8 == 0) ? 1 : 0);
+	}
+	f.sync(rand() % 4 != 0);
+}
+
+//The old frame-at-a-time compatibility check.
+bool old_compatible(portctrl::frame_vector& old, portctrl::frame_vector& with, uint64_t nframe,
+	const uint32_t* polls)
+{
+	if(nframe == 0)
+		return true;
+	uint64_t syncs_seen = 0;
+	uint64_t frames_read = 0;
+	while(syncs_seen < nframe - 1) {
+		portctrl::frame oldc = old.blank_frame(true), newc = with.blank_frame(true);
+		if(frames_read < old.size())
+			oldc = old.get(frames_read);
+		if(frames_read < with.size())
+			newc = with.get(frames_read);
+		if(oldc != newc)
+			return false;
+		frames_read++;
+		if(newc.sync())
+			syncs_seen++;
+	}
+	frames_read--;
+	uint64_t readable_old_subframes = 0, readable_new_subframes = 0;
+	uint64_t oldlen = old.walk_sync(frames_read);
+	uint64_t newlen = with.walk_sync(frames_read);
+	if(frames_read < oldlen)
+		readable_old_subframes = oldlen - frames_read;
+	if(frames_read < newlen)
+		readable_new_subframes = newlen - frames_read;
+	for(unsigned i = 0; i < with.get_types().indices(); i++) {
+		uint32_t p = polls[i] & 0x7FFFFFFFUL;
+		short ov = 0, nv = 0;
+		for(uint32_t j = 0; j < p; j++) {
+			if(j < readable_old_subframes)
+				ov = old.get(j + frames_read).axis2(i);
+			if(j < readable_new_subframes)
+				nv = with.get(j + frames_read).axis2(i);
+			if(ov != nv)
+				return false;
+		}
+	}
+	return true;
+}
+
+//Find the JSON pointer to the port type with the given symbol.
+std::string find_port(const JSON::node& root, const std::string& symbol)
+{
+	const JSON::node& ports = root["ports"];
+	for(size_t i = 0; i < ports.index_count(); i++)
+		if(ports.index(i)["symbol"].as_string8() == symbol)
+			return "ports/" + std::to_string(i);
+	throw std::runtime_error("No port type '" + symbol + "'");
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2) {
+		std::cerr << "Syntax: " << argv[0] << " <ports.json> [<subframes>]" << std::endl;
+		return 1;
+	}
+	size_t subframes = (argc > 2) ? strtoul(argv[2], NULL, 10) : 1000000;
+	bool ok = true;
+
+	JSON::node portsdata;
+	std::string multitap16, justifiers, psystem;
+	try {
+		portsdata = JSON::node(read_file(argv[1]));
+		multitap16 = find_port(portsdata, "multitap16");
+		justifiers = find_port(portsdata, "justifiers");
+		psystem = find_port(portsdata, "psystem");
+	} catch(std::exception& e) {
+		std::cerr << "Bad ports file '" << argv[1] << "': " << e.what() << std::endl;
+		std::cerr << "Syntax: " << argv[0] << " <ports.json> [<subframes>]" << std::endl;
+		return 1;
+	}
+	portctrl::type_generic Smultitap16(portsdata, multitap16);
+	portctrl::type_generic Sjustifiers(portsdata, justifiers);
+	portctrl::type_generic Spsystem(portsdata, psystem);
+	controller_set s;
+	s.ports.push_back(&Spsystem);
+	s.ports.push_back(&Smultitap16);
+	s.ports.push_back(&Sjustifiers);
+	for(unsigned i = 0; i < 4; i++)
+		s.logical_map.push_back(std::make_pair(1, i));
+	for(unsigned i = 0; i < 2; i++)
+		s.logical_map.push_back(std::make_pair(2, i));
+	portctrl::type_set& types = portctrl::type_set::make(s.ports, s.portindex());
+
+	portctrl::frame_vector v(types);
+	portctrl::frame f = v.blank_frame(false);
+	srand(42);
+	for(size_t i = 0; i < subframes; i++) {
+		random_frame(f, types);
+		v.append(f);
+	}
+
+	//Column reads.
+	uint64_t t_old = 0, t_new = 0;
+	std::vector<short> col(subframes), ref(subframes);
+	for(unsigned i = 0; i < types.indices(); i++) {
+		uint64_t t = get_utime();
+		for(size_t j = 0; j < subframes; j++)
+			ref[j] = v.get(j).axis2(i);
+		t_old += get_utime() - t;
+		t = get_utime();
+		v.read_column(0, subframes, i, &col[0]);
+		t_new += get_utime() - t;
+		if(col != ref) {
+			std::cout << "FAIL: Column " << i << " differs" << std::endl;
+			ok = false;
+		}
+		//Unaligned range crossing pages.
+		size_t first = subframes / 3, count = subframes / 3 + 7;
+		v.read_column(first, count, i, &col[0]);
+		if(memcmp(&col[0], &ref[first], count * sizeof(short))) {
+			std::cout << "FAIL: Column " << i << " range differs" << std::endl;
+			ok = false;
+		}
+	}
+	std::cout << "Read columns: " << t_old / 1000 << "ms / " << t_new / 1000 << "ms" << std::endl;
+
+	//Cached reads have to see writes to pages that were shared when cached.
+	{
+		portctrl::frame_vector v4(types);
+		v4 = v;
+		size_t x = subframes / 2;
+		short before = v4.read_axis3(x, 1, 2, 3);
+		v4[x].axis3(1, 2, 3, !before);
+		if(v4.read_axis3(x, 1, 2, 3) != !before || v.read_axis3(x, 1, 2, 3) != before ||
+			v4.read_axis2(x, types.triple_to_index(1, 2, 3)) != !before) {
+			std::cout << "FAIL: Cached read missed a write" << std::endl;
+			ok = false;
+		}
+	}
+
+	//Range compare.
+	portctrl::frame_vector v2(types);
+	v2 = v;
+	if(v.first_difference(v2, 0, subframes) != subframes) {
+		std::cout << "FAIL: Copy differs" << std::endl;
+		ok = false;
+	}
+	size_t changed = subframes * 2 / 3 + 5;
+	v2[changed].axis3(1, 2, 3, !v2[changed].axis3(1, 2, 3));
+	uint64_t t = get_utime();
+	size_t d = 0;
+	while(d < subframes && v.get(d) == v2.get(d))
+		d++;
+	t_old = get_utime() - t;
+	t = get_utime();
+	size_t d2 = v.first_difference(v2, 0, subframes);
+	t_new = get_utime() - t;
+	std::cout << "Compare: " << t_old / 1000 << "ms / " << t_new / 1000 << "ms" << std::endl;
+	if(d != changed || d2 != changed || v.first_difference(v2, changed + 1, subframes - changed - 1) !=
+		subframes) {
+		std::cout << "FAIL: Difference at " << changed << " found at " << d2 << std::endl;
+		ok = false;
+	}
+
+	//Compatibility, with the difference before, in and after the checked frame.
+	uint64_t diffframe = v2.subframe_to_frame(changed);
+	std::vector<uint32_t> polls(types.indices());
+	for(auto& i : polls)
+		i = rand() % 3;
+	for(int64_t delta = -2; delta <= 2; delta++) {
+		uint64_t fr = diffframe + delta;
+		bool a = old_compatible(v, v2, fr, &polls[0]);
+		bool b = v.compatible(v2, fr, &polls[0]);
+		if(a != b) {
+			std::cout << "FAIL: Compatibility at frame " << fr << " is " << b << ", expected " << a
+				<< std::endl;
+			ok = false;
+		}
+	}
+
+	//Reading must not have unshared any page except the one written.
+	size_t shared = 0;
+	for(size_t i = 0; i < v.get_page_count(); i++)
+		if(const_cast<const portctrl::frame_vector&>(v).get_page_buffer(i) ==
+			const_cast<const portctrl::frame_vector&>(v2).get_page_buffer(i))
+			shared++;
+	if(shared + 1 != v.get_page_count()) {
+		std::cout << "FAIL: " << shared << " of " << v.get_page_count() << " pages shared after reads"
+			<< std::endl;
+		ok = false;
+	}
+
+	//Text codec.
+	std::vector<char> text, oldtext;
+	char buffer[MAX_SERIALIZED_SIZE];
+	t = get_utime();
+	for(size_t i = 0; i < subframes; i++) {
+		v.get(i).serialize(buffer);
+		size_t l = strlen(buffer);
+		buffer[l++] = '\n';
+		oldtext.insert(oldtext.end(), buffer, buffer + l);
+	}
+	t_old = get_utime() - t;
+	t = get_utime();
+	v.serialize_frames(0, subframes, text);
+	t_new = get_utime() - t;
+	std::cout << "Serialize: " << t_old / 1000 << "ms / " << t_new / 1000 << "ms" << std::endl;
+	if(text != oldtext) {
+		std::cout << "FAIL: Serialized text differs" << std::endl;
+		ok = false;
+	}
+	portctrl::frame_vector v3(types);
+	v3.load_text(&text[0], text.size());
+	if(v3.size() != v.size() || v3.count_frames() != v.count_frames() || v.first_difference(v3, 0,
+		subframes) != subframes) {
+		std::cout << "FAIL: Loaded movie differs" << std::endl;
+		ok = false;
+	}
+
+	std::cout << (ok ? "OK" : "FAILED") << std::endl;
+	return ok ? 0 : 1;
+}
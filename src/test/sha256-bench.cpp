@@ -0,0 +1,130 @@
+#include "library/sha256.hpp"
+#include <iostream>
+#include <cstdlib>
+#include <sys/time.h>
+
+//Check and benchmark all SHA-256 implementations supported by this CPU.
+
+uint64_t get_utime()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+std::string hash_single(const std::vector<uint8_t>& data, size_t chunk)
+{
+	sha256 h;
+	for(size_t i = 0; i < data.size(); i += chunk)
+		h.write(&data[i], std::min(chunk, data.size() - i));
+	return h.read();
+}
+
+bool check_vectors()
+{
+	bool ok = true;
+	std::vector<uint8_t> abc = {'a', 'b', 'c'};
+	ok = ok && sha256::hash(abc) == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+	std::string s = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+	std::vector<uint8_t> abcd(s.begin(), s.end());
+	ok = ok && sha256::hash(abcd) == "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1";
+	std::vector<uint8_t> million(1000000, 'a');
+	ok = ok && hash_single(million, 999) == "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0";
+	return ok;
+}
+
+std::vector<std::string> hash_all_lengths()
+{
+	std::vector<std::string> r;
+	std::vector<uint8_t> data(300);
+	for(size_t i = 0; i < data.size(); i++)
+		data[i] = i * 7 + 3;
+	for(size_t i = 0; i < data.size(); i++)
+		r.push_back(sha256::hash(&data[0], i));
+	for(size_t i = 1; i < 70; i++)
+		r.push_back(hash_single(data, i));
+	return r;
+}
+
+std::vector<std::string> hash_multi(size_t count, size_t prefix, size_t len)
+{
+	std::vector<uint8_t> data(count * len);
+	for(size_t i = 0; i < data.size(); i++)
+		data[i] = rand();
+	std::vector<sha256> h(count);
+	std::vector<sha256*> hp;
+	std::vector<const uint8_t*> dp;
+	for(size_t i = 0; i < count; i++) {
+		hp.push_back(&h[i]);
+		dp.push_back(&data[i * len]);
+		h[i].write(&data[i * len], prefix);
+		dp[i] += prefix;
+	}
+	sha256::write_multi(&hp[0], &dp[0], len - prefix, count);
+	std::vector<std::string> r;
+	for(size_t i = 0; i < count; i++)
+		r.push_back(h[i].read());
+	return r;
+}
+
+void benchmark(size_t size, size_t loops)
+{
+	std::vector<uint8_t> data(size, 0x5A);
+	uint8_t out[32];
+	uint64_t t = get_utime();
+	for(size_t i = 0; i < loops; i++)
+		sha256::hash(out, &data[0], size);
+	uint64_t dt = get_utime() - t;
+	std::cout << "\t" << size << " byte messages: " << static_cast<double>(size * loops) / dt << "MB/s, "
+		<< static_cast<double>(loops) / dt << "M hashes/s" << std::endl;
+}
+
+void benchmark_multi(size_t size, size_t count)
+{
+	std::vector<uint8_t> data(size * count, 0x5A);
+	std::vector<sha256> h(count);
+	std::vector<sha256*> hp;
+	std::vector<const uint8_t*> dp;
+	for(size_t i = 0; i < count; i++) {
+		hp.push_back(&h[i]);
+		dp.push_back(&data[i * size]);
+	}
+	uint64_t t = get_utime();
+	sha256::write_multi(&hp[0], &dp[0], size, count);
+	uint8_t out[32];
+	for(size_t i = 0; i < count; i++)
+		h[i].read(out);
+	uint64_t dt = get_utime() - t;
+	std::cout << "\t" << count << "x" << size << " byte multi-buffer: " << static_cast<double>(size * count) /
+		dt << "MB/s" << std::endl;
+}
+
+int main()
+{
+	const char* backends[] = {"portable", "shani", "avx2"};
+	sha256::set_backend("portable");
+	std::vector<std::string> reference = hash_all_lengths();
+	srand(1);
+	std::vector<std::string> mreference = hash_multi(21, 0, 4096);
+	srand(2);
+	std::vector<std::string> mreference2 = hash_multi(13, 5, 1000);
+	bool ok = true;
+	for(auto i : backends) {
+		if(!sha256::set_backend(i)) {
+			std::cout << i << ": Not supported" << std::endl;
+			continue;
+		}
+		srand(1);
+		bool m1 = (hash_multi(21, 0, 4096) == mreference);
+		srand(2);
+		bool m2 = (hash_multi(13, 5, 1000) == mreference2);
+		bool good = check_vectors() && hash_all_lengths() == reference && m1 && m2;
+		std::cout << i << ": " << (good ? "OK" : "FAILED") << std::endl;
+		ok = ok && good;
+		benchmark(64, 1000000);
+		benchmark(4096, 50000);
+		benchmark(16 << 20, 8);
+		benchmark_multi(4096, 16384);
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,229 @@
+#include "lsnes.hpp"
+
+#include "core/instance.hpp"
+#include "core/messages.hpp"
+#include "core/misc.hpp"
+#include "core/rom.hpp"
+#include "core/window.hpp"
+#include "interface/callbacks.hpp"
+#include "interface/romtype.hpp"
+#include "library/crandom.hpp"
+#include "library/string.hpp"
+#include "../emulation/sky/search.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <iostream>
+
+//Check that inputs found by sky input search play back to the state the search predicted. The first level is started
+//in the sky core, inputs are searched from there, and then fed to the core frame by frame. Searching with one thread
+//has to find the same inputs, and errors from fitness in worker threads have to reach the caller.
+//Syntax: sky-search-test [--frames=<n>] [--beam=<n>] [--threads=<n>] <romfile>
+
+namespace
+{
+	class search_callbacks : public emucore_callbacks
+	{
+	public:
+		search_callbacks()
+		{
+			keys = 0;
+		}
+		~search_callbacks() throw()
+		{
+		}
+		int16_t get_input(unsigned port, unsigned index, unsigned control)
+		{
+			//The default controller style maps control i to key bit i.
+			if(port != 0 || index != 1)
+				return 0;
+			return (keys >> control) & 1;
+		}
+		int16_t set_input(unsigned port, unsigned index, unsigned control, int16_t value)
+		{
+			return get_input(port, index, control);
+		}
+		void notify_latch(std::list<std::string>& l)
+		{
+		}
+		void timer_tick(uint32_t increment, uint32_t per_second)
+		{
+		}
+		std::string get_firmware_path()
+		{
+			return "";
+		}
+		std::string get_base_path()
+		{
+			return "";
+		}
+		time_t get_time()
+		{
+			return 1000000000;
+		}
+		time_t get_randomseed()
+		{
+			return 0;
+		}
+		void output_frame(framebuffer::raw& screen, uint32_t fps_n, uint32_t fps_d)
+		{
+		}
+		void action_state_updated()
+		{
+		}
+		void memory_read(uint64_t addr, uint64_t value)
+		{
+		}
+		void memory_write(uint64_t addr, uint64_t value)
+		{
+		}
+		void memory_execute(uint64_t addr, uint64_t proc)
+		{
+		}
+		void memory_trace(uint64_t proc, const char* str, bool insn)
+		{
+		}
+		uint16_t keys;
+	};
+
+	core_type& find_type(const std::string& name)
+	{
+		for(auto i : core_type::get_core_types())
+			if(i->get_iname() == name)
+				return *i;
+		throw std::runtime_error("No ROM type '" + name + "'");
+	}
+
+	//The sky savestate is the game state as is.
+	const sky::gstate& game_state(std::vector<char>& buf)
+	{
+		lsnes_instance.rom->runtosave();
+		size_t size = lsnes_instance.rom->save_core_state(buf, true);
+		if(size != sizeof(sky::gstate))
+			throw std::runtime_error("Unexpected savestate size");
+		return *reinterpret_cast<const sky::gstate*>(buf.data());
+	}
+}
+
+int main(int argc, char** argv)
+{
+	try {
+		crandom::init();
+	} catch(std::exception& e) {
+		std::cerr << "Error initializing system RNG" << std::endl;
+		return 1;
+	}
+
+	reached_main();
+	sky::search_params params;
+	params.frames = 300;
+	params.beam = 512;
+	std::string file;
+	for(int i = 1; i < argc; i++) {
+		regex_results r;
+		std::string a = argv[i];
+		try {
+			if(r = regex("--frames=(.*)", a))
+				params.frames = raw_lexical_cast<unsigned>(r[1]);
+			else if(r = regex("--beam=(.*)", a))
+				params.beam = raw_lexical_cast<size_t>(r[1]);
+			else if(r = regex("--threads=(.*)", a))
+				params.threads = raw_lexical_cast<unsigned>(r[1]);
+			else if(a.length() > 0 && a[0] != '-' && file == "")
+				file = a;
+			else
+				throw std::runtime_error("Unknown argument");
+		} catch(std::exception& e) {
+			std::cerr << "Bad argument '" << a << "': " << e.what() << std::endl;
+			return 2;
+		}
+	}
+	if(file == "") {
+		std::cerr << "Syntax: sky-search-test [--frames=<n>] [--beam=<n>] [--threads=<n>] <romfile>"
+			<< std::endl;
+		return 2;
+	}
+
+	//The core is run from this thread.
+	emulator_instance_binding bind(lsnes_instance);
+	platform::init();
+	search_callbacks cb;
+	ecore_callbacks = &cb;
+
+	bool ok = true;
+	try {
+		std::map<std::string, std::string> settings;
+		loaded_rom rom(new rom_image(file, find_type("sky")));
+		rom.load(settings, 1000000000, 0);
+		*lsnes_instance.rom = rom;
+		std::vector<char> buf;
+
+		//Press jump every other frame until the first level is being played.
+		for(unsigned i = 0; game_state(buf).state != sky::state_level_play; i++) {
+			if(i > 10000)
+				throw std::runtime_error("Level did not start");
+			cb.keys = (i & 1) ? 16 : 0;
+			lsnes_instance.rom->emulate();
+		}
+
+		sky::gstate start = game_state(buf);
+		sky::search_result res = sky::search_inputs(start, params);
+		std::cout << "Searched " << res.expanded << " states: " << res.inputs.size() << " frames, "
+			<< (res.finished ? "level finished" : "level not finished") << std::endl;
+		if(res.inputs.empty()) {
+			std::cout << "FAIL: No inputs found" << std::endl;
+			ok = false;
+		}
+		for(auto i : res.inputs) {
+			cb.keys = i;
+			lsnes_instance.rom->emulate();
+		}
+		const sky::gstate& s = game_state(buf);
+		if(memcmp(&s.p, &res.end, sizeof(res.end))) {
+			std::cout << "FAIL: Replay ended at position " << s.p.lpos << " speed " << s.p.lspeed
+				<< ", predicted position " << res.end.lpos << " speed " << res.end.lspeed << std::endl;
+			ok = false;
+		}
+		if(res.finished != (s.state == sky::state_level_complete)) {
+			std::cout << "FAIL: Replay " << (res.finished ? "did not finish" : "finished")
+				<< " the level" << std::endl;
+			ok = false;
+		}
+
+		//The result must not depend on the number of threads.
+		sky::search_params serial = params;
+		serial.threads = 1;
+		sky::search_result res1 = sky::search_inputs(start, serial);
+		if(res1.inputs != res.inputs || res1.score != res.score || res1.merged != res.merged) {
+			std::cout << "FAIL: Search with one thread found different inputs" << std::endl;
+			ok = false;
+		}
+
+		//Fitness of the start state is computed in this thread, the rest in the workers.
+		sky::search_params failing = params;
+		failing.frames = 2;
+		std::atomic<unsigned> calls(0);
+		failing.fitness = [&calls](const sky::physics& p) -> int64_t {
+			if(calls++)
+				throw std::runtime_error("Fitness failed");
+			return 0;
+		};
+		try {
+			sky::search_inputs(start, failing);
+			std::cout << "FAIL: Error from fitness was lost" << std::endl;
+			ok = false;
+		} catch(std::runtime_error& e) {
+			if(std::string(e.what()) != "Fitness failed") {
+				std::cout << "FAIL: Error from fitness became '" << e.what() << "'" << std::endl;
+				ok = false;
+			}
+		}
+	} catch(std::bad_alloc& e) {
+		OOM_panic();
+	} catch(std::exception& e) {
+		std::cout << "FAIL: " << e.what() << std::endl;
+		ok = false;
+	}
+	std::cout << (ok ? "OK" : "FAILED") << std::endl;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+#include "library/streamcompress.hpp"
+#include "library/zip.hpp"
+#include "library/string.hpp"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <sys/time.h>
+
+//Run every registered compressor on the given files (e.g. savestates, movies and dumps) and report compression
+//ratio and speed. Members of ZIP archives (such as .lsmv files) are treated as separate inputs.
+//Syntax: streamcompress-bench [-c<compressor>[:<arguments>]...] <file>...
+
+namespace
+{
+	uint64_t get_utime()
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+	}
+
+	size_t compress(streamcompress::base* c, std::vector<char>& data)
+	{
+		static uint8_t outbuf[65536];
+		uint8_t* in = (uint8_t*)&data[0];
+		size_t insize = data.size();
+		size_t total = 0;
+		while(true) {
+			uint8_t* out = outbuf;
+			size_t outsize = sizeof(outbuf);
+			bool done = c->process(in, insize, out, outsize, true);
+			total += sizeof(outbuf) - outsize;
+			if(done)
+				return total;
+		}
+	}
+
+	void add_input(std::vector<std::pair<std::string, std::vector<char>>>& inputs, const std::string& file)
+	{
+		try {
+			zip::reader r(file);
+			for(auto i : r) {
+				inputs.push_back(std::make_pair(file + "/" + i, std::vector<char>()));
+				r.read_raw_file(i, inputs.back().second);
+			}
+			return;
+		} catch(...) {
+		}
+		std::ifstream s(file, std::ios::binary);
+		if(!s)
+			throw std::runtime_error("Can't open '" + file + "'");
+		inputs.push_back(std::make_pair(file, std::vector<char>()));
+		std::vector<char>& d = inputs.back().second;
+		char buf[65536];
+		while(s) {
+			s.read(buf, sizeof(buf));
+			d.insert(d.end(), buf, buf + s.gcount());
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::pair<std::string, std::string>> compressors;
+	std::vector<std::pair<std::string, std::vector<char>>> inputs;
+	try {
+		for(int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			if(arg.substr(0, 2) == "-c") {
+				size_t s = arg.find(':');
+				if(s < arg.length())
+					compressors.push_back(std::make_pair(arg.substr(2, s - 2), arg.substr(s + 1)));
+				else
+					compressors.push_back(std::make_pair(arg.substr(2), ""));
+			} else
+				add_input(inputs, arg);
+		}
+	} catch(std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	if(compressors.empty())
+		for(auto i : streamcompress::base::get_compressors())
+			compressors.push_back(std::make_pair(i, ""));
+	if(inputs.empty()) {
+		std::cerr << "Syntax: streamcompress-bench [-c<compressor>[:<arguments>]...] <file>..." << std::endl;
+		return 1;
+	}
+	size_t insize = 0;
+	for(auto& i : inputs)
+		insize += i.second.size();
+	for(auto& c : compressors) {
+		std::string name = c.first + (c.second != "" ? "(" + c.second + ")" : "");
+		size_t outsize = 0;
+		uint64_t t = 0;
+		try {
+			for(auto& i : inputs) {
+				if(i.second.empty())
+					continue;
+				streamcompress::base* x = streamcompress::base::create_compressor(c.first, c.second);
+				uint64_t t1 = get_utime();
+				outsize += compress(x, i.second);
+				t += get_utime() - t1;
+				delete x;
+			}
+		} catch(std::exception& e) {
+			std::cout << name << ": " << e.what() << std::endl;
+			continue;
+		}
+		std::cout << name << ": " << insize << " -> " << outsize << " bytes, ratio "
+			<< (outsize ? 1.0 * insize / outsize : 0.0) << ", " << (t ? 1.0 * insize / t : 0.0)
+			<< "MB/s" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,227 @@
+#include "lsnes.hpp"
+
+#include "core/instance.hpp"
+#include "core/inthread.hpp"
+#include "core/loadlib.hpp"
+#include "core/misc.hpp"
+#include "core/settings.hpp"
+#include "core/window.hpp"
+#include "library/crandom.hpp"
+#include "library/loadlib.hpp"
+#include "library/minmax.hpp"
+#include "library/opus.hpp"
+#include "library/serialization.hpp"
+#include "library/string.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <sys/time.h>
+
+//Benchmark superstream export on a synthetic collection of heavily overlapping commentary streams. The streams
+//are imported into a new collection and exported through the real export path, first as one unsegmented
+//segment in one thread and then in segments with one thread per processor. The unsegmented export must match
+//mixing the individually exported streams, each decoded from its start, and the segmented export must be close
+//to it.
+//Syntax: superstream-bench [--libopus=<file>] [--streams=<n>] [--seconds=<n>]
+
+#define SAMPLERATE 48000
+//Largest allowed difference of segmented export against unsegmented. Decoding starting at segment boundaries only
+//converges to the same output.
+#define MAX_DIFFERENCE 0.01
+//Largest allowed difference of unsegmented export against mixing whole streams (rounding only).
+#define MAX_ROUNDING 0.0001
+
+namespace
+{
+	uint64_t get_utime()
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+	}
+
+	void write_sox_header(std::ostream& out, uint64_t samples)
+	{
+		char header[32];
+		serialization::u64l(header, 0x1C586F532EULL);			//Magic and header size.
+		serialization::u64l(header + 8, samples);
+		serialization::u64l(header + 16, 4676829883349860352ULL);	//Sampling rate.
+		serialization::u64l(header + 24, 1);
+		out.write(header, 32);
+	}
+
+	//Read .sox file written by lsnes, as floats.
+	std::vector<float> read_sox(const std::string& filename)
+	{
+		std::ifstream in(filename, std::ios::binary);
+		char header[32];
+		in.read(header, 32);
+		if(!in || serialization::u32l(header) != 0x586F532EULL)
+			throw std::runtime_error("Bad .sox file '" + filename + "'");
+		std::vector<float> x(serialization::u64l(header + 8));
+		std::vector<char> raw(4 * x.size());
+		if(raw.size())
+			in.read(&raw[0], raw.size());
+		if(!in)
+			throw std::runtime_error("Truncated .sox file '" + filename + "'");
+		for(size_t i = 0; i < x.size(); i++)
+			x[i] = serialization::s32l(&raw[4 * i]) / 268435456.0;
+		return x;
+	}
+
+	void make_stream(const std::string& filename, uint64_t length)
+	{
+		std::ofstream out(filename, std::ios::binary);
+		write_sox_header(out, length);
+		double f = 100 + rand() % 400;
+		char buf[4];
+		for(uint64_t i = 0; i < length; i++) {
+			double v = 0.1 * sin(2 * M_PI * f * i / SAMPLERATE) + 0.01 * (rand() % 100 - 50) / 50;
+			serialization::s32l(buf, v * 268435456);
+			out.write(buf, 4);
+		}
+		if(!out)
+			throw std::runtime_error("Can't write '" + filename + "'");
+	}
+
+	uint64_t export_superstream(const std::string& threads, const std::string& segment,
+		const std::string& filename)
+	{
+		lsnes_instance.setcache->set("opus-export-threads", threads);
+		lsnes_instance.setcache->set("opus-export-segment", segment);
+		uint64_t t = get_utime();
+		lsnes_instance.commentary->export_superstream(filename);
+		return get_utime() - t;
+	}
+
+	float max_difference(const std::vector<float>& a, const std::vector<float>& b)
+	{
+		float maxdiff = 0;
+		for(size_t i = 0; i < a.size() && i < b.size(); i++)
+			maxdiff = max(maxdiff, std::fabs(a[i] - b[i]));
+		return maxdiff;
+	}
+
+	int run(unsigned nstreams, uint64_t total)
+	{
+		voice_commentary& vc = *lsnes_instance.commentary;
+		std::string collection = get_temp_file();
+		std::string tmp = get_temp_file();
+		std::string whole_out = get_temp_file();
+		std::string parallel_out = get_temp_file();
+		vc.load_collection(collection);
+		srand(1);
+		for(unsigned i = 0; i < nstreams; i++) {
+			//5 to 60 second clips, heavily overlapping.
+			make_stream(tmp, (5 + rand() % 56) * SAMPLERATE);
+			vc.import_stream(rand() % total, tmp, voice_commentary::EXTFMT_SOX);
+		}
+
+		//Reference: every stream decoded from its start, and mixed.
+		std::vector<float> reference;
+		for(auto& i : vc.get_stream_info()) {
+			vc.export_stream(i.id, tmp, voice_commentary::EXTFMT_SOX);
+			std::vector<float> s = read_sox(tmp);
+			if(reference.size() < i.base + s.size())
+				reference.resize(i.base + s.size());
+			for(size_t j = 0; j < s.size(); j++)
+				reference[i.base + j] += s[j];
+		}
+
+		unsigned nthreads = max(threads::thread::hardware_concurrency(), 1U);
+		uint64_t t1 = export_superstream("1", "0", whole_out);
+		uint64_t t2 = export_superstream((stringfmt() << nthreads).str(), "10", parallel_out);
+		std::vector<float> whole = read_sox(whole_out);
+		std::vector<float> parallel = read_sox(parallel_out);
+		vc.unload_collection();
+		remove(collection.c_str());
+		remove(tmp.c_str());
+		remove(whole_out.c_str());
+		remove(parallel_out.c_str());
+
+		bool ok = true;
+		if(whole.size() != reference.size() || parallel.size() != reference.size()) {
+			std::cout << "FAIL: Exports have " << whole.size() << " and " << parallel.size()
+				<< " samples, expected " << reference.size() << std::endl;
+			ok = false;
+		}
+		float rounding = max_difference(whole, reference);
+		if(rounding > MAX_ROUNDING) {
+			std::cout << "FAIL: Unsegmented export differs from mixing whole streams" << std::endl;
+			ok = false;
+		}
+		float maxdiff = max_difference(parallel, whole);
+		if(maxdiff > MAX_DIFFERENCE) {
+			std::cout << "FAIL: Segmented export differs from unsegmented" << std::endl;
+			ok = false;
+		}
+		std::cout << nstreams << " streams, " << whole.size() / SAMPLERATE << "s: unsegmented " << t1 / 1000
+			<< "ms, " << nthreads << " threads " << t2 / 1000 << "ms, max difference " << maxdiff
+			<< std::endl;
+		std::cout << (ok ? "OK" : "FAILED") << std::endl;
+		return ok ? 0 : 1;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	try {
+		crandom::init();
+	} catch(std::exception& e) {
+		std::cerr << "Error initializing system RNG" << std::endl;
+		return 1;
+	}
+
+	reached_main();
+	std::string libopus;
+	unsigned nstreams = 200;
+	uint64_t seconds = 600;
+	for(int i = 1; i < argc; i++) {
+		regex_results r;
+		std::string a = argv[i];
+		try {
+			if(r = regex("--libopus=(.*)", a))
+				libopus = r[1];
+			else if(r = regex("--streams=(.*)", a))
+				nstreams = raw_lexical_cast<unsigned>(r[1]);
+			else if(r = regex("--seconds=(.*)", a))
+				seconds = raw_lexical_cast<uint64_t>(r[1]);
+			else
+				throw std::runtime_error("Unknown argument");
+		} catch(std::exception& e) {
+			std::cerr << "Bad argument '" << a << "': " << e.what() << std::endl;
+			std::cerr << "Syntax: superstream-bench [--libopus=<file>] [--streams=<n>] "
+				<< "[--seconds=<n>]" << std::endl;
+			return 2;
+		}
+	}
+
+	platform::init();
+	autoload_libraries();
+	try {
+		if(libopus != "")
+			with_loaded_library(*new loadlib::module(loadlib::library(libopus)));
+	} catch(std::exception& e) {
+		std::cerr << "Can't load '" << libopus << "': " << e.what() << std::endl;
+		return 2;
+	}
+	if(!opus::libopus_loaded()) {
+		std::cerr << "libopus not available" << std::endl;
+		return 2;
+	}
+	int ret = 2;
+	lsnes_instance.commentary->init();
+	try {
+		ret = run(nstreams, max(seconds, static_cast<uint64_t>(1)) * SAMPLERATE);
+	} catch(std::bad_alloc& e) {
+		OOM_panic();
+	} catch(std::exception& e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+	}
+	lsnes_instance.commentary->kill();
+	return ret;
+}
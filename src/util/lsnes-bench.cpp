@@ -0,0 +1,279 @@
+#include "lsnes.hpp"
+
+#include "core/framerate.hpp"
+#include "core/instance.hpp"
+#include "core/messages.hpp"
+#include "core/misc.hpp"
+#include "core/movie.hpp"
+#include "core/rom.hpp"
+#include "core/window.hpp"
+#include "interface/callbacks.hpp"
+#include "interface/controller.hpp"
+#include "interface/romtype.hpp"
+#include "library/crandom.hpp"
+#include "library/hex.hpp"
+#include "library/json.hpp"
+#include "library/sha256.hpp"
+#include "library/string.hpp"
+#include "lua/lua.hpp"
+
+#include <fstream>
+#include <iostream>
+
+//Measure raw emulation speed of cores. Each ROM is run headless for a fixed number of frames with a fixed input
+//pattern, then rerun from the starting state to check that the final state matches. After that, savestates and
+//loadstates are timed. Results are printed as JSON.
+//Syntax: lsnes-bench [--frames=<n>] [--states=<n>] [--output=<file>] <type>=<romfile>...
+//<type> is the internal name of the ROM type (e.g. snes, gb, sky or test). <romfile> may be empty if the type
+//doesn't need one.
+
+namespace
+{
+	//Inputs are held for this many frames.
+	const unsigned input_hold = 4;
+
+	class bench_callbacks : public emucore_callbacks
+	{
+	public:
+		bench_callbacks(const controller_set& _ports)
+			: ports(_ports)
+		{
+			frame = 0;
+		}
+		~bench_callbacks() throw()
+		{
+		}
+		int16_t get_input(unsigned port, unsigned index, unsigned control)
+		{
+			if(port >= ports.ports.size())
+				return 0;
+			portctrl::controller* c = ports.ports[port]->controller_info->get(index);
+			portctrl::button* b = c ? c->get(control) : NULL;
+			//Shadow controls include resets, which would make the run meaningless.
+			if(!b || b->shadow || b->type == portctrl::button::TYPE_NULL)
+				return 0;
+			uint64_t v = frame / input_hold;
+			v = v * 0x9E3779B97F4A7C15ULL + port;
+			v = v * 0x9E3779B97F4A7C15ULL + index;
+			v = v * 0x9E3779B97F4A7C15ULL + control;
+			v ^= v >> 29;
+			if(b->is_analog())
+				return b->rmin + static_cast<int32_t>(v % (static_cast<int32_t>(b->rmax) - b->rmin + 1));
+			return ((v & 3) == 0) ? 1 : 0;
+		}
+		int16_t set_input(unsigned port, unsigned index, unsigned control, int16_t value)
+		{
+			return get_input(port, index, control);
+		}
+		void notify_latch(std::list<std::string>& l)
+		{
+		}
+		void timer_tick(uint32_t increment, uint32_t per_second)
+		{
+		}
+		std::string get_firmware_path()
+		{
+			return "";
+		}
+		std::string get_base_path()
+		{
+			return "";
+		}
+		time_t get_time()
+		{
+			return 1000000000;
+		}
+		time_t get_randomseed()
+		{
+			return 0;
+		}
+		void output_frame(framebuffer::raw& screen, uint32_t fps_n, uint32_t fps_d)
+		{
+			frame++;
+		}
+		void action_state_updated()
+		{
+		}
+		void memory_read(uint64_t addr, uint64_t value)
+		{
+		}
+		void memory_write(uint64_t addr, uint64_t value)
+		{
+		}
+		void memory_execute(uint64_t addr, uint64_t proc)
+		{
+		}
+		void memory_trace(uint64_t proc, const char* str, bool insn)
+		{
+		}
+		uint64_t frame;
+	private:
+		const controller_set& ports;
+	};
+
+	core_type& find_type(const std::string& name)
+	{
+		for(auto i : core_type::get_core_types())
+			if(i->get_iname() == name)
+				return *i;
+		throw std::runtime_error("No ROM type '" + name + "'");
+	}
+
+	std::string hash_state(const char* state, size_t size)
+	{
+		uint8_t h[32];
+		sha256::hash(h, reinterpret_cast<const uint8_t*>(state), size);
+		return hex::b_to(h, 32);
+	}
+
+	JSON::node timing(uint64_t usecs, uint64_t count)
+	{
+		JSON::node r(JSON::object);
+		r.insert("usec_per_frame", JSON::node(JSON::number, count ? 1.0 * usecs / count : 0.0));
+		r.insert("per_second", JSON::node(JSON::number, usecs ? 1000000.0 * count / usecs : 0.0));
+		return r;
+	}
+
+	//Emulate specified number of frames, returning time taken.
+	uint64_t run_frames(uint64_t frames)
+	{
+		uint64_t t = framerate_regulator::get_utime();
+		for(uint64_t i = 0; i < frames; i++)
+			lsnes_instance.rom->emulate();
+		return framerate_regulator::get_utime() - t;
+	}
+
+	JSON::node bench_rom(const std::string& type, const std::string& file, uint64_t frames, uint64_t states,
+		bool& ok)
+	{
+		JSON::node r(JSON::object);
+		core_type& ctype = find_type(type);
+		r.insert("type", JSON::node(JSON::string, type));
+		r.insert("core", JSON::node(JSON::string, ctype.get_core_identifier()));
+		r.insert("rom", JSON::node(JSON::string, file));
+		r.insert("frames", JSON::node(JSON::number, frames));
+		std::map<std::string, std::string> settings;
+		loaded_rom rom(new rom_image(file, ctype));
+		rom.load(settings, 1000000000, 0);
+		*lsnes_instance.rom = rom;
+		controller_set ports = lsnes_instance.rom->controllerconfig(settings);
+		bench_callbacks cb(ports);
+		emucore_callbacks* old_callbacks = ecore_callbacks;
+		ecore_callbacks = &cb;
+		try {
+			std::vector<char> start, arena;
+			lsnes_instance.rom->runtosave();
+			size_t start_size = lsnes_instance.rom->save_core_state(start, true);
+
+			uint64_t t = run_frames(frames);
+			r.insert("emulate", timing(t, frames));
+			lsnes_instance.rom->runtosave();
+			size_t size = lsnes_instance.rom->save_core_state(arena, true);
+			std::string hash = hash_state(arena.data(), size);
+			r.insert("state_size", JSON::node(JSON::number, static_cast<uint64_t>(size)));
+			r.insert("state_hash", JSON::node(JSON::string, hash));
+
+			lsnes_instance.rom->load_core_state(start.data(), start_size, true);
+			cb.frame = 0;
+			run_frames(frames);
+			lsnes_instance.rom->runtosave();
+			size = lsnes_instance.rom->save_core_state(arena, true);
+			bool deterministic = (hash_state(arena.data(), size) == hash);
+			r.insert("deterministic", JSON::node(JSON::boolean, deterministic));
+			ok &= deterministic;
+
+			t = framerate_regulator::get_utime();
+			for(uint64_t i = 0; i < states; i++)
+				size = lsnes_instance.rom->save_core_state(arena, true);
+			r.insert("savestate", timing(framerate_regulator::get_utime() - t, states));
+			t = framerate_regulator::get_utime();
+			for(uint64_t i = 0; i < states; i++)
+				lsnes_instance.rom->load_core_state(arena.data(), size, true);
+			r.insert("loadstate", timing(framerate_regulator::get_utime() - t, states));
+		} catch(...) {
+			ecore_callbacks = old_callbacks;
+			throw;
+		}
+		ecore_callbacks = old_callbacks;
+		return r;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	try {
+		crandom::init();
+	} catch(std::exception& e) {
+		std::cerr << "Error initializing system RNG" << std::endl;
+		return 1;
+	}
+
+	reached_main();
+	uint64_t frames = 3600;
+	uint64_t states = 100;
+	std::string output;
+	std::vector<std::pair<std::string, std::string>> roms;
+	for(int i = 1; i < argc; i++) {
+		regex_results r;
+		std::string a = argv[i];
+		try {
+			if(r = regex("--frames=(.*)", a))
+				frames = raw_lexical_cast<uint64_t>(r[1]);
+			else if(r = regex("--states=(.*)", a))
+				states = raw_lexical_cast<uint64_t>(r[1]);
+			else if(r = regex("--output=(.*)", a))
+				output = r[1];
+			else if(r = regex("([^-=][^=]*)=(.*)", a))
+				roms.push_back(std::make_pair(r[1], r[2]));
+			else
+				throw std::runtime_error("Unknown argument");
+		} catch(std::exception& e) {
+			std::cerr << "Bad argument '" << a << "': " << e.what() << std::endl;
+			return 2;
+		}
+	}
+	if(roms.empty()) {
+		std::cerr << "Syntax: lsnes-bench [--frames=<n>] [--states=<n>] [--output=<file>] <type>=<romfile>..."
+			<< std::endl;
+		return 2;
+	}
+
+	//The cores are run from this thread.
+	emulator_instance_binding bind(lsnes_instance);
+	platform::init();
+	init_lua(lsnes_instance);
+
+	bool ok = true;
+	JSON::node results(JSON::array);
+	for(auto i : roms) {
+		try {
+			results.append(bench_rom(i.first, i.second, frames, states, ok));
+		} catch(std::bad_alloc& e) {
+			OOM_panic();
+		} catch(std::exception& e) {
+			JSON::node r(JSON::object);
+			r.insert("type", JSON::node(JSON::string, i.first));
+			r.insert("rom", JSON::node(JSON::string, i.second));
+			r.insert("error", JSON::node(JSON::string, e.what()));
+			results.append(r);
+			ok = false;
+		}
+	}
+	JSON::node root(JSON::object);
+	root.insert("version", JSON::node(JSON::string, lsnes_version));
+	root.insert("results", results);
+	JSON::printer_indenting p;
+	std::string doc = root.serialize(&p);
+	if(output != "") {
+		std::ofstream out(output);
+		out << doc;
+		if(!out) {
+			std::cerr << "Can't write '" << output << "'" << std::endl;
+			ok = false;
+		}
+	} else
+		std::cout << doc;
+	quit_lua(lsnes_instance);
+	lsnes_instance.mlogic->release_memory();
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,392 @@
+#include "lsnes.hpp"
+
+#include "core/advdumper.hpp"
+#include "core/command.hpp"
+#include "core/instance.hpp"
+#include "core/loadlib.hpp"
+#include "core/mainloop.hpp"
+#include "core/messages.hpp"
+#include "core/misc.hpp"
+#include "core/movie.hpp"
+#include "core/moviedata.hpp"
+#include "core/random.hpp"
+#include "core/rom.hpp"
+#include "core/settings.hpp"
+#include "core/window.hpp"
+#include "library/crandom.hpp"
+#include "library/string.hpp"
+#include "library/threads.hpp"
+#include "lua/lua.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <sstream>
+#if defined(_WIN32) || defined(_WIN64)
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+//Verify that a movie syncs by splitting it at savestates and replaying the segments in parallel. Each segment is
+//replayed by a worker process from the savestate at its start (or the movie start) using the movie input, and the
+//core state at its end is compared with the savestate there.
+//Syntax: lsnes-verify [--jobs=<n>] [--verbose] [<rom options>] <movie> <savestate>...
+//Exit status is 0 if all segments sync, 1 if some segment desyncs and 2 on error.
+
+namespace
+{
+	enum segment_status
+	{
+		SEGMENT_SYNCED = 0,
+		SEGMENT_DESYNCED = 1,
+		SEGMENT_ERROR = 2,
+		SEGMENT_NOT_RUN = 3,
+	};
+
+	struct segment
+	{
+		std::string from;	//Empty => Movie start.
+		std::string to;
+		uint64_t start;
+		uint64_t end;
+		int status;
+	};
+
+#if defined(_WIN32) || defined(_WIN64)
+	typedef intptr_t worker_t;
+
+	worker_t start_worker(const std::string& self, const std::vector<std::string>& args, bool verbose)
+	{
+		std::vector<const char*> argv;
+		argv.push_back(self.c_str());
+		for(auto& i : args)
+			argv.push_back(i.c_str());
+		argv.push_back(NULL);
+		worker_t w = _spawnvp(_P_NOWAIT, self.c_str(), &argv[0]);
+		if(w == -1)
+			throw std::runtime_error("Can't start worker");
+		return w;
+	}
+
+	int wait_worker(worker_t w)
+	{
+		int status;
+		if(_cwait(&status, w, 0) == -1)
+			return SEGMENT_ERROR;
+		return status;
+	}
+#else
+	typedef pid_t worker_t;
+
+	worker_t start_worker(const std::string& self, const std::vector<std::string>& args, bool verbose)
+	{
+		std::vector<char*> argv;
+		argv.push_back(const_cast<char*>(self.c_str()));
+		for(auto& i : args)
+			argv.push_back(const_cast<char*>(i.c_str()));
+		argv.push_back(NULL);
+		worker_t w = fork();
+		if(w < 0)
+			throw std::runtime_error("Can't start worker");
+		if(w == 0) {
+			//Workers print the usual startup messages, which are just noise in parallel.
+			if(!verbose) {
+				int fd = open("/dev/null", O_WRONLY);
+				if(fd >= 0) {
+					dup2(fd, 1);
+					close(fd);
+				}
+			}
+			//argv[0] need not be a path to this program.
+#ifdef __linux__
+			execv("/proc/self/exe", &argv[0]);
+#endif
+			execvp(self.c_str(), &argv[0]);
+			_exit(SEGMENT_ERROR);
+		}
+		return w;
+	}
+
+	int wait_worker(worker_t w)
+	{
+		int status;
+		if(waitpid(w, &status, 0) < 0 || !WIFEXITED(status))
+			return SEGMENT_ERROR;
+		return WEXITSTATUS(status);
+	}
+#endif
+
+	//Saves the state and quits when the target frame has been emulated.
+	class segment_end_snoop : public dumper_base
+	{
+	public:
+		segment_end_snoop(uint64_t _target, const std::string& _filename)
+			: target(_target), filename(_filename)
+		{
+			saved = false;
+			lsnes_instance.mdumper->add_dumper(*this);
+		}
+		~segment_end_snoop() throw()
+		{
+			lsnes_instance.mdumper->drop_dumper(*this);
+		}
+		void on_frame(struct framebuffer::raw& _frame, uint32_t fps_n, uint32_t fps_d)
+		{
+			auto& core = CORE();
+			if(saved || core.mlogic->get_movie().get_current_frame() < target)
+				return;
+			//The save happens at the start of the next frame, before anything is emulated.
+			core.command->invoke("save-state-binary " + filename);
+			core.command->invoke("quit-emulator");
+			saved = true;
+		}
+		void on_sample(short l, short r)
+		{
+		}
+		void on_rate_change(uint32_t n, uint32_t d)
+		{
+		}
+		void on_gameinfo_change(const master_dumper::gameinfo& gi)
+		{
+		}
+		void on_end()
+		{
+		}
+		bool saved;
+	private:
+		uint64_t target;
+		std::string filename;
+	};
+
+	void apply_settings(const std::vector<std::string>& cmdline)
+	{
+		for(auto i : cmdline) {
+			regex_results r;
+			if(r = regex("--firmware-path=(.*)", i)) {
+				try {
+					lsnes_instance.setcache->set("firmwarepath", r[1]);
+				} catch(std::exception& e) {
+					std::cerr << "Can't set firmware path to '" << r[1] << "': " << e.what()
+						<< std::endl;
+				}
+			}
+			if(r = regex("--setting-(.*)=(.*)", i)) {
+				try {
+					lsnes_instance.setcache->set(r[1], r[2]);
+				} catch(std::exception& e) {
+					std::cerr << "Can't set " << r[1] << " to '" << r[2] << "': " << e.what()
+						<< std::endl;
+				}
+			}
+		}
+	}
+
+	//Replay one segment. Returns segment_status.
+	int run_segment(const std::vector<std::string>& cmdline, const std::string& movfn, const std::string& from,
+		const std::string& to)
+	{
+		set_random_seed();
+		platform::init();
+		init_lua(lsnes_instance);
+		autoload_libraries();
+		apply_settings(cmdline);
+
+		std::string tmpfile = get_temp_file();
+		int status = SEGMENT_ERROR;
+		try {
+			struct loaded_rom r;
+			std::map<std::string, std::string> tmp;
+			r = construct_rom(movfn, cmdline);
+			r.load(tmp, 1000000000, 0);
+			core_type& ctype = r.get_internal_rom_type();
+			moviefile* movie = new moviefile(movfn, ctype);
+			moviefile* start = movie;
+			if(from != "") {
+				start = new moviefile(from, ctype);
+				//The savestate may have older input than the movie, and the movie is what is verified.
+				*start->input = *movie->input;
+				delete movie;
+			}
+			moviefile end(to, ctype);
+			uint64_t target = end.dyn.save_frame;
+			*lsnes_instance.rom = r;
+			lsnes_instance.rom->set_internal_region(start->gametype->get_region());
+			lsnes_instance.rom->load(start->settings, start->movie_rtc_second, start->movie_rtc_subsecond);
+			segment_end_snoop snoop(target, tmpfile);
+			main_loop(r, *start, true);
+			if(!snoop.saved)
+				throw std::runtime_error("Movie stopped before frame " + (stringfmt() << target).str());
+			moviefile got(tmpfile, ctype);
+			if(got.dyn.save_frame != end.dyn.save_frame)
+				std::cerr << "Segment ending at frame " << target << ": ended at frame "
+					<< got.dyn.save_frame << std::endl;
+			else if(got.dyn.savestate != end.dyn.savestate)
+				std::cerr << "Segment ending at frame " << target << ": core state differs"
+					<< std::endl;
+			else if(got.dyn.pollcounters != end.dyn.pollcounters)
+				std::cerr << "Segment ending at frame " << target << ": poll counters differ"
+					<< std::endl;
+			else
+				status = SEGMENT_SYNCED;
+			if(status != SEGMENT_SYNCED)
+				status = SEGMENT_DESYNCED;
+		} catch(std::bad_alloc& e) {
+			OOM_panic();
+		} catch(std::exception& e) {
+			std::cerr << "Segment ending at '" << to << "': " << e.what() << std::endl;
+		}
+		remove(tmpfile.c_str());
+		quit_lua(lsnes_instance);
+		return status;
+	}
+
+	std::string describe(const segment& s)
+	{
+		std::ostringstream x;
+		x << "frames " << s.start << "-" << s.end << " (" << (s.from != "" ? s.from : "movie start")
+			<< " -> " << s.to << ")";
+		return x.str();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	try {
+		crandom::init();
+	} catch(std::exception& e) {
+		std::cerr << "Error initializing system RNG" << std::endl;
+		return SEGMENT_ERROR;
+	}
+
+	reached_main();
+	std::vector<std::string> cmdline;
+	for(int i = 1; i < argc; i++)
+		cmdline.push_back(argv[i]);
+
+	//Options are passed to workers as is, except for these.
+	std::vector<std::string> worker_args;
+	std::vector<std::string> files;
+	unsigned jobs = 0;
+	bool verbose = false;
+	bool worker = false;
+	std::string from, to;
+	for(auto i : cmdline) {
+		regex_results r;
+		try {
+			if(r = regex("--jobs=(.*)", i))
+				jobs = raw_lexical_cast<unsigned>(r[1]);
+			else if(i == "--verbose")
+				verbose = true;
+			else if(r = regex("--segment-from=(.*)", i)) {
+				from = r[1];
+				worker = true;
+			} else if(r = regex("--segment-to=(.*)", i)) {
+				to = r[1];
+				worker = true;
+			} else if(i.length() > 0 && i[0] != '-')
+				files.push_back(i);
+			else
+				worker_args.push_back(i);
+		} catch(std::exception& e) {
+			std::cerr << "Bad argument '" << i << "': " << e.what() << std::endl;
+			return SEGMENT_ERROR;
+		}
+	}
+	if(files.empty() || (!worker && files.size() < 2)) {
+		std::cerr << "Syntax: lsnes-verify [--jobs=<n>] [--verbose] [<rom options>] <movie> <savestate>..."
+			<< std::endl;
+		return SEGMENT_ERROR;
+	}
+	if(worker)
+		return run_segment(worker_args, files[0], from, to);
+
+	std::vector<segment> segments;
+	try {
+		moviefile::brief_info movie(files[0]);
+		std::vector<std::pair<uint64_t, std::string>> states;
+		for(size_t i = 1; i < files.size(); i++) {
+			moviefile::brief_info state(files[i]);
+			if(state.projectid != movie.projectid)
+				std::cerr << "Skipping '" << files[i] << "': Not from the same movie" << std::endl;
+			else if(!state.current_frame)
+				std::cerr << "Skipping '" << files[i] << "': Not a savestate" << std::endl;
+			else
+				states.push_back(std::make_pair(state.current_frame, files[i]));
+		}
+		std::sort(states.begin(), states.end());
+		segment s;
+		s.start = 0;
+		s.status = SEGMENT_NOT_RUN;
+		for(auto& i : states) {
+			if(i.first == s.start)
+				continue;
+			s.to = i.second;
+			s.end = i.first;
+			segments.push_back(s);
+			s.from = i.second;
+			s.start = i.first;
+		}
+	} catch(std::exception& e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return SEGMENT_ERROR;
+	}
+	if(segments.empty()) {
+		std::cerr << "No savestates to verify against" << std::endl;
+		return SEGMENT_ERROR;
+	}
+	if(!jobs)
+		jobs = threads::thread::hardware_concurrency();
+	jobs = std::max(jobs, 1U);
+
+	std::cout << "Verifying " << segments.size() << " segments using " << jobs << " workers" << std::endl;
+	//Workers are reaped in start order, segments are of roughly similar length anyway.
+	std::deque<std::pair<size_t, worker_t>> running;
+	size_t first_bad = segments.size();
+	for(size_t i = 0; i < segments.size() || !running.empty();) {
+		if(i < segments.size() && i < first_bad && running.size() < jobs) {
+			std::vector<std::string> args = worker_args;
+			args.push_back("--segment-from=" + segments[i].from);
+			args.push_back("--segment-to=" + segments[i].to);
+			args.push_back(files[0]);
+			try {
+				running.push_back(std::make_pair(i, start_worker(argv[0], args, verbose)));
+			} catch(std::exception& e) {
+				std::cerr << "Error: " << e.what() << std::endl;
+				segments[i].status = SEGMENT_ERROR;
+				first_bad = std::min(first_bad, i);
+			}
+			i++;
+			continue;
+		}
+		if(running.empty()) {
+			i++;
+			continue;
+		}
+		auto w = running.front();
+		running.pop_front();
+		segment& s = segments[w.first];
+		s.status = wait_worker(w.second);
+		if(s.status != SEGMENT_SYNCED && s.status != SEGMENT_DESYNCED)
+			s.status = SEGMENT_ERROR;
+		std::cout << ((s.status == SEGMENT_SYNCED) ? "OK: " : (s.status == SEGMENT_DESYNCED) ? "DESYNC: " :
+			"ERROR: ") << describe(s) << std::endl;
+		//Segments after a failed one need not be run.
+		if(s.status != SEGMENT_SYNCED)
+			first_bad = std::min(first_bad, w.first);
+	}
+	if(first_bad == segments.size()) {
+		std::cout << "All " << segments.size() << " segments sync" << std::endl;
+		return SEGMENT_SYNCED;
+	}
+	segment& s = segments[first_bad];
+	std::cout << "First failing segment: " << describe(s) << std::endl;
+	//Only segment ends are checked, so the exact frame is not known.
+	if(s.status == SEGMENT_DESYNCED)
+		std::cout << "Movie desyncs after frame " << s.start << " and at latest by frame " << s.end
+			<< std::endl;
+	return (s.status == SEGMENT_DESYNCED) ? SEGMENT_DESYNCED : SEGMENT_ERROR;
+}
@@ -360,7 +360,10 @@ again:
 			try {
 				unsigned srate_setting = soundrate_setting(*core.settings);
 				chans = info.audio_chans = 2;
-				soundrate = mdumper.get_rate();
+				//Resampling modes resample anyway, so save work on high-rate cores.
+				if(srate_setting == 4 || srate_setting == 5)
+					request_decimated_audio();
+				soundrate = mdumper.get_rate(wants_decimated_audio());
 				audio_record_rate = info.sample_rate = get_rate(soundrate.first, soundrate.second,
 					srate_setting);
 				worker = new avi_worker(info);
@@ -452,7 +455,7 @@ again:
 		{
 			messages << "Warning: Changing AVI sound rate mid-dump is not supported!" << std::endl;
 			//Try to do it anyway.
-			soundrate = mdumper.get_rate();
+			soundrate = mdumper.get_rate(wants_decimated_audio());
 			dcounter = 0;
 			double ratio =  1.0 * audio_record_rate * soundrate.second / soundrate.first;
 			if(resampler_w)